@@ -0,0 +1,201 @@
+#include "allocators.h"
+#include <cstdlib>
+
+namespace
+{
+	// statistics per tag, zero initialized as static storage
+	std::atomic<size_t> tagBytes[memoryNS::TAG_COUNT];
+	std::atomic<size_t> tagPeak[memoryNS::TAG_COUNT];
+	std::atomic<UINT64> tagAllocations[memoryNS::TAG_COUNT];
+	std::atomic<UINT64> heapAllocations;
+
+	const char* const tagNames[memoryNS::TAG_COUNT] =
+	{
+		"general", "graphics", "input", "world", "collision", "jobs", "frame", "profiler",
+		"assets", "particles"
+	};
+
+	// Stored in front of every tagged allocation.
+	struct Header
+	{
+		void*  raw;                 // pointer returned by malloc
+		size_t bytes;
+		int    tag;
+	};
+
+	// Return tag clamped to the valid range.
+	int validTag(int tag)
+	{
+		return tag >= 0 && tag < memoryNS::TAG_COUNT ? tag : memoryNS::TAG_GENERAL;
+	}
+}
+
+#ifdef BEX_TRACK_HEAP
+// Count every general purpose heap allocation.
+void* operator new(size_t bytes)
+{
+	++heapAllocations;
+	void* p = malloc(bytes ? bytes : 1);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t bytes)
+{
+	++heapAllocations;
+	void* p = malloc(bytes ? bytes : 1);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) throw()   { free(p); }
+void operator delete[](void* p) throw() { free(p); }
+#endif
+
+//=============================================================================
+// Allocate bytes aligned to align for subsystem tag
+// Throws GameError
+//=============================================================================
+void* TaggedAllocator::allocate(size_t bytes, int tag, size_t align)
+{
+	tag = validTag(tag);
+	if (align < sizeof(void*))
+		align = sizeof(void*);
+	void* raw = malloc(bytes + sizeof(Header) + align);
+	if (raw == nullptr)
+		throw(GameError(gameErrorNS::FATAL_ERROR, std::string("Out of memory for ") + tagNames[tag]));
+	uintptr_t p = ((uintptr_t)raw + sizeof(Header) + align - 1) & ~(uintptr_t)(align - 1);
+	Header* h = (Header*)p - 1;
+	h->raw = raw;
+	h->bytes = bytes;
+	h->tag = tag;
+
+	size_t now = (tagBytes[tag] += bytes);
+	size_t peak = tagPeak[tag].load();
+	while (now > peak && !tagPeak[tag].compare_exchange_weak(peak, now))
+		;
+	++tagAllocations[tag];
+	return (void*)p;
+}
+
+//=============================================================================
+// Free memory returned by allocate()
+//=============================================================================
+void TaggedAllocator::free(void* p)
+{
+	if (p == nullptr)
+		return;
+	Header* h = (Header*)p - 1;
+	tagBytes[h->tag] -= h->bytes;
+	::free(h->raw);
+}
+
+//=============================================================================
+// Statistics
+//=============================================================================
+size_t TaggedAllocator::getBytes(int tag)       { return tagBytes[validTag(tag)].load(); }
+size_t TaggedAllocator::getPeakBytes(int tag)   { return tagPeak[validTag(tag)].load(); }
+UINT64 TaggedAllocator::getAllocations(int tag) { return tagAllocations[validTag(tag)].load(); }
+const char* TaggedAllocator::getTagName(int tag) { return tagNames[validTag(tag)]; }
+UINT64 TaggedAllocator::getHeapAllocations()   { return heapAllocations.load(); }
+
+bool TaggedAllocator::isHeapTracked()
+{
+#ifdef BEX_TRACK_HEAP
+	return true;
+#else
+	return false;
+#endif
+}
+
+//=============================================================================
+// LinearArena constructor
+//=============================================================================
+LinearArena::LinearArena()
+{
+	buffer = nullptr;
+	capacity = 0;
+	used = 0;
+	peak = 0;
+}
+
+//=============================================================================
+// LinearArena destructor
+//=============================================================================
+LinearArena::~LinearArena()
+{
+	TaggedAllocator::free(buffer);
+}
+
+//=============================================================================
+// Allocate the buffer
+// Throws GameError
+//=============================================================================
+void LinearArena::initialize(size_t size, int tag)
+{
+	TaggedAllocator::free(buffer);
+	buffer = nullptr;
+	capacity = 0;
+	buffer = (unsigned char*)TaggedAllocator::allocate(size, tag, 64);
+	capacity = size;
+	used = 0;
+	peak = 0;
+}
+
+//=============================================================================
+// Allocate bytes aligned to align, safe from several threads
+// Throws GameError when the arena is full
+//=============================================================================
+void* LinearArena::allocate(size_t bytes, size_t align)
+{
+	size_t offset = used.load();
+	size_t start, end;
+	do
+	{
+		start = (offset + align - 1) & ~(align - 1);
+		end = start + bytes;
+		if (end > capacity)
+			throw(GameError(gameErrorNS::FATAL_ERROR, "Linear arena out of memory"));
+	} while (!used.compare_exchange_weak(offset, end));
+	return buffer + start;
+}
+
+//=============================================================================
+// FrameArena constructor
+//=============================================================================
+FrameArena::FrameArena()
+{
+	current = 0;
+}
+
+//=============================================================================
+// Allocate both buffers
+// Throws GameError
+//=============================================================================
+void FrameArena::initialize(size_t capacity)
+{
+	arenas[0].initialize(capacity, memoryNS::TAG_FRAME);
+	arenas[1].initialize(capacity, memoryNS::TAG_FRAME);
+	current = 0;
+}
+
+//=============================================================================
+// Switch buffers, the buffer of the frame before this one is reused
+//=============================================================================
+void FrameArena::endFrame()
+{
+	current ^= 1;
+	arenas[current].reset();
+}
+
+//=============================================================================
+// Return most bytes used in one frame
+//=============================================================================
+size_t FrameArena::getPeak() const
+{
+	size_t peak = arenas[0].getPeak() > arenas[1].getPeak() ? arenas[0].getPeak() : arenas[1].getPeak();
+	size_t now = arenas[current].getUsed();
+	return now > peak ? now : peak;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include "constants.h"
+#include "gameError.h"
+
+namespace memoryNS
+{
+	const size_t DEFAULT_ALIGN = 16;
+	const size_t FRAME_ARENA_SIZE = 4 * 1024 * 1024;    // bytes of each frame arena buffer
+
+	// subsystems that memory is reported for
+	const int TAG_GENERAL = 0;
+	const int TAG_GRAPHICS = 1;
+	const int TAG_INPUT = 2;
+	const int TAG_WORLD = 3;
+	const int TAG_COLLISION = 4;
+	const int TAG_JOBS = 5;
+	const int TAG_FRAME = 6;                // frame arena
+	const int TAG_PROFILER = 7;
+	const int TAG_ASSETS = 8;               // decompressed assets
+	const int TAG_PARTICLES = 9;
+	const int TAG_COUNT = 10;
+}
+
+// Heap allocator that reports bytes per subsystem.
+// Allocations carry a tag; current bytes, peak bytes and allocation counts
+// are kept per tag and are safe to update from any thread.
+// When the engine is built with BEX_TRACK_HEAP defined, all operator new
+// calls are counted as well, so steady state code can be checked for
+// general purpose heap allocations with getHeapAllocations().
+class TaggedAllocator final
+{
+public:
+	// Allocate bytes aligned to align for subsystem tag.
+	// Throws GameError when out of memory
+	// Pre: align = power of 2
+	static void* allocate(size_t bytes, int tag, size_t align = memoryNS::DEFAULT_ALIGN);
+
+	// Free memory returned by allocate(), nullptr is ignored.
+	static void  free(void* p);
+
+	// Return bytes currently allocated with tag.
+	static size_t getBytes(int tag);
+
+	// Return most bytes allocated with tag at any time.
+	static size_t getPeakBytes(int tag);
+
+	// Return number of allocations made with tag.
+	static UINT64 getAllocations(int tag);
+
+	// Return name of tag.
+	static const char* getTagName(int tag);
+
+	// Return number of operator new calls, 0 unless built with BEX_TRACK_HEAP.
+	static UINT64 getHeapAllocations();
+
+	// Return true if built with BEX_TRACK_HEAP.
+	static bool  isHeapTracked();
+};
+
+// Linear allocator over a fixed buffer.
+// Allocation bumps an offset and may be done from several threads at once;
+// all memory is released together by reset(). Nothing is destructed, use it
+// for plain data.
+class LinearArena final
+{
+public:
+	// Constructor, no memory until initialize().
+	LinearArena();
+
+	// Destructor
+	~LinearArena();
+
+	// Allocate the buffer.
+	// Throws GameError
+	void    initialize(size_t capacity, int tag = memoryNS::TAG_FRAME);
+
+	// Allocate bytes aligned to align.
+	// Throws GameError when the arena is full
+	void*   allocate(size_t bytes, size_t align = memoryNS::DEFAULT_ALIGN);
+
+	// Allocate count default constructed T.
+	// Throws GameError when the arena is full
+	template<class T> T* allocate(size_t count = 1)
+	{
+		const size_t align = std::alignment_of<T>::value;
+		T* p = (T*)allocate(sizeof(T) * count, align > memoryNS::DEFAULT_ALIGN ? align : memoryNS::DEFAULT_ALIGN);
+		for (size_t i = 0; i < count; i++)
+			new(p + i) T();
+		return p;
+	}
+
+	// Release the allocations made after getUsed() returned mark.
+	// Pre: no other thread allocates
+	void    rewind(size_t mark)
+	{
+		if (used.load() > peak)
+			peak = used.load();
+		used = mark < used.load() ? mark : used.load();
+	}
+
+	// Release all allocations.
+	void    reset()
+	{
+		if (used.load() > peak)
+			peak = used.load();
+		used = 0;
+	}
+
+	// Return bytes in use.
+	size_t  getUsed() const { return used.load(); }
+
+	// Return most bytes used before a reset.
+	size_t  getPeak() const { return peak; }
+
+	// Return size of the buffer.
+	size_t  getCapacity() const { return capacity; }
+
+private:
+	unsigned char* buffer;
+	size_t  capacity;
+	std::atomic<size_t> used;
+	size_t  peak;
+
+	LinearArena(const LinearArena&);        // no copies
+	LinearArena& operator=(const LinearArena&);
+};
+
+// Double buffered arena for data that lives one frame.
+// Memory allocated during a frame stays valid through the next frame, so a
+// frame may read what the previous frame produced. Game calls endFrame()
+// at the end of every run().
+class FrameArena final
+{
+public:
+	// Constructor
+	FrameArena();
+
+	// Allocate both buffers.
+	// Throws GameError
+	void    initialize(size_t capacity = memoryNS::FRAME_ARENA_SIZE);
+
+	// Allocate bytes for this and the next frame.
+	// Throws GameError when the arena is full
+	void*   allocate(size_t bytes, size_t align = memoryNS::DEFAULT_ALIGN)
+	{
+		return arenas[current].allocate(bytes, align);
+	}
+
+	// Allocate count default constructed T for this and the next frame.
+	template<class T> T* allocate(size_t count = 1) { return arenas[current].allocate<T>(count); }
+
+	// Switch buffers, frees the memory of the frame before this one.
+	void    endFrame();
+
+	// Return bytes used in this frame.
+	size_t  getUsed() const { return arenas[current].getUsed(); }
+
+	// Release the allocations of this frame made after getUsed() returned
+	// mark, e.g. the scratch memory of a step that is run again.
+	void    rewind(size_t mark) { arenas[current].rewind(mark); }
+
+	// Return most bytes used in one frame.
+	size_t  getPeak() const;
+
+	// Return capacity of one frame.
+	size_t  getCapacity() const { return arenas[current].getCapacity(); }
+
+private:
+	LinearArena arenas[2];
+	int     current;                        // buffer of this frame
+};
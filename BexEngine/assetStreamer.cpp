@@ -0,0 +1,449 @@
+#include "assetStreamer.h"
+#include "allocators.h"
+#include "framePacer.h"
+#include "gameError.h"
+#include "lz4.h"
+#include <algorithm>
+
+//=============================================================================
+// AssetHandle copy constructor
+//=============================================================================
+AssetHandle::AssetHandle(const AssetHandle& h) : asset(h.asset)
+{
+	if (asset)
+		++asset->refs;
+}
+
+//=============================================================================
+// Refer to a, adds a reference
+//=============================================================================
+AssetHandle::AssetHandle(Asset* a) : asset(a)
+{
+	if (asset)
+		++asset->refs;
+}
+
+//=============================================================================
+// Share the asset of h
+//=============================================================================
+AssetHandle& AssetHandle::operator=(const AssetHandle& h)
+{
+	if (h.asset)
+		++h.asset->refs;
+	release();
+	asset = h.asset;
+	return *this;
+}
+
+//=============================================================================
+// Release the asset
+//=============================================================================
+void AssetHandle::release()
+{
+	// the last reference of an asset the streamer let go of
+	if (asset && --asset->refs == 0)
+	{
+		AssetStreamer::freeData(asset);
+		delete asset;
+	}
+	asset = nullptr;
+}
+
+//=============================================================================
+// Return the bytes of the asset, nullptr until it is ready
+//=============================================================================
+const void* AssetHandle::getData() const
+{
+	if (!isReady())
+		return nullptr;
+	if (!asset->used)
+	{
+		asset->used = true;
+		asset->owner->recordFirstUse(asset);
+	}
+	return asset->data;
+}
+
+//=============================================================================
+// Return name of the asset
+//=============================================================================
+const std::string& AssetHandle::getName() const
+{
+	static const std::string none;
+	return asset ? asset->name : none;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+AssetStreamer::AssetStreamer()
+{
+	quit = false;
+	pending = 0;
+	sequence = 0;
+	loadingCount = 0;
+	maxQueueDepth = 0;
+	loadsCompleted = 0;
+	loadsFailed = 0;
+	bytesRead = 0;
+	bytesLoaded = 0;
+	busySeconds = 0;
+	timeToReady = 0;
+	firstUses = 0;
+	timeToFirstUse = 0;
+	maxTimeToFirstUse = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+AssetStreamer::~AssetStreamer()
+{
+	shutdown();
+}
+
+//=============================================================================
+// Start the I/O threads
+// Throws GameError
+//=============================================================================
+void AssetStreamer::initialize(UINT threads)
+{
+	shutdown();
+	if (threads == 0)
+		threads = 1;
+	try{
+		for (UINT i = 0; i < threads; i++)
+			workers.push_back(std::thread(&AssetStreamer::workerLoop, this));
+	}
+	catch (...)
+	{
+		shutdown();
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error starting asset I/O threads"));
+	}
+}
+
+//=============================================================================
+// Stop the I/O threads and release all assets and packs
+//=============================================================================
+void AssetStreamer::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	quit = false;
+
+	// in flight assets lose the reference of their request
+	queue.insert(queue.end(), loaded.begin(), loaded.end());
+	queue.insert(queue.end(), completing.begin(), completing.end());
+	for (size_t i = 0; i < queue.size(); i++)
+		--queue[i]->refs;
+	queue.clear();
+	loaded.clear();
+	completing.clear();
+
+	// handles still held see a failed asset without data
+	for (std::unordered_map<std::string, Asset*>::iterator it = assets.begin(); it != assets.end(); ++it)
+	{
+		Asset* a = it->second;
+		freeData(a);
+		a->state = assetNS::STATE_FAILED;
+		a->callbacks.clear();
+		if (--a->refs == 0)
+			delete a;
+	}
+	assets.clear();
+	for (size_t i = 0; i < packs.size(); i++)
+		delete packs[i];
+	packs.clear();
+	pending = 0;
+}
+
+//=============================================================================
+// Map a pack
+// Throws GameError
+//=============================================================================
+void AssetStreamer::mount(const std::string& filename)
+{
+	PackFile* pack = new PackFile;
+	try{
+		pack->open(filename);
+	}
+	catch (...)
+	{
+		delete pack;
+		throw;
+	}
+	packs.push_back(pack);
+}
+
+//=============================================================================
+// Order the load queue, higher priority first, then request order
+//=============================================================================
+bool AssetStreamer::queueLess(const Asset* a, const Asset* b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return a->sequence > b->sequence;
+}
+
+//=============================================================================
+// Request an asset
+//=============================================================================
+AssetHandle AssetStreamer::load(const std::string& name, int priority, const AssetCallback& callback)
+{
+	std::unordered_map<std::string, Asset*>::iterator it = assets.find(name);
+	if (it != assets.end())
+	{
+		Asset* a = it->second;
+		if (callback)
+		{
+			a->callbacks.push_back(callback);
+			int state = a->state.load();
+			if (state == assetNS::STATE_READY || state == assetNS::STATE_FAILED)
+			{
+				// completed already, the callback runs in the next update()
+				++a->refs;
+				completing.push_back(a);
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (a->state.load() == assetNS::STATE_QUEUED && priority > a->priority)
+		{
+			a->priority = priority;
+			std::make_heap(queue.begin(), queue.end(), queueLess);
+		}
+		return AssetHandle(a);
+	}
+
+	Asset* a = new Asset;
+	a->name = name;
+	a->owner = this;
+	a->refs = 2;                        // the streamer and the request
+	a->state = assetNS::STATE_QUEUED;
+	a->priority = priority;
+	a->sequence = sequence++;
+	a->pack = nullptr;
+	a->entry = nullptr;
+	a->buffer = nullptr;
+	a->data = nullptr;
+	a->size = 0;
+	a->requestTime = FramePacer::now();
+	a->readyTime = 0;
+	a->used = false;
+	a->failed = false;
+	if (callback)
+		a->callbacks.push_back(callback);
+	assets[name] = a;
+	++pending;
+
+	// later packs override earlier ones
+	for (size_t i = packs.size(); i-- > 0 && a->entry == nullptr;)
+	{
+		a->entry = packs[i]->find(name);
+		a->pack = packs[i];
+	}
+	if (a->entry == nullptr)
+	{
+		a->failed = true;
+		a->state = assetNS::STATE_LOADED;
+		completing.push_back(a);
+		return AssetHandle(a);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(a);
+		std::push_heap(queue.begin(), queue.end(), queueLess);
+		if (queue.size() > maxQueueDepth)
+			maxQueueDepth = (UINT)queue.size();
+	}
+	wake.notify_one();
+	return AssetHandle(a);
+}
+
+//=============================================================================
+// I/O thread main loop
+//=============================================================================
+void AssetStreamer::workerLoop()
+{
+	for (;;)
+	{
+		Asset* a;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!quit && queue.empty())
+				wake.wait(lock);
+			if (quit)
+				return;
+			std::pop_heap(queue.begin(), queue.end(), queueLess);
+			a = queue.back();
+			queue.pop_back();
+			a->state = assetNS::STATE_LOADING;
+			++loadingCount;
+		}
+
+		double start = FramePacer::now();
+		bool ok = read(a);
+		double seconds = FramePacer::now() - start;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		--loadingCount;
+		busySeconds += seconds;
+		if (ok)
+		{
+			bytesRead += a->entry->storedSize;
+			bytesLoaded += a->size;
+		}
+		a->failed = !ok;
+		a->state = assetNS::STATE_LOADED;
+		loaded.push_back(a);
+	}
+}
+
+//=============================================================================
+// Read and decompress an asset
+// Returns false if it is damaged
+//=============================================================================
+bool AssetStreamer::read(Asset* a)
+{
+	const PackEntry& e = *a->entry;
+	const unsigned char* blob = a->pack->getBlob(e);
+	if (e.flags & packNS::FLAG_LZ4)
+	{
+		try{
+			a->buffer = (unsigned char*)TaggedAllocator::allocate(e.size > 0 ? (size_t)e.size : 1,
+				memoryNS::TAG_ASSETS);
+		}
+		catch (...)
+		{
+			return false;               // out of memory
+		}
+		if (!lz4::decompress(blob, (size_t)e.storedSize, a->buffer, (size_t)e.size))
+		{
+			freeData(a);
+			return false;
+		}
+		a->data = a->buffer;
+	}
+	else
+	{
+		// touch every page so the OS reads it now and not on first use
+		volatile unsigned char sum = 0;
+		for (UINT64 i = 0; i < e.storedSize; i += assetNS::PAGE_SIZE)
+			sum += blob[i];
+		a->data = blob;
+	}
+	a->size = (size_t)e.size;
+	return true;
+}
+
+//=============================================================================
+// Complete loaded assets and free the assets no handle refers to
+//=============================================================================
+void AssetStreamer::update()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		completing.insert(completing.end(), loaded.begin(), loaded.end());
+		loaded.clear();
+	}
+
+	// at least one completion per frame, more while the budget lasts
+	double start = FramePacer::now();
+	size_t done = 0;
+	while (done < completing.size() &&
+		(done == 0 || FramePacer::now() - start < assetNS::COMPLETION_BUDGET))
+		complete(completing[done++]);
+	completing.erase(completing.begin(), completing.begin() + done);
+
+	for (std::unordered_map<std::string, Asset*>::iterator it = assets.begin(); it != assets.end();)
+	{
+		Asset* a = it->second;
+		int state = a->state.load();
+		if (a->refs.load() == 1 && (state == assetNS::STATE_READY || state == assetNS::STATE_FAILED))
+		{
+			freeData(a);
+			delete a;
+			it = assets.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+//=============================================================================
+// Complete an asset and run its callbacks
+//=============================================================================
+void AssetStreamer::complete(Asset* a)
+{
+	if (a->state.load() == assetNS::STATE_LOADED)
+	{
+		a->readyTime = FramePacer::now();
+		timeToReady += a->readyTime - a->requestTime;
+		if (a->failed)
+			++loadsFailed;
+		else
+			++loadsCompleted;
+		a->state = a->failed ? assetNS::STATE_FAILED : assetNS::STATE_READY;
+		--pending;
+	}
+
+	// a callback may request more assets
+	std::vector<AssetCallback> callbacks;
+	callbacks.swap(a->callbacks);
+	AssetHandle h(a);
+	--a->refs;                          // the reference of the request
+	for (size_t i = 0; i < callbacks.size(); i++)
+		callbacks[i](h);
+}
+
+//=============================================================================
+// Count the first use of an asset
+//=============================================================================
+void AssetStreamer::recordFirstUse(const Asset* a)
+{
+	double t = FramePacer::now() - a->requestTime;
+	++firstUses;
+	timeToFirstUse += t;
+	if (t > maxTimeToFirstUse)
+		maxTimeToFirstUse = t;
+}
+
+//=============================================================================
+// Free the memory of an asset
+//=============================================================================
+void AssetStreamer::freeData(Asset* a)
+{
+	TaggedAllocator::free(a->buffer);
+	a->buffer = nullptr;
+	a->data = nullptr;
+	a->size = 0;
+}
+
+//=============================================================================
+// Return loading statistics
+//=============================================================================
+AssetStats AssetStreamer::getStats() const
+{
+	AssetStats s;
+	std::lock_guard<std::mutex> lock(mutex);
+	s.queueDepth = (UINT)queue.size();
+	s.maxQueueDepth = maxQueueDepth;
+	s.loading = loadingCount;
+	s.resident = (UINT)assets.size();
+	s.loadsCompleted = loadsCompleted;
+	s.loadsFailed = loadsFailed;
+	s.bytesRead = bytesRead;
+	s.bytesLoaded = bytesLoaded;
+	s.bytesPerSecond = busySeconds > 0 ? bytesLoaded / busySeconds : 0;
+	UINT64 finished = loadsCompleted + loadsFailed;
+	s.avgTimeToReady = finished > 0 ? timeToReady / finished : 0;
+	s.avgTimeToFirstUse = firstUses > 0 ? timeToFirstUse / firstUses : 0;
+	s.maxTimeToFirstUse = maxTimeToFirstUse;
+	return s;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "packFile.h"
+#include "constants.h"
+
+namespace assetNS
+{
+	const UINT IO_THREADS = 2;              // background threads reading packs
+	const double COMPLETION_BUDGET = 0.002; // seconds per frame spent on completions
+	const size_t PAGE_SIZE = 4096;          // bytes touched per page to read a mapped blob
+
+	// load priorities, higher loads first
+	const int PRIORITY_LOW = 0;
+	const int PRIORITY_NORMAL = 1;
+	const int PRIORITY_HIGH = 2;
+	const int PRIORITY_CRITICAL = 3;
+
+	// asset states
+	const int STATE_QUEUED = 0;             // waiting for an I/O thread
+	const int STATE_LOADING = 1;            // being read
+	const int STATE_LOADED = 2;             // read, waiting for the main thread
+	const int STATE_READY = 3;              // usable
+	const int STATE_FAILED = 4;             // not found or damaged
+}
+
+class AssetStreamer;
+class AssetHandle;
+
+// Called on the main thread when an asset is ready or failed.
+typedef std::function<void(AssetHandle&)> AssetCallback;
+
+// Asset loading statistics.
+struct AssetStats
+{
+	UINT   queueDepth;                  // requests waiting for an I/O thread
+	UINT   maxQueueDepth;
+	UINT   loading;                     // requests being read
+	UINT   resident;                    // assets in memory
+	UINT64 loadsCompleted;
+	UINT64 loadsFailed;
+	UINT64 bytesRead;                   // stored bytes read from packs
+	UINT64 bytesLoaded;                 // bytes after decompression
+	double bytesPerSecond;              // bytesLoaded per second an I/O thread was busy
+	double avgTimeToReady;              // seconds from request to ready
+	double avgTimeToFirstUse;           // seconds from request to first getData()
+	double maxTimeToFirstUse;
+};
+
+// A loaded or loading blob, shared by its handles.
+class Asset final
+{
+private:
+	friend class AssetStreamer;
+	friend class AssetHandle;
+
+	std::string name;
+	AssetStreamer* owner;
+	std::atomic<int> refs;              // handles, the streamer and a request in flight
+	std::atomic<int> state;             // assetNS::STATE_
+	int    priority;
+	UINT64 sequence;                    // request order within a priority
+	const PackFile* pack;
+	const PackEntry* entry;
+	unsigned char* buffer;              // decompressed bytes, nullptr if used in place
+	const unsigned char* data;
+	size_t size;
+	double requestTime;
+	double readyTime;
+	bool   used;                        // true after the first getData()
+	bool   failed;                      // not found or damaged, set before STATE_LOADED
+	std::vector<AssetCallback> callbacks;
+};
+
+// Reference counted handle of an asset.
+// Handles are used on the main thread; the asset stays in memory while a
+// handle refers to it.
+class AssetHandle final
+{
+public:
+	// Constructor, no asset.
+	AssetHandle() : asset(nullptr) {}
+
+	// Copy constructor, shares the asset.
+	AssetHandle(const AssetHandle& h);
+
+	// Destructor, releases the asset.
+	~AssetHandle() { release(); }
+
+	// Share the asset of h.
+	AssetHandle& operator=(const AssetHandle& h);
+
+	// Release the asset, the handle becomes empty.
+	void release();
+
+	// Return true if the handle refers to an asset.
+	bool isValid() const { return asset != nullptr; }
+
+	// Return true if the asset is loaded and usable.
+	bool isReady() const { return asset && asset->state.load() == assetNS::STATE_READY; }
+
+	// Return true if the asset could not be loaded.
+	bool isFailed() const { return asset && asset->state.load() == assetNS::STATE_FAILED; }
+
+	// Return the bytes of the asset, nullptr until it is ready.
+	// The first call of a ready asset counts its time to first use.
+	const void* getData() const;
+
+	// Return size of the asset in bytes, 0 until it is ready.
+	size_t getSize() const { return isReady() ? asset->size : 0; }
+
+	// Return name of the asset.
+	const std::string& getName() const;
+
+private:
+	friend class AssetStreamer;
+	Asset* asset;
+
+	// Refer to a, adds a reference.
+	explicit AssetHandle(Asset* a);
+};
+
+// Streams assets from memory mapped pack files.
+// load() returns at once with a handle; background I/O threads read the
+// requests by priority, touch the pages of stored blobs so the OS reads them
+// and decompress LZ4 blobs. Completion happens on the main thread in
+// update(), which runs the callbacks within a time budget so loading a level
+// never stalls a frame.
+class AssetStreamer final
+{
+public:
+	// Constructor
+	AssetStreamer();
+
+	// Destructor, stops the I/O threads.
+	~AssetStreamer();
+
+	// Start the I/O threads.
+	// Throws GameError
+	void initialize(UINT threads = assetNS::IO_THREADS);
+
+	// Stop the I/O threads and release all assets and packs.
+	// Handles still held become empty failed handles.
+	void shutdown();
+
+	// Map a pack, later packs are searched first.
+	// Throws GameError
+	void mount(const std::string& filename);
+
+	// Request the asset name. A loaded or loading asset is shared.
+	// callback, if set, is called by update() when the asset is ready or failed.
+	AssetHandle load(const std::string& name, int priority = assetNS::PRIORITY_NORMAL,
+		const AssetCallback& callback = AssetCallback());
+
+	// Complete loaded assets and free the assets no handle refers to.
+	// Call once per frame on the main thread.
+	void update();
+
+	// Return loading statistics.
+	AssetStats getStats() const;
+
+	// Return number of requests not completed yet.
+	UINT getPending() const { return pending; }
+
+private:
+	friend class AssetHandle;
+
+	std::vector<PackFile*> packs;
+	std::unordered_map<std::string, Asset*> assets;    // by name, holds a reference
+	std::vector<Asset*> queue;                          // heap by priority
+	std::vector<Asset*> loaded;                         // read by I/O threads
+	std::vector<Asset*> completing;                     // waiting for update()
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;                           // guards queue and loaded
+	std::condition_variable wake;
+	bool   quit;
+	UINT   pending;                                     // requests not completed
+	UINT64 sequence;
+	UINT   loadingCount;
+	UINT   maxQueueDepth;
+	UINT64 loadsCompleted;
+	UINT64 loadsFailed;
+	UINT64 bytesRead;
+	UINT64 bytesLoaded;
+	double busySeconds;                                 // I/O thread time spent loading
+	double timeToReady;                                 // sum of the seconds to ready
+	UINT64 firstUses;
+	double timeToFirstUse;                              // sum of the seconds to first use
+	double maxTimeToFirstUse;
+
+	AssetStreamer(const AssetStreamer&);                // no copies
+	AssetStreamer& operator=(const AssetStreamer&);
+
+	// I/O thread main loop.
+	void workerLoop();
+	// Read and decompress an asset, returns false if it is damaged.
+	bool read(Asset* a);
+	// Complete an asset and run its callbacks.
+	void complete(Asset* a);
+	// Count the first use of an asset.
+	void recordFirstUse(const Asset* a);
+	// Free the memory of an asset.
+	static void freeData(Asset* a);
+	// Order the load queue, higher priority first, then request order.
+	static bool queueLess(const Asset* a, const Asset* b);
+};
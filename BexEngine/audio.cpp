@@ -0,0 +1,829 @@
+#include "audio.h"
+#include "audioKernels.h"
+#include "framePacer.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	const UINT STREAM_SCRATCH = audioNS::BLOCK_FRAMES * 16 + 2;    // stream frames of one block at 16x speed
+	const float PI_4 = 0.785398163f;
+
+	// Format of a .wav file.
+	struct WavInfo
+	{
+		UINT    channels;
+		UINT    rate;
+		UINT    bytesPerSample;             // 2 for 16 bit, 4 for float
+		long    dataStart;                  // file offset of the samples
+		UINT    frames;
+	};
+
+	// Read the header of a .wav file up to its samples.
+	// Returns false if it is not a 16 bit or float .wav file of 1 or 2 channels.
+	bool readWavInfo(FILE* file, WavInfo& w)
+	{
+		char id[4], wave[4];
+		uint32_t size;
+		if (fread(id, 1, 4, file) != 4 || memcmp(id, "RIFF", 4) != 0 || fread(&size, 4, 1, file) != 1 ||
+			fread(wave, 1, 4, file) != 4 || memcmp(wave, "WAVE", 4) != 0)
+			return false;
+		bool format = false;
+		while (fread(id, 1, 4, file) == 4 && fread(&size, 4, 1, file) == 1)
+		{
+			if (memcmp(id, "fmt ", 4) == 0 && size >= 16)
+			{
+				uint16_t tag, channels, blockAlign, bits;
+				uint32_t rate, byteRate;
+				if (fread(&tag, 2, 1, file) != 1 || fread(&channels, 2, 1, file) != 1 ||
+					fread(&rate, 4, 1, file) != 1 || fread(&byteRate, 4, 1, file) != 1 ||
+					fread(&blockAlign, 2, 1, file) != 1 || fread(&bits, 2, 1, file) != 1)
+					return false;
+				if (!((tag == 1 && bits == 16) || (tag == 3 && bits == 32)) ||
+					channels < 1 || channels > 2 || rate == 0)
+					return false;
+				w.channels = channels;
+				w.rate = rate;
+				w.bytesPerSample = bits / 8;
+				format = true;
+				fseek(file, (long)(size - 16 + (size & 1)), SEEK_CUR);
+			}
+			else if (memcmp(id, "data", 4) == 0)
+			{
+				if (!format)
+					return false;
+				w.dataStart = ftell(file);
+				w.frames = size / (w.channels * w.bytesPerSample);
+				return true;
+			}
+			else
+				fseek(file, (long)(size + (size & 1)), SEEK_CUR);
+		}
+		return false;
+	}
+
+	// Return sample i of the samples read from a .wav file.
+	inline float wavSample(const char* data, size_t i, UINT bytesPerSample)
+	{
+		if (bytesPerSample == 4)
+		{
+			float f;
+			memcpy(&f, data + i * 4, 4);
+			return f;
+		}
+		int16_t s;
+		memcpy(&s, data + i * 2, 2);
+		return s * (1.0f / 32768);
+	}
+
+	// Channel gains of volume and pan, constant power for mono, balance for stereo.
+	void panGains(float volume, float pan, bool stereo, float& left, float& right)
+	{
+		pan = pan < -1 ? -1 : (pan > 1 ? 1 : pan);
+		if (stereo)
+		{
+			left = volume * (pan > 0 ? 1 - pan : 1);
+			right = volume * (pan < 0 ? 1 + pan : 1);
+		}
+		else
+		{
+			left = volume * std::cos((pan + 1) * PI_4);
+			right = volume * std::sin((pan + 1) * PI_4);
+		}
+	}
+}
+
+// A .wav file streamed into a ring buffer.
+// The stream thread reads the file and owns written, the mixer owns read.
+class AudioStream
+{
+public:
+	FILE*   file;
+	WavInfo info;
+	bool    loop;
+	UINT    filePos;                        // frames read from the file
+	std::vector<float> left, right;         // ring of STREAM_FRAMES frames, right empty for mono
+	std::vector<char> buffer;               // file read buffer
+	std::atomic<UINT64> written;            // frames put in the ring
+	std::atomic<UINT64> read;               // frames taken from the ring
+	std::atomic<bool> ended;                // no more frames will be written
+	std::atomic<bool> done;                 // the mixer finished the voice
+
+	AudioStream() : file(nullptr), loop(false), filePos(0), written(0), read(0), ended(false), done(false) {}
+	~AudioStream() { if (file) fclose(file); }
+
+	// Read frames from the file into the free part of the ring.
+	void fill()
+	{
+		const UINT64 mask = audioNS::STREAM_FRAMES - 1;
+		UINT64 w = written.load(std::memory_order_relaxed);
+		UINT64 room = audioNS::STREAM_FRAMES - (w - read.load(std::memory_order_acquire));
+		while (room > 0 && !ended)
+		{
+			if (filePos == info.frames)
+			{
+				if (!loop || info.frames == 0)
+				{
+					ended.store(true, std::memory_order_release);
+					break;
+				}
+				fseek(file, info.dataStart, SEEK_SET);
+				filePos = 0;
+			}
+			UINT n = (UINT)std::min<UINT64>(std::min<UINT64>(room, audioNS::STREAM_READ), info.frames - filePos);
+			UINT frameBytes = info.channels * info.bytesPerSample;
+			buffer.resize((size_t)n * frameBytes);
+			n = (UINT)(fread(&buffer[0], frameBytes, n, file));
+			if (n == 0)
+			{
+				// a truncated file ends early
+				ended.store(true, std::memory_order_release);
+				break;
+			}
+			for (UINT i = 0; i < n; i++)
+			{
+				size_t k = (size_t)((w + i) & mask);
+				left[k] = wavSample(&buffer[0], (size_t)i * info.channels, info.bytesPerSample);
+				if (info.channels == 2)
+					right[k] = wavSample(&buffer[0], (size_t)i * 2 + 1, info.bytesPerSample);
+			}
+			w += n;
+			written.store(w, std::memory_order_release);
+			filePos += n;
+			room -= n;
+		}
+	}
+};
+
+//=============================================================================
+// Constructor
+//=============================================================================
+AudioSystem::AudioSystem() : commands(audioNS::COMMAND_QUEUE_SIZE), finished(audioNS::MAX_VOICES)
+{
+	sink = nullptr;
+	initialized = false;
+	for (UINT i = 0; i < audioNS::MAX_VOICES; i++)
+	{
+		generations[i] = 0;
+		busy[i] = false;
+		voices[i].handle = audioNS::INVALID;
+	}
+	masterVolume = 1;
+	quit = false;
+	voiceCount = 0;
+	peakVoices = 0;
+	blocks = 0;
+	voiceBlocks = 0;
+	mixNanos = 0;
+	underruns = 0;
+	dropped = 0;
+	streamCount = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+AudioSystem::~AudioSystem()
+{
+	release();
+}
+
+//=============================================================================
+// Open the sink and start the mixer and stream threads
+// Throws GameError
+//=============================================================================
+void AudioSystem::initialize(AudioSink* s, bool threaded)
+{
+	release();
+	sink = s ? s : new NullAudioSink;
+	sink->open(audioNS::SAMPLE_RATE, audioNS::BLOCK_FRAMES);      // throws GameError
+
+	freeVoices.clear();
+	for (UINT i = audioNS::MAX_VOICES; i-- > 0;)
+		freeVoices.push_back(i);
+	active.reserve(audioNS::MAX_VOICES);
+	mix.assign(audioNS::BLOCK_FRAMES * 2, 0.0f);
+	output.assign(audioNS::BLOCK_FRAMES * 2, 0);
+	streamLeft.assign(STREAM_SCRATCH, 0.0f);
+	streamRight.assign(STREAM_SCRATCH, 0.0f);
+	masterVolume = 1;
+	initialized = true;
+
+	if (!threaded)
+		return;
+	quit = false;
+	try{
+		mixer = std::thread(&AudioSystem::mixLoop, this);
+		streamer = std::thread(&AudioSystem::streamLoop, this);
+	}
+	catch (...)
+	{
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error starting the audio threads"));
+	}
+}
+
+//=============================================================================
+// Stop the threads, close the sink and free sounds and streams
+//=============================================================================
+void AudioSystem::release()
+{
+	stopThreads();
+	if (sink)
+	{
+		sink->close();
+		delete sink;
+		sink = nullptr;
+	}
+	// the commands not applied may hold streams
+	while (const Command* c = commands.front())
+	{
+		if (c->type == CMD_PLAY && c->stream)
+			c->stream->done = true;
+		commands.pop();
+	}
+	while (finished.front())
+		finished.pop();
+	for (size_t i = 0; i < active.size(); i++)
+		voices[active[i]].handle = audioNS::INVALID;
+	active.clear();
+	for (size_t i = 0; i < newStreams.size(); i++)
+		delete newStreams[i];
+	newStreams.clear();
+	for (size_t i = 0; i < streams.size(); i++)
+		delete streams[i];
+	streams.clear();
+	for (size_t i = 0; i < sounds.size(); i++)
+		delete sounds[i];
+	sounds.clear();
+	for (UINT i = 0; i < audioNS::MAX_VOICES; i++)
+		busy[i] = false;
+	freeVoices.clear();
+	voiceCount = 0;
+	streamCount = 0;
+	initialized = false;
+}
+
+//=============================================================================
+// Stop and join the threads
+//=============================================================================
+void AudioSystem::stopThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	if (mixer.joinable())
+		mixer.join();
+	if (streamer.joinable())
+		streamer.join();
+}
+
+//=============================================================================
+// Add a sound of interleaved float samples, returns its id
+// Throws GameError
+//=============================================================================
+UINT AudioSystem::addSound(const float* samples, UINT frames, UINT channels, UINT rate)
+{
+	if (frames == 0 || frames >= 0x7FFFFFFF || channels < 1 || channels > 2 || rate == 0)
+		throw(GameError(gameErrorNS::WARNING, "Invalid sound data"));
+	Sound* s = new Sound;
+	s->frames = frames;
+	s->rate = rate;
+	s->left.resize(frames + 1);
+	if (channels == 2)
+		s->right.resize(frames + 1);
+	for (UINT i = 0; i < frames; i++)
+	{
+		s->left[i] = samples[(size_t)i * channels];
+		if (channels == 2)
+			s->right[i] = samples[(size_t)i * 2 + 1];
+	}
+	// the frame after the last is the first, so a loop interpolates across its end
+	s->left[frames] = s->left[0];
+	if (channels == 2)
+		s->right[frames] = s->right[0];
+	sounds.push_back(s);
+	return (UINT)sounds.size();
+}
+
+//=============================================================================
+// Load a .wav file, returns its id
+// Throws GameError
+//=============================================================================
+UINT AudioSystem::loadSound(const std::string& filename)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Can not open sound " + filename));
+	WavInfo info;
+	std::vector<char> data;
+	bool ok = readWavInfo(file, info) && info.frames > 0;
+	if (ok)
+	{
+		data.resize((size_t)info.frames * info.channels * info.bytesPerSample);
+		ok = fread(&data[0], 1, data.size(), file) == data.size();
+	}
+	fclose(file);
+	if (!ok)
+		throw(GameError(gameErrorNS::WARNING, "Not a supported .wav file " + filename));
+	std::vector<float> samples((size_t)info.frames * info.channels);
+	for (size_t i = 0; i < samples.size(); i++)
+		samples[i] = wavSample(&data[0], i, info.bytesPerSample);
+	return addSound(&samples[0], info.frames, info.channels, info.rate);
+}
+
+//=============================================================================
+// Queue a command
+//=============================================================================
+bool AudioSystem::send(const Command& c)
+{
+	if (commands.push(c))
+		return true;
+	++dropped;
+	return false;
+}
+
+//=============================================================================
+// Return the slot of a new voice handle, -1 if none is free
+//=============================================================================
+int AudioSystem::allocateVoice()
+{
+	if (!initialized || freeVoices.empty())
+	{
+		++dropped;
+		return -1;
+	}
+	UINT slot = freeVoices.back();
+	freeVoices.pop_back();
+	// handle = generation << 16 | slot, the generation is never 0
+	generations[slot] = (generations[slot] + 1) & 0xFFFF;
+	if (generations[slot] == 0)
+		generations[slot] = 1;
+	busy[slot] = true;
+	return (int)slot;
+}
+
+//=============================================================================
+// Play a sound, returns the voice
+//=============================================================================
+UINT AudioSystem::play(UINT sound, float volume, float pan, float pitch, bool loop)
+{
+	if (sound == audioNS::INVALID || sound > sounds.size())
+		return audioNS::INVALID;
+	int slot = allocateVoice();
+	if (slot < 0)
+		return audioNS::INVALID;
+	Command c;
+	c.type = CMD_PLAY;
+	c.voice = generations[slot] << 16 | (UINT)slot;
+	c.sound = sounds[sound - 1];
+	c.stream = nullptr;
+	c.volume = volume;
+	c.pan = pan;
+	c.pitch = pitch;
+	c.loop = loop;
+	if (!send(c))
+	{
+		busy[slot] = false;
+		freeVoices.push_back(slot);
+		return audioNS::INVALID;
+	}
+	return c.voice;
+}
+
+//=============================================================================
+// Stream a .wav file, returns the voice
+// Throws GameError
+//=============================================================================
+UINT AudioSystem::playStream(const std::string& filename, float volume, bool loop)
+{
+	if (!initialized)
+		return audioNS::INVALID;
+	AudioStream* s = new AudioStream;
+	s->file = fopen(filename.c_str(), "rb");
+	if (s->file == nullptr || !readWavInfo(s->file, s->info))
+	{
+		delete s;
+		throw(GameError(gameErrorNS::WARNING, "Can not stream " + filename));
+	}
+	s->loop = loop;
+	s->left.resize(audioNS::STREAM_FRAMES);
+	if (s->info.channels == 2)
+		s->right.resize(audioNS::STREAM_FRAMES);
+	s->fill();                          // the first frames are ready when the voice starts
+
+	int slot = allocateVoice();
+	if (slot < 0)
+	{
+		delete s;
+		return audioNS::INVALID;
+	}
+	Command c;
+	c.type = CMD_PLAY;
+	c.voice = generations[slot] << 16 | (UINT)slot;
+	c.sound = nullptr;
+	c.stream = s;
+	c.volume = volume;
+	c.pan = 0;
+	c.pitch = 1;
+	c.loop = loop;
+	if (!send(c))
+	{
+		delete s;
+		busy[slot] = false;
+		freeVoices.push_back(slot);
+		return audioNS::INVALID;
+	}
+	// the stream thread refills it and deletes it after the voice finished
+	std::lock_guard<std::mutex> lock(streamMutex);
+	newStreams.push_back(s);
+	return c.voice;
+}
+
+//=============================================================================
+// Stop voice
+//=============================================================================
+void AudioSystem::stop(UINT voice)
+{
+	if (!isPlaying(voice))
+		return;
+	Command c;
+	memset(&c, 0, sizeof(c));
+	c.type = CMD_STOP;
+	c.voice = voice;
+	send(c);
+}
+
+//=============================================================================
+// Change volume, pan and pitch of voice
+//=============================================================================
+void AudioSystem::setVoice(UINT voice, float volume, float pan, float pitch)
+{
+	if (!isPlaying(voice))
+		return;
+	Command c;
+	memset(&c, 0, sizeof(c));
+	c.type = CMD_SET;
+	c.voice = voice;
+	c.volume = volume;
+	c.pan = pan;
+	c.pitch = pitch;
+	send(c);
+}
+
+//=============================================================================
+// Stop all voices
+//=============================================================================
+void AudioSystem::stopAll()
+{
+	Command c;
+	memset(&c, 0, sizeof(c));
+	c.type = CMD_STOP_ALL;
+	send(c);
+}
+
+//=============================================================================
+// Set the volume of the mix
+//=============================================================================
+void AudioSystem::setMasterVolume(float volume)
+{
+	Command c;
+	memset(&c, 0, sizeof(c));
+	c.type = CMD_MASTER;
+	c.volume = volume;
+	send(c);
+}
+
+//=============================================================================
+// Return true until the voice finished
+//=============================================================================
+bool AudioSystem::isPlaying(UINT voice) const
+{
+	UINT slot = voice & 0xFFFF;
+	return voice != audioNS::INVALID && slot < audioNS::MAX_VOICES && busy[slot] &&
+		generations[slot] == voice >> 16;
+}
+
+//=============================================================================
+// Free the voices that finished
+//=============================================================================
+void AudioSystem::update()
+{
+	const UINT* h;
+	while ((h = finished.front()) != nullptr)
+	{
+		UINT slot = *h & 0xFFFF;
+		if (isPlaying(*h))
+		{
+			busy[slot] = false;
+			freeVoices.push_back(slot);
+		}
+		finished.pop();
+	}
+}
+
+//=============================================================================
+// Mix blocks blocks and write them to the sink, without threads
+//=============================================================================
+void AudioSystem::pump(UINT count)
+{
+	if (!initialized || mixer.joinable())
+		return;
+	for (UINT i = 0; i < count; i++)
+	{
+		fillStreams();
+		mixBlock();
+		sink->write(&output[0], audioNS::BLOCK_FRAMES);
+		update();
+	}
+}
+
+//=============================================================================
+// Apply the queued commands
+//=============================================================================
+void AudioSystem::applyCommands()
+{
+	const Command* c;
+	while ((c = commands.front()) != nullptr)
+	{
+		UINT slot = c->voice & 0xFFFF;
+		Voice* v = slot < audioNS::MAX_VOICES ? &voices[slot] : nullptr;
+		switch (c->type)
+		{
+		case CMD_PLAY:
+		{
+			v->handle = c->voice;
+			v->sound = c->sound;
+			v->stream = c->stream;
+			v->pos = 0;
+			v->loop = c->loop;
+			UINT rate = c->sound ? c->sound->rate : c->stream->info.rate;
+			bool stereo = c->sound ? !c->sound->right.empty() : c->stream->info.channels == 2;
+			float pitch = c->pitch < 0 ? 0 : (c->pitch > audioNS::MAX_PITCH ? audioNS::MAX_PITCH : c->pitch);
+			v->step = (uint64_t)((double)pitch * rate / audioNS::SAMPLE_RATE * audioKernels::ONE);
+			panGains(c->volume, c->pan, stereo, v->gainLeft, v->gainRight);
+			active.push_back(slot);
+			break;
+		}
+		case CMD_STOP: case CMD_SET:
+			if (v && v->handle == c->voice)
+			{
+				for (size_t i = 0; i < active.size(); i++)
+				{
+					if (active[i] != slot)
+						continue;
+					if (c->type == CMD_STOP)
+					{
+						if (v->stream)
+							v->stream->done = true;
+						v->handle = audioNS::INVALID;
+						finished.push(c->voice);
+						active[i] = active.back();
+						active.pop_back();
+					}
+					else
+					{
+						UINT rate = v->sound ? v->sound->rate : v->stream->info.rate;
+						bool stereo = v->sound ? !v->sound->right.empty() : v->stream->info.channels == 2;
+						float pitch = c->pitch < 0 ? 0 : (c->pitch > audioNS::MAX_PITCH ? audioNS::MAX_PITCH : c->pitch);
+						v->step = (uint64_t)((double)pitch * rate / audioNS::SAMPLE_RATE * audioKernels::ONE);
+						panGains(c->volume, c->pan, stereo, v->gainLeft, v->gainRight);
+					}
+					break;
+				}
+			}
+			break;
+		case CMD_STOP_ALL:
+			for (size_t i = 0; i < active.size(); i++)
+			{
+				Voice& a = voices[active[i]];
+				if (a.stream)
+					a.stream->done = true;
+				finished.push(a.handle);
+				a.handle = audioNS::INVALID;
+			}
+			active.clear();
+			break;
+		case CMD_MASTER:
+			masterVolume = c->volume;
+			break;
+		}
+		commands.pop();
+	}
+}
+
+//=============================================================================
+// Mix a voice of a sound into mix, returns false when it finished
+//=============================================================================
+bool AudioSystem::mixVoice(Voice& v)
+{
+	const Sound& s = *v.sound;
+	const float* left = &s.left[0];
+	const float* right = s.right.empty() ? left : &s.right[0];
+	const uint64_t end = (uint64_t)s.frames << 32;
+	if (v.step == 0)
+		return true;                    // paused at pitch 0
+	UINT done = 0;
+	while (done < audioNS::BLOCK_FRAMES)
+	{
+		if (v.pos >= end)
+		{
+			if (!v.loop)
+				return false;
+			v.pos %= end;
+		}
+		// frames until the end of the sound
+		uint64_t n = (end - v.pos + v.step - 1) / v.step;
+		UINT count = (UINT)std::min<uint64_t>(n, audioNS::BLOCK_FRAMES - done);
+		audioKernels::mixVoice(&mix[done * 2], (int)count, left, right, v.pos, v.step, v.gainLeft, v.gainRight);
+		v.pos += count * v.step;
+		done += count;
+	}
+	if (v.pos >= end && !v.loop)
+		return false;
+	return true;
+}
+
+//=============================================================================
+// Mix a stream voice into mix, returns false when it finished.
+// The frames the block needs are copied out of the ring first, the frame
+// after the last one mixed must be there for the interpolation unless the
+// stream ended.
+//=============================================================================
+bool AudioSystem::mixStream(Voice& v)
+{
+	AudioStream& s = *v.stream;
+	const bool ended = s.ended.load(std::memory_order_acquire);
+	const UINT64 r = s.read.load(std::memory_order_relaxed);
+	const UINT64 available = s.written.load(std::memory_order_acquire) - r;
+	if (v.step == 0)
+		return true;
+
+	// v.pos is the fraction of a frame the stream is at
+	uint64_t needed = ((v.pos + (uint64_t)audioNS::BLOCK_FRAMES * v.step) >> 32) + 2;
+	UINT take = (UINT)std::min<uint64_t>(std::min<uint64_t>(available, needed), STREAM_SCRATCH - 1);
+	const UINT64 mask = audioNS::STREAM_FRAMES - 1;
+	UINT first = (UINT)(r & mask);
+	UINT part = std::min(take, (UINT)(audioNS::STREAM_FRAMES - first));
+	bool stereo = !s.right.empty();
+	memcpy(&streamLeft[0], &s.left[first], part * sizeof(float));
+	memcpy(&streamLeft[part], &s.left[0], (take - part) * sizeof(float));
+	if (stereo)
+	{
+		memcpy(&streamRight[0], &s.right[first], part * sizeof(float));
+		memcpy(&streamRight[part], &s.right[0], (take - part) * sizeof(float));
+	}
+
+	uint64_t limit;
+	bool last = ended && take == available;
+	if (last)
+	{
+		// the final frames interpolate towards silence
+		streamLeft[take] = 0;
+		streamRight[take] = 0;
+		limit = (uint64_t)take << 32;
+	}
+	else
+		limit = take > 0 ? (uint64_t)(take - 1) << 32 : 0;
+	UINT count = 0;
+	if (limit > v.pos)
+		count = (UINT)std::min<uint64_t>(audioNS::BLOCK_FRAMES, (limit - v.pos + v.step - 1) / v.step);
+	audioKernels::mixVoice(&mix[0], (int)count, &streamLeft[0], stereo ? &streamRight[0] : &streamLeft[0],
+		v.pos, v.step, v.gainLeft, v.gainRight);
+
+	uint64_t endPos = v.pos + count * v.step;
+	UINT consumed = (UINT)std::min<uint64_t>(endPos >> 32, take);
+	v.pos = endPos - ((uint64_t)consumed << 32);
+	s.read.store(r + consumed, std::memory_order_release);
+	if (count < audioNS::BLOCK_FRAMES)
+	{
+		if (last)
+			return false;
+		++underruns;
+	}
+	return true;
+}
+
+//=============================================================================
+// Mix one block of all voices into output
+//=============================================================================
+void AudioSystem::mixBlock()
+{
+	double start = FramePacer::now();
+	applyCommands();
+	std::fill(mix.begin(), mix.end(), 0.0f);
+	UINT count = (UINT)active.size();
+	for (size_t i = 0; i < active.size();)
+	{
+		Voice& v = voices[active[i]];
+		if (v.stream ? mixStream(v) : mixVoice(v))
+		{
+			i++;
+			continue;
+		}
+		if (v.stream)
+			v.stream->done = true;
+		finished.push(v.handle);
+		v.handle = audioNS::INVALID;
+		active[i] = active.back();
+		active.pop_back();
+	}
+	if (masterVolume != 1)
+		for (size_t i = 0; i < mix.size(); i++)
+			mix[i] *= masterVolume;
+	audioKernels::toInt16(&output[0], &mix[0], (int)mix.size());
+
+	voiceCount = count;
+	if (count > peakVoices)
+		peakVoices = count;
+	++blocks;
+	voiceBlocks += count;
+	mixNanos += (UINT64)((FramePacer::now() - start) * 1e9);
+}
+
+//=============================================================================
+// Mixer thread main loop
+//=============================================================================
+void AudioSystem::mixLoop()
+{
+	const std::chrono::nanoseconds period((long long)(1e9 * audioNS::BLOCK_FRAMES / audioNS::SAMPLE_RATE));
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!quit)
+	{
+		lock.unlock();
+		mixBlock();
+		sink->write(&output[0], audioNS::BLOCK_FRAMES);
+		lock.lock();
+		if (sink->isRealTime())
+			continue;
+		// pace a sink without a device to real time, a stall is not caught up
+		next += period;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (next < now - period * 8)
+			next = now;
+		wake.wait_until(lock, next, [this] { return quit; });
+	}
+}
+
+//=============================================================================
+// Stream thread main loop
+//=============================================================================
+void AudioSystem::streamLoop()
+{
+	const std::chrono::nanoseconds period((long long)(1e9 * audioNS::STREAM_PERIOD));
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!quit)
+	{
+		lock.unlock();
+		fillStreams();
+		lock.lock();
+		wake.wait_for(lock, period, [this] { return quit; });
+	}
+}
+
+//=============================================================================
+// Refill the ring buffers of the streams, delete the finished ones
+//=============================================================================
+void AudioSystem::fillStreams()
+{
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		streams.insert(streams.end(), newStreams.begin(), newStreams.end());
+		newStreams.clear();
+	}
+	for (size_t i = 0; i < streams.size();)
+	{
+		AudioStream* s = streams[i];
+		if (s->done)
+		{
+			delete s;
+			streams[i] = streams.back();
+			streams.pop_back();
+			continue;
+		}
+		s->fill();
+		i++;
+	}
+	streamCount = (UINT)streams.size();
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+AudioStats AudioSystem::getStats() const
+{
+	AudioStats s;
+	s.voices = voiceCount;
+	s.peakVoices = peakVoices;
+	s.blocks = blocks;
+	s.voiceBlocks = voiceBlocks;
+	s.mixTime = mixNanos / 1e9;
+	s.underruns = underruns;
+	s.dropped = dropped;
+	s.streams = streamCount;
+	return s;
+}
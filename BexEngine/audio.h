@@ -0,0 +1,214 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "constants.h"
+#include "gameError.h"
+#include "spscQueue.h"
+#include "audioSink.h"
+
+namespace audioNS
+{
+	const UINT SAMPLE_RATE = 48000;         // frames per second of the mix
+	const UINT BLOCK_FRAMES = 256;          // frames mixed at once, 5.3 ms
+	const UINT MAX_VOICES = 512;            // voices playing at once
+	const UINT COMMAND_QUEUE_SIZE = 4096;   // commands between two mixed blocks
+	const float MAX_PITCH = 4;              // highest playback speed of a voice
+	const UINT STREAM_FRAMES = 65536;       // frames buffered per stream, 1.4 s at 48 kHz
+	const UINT STREAM_READ = 8192;          // frames read from a stream file at once
+	const double STREAM_PERIOD = 0.02;      // seconds between refills of the streams
+	const UINT INVALID = 0;                 // no sound or voice
+}
+
+// A sound in memory, float samples of each channel.
+struct Sound
+{
+	std::vector<float> left;                // frames + 1, the last is a copy of the first
+	std::vector<float> right;               // empty for mono
+	UINT    frames;
+	UINT    rate;                           // frames per second
+};
+
+class AudioStream;
+
+// Audio statistics.
+struct AudioStats
+{
+	UINT    voices;                         // voices playing in the last block
+	UINT    peakVoices;
+	UINT64  blocks;                         // blocks mixed
+	UINT64  voiceBlocks;                    // sum of the voices of every block
+	double  mixTime;                        // seconds spent mixing
+	UINT64  underruns;                      // blocks a stream had too few frames for
+	UINT64  dropped;                        // plays without a free voice or queue room
+	UINT    streams;                        // streams open
+};
+
+// Software audio mixer.
+// The mixer thread mixes blocks of BLOCK_FRAMES frames of all voices into a
+// float buffer with the audioKernels (linear resampling, gain and pan) and
+// writes them to an AudioSink; a sink that does not wait for a device is
+// paced to real time by the mixer. The game thread never locks against the
+// mixer: play(), stop() and setVoice() are commands in a lock-free queue
+// applied before the next block, and the mixer returns finished voices
+// through a second queue read by update(). Voice handles carry a generation
+// so a stale handle does nothing. Long tracks are streamed from .wav files
+// by a stream thread into a ring buffer per stream.
+class AudioSystem final
+{
+public:
+	// Constructor
+	AudioSystem();
+
+	// Destructor
+	~AudioSystem();
+
+	// Open sink and start the mixer and stream threads. The AudioSystem owns
+	// sink, nullptr is a NullAudioSink. Without threads the caller mixes with
+	// pump(), e.g. to render faster than real time.
+	// Throws GameError
+	void    initialize(AudioSink* sink, bool threaded = true);
+
+	// Stop the threads, close the sink and free sounds and streams.
+	void    release();
+
+	// Add a sound of frames frames of channels interleaved float samples at
+	// rate frames per second, returns its id.
+	// Throws GameError on invalid data
+	// Pre: channels = 1 or 2
+	UINT    addSound(const float* samples, UINT frames, UINT channels, UINT rate);
+
+	// Load a 16 bit or float .wav file of 1 or 2 channels, returns its id.
+	// Throws GameError if the file can not be read
+	UINT    loadSound(const std::string& filename);
+
+	// Play sound, returns the voice or audioNS::INVALID if no voice is free.
+	// Pre: volume >= 0, pan = -1 (left) .. 1 (right), pitch = speed 0..MAX_PITCH
+	UINT    play(UINT sound, float volume = 1, float pan = 0, float pitch = 1, bool loop = false);
+
+	// Stream a .wav file, returns the voice or audioNS::INVALID if no voice is free.
+	// Opens the file and reads its start on the calling thread.
+	// Throws GameError if the file can not be read
+	UINT    playStream(const std::string& filename, float volume = 1, bool loop = false);
+
+	// Stop voice.
+	void    stop(UINT voice);
+
+	// Change volume, pan and pitch of voice.
+	void    setVoice(UINT voice, float volume, float pan, float pitch);
+
+	// Stop all voices.
+	void    stopAll();
+
+	// Set the volume of the mix.
+	void    setMasterVolume(float volume);
+
+	// Return true until the voice finished, as of the last update().
+	bool    isPlaying(UINT voice) const;
+
+	// Free the voices that finished, once per frame.
+	void    update();
+
+	// Mix blocks blocks and write them to the sink, without threads only.
+	void    pump(UINT blocks);
+
+	// Return statistics.
+	AudioStats getStats() const;
+
+private:
+	// command types
+	enum { CMD_PLAY, CMD_STOP, CMD_SET, CMD_STOP_ALL, CMD_MASTER };
+
+	// A request of the game thread to the mixer.
+	struct Command
+	{
+		UINT    type;
+		UINT    voice;                      // handle
+		const Sound* sound;
+		AudioStream* stream;
+		float   volume, pan, pitch;
+		bool    loop;
+	};
+
+	// A voice in the mixer.
+	struct Voice
+	{
+		UINT    handle;
+		const Sound* sound;                 // or stream
+		AudioStream* stream;
+		uint64_t pos;                       // source position, 32.32 fixed point
+		uint64_t step;                      // source frames per output frame, 32.32
+		float   gainLeft, gainRight;
+		bool    loop;
+	};
+
+	AudioSink* sink;
+	bool    initialized;
+
+	// game thread
+	std::vector<Sound*> sounds;             // by id - 1
+	std::vector<UINT> freeVoices;           // slots
+	UINT    generations[audioNS::MAX_VOICES];   // of the slot handles
+	bool    busy[audioNS::MAX_VOICES];      // slot has a voice the mixer did not finish
+	SpscQueue<Command> commands;            // game thread to mixer
+	SpscQueue<UINT> finished;               // mixer to game thread, handles
+
+	// mixer
+	Voice   voices[audioNS::MAX_VOICES];    // by slot
+	std::vector<UINT> active;               // slots of the playing voices
+	std::vector<float> mix;                 // BLOCK_FRAMES stereo frames
+	std::vector<int16_t> output;
+	std::vector<float> streamLeft, streamRight;     // stream frames of one block
+	float   masterVolume;
+	std::thread mixer;
+	std::mutex mutex;                       // for the waits of the threads
+	std::condition_variable wake;
+	bool    quit;                           // guarded by mutex
+
+	// stream thread
+	std::thread streamer;
+	std::mutex streamMutex;                 // guards newStreams
+	std::vector<AudioStream*> newStreams;   // opened by playStream()
+	std::vector<AudioStream*> streams;      // stream thread
+
+	// statistics
+	std::atomic<UINT> voiceCount;
+	UINT    peakVoices;
+	std::atomic<UINT64> blocks;
+	std::atomic<UINT64> voiceBlocks;
+	std::atomic<UINT64> mixNanos;
+	std::atomic<UINT64> underruns;
+	std::atomic<UINT64> dropped;
+	std::atomic<UINT> streamCount;
+
+	// Queue a command, counts it as dropped if the queue is full.
+	bool    send(const Command& c);
+	// Return the slot of a new voice handle, -1 if none is free.
+	int     allocateVoice();
+	// Mix one block into output.
+	void    mixBlock();
+	// Apply the queued commands.
+	void    applyCommands();
+	// Mix voice v into mix, returns false when it finished.
+	bool    mixVoice(Voice& v);
+	// Mix stream voice v into mix, returns false when it finished.
+	bool    mixStream(Voice& v);
+	// Mixer thread main loop.
+	void    mixLoop();
+	// Stream thread main loop.
+	void    streamLoop();
+	// Refill the ring buffers of the streams, delete the finished ones.
+	void    fillStreams();
+	// Stop and join the threads.
+	void    stopThreads();
+
+	AudioSystem(const AudioSystem&);        // no copies
+	AudioSystem& operator=(const AudioSystem&);
+};
@@ -0,0 +1,146 @@
+#include "audioKernels.h"
+#include <cmath>
+
+#if defined(__AVX2__)
+#define AUDIO_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const float FRACTION_SCALE = 1.0f / 16777216;  // 24 bit fraction to 0..1
+
+	// frame index and 24 bit fraction of source position p
+	inline void split(uint64_t p, int& index, int& fraction)
+	{
+		index = (int)(p >> 32);
+		fraction = (int)((p >> 8) & 0xFFFFFF);
+	}
+
+	// linear interpolation between a and b
+	inline float lerp(float a, float b, int fraction)
+	{
+		return a + (b - a) * ((float)fraction * FRACTION_SCALE);
+	}
+}
+
+//=============================================================================
+// Return name of the compiled kernel set
+//=============================================================================
+const char* audioKernels::getKernelName()
+{
+#if defined(AUDIO_AVX2)
+	return "AVX2";
+#elif defined(AUDIO_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+//=============================================================================
+// Add count resampled frames of a voice to out
+//=============================================================================
+void audioKernels::mixVoice(float* out, int count, const float* left, const float* right,
+	uint64_t pos, uint64_t step, float gainLeft, float gainRight)
+{
+	int i = 0;
+	const bool mono = left == right;
+#if defined(AUDIO_AVX2)
+	{
+		const __m256 gl = _mm256_set1_ps(gainLeft), gr = _mm256_set1_ps(gainRight);
+		const __m256 scale = _mm256_set1_ps(FRACTION_SCALE);
+		const __m256i one = _mm256_set1_epi32(1);
+		for (; i + 8 <= count; i += 8)
+		{
+			int index[8], fraction[8];
+			for (int j = 0; j < 8; j++)
+				split(pos + (uint64_t)(i + j) * step, index[j], fraction[j]);
+			__m256i k = _mm256_loadu_si256((const __m256i*)index);
+			__m256i k1 = _mm256_add_epi32(k, one);
+			__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)fraction)), scale);
+			__m256 a = _mm256_i32gather_ps(left, k, 4);
+			__m256 l = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(left, k1, 4), a), f));
+			__m256 r = l;
+			if (!mono)
+			{
+				a = _mm256_i32gather_ps(right, k, 4);
+				r = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(right, k1, 4), a), f));
+			}
+			l = _mm256_mul_ps(l, gl);
+			r = _mm256_mul_ps(r, gr);
+			// frames 0 1 4 5 and 2 3 6 7 interleaved, then in order
+			__m256 lo = _mm256_unpacklo_ps(l, r);
+			__m256 hi = _mm256_unpackhi_ps(l, r);
+			float* o = out + i * 2;
+			_mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), _mm256_permute2f128_ps(lo, hi, 0x20)));
+			_mm256_storeu_ps(o + 8, _mm256_add_ps(_mm256_loadu_ps(o + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+		}
+	}
+#endif
+#if defined(AUDIO_SSE2) || defined(AUDIO_AVX2)
+	{
+		const __m128 gl = _mm_set1_ps(gainLeft), gr = _mm_set1_ps(gainRight);
+		const __m128 scale = _mm_set1_ps(FRACTION_SCALE);
+		for (; i + 4 <= count; i += 4)
+		{
+			int index[4], fraction[4];
+			for (int j = 0; j < 4; j++)
+				split(pos + (uint64_t)(i + j) * step, index[j], fraction[j]);
+			__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)fraction)), scale);
+			__m128 a = _mm_setr_ps(left[index[0]], left[index[1]], left[index[2]], left[index[3]]);
+			__m128 b = _mm_setr_ps(left[index[0] + 1], left[index[1] + 1], left[index[2] + 1], left[index[3] + 1]);
+			__m128 l = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f));
+			__m128 r = l;
+			if (!mono)
+			{
+				a = _mm_setr_ps(right[index[0]], right[index[1]], right[index[2]], right[index[3]]);
+				b = _mm_setr_ps(right[index[0] + 1], right[index[1] + 1], right[index[2] + 1], right[index[3] + 1]);
+				r = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f));
+			}
+			l = _mm_mul_ps(l, gl);
+			r = _mm_mul_ps(r, gr);
+			float* o = out + i * 2;
+			_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(l, r)));
+			_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(l, r)));
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		int k, fraction;
+		split(pos + (uint64_t)i * step, k, fraction);
+		float l = lerp(left[k], left[k + 1], fraction);
+		float r = mono ? l : lerp(right[k], right[k + 1], fraction);
+		out[i * 2] += l * gainLeft;
+		out[i * 2 + 1] += r * gainRight;
+	}
+}
+
+//=============================================================================
+// Convert count samples to saturated 16 bit
+//=============================================================================
+void audioKernels::toInt16(int16_t* dst, const float* src, int count)
+{
+	int i = 0;
+#if defined(AUDIO_SSE2) || defined(AUDIO_AVX2)
+	const __m128 scale = _mm_set1_ps(32767.0f);
+	const __m128 low = _mm_set1_ps(-32768.0f), high = _mm_set1_ps(32767.0f);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), low), high);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), low), high);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float s = src[i] * 32767.0f;
+		s = s < -32768.0f ? -32768.0f : s;
+		s = s > 32767.0f ? 32767.0f : s;
+		dst[i] = (int16_t)std::lrint(s);
+	}
+}
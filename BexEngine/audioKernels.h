@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Mixing kernels of the audio mixer.
+// The mix is 32 bit float stereo, left and right interleaved. All kernels
+// produce bit identical results in the scalar, SSE2 and AVX2 versions; the
+// version is selected at compile time (AVX2 with /arch:AVX2 or -mavx2, SSE2
+// on x86).
+namespace audioKernels
+{
+	const uint64_t ONE = (uint64_t)1 << 32;     // source position step of 1 frame, 32.32 fixed point
+
+	// Return name of the compiled kernel set: "AVX2", "SSE2" or "scalar".
+	const char* getKernelName();
+
+	// Add count frames of a voice to out. Frame i is read at source position
+	// p = pos + i * step, 32.32 fixed point, interpolated linearly between
+	// frame k = p >> 32 and k + 1 with the top 24 bits of the fraction:
+	// s = src[k] + (src[k + 1] - src[k]) * f. The left channel is scaled by
+	// gainLeft and the right by gainRight. A mono voice passes its samples
+	// as left and right.
+	// Pre: left[k + 1] and right[k + 1] are valid for the last frame
+	void mixVoice(float* out, int count, const float* left, const float* right,
+		uint64_t pos, uint64_t step, float gainLeft, float gainRight);
+
+	// Convert count samples to 16 bit, s * 32767 rounded to nearest and saturated.
+	void toInt16(int16_t* dst, const float* src, int count);
+}
@@ -0,0 +1,180 @@
+#include "audioSink.h"
+#include <cstring>
+
+namespace
+{
+	// 44 byte header of a 16 bit stereo PCM .wav file of frames frames
+	void writeWavHeader(FILE* file, UINT rate, UINT64 frames)
+	{
+		uint32_t dataBytes = (uint32_t)(frames * 4);
+		uint32_t riff = 36 + dataBytes;
+		uint32_t fmtBytes = 16, byteRate = rate * 4, sampleRate = rate;
+		uint16_t format = 1, channels = 2, blockAlign = 4, bits = 16;
+		fwrite("RIFF", 1, 4, file);
+		fwrite(&riff, 4, 1, file);
+		fwrite("WAVEfmt ", 1, 8, file);
+		fwrite(&fmtBytes, 4, 1, file);
+		fwrite(&format, 2, 1, file);
+		fwrite(&channels, 2, 1, file);
+		fwrite(&sampleRate, 4, 1, file);
+		fwrite(&byteRate, 4, 1, file);
+		fwrite(&blockAlign, 2, 1, file);
+		fwrite(&bits, 2, 1, file);
+		fwrite("data", 1, 4, file);
+		fwrite(&dataBytes, 4, 1, file);
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+WavFileSink::WavFileSink(const std::string& name)
+{
+	filename = name;
+	file = nullptr;
+	frames = 0;
+	sampleRate = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+WavFileSink::~WavFileSink()
+{
+	close();
+}
+
+//=============================================================================
+// Create the file
+// Throws GameError
+//=============================================================================
+void WavFileSink::open(UINT rate, UINT /*blockFrames*/)
+{
+	close();
+	file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Can not create audio file " + filename));
+	frames = 0;
+	// the sizes are written by close()
+	writeWavHeader(file, rate, 0);
+	sampleRate = rate;
+}
+
+//=============================================================================
+// Complete the header and close the file
+//=============================================================================
+void WavFileSink::close()
+{
+	if (file == nullptr)
+		return;
+	fseek(file, 0, SEEK_SET);
+	writeWavHeader(file, sampleRate, frames);
+	fclose(file);
+	file = nullptr;
+}
+
+//=============================================================================
+// Append count frames
+//=============================================================================
+void WavFileSink::write(const int16_t* samples, UINT count)
+{
+	if (file == nullptr)
+		return;
+	fwrite(samples, 4, count, file);
+	frames += count;
+}
+
+#ifdef _WIN32
+//=============================================================================
+// Constructor
+//=============================================================================
+WaveOutSink::WaveOutSink()
+{
+	device = nullptr;
+	done = nullptr;
+	next = 0;
+	memset(headers, 0, sizeof(headers));
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+WaveOutSink::~WaveOutSink()
+{
+	close();
+}
+
+//=============================================================================
+// Open the default device
+// Throws GameError
+//=============================================================================
+void WaveOutSink::open(UINT rate, UINT blockFrames)
+{
+	close();
+	WAVEFORMATEX format;
+	memset(&format, 0, sizeof(format));
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = 2;
+	format.nSamplesPerSec = rate;
+	format.wBitsPerSample = 16;
+	format.nBlockAlign = 4;
+	format.nAvgBytesPerSec = rate * 4;
+	done = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (done == nullptr ||
+		waveOutOpen(&device, WAVE_MAPPER, &format, (DWORD_PTR)done, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+	{
+		device = nullptr;
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Can not open the sound device"));
+	}
+	for (UINT i = 0; i < audioSinkNS::DEVICE_BUFFERS; i++)
+	{
+		buffers[i].assign(blockFrames * 2, 0);
+		memset(&headers[i], 0, sizeof(WAVEHDR));
+		headers[i].lpData = (LPSTR)&buffers[i][0];
+		headers[i].dwBufferLength = blockFrames * 4;
+		waveOutPrepareHeader(device, &headers[i], sizeof(WAVEHDR));
+		headers[i].dwFlags |= WHDR_DONE;    // free to write
+	}
+	next = 0;
+}
+
+//=============================================================================
+// Stop and close the device
+//=============================================================================
+void WaveOutSink::close()
+{
+	if (device)
+	{
+		waveOutReset(device);               // returns all buffers
+		for (UINT i = 0; i < audioSinkNS::DEVICE_BUFFERS; i++)
+			waveOutUnprepareHeader(device, &headers[i], sizeof(WAVEHDR));
+		waveOutClose(device);
+		device = nullptr;
+	}
+	if (done)
+	{
+		CloseHandle(done);
+		done = nullptr;
+	}
+}
+
+//=============================================================================
+// Queue count frames, waits until the next buffer was played
+//=============================================================================
+void WaveOutSink::write(const int16_t* samples, UINT count)
+{
+	if (device == nullptr)
+		return;
+	WAVEHDR& h = headers[next];
+	while (!(h.dwFlags & WHDR_DONE))
+		WaitForSingleObject(done, 100);
+	if (count * 4 > buffers[next].size() * 2)
+		count = (UINT)buffers[next].size() / 2;
+	memcpy(h.lpData, samples, count * 4);
+	h.dwBufferLength = count * 4;
+	h.dwFlags &= ~WHDR_DONE;
+	waveOutWrite(device, &h, sizeof(WAVEHDR));
+	next = (next + 1) % audioSinkNS::DEVICE_BUFFERS;
+}
+#endif
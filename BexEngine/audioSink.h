@@ -0,0 +1,124 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#ifdef _WIN32
+#include <mmsystem.h>
+#endif
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "constants.h"
+#include "gameError.h"
+
+namespace audioSinkNS
+{
+	const UINT DEVICE_BUFFERS = 4;          // blocks queued on the sound device
+}
+
+// Output of the audio mixer, 16 bit stereo frames with left and right interleaved.
+// Called by the mixer thread only.
+class AudioSink
+{
+public:
+	// Destructor
+	virtual ~AudioSink() {}
+
+	// Open the output for rate frames per second of blocks of up to blockFrames frames.
+	// Throws GameError on error
+	virtual void open(UINT rate, UINT blockFrames) = 0;
+
+	// Close the output, frames not played are dropped.
+	virtual void close() = 0;
+
+	// Write frames stereo frames. A real time sink waits until the device
+	// has room for them.
+	virtual void write(const int16_t* samples, UINT frames) = 0;
+
+	// Return true if write() waits for the device. The mixer paces the
+	// other sinks to real time itself.
+	virtual bool isRealTime() const = 0;
+};
+
+// Sink that discards the frames, for running without a sound device.
+class NullAudioSink final : public AudioSink
+{
+public:
+	// Constructor
+	NullAudioSink() : frames(0) {}
+
+	void    open(UINT /*rate*/, UINT /*blockFrames*/) override {}
+	void    close() override {}
+	void    write(const int16_t* /*samples*/, UINT count) override { frames += count; }
+	bool    isRealTime() const override { return false; }
+
+	// Return number of frames written.
+	UINT64  getFrames() const { return frames; }
+
+private:
+	UINT64  frames;
+};
+
+// Sink that writes a 16 bit stereo .wav file, to listen to or compare the
+// output of headless runs.
+class WavFileSink final : public AudioSink
+{
+public:
+	// Constructor
+	explicit WavFileSink(const std::string& filename);
+
+	// Destructor, closes the file.
+	virtual ~WavFileSink();
+
+	// Create the file.
+	// Throws GameError if the file can not be created
+	void    open(UINT rate, UINT blockFrames) override;
+
+	// Complete the header and close the file.
+	void    close() override;
+
+	void    write(const int16_t* samples, UINT count) override;
+	bool    isRealTime() const override { return false; }
+
+	// Return number of frames written.
+	UINT64  getFrames() const { return frames; }
+
+private:
+	std::string filename;
+	FILE*   file;
+	UINT64  frames;
+	UINT    sampleRate;
+};
+
+#ifdef _WIN32
+// Sink that plays on the default sound device with waveOut, DEVICE_BUFFERS
+// blocks are queued.
+class WaveOutSink final : public AudioSink
+{
+public:
+	// Constructor
+	WaveOutSink();
+
+	// Destructor, closes the device.
+	virtual ~WaveOutSink();
+
+	// Open the default device.
+	// Throws GameError if the device can not be opened
+	void    open(UINT rate, UINT blockFrames) override;
+
+	// Stop and close the device.
+	void    close() override;
+
+	// Queue frames, waits until a buffer was played.
+	void    write(const int16_t* samples, UINT count) override;
+	bool    isRealTime() const override { return true; }
+
+private:
+	HWAVEOUT device;
+	HANDLE  done;                           // set by the device when a buffer was played
+	WAVEHDR headers[audioSinkNS::DEVICE_BUFFERS];
+	std::vector<int16_t> buffers[audioSinkNS::DEVICE_BUFFERS];
+	UINT    next;                           // buffer written next
+};
+#endif
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "lz4.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstring>
+
+namespace
+{
+	const char* const PACK_FILE = "assetbench.pack";   // written to the working directory
+	const double LOAD_TIMEOUT = 10;                     // seconds to wait for the loads
+
+	// Return the bytes of asset i, 1 KB to 128 KB, repeating text for even i
+	// that compresses and noise for odd i that is stored as is.
+	std::vector<unsigned char> assetBytes(UINT i)
+	{
+		std::vector<unsigned char> bytes((size_t)1024 << (i % 8));
+		UINT seed = i * 2654435761u + 1;
+		for (size_t k = 0; k < bytes.size(); k++)
+		{
+			if (i % 2 == 0)
+				bytes[k] = (unsigned char)("tile map row "[k % 13] + (k / 4096 + i) % 3);
+			else
+			{
+				seed = seed * 1664525 + 1013904223;
+				bytes[k] = (unsigned char)(seed >> 24);
+			}
+		}
+		return bytes;
+	}
+
+	// Compress and decompress bytes, returns false if they do not come back,
+	// or a truncated block or a wrong size decompresses.
+	bool roundTrip(const std::vector<unsigned char>& bytes, size_t& packed)
+	{
+		const unsigned char* src = bytes.empty() ? nullptr : &bytes[0];
+		std::vector<unsigned char> block(lz4::compressBound(bytes.size()));
+		packed = lz4::compress(src, bytes.size(), &block[0], block.size());
+		if (packed == 0)
+			return false;
+		std::vector<unsigned char> out(bytes.size() + 1);
+		if (!lz4::decompress(&block[0], packed, &out[0], bytes.size()) ||
+			(!bytes.empty() && memcmp(&out[0], src, bytes.size()) != 0))
+			return false;
+		if (lz4::decompress(&block[0], packed, &out[0], bytes.size() + 1))
+			return false;
+		return bytes.empty() || !lz4::decompress(&block[0], packed - 1, &out[0], bytes.size());
+	}
+}
+
+//=============================================================================
+// Round trip blocks through LZ4, write count assets to a pack with
+// PackWriter, mount it, stream them and a missing asset with an AssetStreamer
+// and print its statistics.
+// Returns false if a block did not round trip, an asset did not load with
+// its bytes or the missing asset did not fail.
+// Throws GameError
+//=============================================================================
+bool headlessBench::assets(UINT count)
+{
+	// empty, short, run, text and noise blocks, and every asset
+	std::vector<std::vector<unsigned char> > blocks;
+	blocks.push_back(std::vector<unsigned char>());
+	blocks.push_back(std::vector<unsigned char>(5, 'a'));
+	blocks.push_back(std::vector<unsigned char>(100000, 7));
+	for (UINT i = 0; i < 8; i++)
+		blocks.push_back(assetBytes(i));
+	size_t raw = 0, compressed = 0;
+	UINT wrong = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		size_t packed = 0;
+		if (!roundTrip(blocks[i], packed))
+			++wrong;
+		raw += blocks[i].size();
+		compressed += packed;
+	}
+	printf("assets: lz4 %u blocks, %.1f KB to %.1f KB, %u wrong, %s\n", (UINT)blocks.size(),
+		raw / 1024.0, compressed / 1024.0, wrong, wrong == 0 ? "ok" : "WRONG");
+
+	PackWriter writer;
+	for (UINT i = 0; i < count; i++)
+	{
+		std::vector<unsigned char> bytes = assetBytes(i);
+		writer.add("asset" + std::to_string(i), &bytes[0], bytes.size());
+	}
+	writer.save(PACK_FILE);         // throws GameError
+
+	// all priorities at once, so the queue sorts them
+	AssetStreamer streamer;
+	streamer.initialize();          // throws GameError
+	streamer.mount(PACK_FILE);      // throws GameError
+	UINT callbacks = 0;
+	std::vector<AssetHandle> handles;
+	for (UINT i = 0; i < count; i++)
+		handles.push_back(streamer.load("asset" + std::to_string(i), (int)(i % 4),
+			[&callbacks](AssetHandle&) { ++callbacks; }));
+	AssetHandle missing = streamer.load("missing", assetNS::PRIORITY_CRITICAL,
+		[&callbacks](AssetHandle&) { ++callbacks; });
+	double start = FramePacer::now();
+	while (streamer.getPending() > 0 && FramePacer::now() - start < LOAD_TIMEOUT)
+	{
+		streamer.update();
+		std::this_thread::yield();
+	}
+	streamer.update();
+
+	UINT loaded = 0;
+	for (UINT i = 0; i < count; i++)
+	{
+		std::vector<unsigned char> bytes = assetBytes(i);
+		if (handles[i].isReady() && handles[i].getSize() == bytes.size() &&
+			memcmp(handles[i].getData(), &bytes[0], bytes.size()) == 0)
+			++loaded;
+	}
+	bool failed = missing.isFailed() && missing.getData() == nullptr;
+	AssetStats as = streamer.getStats();
+	printf("assets: %u of %u loaded, %.1f MB in %.1f MB, %.1f MB/s, max queue depth %u\n", loaded, count,
+		as.bytesLoaded / 1048576.0, as.bytesRead / 1048576.0, as.bytesPerSecond / 1048576.0, as.maxQueueDepth);
+	printf("assets: %.3f ms to ready, %.3f ms avg and %.3f ms max to first use, missing asset %s\n",
+		as.avgTimeToReady * 1000, as.avgTimeToFirstUse * 1000, as.maxTimeToFirstUse * 1000,
+		failed ? "failed" : "DID NOT FAIL");
+
+	handles.clear();
+	missing.release();
+	streamer.shutdown();
+	remove(PACK_FILE);
+	return wrong == 0 && loaded == count && failed && callbacks == count + 1 &&
+		as.loadsCompleted == count && as.loadsFailed == 1;
+}
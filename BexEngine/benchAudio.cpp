@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "audioKernels.h"
+#include <vector>
+#include <cmath>
+
+//=============================================================================
+// Mix 10 s of voices looping voices with random pitch and pan without the
+// mixer thread, written to the .wav file filename if not nullptr, and print
+// the mix time and the voices a cpu core mixes in real time.
+// Returns false if blocks were dropped.
+// Throws GameError
+//=============================================================================
+bool headlessBench::audio(UINT voices, const char* filename)
+{
+	const UINT SECONDS = 10;
+	if (voices == 0)
+		return true;
+	AudioSystem audio;
+	audio.initialize(filename ? new WavFileSink(filename) : nullptr, false);   // throws GameError
+
+	// a 440 Hz mono tone at 44.1 kHz is resampled, a stereo chord at 48 kHz
+	std::vector<float> samples(44100);
+	for (UINT i = 0; i < 44100; i++)
+		samples[i] = (float)std::sin(i * 2 * 3.14159265 * 440 / 44100);
+	UINT tone = audio.addSound(&samples[0], 44100, 1, 44100);
+	samples.resize(48000 * 2);
+	for (UINT i = 0; i < 48000; i++)
+	{
+		samples[i * 2] = (float)std::sin(i * 2 * 3.14159265 * 330 / 48000);
+		samples[i * 2 + 1] = (float)std::sin(i * 2 * 3.14159265 * 495 / 48000);
+	}
+	UINT chord = audio.addSound(&samples[0], 48000, 2, 48000);
+
+	srand(1);
+	for (UINT i = 0; i < voices; i++)
+	{
+		float pitch = 0.5f + (rand() % 1000) / 1000.0f;
+		float pan = (rand() % 2001) / 1000.0f - 1;
+		audio.play(i % 2 ? chord : tone, 1 / std::sqrt((float)voices), pan, pitch, true);
+	}
+	audio.pump(SECONDS * audioNS::SAMPLE_RATE / audioNS::BLOCK_FRAMES);
+	audio.release();                    // completes the file
+
+	AudioStats as = audio.getStats();
+	double audioSeconds = (double)as.blocks * audioNS::BLOCK_FRAMES / audioNS::SAMPLE_RATE;
+	double voiceMs = (double)as.voiceBlocks * audioNS::BLOCK_FRAMES / audioNS::SAMPLE_RATE * 1000;
+	printf("audio %s: %u voices, %.1f s mixed in %.1f ms, %.0f voice-ms per cpu ms "
+		"(real time voices per core), %llu dropped\n", audioKernels::getKernelName(), as.peakVoices,
+		audioSeconds, as.mixTime * 1000, voiceMs / (as.mixTime * 1000), (unsigned long long)as.dropped);
+	return as.dropped == 0;
+}
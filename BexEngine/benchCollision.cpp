@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "broadphase.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// A moving circle of the broadphase bench.
+	struct Body
+	{
+		Circle circle;
+		float vx, vy;
+	};
+
+	// Return the bounding box of c.
+	AABB boxOf(const Circle& c)
+	{
+		AABB b = { c.x - c.radius, c.y - c.radius, c.x + c.radius, c.y + c.radius };
+		return b;
+	}
+
+	bool pairLess(const CollisionPair& a, const CollisionPair& b)
+	{
+		return a.a != b.a ? a.a < b.a : a.b < b.b;
+	}
+
+	bool samePairs(const std::vector<CollisionPair>& a, const std::vector<CollisionPair>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (a[i].a != b[i].a || a[i].b != b[i].b)
+				return false;
+		return true;
+	}
+}
+
+//=============================================================================
+// Move bodies circles of 2 to 8 pixels radius for 1 s of 200 Hz steps in a
+// square with about 0.2 overlaps per body, find the overlapping boxes with
+// the spatial hash and with sweep and prune, and print the pairs tested and
+// found and the time per step of each. The circles of the pairs are tested
+// with the narrowphase.
+// Returns false if the two broadphases, or brute force on the last step of
+// up to 4000 bodies, found different pairs.
+//=============================================================================
+bool headlessBench::broadphase(UINT bodies, UINT64 steps)
+{
+	const float STEP = 1.0f / 200, CELL_SIZE = 16;
+	const float side = std::sqrt((float)bodies) * 40;
+	const char* names[2] = { "spatial hash", "sweep and prune" };
+	if (bodies == 0 || steps == 0)
+		return true;
+
+	std::vector<Body> b(bodies);
+	UINT seed = 1;
+	for (UINT i = 0; i < bodies; i++)
+	{
+		float r[4];
+		for (int k = 0; k < 4; k++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			r[k] = (seed >> 8) / 16777216.0f;
+		}
+		b[i].circle.x = r[0] * side;
+		b[i].circle.y = r[1] * side;
+		b[i].circle.radius = 2 + r[2] * 6;
+		b[i].vx = (r[3] - 0.5f) * 200;
+		b[i].vy = (r[2] - 0.5f) * 200;
+	}
+	SpatialHash hash(CELL_SIZE);
+	SweepAndPrune sweep;
+	Broadphase* phases[2] = { &hash, &sweep };
+	std::vector<uint32_t> proxies[2];
+	for (int k = 0; k < 2; k++)
+		for (UINT i = 0; i < bodies; i++)
+			proxies[k].push_back(phases[k]->add(boxOf(b[i].circle), i));
+
+	std::vector<CollisionPair> pairs[2];
+	double time[2] = { 0, 0 };
+	UINT64 tested[2] = { 0, 0 }, found[2] = { 0, 0 }, hits = 0;
+	bool same = true;
+	for (UINT64 s = 0; s < steps; s++)
+	{
+		// bounce off the sides of the square
+		for (UINT i = 0; i < bodies; i++)
+		{
+			Circle& c = b[i].circle;
+			c.x += b[i].vx * STEP;
+			c.y += b[i].vy * STEP;
+			if (c.x < 0 || c.x > side)
+				b[i].vx = -b[i].vx;
+			if (c.y < 0 || c.y > side)
+				b[i].vy = -b[i].vy;
+		}
+		for (int k = 0; k < 2; k++)
+		{
+			double start = FramePacer::now();
+			for (UINT i = 0; i < bodies; i++)
+				phases[k]->update(proxies[k][i], boxOf(b[i].circle));
+			phases[k]->findPairs(pairs[k]);
+			time[k] += FramePacer::now() - start;
+			tested[k] += phases[k]->getPairsTested();
+			found[k] += phases[k]->getPairsFound();
+			std::sort(pairs[k].begin(), pairs[k].end(), pairLess);
+		}
+		same = same && samePairs(pairs[0], pairs[1]);
+		for (size_t i = 0; i < pairs[0].size(); i++)
+			hits += collision::circleCircle(b[pairs[0][i].a].circle, b[pairs[0][i].b].circle);
+	}
+
+	// brute force on the last step
+	bool bruteChecked = bodies <= 4000, bruteSame = true;
+	if (bruteChecked)
+	{
+		std::vector<CollisionPair> brute;
+		for (UINT i = 0; i < bodies; i++)
+			for (UINT j = i + 1; j < bodies; j++)
+				if (collision::overlaps(boxOf(b[i].circle), boxOf(b[j].circle)))
+				{
+					CollisionPair p = { i, j };
+					brute.push_back(p);
+				}
+		bruteSame = samePairs(brute, pairs[0]);
+	}
+
+	for (int k = 0; k < 2; k++)
+		printf("broadphase %s: %u bodies, %.0f pairs tested and %.0f found per step, %.3f ms per step\n",
+			names[k], bodies, (double)tested[k] / steps, (double)found[k] / steps, time[k] * 1000 / steps);
+	printf("broadphase: %.0f circles overlap per step, pairs %s%s\n", (double)hits / steps,
+		same ? "identical" : "DIFFERENT", bruteChecked ? (bruteSame ? ", brute force identical" :
+		", brute force DIFFERENT") : "");
+	return same && bruteSame;
+}
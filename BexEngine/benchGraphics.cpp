@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "tilemap.h"
+#include "headlessBackend.h"
+#include "softwareBackend.h"
+#include <vector>
+#include <cmath>
+
+namespace
+{
+	const int GOLDEN_WIDTH = 160;           // size of the golden image
+	const int GOLDEN_HEIGHT = 120;
+	const int CHANNEL_TOLERANCE = 4;        // levels a channel may differ
+	const double MAX_DIFFERENT = 0.005;     // share of pixels that may differ more
+
+	// Draw the golden scene: solid, blended and added rectangles, scaled,
+	// rotated, tinted and flipped sprites of a texture with an alpha gradient,
+	// and lines.
+	void drawGoldenScene(SoftwareBackend& backend, SpriteBatch& batch, void* texture)
+	{
+		backend.beginScene(SETCOLOR_ARGB(255, 16, 24, 48));
+		batch.begin(spriteBatchNS::SORT_NONE);
+		batch.drawRect(8, 8, 48, 32, SETCOLOR_ARGB(255, 200, 40, 40), spriteBatchNS::BLEND_OPAQUE);
+		batch.drawRect(32, 24, 48, 32, SETCOLOR_ARGB(128, 40, 200, 40));
+		batch.drawRect(56, 8, 48, 48, SETCOLOR_ARGB(160, 40, 40, 220), spriteBatchNS::BLEND_ADDITIVE);
+		SpriteData s;
+		s.texture = texture;
+		s.width = 16;
+		s.height = 16;
+		s.x = 112;
+		s.y = 8;
+		s.scale = 2;
+		batch.draw(s);
+		s.x = 16;
+		s.y = 64;
+		s.scale = 2.5f;
+		s.angle = 0.6f;
+		batch.draw(s);
+		s.x = 72;
+		s.scale = 2;
+		s.angle = 0;
+		s.color = SETCOLOR_ARGB(255, 255, 160, 64);
+		s.flipHorizontal = true;
+		batch.draw(s);
+		s.x = 112;
+		s.color = SETCOLOR_ARGB(255, 255, 255, 255);
+		s.blend = spriteBatchNS::BLEND_ADDITIVE;
+		s.flipHorizontal = false;
+		s.flipVertical = true;
+		batch.draw(s);
+		batch.end(backend);
+		for (int i = 0; i < 8; i++)
+			backend.drawLine(4, 116, 4 + i * 20.0f, 60 + i * 2.0f, SETCOLOR_ARGB(255, 255, 255, 32 * i));
+		backend.drawLine(0, 0, 159, 119, SETCOLOR_ARGB(96, 255, 255, 255));
+		backend.endScene();
+		backend.present();
+	}
+
+	// One draw call a sprite batch case expects.
+	struct ExpectedDraw
+	{
+		int texture;                        // index of the texture
+		UINT baseVertex;                    // first vertex in the ring
+		UINT quadCount;
+		float x;                            // x of the first quad, the index of its sprite,
+		                                    // < 0 if the wrap wrote over it later
+	};
+
+	// Compare the draw calls of the frame with expected and print the case.
+	// Returns false if the draw calls, their vertices or the batch statistics differ.
+	bool checkBatch(const char* name, const HeadlessBackend& backend, const SpriteBatch& batch,
+		void* const* textures, const ExpectedDraw* expected, UINT calls, UINT stateChanges)
+	{
+		const std::vector<HeadlessDrawCall>& dc = backend.getDrawCalls();
+		const std::vector<SpriteVertex>& ring = backend.getVertices();
+		UINT quads = 0;
+		for (UINT i = 0; i < calls; i++)
+			quads += expected[i].quadCount;
+		bool ok = dc.size() == calls && batch.getDrawCalls() == calls &&
+			batch.getVertices() == quads * 4 && batch.getStateChanges() == stateChanges;
+		for (UINT i = 0; ok && i < calls; i++)
+		{
+			const ExpectedDraw& e = expected[i];
+			ok = dc[i].texture == textures[e.texture] && dc[i].baseVertex == e.baseVertex &&
+				dc[i].quadCount == e.quadCount && (e.x < 0 || ring[e.baseVertex].x == e.x);
+		}
+		printf("spritebatch %s: %u draw calls, %u vertices, %u state changes, %s\n", name,
+			batch.getDrawCalls(), batch.getVertices(), batch.getStateChanges(), ok ? "ok" : "WRONG");
+		return ok;
+	}
+
+	// Return count untextured sprites at x = index, of texture textures[index % 2]
+	// or, if not nullptr, textures[pattern[index]].
+	std::vector<SpriteData> batchSprites(UINT count, void* const* textures, const int* pattern = nullptr)
+	{
+		std::vector<SpriteData> sprites(count);
+		for (UINT i = 0; i < count; i++)
+		{
+			sprites[i].x = (float)i;
+			sprites[i].texture = textures[pattern ? pattern[i] : i % 2];
+		}
+		return sprites;
+	}
+}
+
+//=============================================================================
+// Scroll over a size x size map of 16 x 16 pixel tiles for frames frames
+// and print what a frame draws.
+// Throws GameError
+//=============================================================================
+bool headlessBench::tilemap(Game& game, UINT size, UINT64 frames)
+{
+	const int TILE = 16, COLUMNS = 4;
+	GraphicsSystem& graphics = game.getGraphics();
+
+	// tileset of 16 tiles, one shade each with a dark border
+	std::vector<uint32_t> pixels(TILE * COLUMNS * TILE * COLUMNS);
+	for (int y = 0; y < TILE * COLUMNS; y++)
+	{
+		for (int x = 0; x < TILE * COLUMNS; x++)
+		{
+			int tile = y / TILE * COLUMNS + x / TILE;
+			bool border = x % TILE == 0 || y % TILE == 0;
+			pixels[y * TILE * COLUMNS + x] = border ? SETCOLOR_ARGB(255, 20, 40, 20) :
+				SETCOLOR_ARGB(255, 40 + tile * 8, 90 + tile * 6, 40);
+		}
+	}
+	UINT tileset = graphics.getTextures().add(TILE * COLUMNS, TILE * COLUMNS, &pixels[0]);
+
+	// ground everywhere, a sparse second layer
+	Tilemap map;
+	map.create(size, size, 2, TILE, TILE);
+	map.setTileset(0, tileset);
+	map.setTileset(1, tileset);
+	UINT seed = 1;
+	for (UINT y = 0; y < size; y++)
+	{
+		for (UINT x = 0; x < size; x++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			map.setTile(0, x, y, (uint16_t)(1 + (seed >> 16) % 12));
+			if ((seed >> 8) % 8 == 0)
+				map.setTile(1, x, y, (uint16_t)(13 + (seed >> 24) % 4));
+		}
+	}
+
+	// diagonal scroll at 600 pixels per second of 60 Hz frames
+	double drawTime = 0;
+	UINT64 quads = 0, chunks = 0;
+	const float mapPixels = (float)(size * TILE);
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		float camX = std::fmod(f * 10.0f, mapPixels);
+		float camY = std::fmod(f * 7.0f, mapPixels);
+		if (FAILED(graphics.beginScene()))
+			continue;
+		double start = FramePacer::now();
+		map.draw(graphics, camX, camY, (float)GAME_WIDTH, (float)GAME_HEIGHT);
+		drawTime += FramePacer::now() - start;
+		graphics.endScene();
+		graphics.showBackbuffer();
+		TilemapStats ts = map.getStats();
+		quads += ts.quadsDrawn;
+		chunks += ts.chunksDrawn;
+	}
+	graphics.flush();
+	if (frames == 0)
+		return true;
+	TilemapStats ts = map.getStats();
+	printf("tilemap: %ux%u tiles, %.1f chunks and %.0f tiles drawn per frame, draw %.3f ms per frame\n",
+		size, size, (double)chunks / frames, (double)quads / frames, drawTime * 1000 / frames);
+	printf("tilemap: %llu chunks built in %.3f ms, %u cached\n", (unsigned long long)ts.chunksBuilt,
+		ts.buildTime * 1000, ts.cachedChunks);
+	return true;
+}
+
+//=============================================================================
+// Feed a sprite batch known sprite sequences through the recording headless
+// backend: texture sorting, merging of equal neighbours in submission order,
+// the split at the 16 bit index limit, the ring wrap and prepared vertices.
+// Returns false if a case drew other draw calls, vertices or state changes.
+// Throws GameError
+//=============================================================================
+bool headlessBench::spriteBatch()
+{
+	using namespace spriteBatchNS;
+	HeadlessBackend backend(headlessNS::RECORD);
+	backend.initialize(nullptr, GAME_WIDTH, GAME_HEIGHT, false);   // throws GameError
+	int ids[2];
+	void* const textures[2] = { &ids[0], &ids[1] };     // ordered like the sort orders them
+	bool passed = true;
+
+	// alternating textures sort into one draw call each, the first frame starts the ring
+	SpriteBatch batch;
+	backend.beginScene(0);
+	std::vector<SpriteData> sprites = batchSprites(6, textures);
+	batch.begin(SORT_TEXTURE);
+	for (size_t i = 0; i < sprites.size(); i++)
+		batch.draw(sprites[i]);
+	batch.end(backend);
+	const ExpectedDraw sorted[] = { { 0, 0, 3, 0 }, { 1, 12, 3, 1 } };
+	passed = checkBatch("texture sort", backend, batch, textures, sorted, 2, 2) && passed;
+
+	// submission order merges equal neighbours only
+	backend.beginScene(0);
+	batch.resetFrameStats();
+	const int pattern[] = { 0, 0, 1, 1, 0, 0 };
+	sprites = batchSprites(6, textures, pattern);
+	batch.drawSprites(&sprites[0], 6, SORT_NONE, backend);
+	const ExpectedDraw merged[] = { { 0, 24, 2, 0 }, { 1, 32, 2, 2 }, { 0, 40, 2, 4 } };
+	passed = checkBatch("submission order", backend, batch, textures, merged, 3, 3) && passed;
+
+	// one texture splits at the quads 16 bit indices reach
+	SpriteBatch limit;
+	backend.beginScene(0);
+	std::vector<int> one(MAX_BATCH_QUADS + 1, 0);
+	sprites = batchSprites(MAX_BATCH_QUADS + 1, textures, &one[0]);
+	limit.drawSprites(&sprites[0], MAX_BATCH_QUADS + 1, SORT_TEXTURE, backend);
+	const ExpectedDraw split[] = { { 0, 0, MAX_BATCH_QUADS, 0 },
+		{ 0, MAX_BATCH_QUADS * 4, 1, (float)MAX_BATCH_QUADS } };
+	passed = checkBatch("index limit", backend, limit, textures, split, 2, 1) && passed;
+
+	// the next frame fills the end of the ring and wraps to the start
+	backend.beginScene(0);
+	limit.resetFrameStats();
+	const UINT WRAP_SPRITES = 20000;
+	const UINT tail = RING_QUADS - (MAX_BATCH_QUADS + 1);
+	one.assign(WRAP_SPRITES, 0);
+	sprites = batchSprites(WRAP_SPRITES, textures, &one[0]);
+	limit.drawSprites(&sprites[0], WRAP_SPRITES, SORT_TEXTURE, backend);
+	const ExpectedDraw wrapped[] = { { 0, (MAX_BATCH_QUADS + 1) * 4, tail, 0 },
+		{ 0, 0, WRAP_SPRITES - tail, (float)tail } };
+	passed = checkBatch("ring wrap", backend, limit, textures, wrapped, 2, 1) && passed;
+
+	// prepared vertices split at the index limit and at the end of the ring
+	backend.beginScene(0);
+	limit.resetFrameStats();
+	const UINT PREPARED_QUADS = 40000;
+	std::vector<SpriteVertex> vertices(PREPARED_QUADS * 4);
+	for (UINT i = 0; i < PREPARED_QUADS * 4; i++)
+	{
+		SpriteVertex v = { (float)(i / 4), 0, 0, 1, 0xFFFFFFFF, 0, 0 };
+		vertices[i] = v;
+	}
+	limit.drawVertices(&vertices[0], PREPARED_QUADS, textures[1], BLEND_ALPHA, backend);
+	const UINT start = WRAP_SPRITES - tail;
+	const UINT fill = RING_QUADS - start - MAX_BATCH_QUADS;
+	const ExpectedDraw prepared[] = { { 1, start * 4, MAX_BATCH_QUADS, -1 },
+		{ 1, (start + MAX_BATCH_QUADS) * 4, fill, (float)MAX_BATCH_QUADS },
+		{ 1, 0, PREPARED_QUADS - MAX_BATCH_QUADS - fill, (float)(MAX_BATCH_QUADS + fill) } };
+	passed = checkBatch("prepared vertices", backend, limit, textures, prepared, 3, 1) && passed;
+	return passed;
+}
+
+//=============================================================================
+// Add video memory images, an atlas page of small ones and a large one, run
+// a frame, add one more small image, lose the headless device and run frames
+// frames, then print the textures the reset recreated.
+// Returns false if the page that gained an image got a new texture, or if
+// the reset did not recreate the two video memory textures.
+// Throws GameError
+//=============================================================================
+bool headlessBench::deviceLoss(HeadlessPlatform& platform, Game& game, UINT64 frames)
+{
+	const int SMALL = 32, LARGE = 512, IMAGES = 8;
+	GraphicsSystem& graphics = game.getGraphics();
+	TextureCache& textures = graphics.getTextures();
+	HeadlessBackend* backend = (HeadlessBackend*)graphics.getBackend();
+
+	std::vector<uint32_t> pixels(LARGE * LARGE, SETCOLOR_ARGB(255, 255, 255, 255));
+	std::vector<UINT> ids;
+	for (int i = 0; i < IMAGES; i++)
+		ids.push_back(textures.add(SMALL, SMALL, &pixels[0], textureCacheNS::FLAG_VIDEO));
+	ids.push_back(textures.add(LARGE, LARGE, &pixels[0], textureCacheNS::FLAG_VIDEO));
+	platform.run(1);
+
+	// the atlas page gains an image while its texture is in use
+	void* page = textures.get(ids[0]).texture;
+	ids.push_back(textures.add(SMALL, SMALL, &pixels[0], textureCacheNS::FLAG_VIDEO));
+	platform.run(1);
+	const HeadlessTexture* updated = (const HeadlessTexture*)textures.get(ids.back()).texture;
+	bool inPlace = page != nullptr && updated == page && updated->updates > 0;
+
+	backend->loseDevice();
+	platform.run(frames);
+	bool recreated = true;
+	for (size_t i = 0; i < ids.size(); i++)
+		recreated = recreated && textures.get(ids[i]).texture != nullptr;
+
+	TextureCacheStats ts = textures.getStats();
+	printf("lose: %u video memory images, atlas page %s, %u resets, %u textures recreated in %.3f ms, %s\n",
+		(UINT)ids.size(), inPlace ? "updated in place" : "RECREATED", ts.resets, ts.recreated,
+		ts.recreateTime * 1000, recreated ? "all images have textures" : "images LOST their textures");
+	return inPlace && recreated && ts.recreated >= 2;
+}
+
+//=============================================================================
+// Render a fixed scene with the software backend and compare it with the
+// reference image, or write the reference if update is true.
+// Returns false if the reference cannot be read or written, has another
+// size, or more than 0.5% of the pixels have a channel more than 4 levels off.
+// Throws GameError
+//=============================================================================
+bool headlessBench::golden(const char* reference, bool update)
+{
+	SoftwareBackend backend;
+	backend.initialize(nullptr, GOLDEN_WIDTH, GOLDEN_HEIGHT, false);   // throws GameError
+
+	// white and blue checkers, alpha falls from the top to the bottom
+	std::vector<uint32_t> pixels(16 * 16);
+	for (int y = 0; y < 16; y++)
+		for (int x = 0; x < 16; x++)
+			pixels[y * 16 + x] = ((x / 4 + y / 4) % 2) ? SETCOLOR_ARGB(255 - y * 12, 255, 255, 255) :
+				SETCOLOR_ARGB(255 - y * 12, 32, 96, 255);
+	void* texture = backend.createTexture(16, 16, &pixels[0], graphicsNS::POOL_MANAGED);
+	SpriteBatch batch;
+	drawGoldenScene(backend, batch, texture);
+	backend.releaseTexture(texture);
+
+	if (update)
+	{
+		bool written = backend.savePPM(reference);
+		printf("golden: %s %s\n", written ? "wrote" : "CANNOT WRITE", reference);
+		return written;
+	}
+	int width, height;
+	std::vector<uint32_t> expected;
+	if (!SoftwareBackend::loadPPM(reference, width, height, expected))
+	{
+		printf("golden: CANNOT READ %s\n", reference);
+		return false;
+	}
+	if (width != GOLDEN_WIDTH || height != GOLDEN_HEIGHT)
+	{
+		printf("golden: %s is %dx%d, the scene %dx%d\n", reference, width, height, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+		return false;
+	}
+	const uint32_t* frame = backend.getFramebuffer();
+	UINT different = 0;
+	int maxError = 0;
+	for (int i = 0; i < width * height; i++)
+	{
+		int error = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			int d = std::abs((int)(frame[i] >> shift & 0xFF) - (int)(expected[i] >> shift & 0xFF));
+			if (d > error)
+				error = d;
+		}
+		if (error > CHANNEL_TOLERANCE)
+			++different;
+		if (error > maxError)
+			maxError = error;
+	}
+	bool same = different <= MAX_DIFFERENT * width * height;
+	printf("golden: %u of %d pixels differ by more than %d levels, max %d, %s %s\n", different,
+		width * height, CHANNEL_TOLERANCE, maxError, same ? "matches" : "DOES NOT MATCH", reference);
+	return same;
+}
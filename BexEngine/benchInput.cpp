@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include <climits>
+#include <string>
+
+//=============================================================================
+// Time the per-frame input work for frames frames: applying four key events,
+// resolving 16 action bindings and 64 queries, and print ns per frame.
+// Throws GameError
+//=============================================================================
+bool headlessBench::input(UINT64 frames)
+{
+	InputSystem input;
+	InputActions actions;
+	input.initialize(nullptr, false);
+	const UCHAR keys[16] = { 'W', 'A', 'S', 'D', VK_SPACE, VK_RETURN, VK_ESCAPE, VK_LEFT,
+		VK_RIGHT, VK_UP, VK_DOWN, 'Q', 'E', 'R', 'F', VK_TAB };
+	for (UINT i = 0; i < 16; i++)
+	{
+		UINT id = actions.add("action" + std::to_string(i));
+		// every fourth action is a chord with shift
+		if (i % 4 == 3)
+			actions.bindKeys(id, KeyBits(VK_SHIFT, keys[i]));
+		else
+			actions.bindKeys(id, KeyBits(keys[i]));
+		actions.bindGamepad(id, (WORD)(1 << i));
+	}
+
+	double eventTime = 0, actionTime = 0, queryTime = 0;
+	UINT hits = 0;
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		// press a key and a shifted key, release the keys of the frame before
+		UCHAR key = keys[f % 16], prev = keys[(f + 15) % 16];
+		double start = FramePacer::now();
+		input.postEvent(inputNS::EVENT_KEY_UP, prev, 0);
+		input.postEvent(inputNS::EVENT_KEY_UP, VK_SHIFT, 0);
+		input.postEvent(inputNS::EVENT_KEY_DOWN, VK_SHIFT, 0);
+		input.postEvent(inputNS::EVENT_KEY_DOWN, key, 0);
+		input.processEvents(LLONG_MAX);
+		double t1 = FramePacer::now();
+		actions.update(input);
+		double t2 = FramePacer::now();
+		for (UINT i = 0; i < 16; i++)
+		{
+			hits += actions.isDown(i) + actions.wasPressed(i) + actions.wasReleased(i);
+			hits += input.wasKeyPressed(keys[i]);
+		}
+		hits += input.anyKeyPressed();
+		input.clear(inputNS::KEYS_PRESSED);
+		double t3 = FramePacer::now();
+		eventTime += t1 - start;
+		actionTime += t2 - t1;
+		queryTime += t3 - t2;
+	}
+	if (frames == 0)
+		return true;
+	printf("input: events %.0f ns, actions %.0f ns, 65 queries and clear %.0f ns per frame (%u hits)\n",
+		eventTime * 1e9 / frames, actionTime * 1e9 / frames, queryTime * 1e9 / frames, hits);
+	return true;
+}
+
+//=============================================================================
+// Run frames 1 ms frames of gamepad input from a fake controller in slot 0,
+// slow to probe empty slots and a device change every 200 frames, polled on
+// the game thread and on the controller thread, and print the cost of each.
+// Throws GameError
+//=============================================================================
+bool headlessBench::controllers(UINT64 frames)
+{
+	const double PROBE_DELAY = 0.0005;  // seconds an empty slot takes to probe
+	FramePacer pacer;
+	pacer.initialize();
+	for (int threaded = 0; threaded < 2; threaded++)
+	{
+		FakeControllerDevice device;
+		device.setProbeDelay(PROBE_DELAY);
+		device.connect(0, true);
+		InputSystem input;
+		input.setControllerDevice(&device, threaded ? controllerNS::POLL_RATE : 0);
+		input.initialize(nullptr, false);
+
+		double gameTime = 0;
+		UINT64 moved = 0;
+		for (UINT64 f = 0; f < frames; f++)
+		{
+			XINPUT_GAMEPAD pad = {};
+			pad.sThumbLX = (SHORT)(f * 97);
+			pad.wButtons = (WORD)(f / 30 % 2 ? GAMEPAD_A : 0);
+			device.setGamepad(0, pad);
+			double start = FramePacer::now();
+			if (f % 200 == 199)
+				input.checkControllers();
+			input.readControllers();
+			if (input.getGamepadA(0))
+				input.gamePadVibrateLeft(0, 30000, 0.1f);
+			moved += input.getGamepadThumbLX(0) != 0;
+			input.vibrateControllers(0.001f);
+			gameTime += FramePacer::now() - start;
+			pacer.wait(0.001);
+		}
+		if (frames == 0)
+			return true;
+		ControllerStats cs = input.getControllerStats();
+		printf("controllers %s: %.0f ns per frame on the game thread, %llu polls, %llu probes, "
+			"%llu vibrations, %.3f ms polling (%llu frames)\n", threaded ? "threaded" : "game thread",
+			gameTime * 1e9 / frames, (unsigned long long)cs.polls, (unsigned long long)cs.probes,
+			(unsigned long long)cs.vibrations, cs.pollTime * 1000, (unsigned long long)moved);
+	}
+	return true;
+}
+
+//=============================================================================
+// Feed frames 60 Hz frames of a rate Hz synthetic mouse to an InputSystem
+// with one message per report, with a message per ms that drains all queued
+// reports, and with the reports kept as history, and print the cost per
+// second of input of the message thread and of processEvents().
+// Returns false if motion was lost or history samples are out of order.
+//=============================================================================
+bool headlessBench::mouse(double rate, UINT64 frames)
+{
+	const double FRAME = 1.0 / 60, PUMP = 0.001;
+	const char* modes[3] = { "per report", "batched", "history" };
+	bool complete = true;
+	if (frames == 0 || rate <= 0)
+		return true;
+	for (int mode = 0; mode < 3; mode++)
+	{
+		SyntheticMotionSource source(rate);
+		InputSystem input;
+		input.setMouseHistory(mode == 2);
+		double messageTime = 0, applyTime = 0;
+		LONGLONG sumX = 0, sumY = 0;
+		UINT64 messages = 0, samples = 0;
+		bool ordered = true;
+		const double step = mode == 0 ? 1 / rate : PUMP;
+		double posted = 0;              // seconds of input posted
+		for (UINT64 f = 0; f < frames; f++)
+		{
+			double start = FramePacer::now();
+			for (; posted < (f + 1) * FRAME; posted += step)
+			{
+				source.advance(step);
+				if (input.postRawMotion(source) > 0)
+					++messages;
+			}
+			double t1 = FramePacer::now();
+			input.processEvents(LLONG_MAX);
+			applyTime += FramePacer::now() - t1;
+			messageTime += t1 - start;
+			sumX += input.getMouseRawX();
+			sumY += input.getMouseRawY();
+			const std::vector<RawMotion>& history = input.getMouseSamples();
+			for (size_t i = 1; i < history.size(); i++)
+				ordered = ordered && history[i].time >= history[i - 1].time;
+			samples += history.size();
+		}
+		double seconds = frames * FRAME;
+		bool lost = sumX != source.getTotalX() || sumY != source.getTotalY() || input.getEventsDropped() > 0;
+		if (!ordered)
+			printf("mouse %.0f Hz %s: history samples OUT OF ORDER\n", rate, modes[mode]);
+		printf("mouse %.0f Hz %s: %.0f messages/s, message thread %.1f us/s, processEvents %.1f us/s, "
+			"%.0f samples/frame, motion %s\n", rate, modes[mode], messages / seconds,
+			messageTime * 1e6 / seconds, applyTime * 1e6 / seconds, (double)samples / frames,
+			lost ? "LOST" : "complete");
+		complete = complete && !lost && ordered;
+	}
+	return complete;
+}
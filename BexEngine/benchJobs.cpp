@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include <vector>
+#include <cmath>
+#include <string>
+
+namespace
+{
+	const UINT CHUNKS = 64;                 // jobs of the first stage
+	const UINT CHUNK_SIZE = 4096;           // values per chunk
+	const UINT GROUPS = 8;                  // reduce jobs, CHUNKS / GROUPS chunks each
+
+	// Data of the job graph of one frame.
+	struct Graph
+	{
+		std::vector<float> values;
+		double partial[GROUPS];
+		double total;
+	};
+
+	// Move the values of chunk c of frame f, a few square roots per value.
+	void simulate(Graph& g, UINT64 f, UINT c)
+	{
+		float* v = &g.values[c * CHUNK_SIZE];
+		for (UINT i = 0; i < CHUNK_SIZE; i++)
+		{
+			float x = v[i] + (float)((f + c + i) % 7);
+			for (int k = 0; k < 8; k++)
+				x = std::sqrt(x * x + 1.0f) * 0.999f;
+			v[i] = x;
+		}
+	}
+
+	// Sum the chunks of group j.
+	void reduce(Graph& g, UINT j)
+	{
+		const UINT size = CHUNKS / GROUPS * CHUNK_SIZE;
+		const float* v = &g.values[j * size];
+		double sum = 0;
+		for (UINT i = 0; i < size; i++)
+			sum += v[i];
+		g.partial[j] = sum;
+	}
+
+	// Run frames frames of the graph, CHUNKS simulate jobs, then GROUPS
+	// reduce jobs and a job that adds up their sums, on jobs. Returns the
+	// seconds taken and the total of the last frame in total.
+	double runGraph(JobSystem& jobs, UINT64 frames, double& total)
+	{
+		Graph g;
+		g.values.assign(CHUNKS * CHUNK_SIZE, 1.0f);
+		g.total = 0;
+		Graph* gp = &g;
+		double start = FramePacer::now();
+		for (UINT64 f = 0; f < frames; f++)
+		{
+			JobCounter simulated, reduced, done;
+			for (UINT c = 0; c < CHUNKS; c++)
+				jobs.run([gp, f, c]() { simulate(*gp, f, c); }, &simulated);
+			for (UINT j = 0; j < GROUPS; j++)
+				jobs.runAfter(simulated, [gp, j]() { reduce(*gp, j); }, &reduced);
+			jobs.runAfter(reduced, [gp]()
+			{
+				gp->total = 0;
+				for (UINT j = 0; j < GROUPS; j++)
+					gp->total += gp->partial[j];
+			}, &done);
+			jobs.wait(done);
+		}
+		total = g.total;
+		return FramePacer::now() - start;
+	}
+}
+
+//=============================================================================
+// Run frames frames of a fixed job graph on 1 to threads threads and print
+// the time per frame and the speedup over one thread. Then check that a job
+// that throws finishes its counter and wait() rethrows the exception.
+// Returns false if a thread count gave a different result or the exception
+// was lost.
+// Throws GameError
+//=============================================================================
+bool headlessBench::jobs(UINT threads, UINT64 frames)
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	if (frames == 0)
+		return true;
+
+	double oneThread = 0, expected = 0;
+	bool same = true;
+	for (UINT t = 1; t <= threads; t++)
+	{
+		JobSystem jobs;
+		jobs.initialize(t);             // throws GameError
+		double total;
+		double time = runGraph(jobs, frames, total);
+		if (t == 1)
+		{
+			oneThread = time;
+			expected = total;
+		}
+		same = same && total == expected;
+		printf("jobs %2u threads: %.3f ms per frame, speedup %.2f, %.1f jobs stolen per frame\n", t,
+			time * 1000 / frames, oneThread / time, (double)jobs.getJobsStolen() / frames);
+	}
+
+	// the counter of a throwing job completes, wait() rethrows the error
+	JobSystem jobs;
+	jobs.initialize(threads);           // throws GameError
+	JobCounter counter;
+	for (UINT i = 0; i < 4; i++)
+		jobs.run([i]()
+		{
+			if (i == 2)
+				throw(GameError(gameErrorNS::WARNING, "job error"));
+		}, &counter);
+	bool rethrown = false;
+	try{
+		jobs.wait(counter);
+	}
+	catch (const GameError& e)
+	{
+		rethrown = e.getMessage() == std::string("job error");
+	}
+	printf("jobs: results %s, exception of a job %s\n", same ? "identical" : "DIFFERENT",
+		rethrown ? "rethrown by wait()" : "LOST");
+	return same && rethrown;
+}
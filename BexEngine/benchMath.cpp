@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "mathKernels.h"
+#include <vector>
+#include <cmath>
+
+// The scalar loops stay scalar, the compilers would vectorize them.
+#if defined(_MSC_VER)
+#define SCALAR_LOOP __pragma(loop(no_vector))
+#define SCALAR_FUNCTION
+#elif defined(__clang__)
+#define SCALAR_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#define SCALAR_FUNCTION
+#else
+#define SCALAR_LOOP
+#define SCALAR_FUNCTION __attribute__((optimize("no-tree-vectorize")))
+#endif
+
+namespace
+{
+	const int BATCH = 4096;                 // elements per kernel call
+	const float SIN_TOLERANCE = 2e-7f;      // of sinCos() to sinf() and cosf()
+	const float CORNER_TOLERANCE = 1e-3f;   // pixels, corners of quadCorners()
+
+	// Print the ns per element of a kernel and its scalar loop.
+	void report(const char* name, double kernel, double scalar, double elements, bool ok)
+	{
+		printf("math %-15s scalar %6.2f ns, %s %6.2f ns per element, speedup %5.2f, results %s\n", name,
+			scalar * 1e9 / elements, mathKernels::getKernelName(), kernel * 1e9 / elements, scalar / kernel,
+			ok ? "match" : "DIFFERENT");
+	}
+
+	SCALAR_FUNCTION void transformLoop(const Mat3& m, const Vec2* in, Vec2* out, int count)
+	{
+		SCALAR_LOOP
+		for (int i = 0; i < count; i++)
+			out[i] = m.transformPoint(in[i]);
+	}
+
+	SCALAR_FUNCTION void integrateLoop(float* pos, const float* vel, int count, float t)
+	{
+		SCALAR_LOOP
+		for (int i = 0; i < count; i++)
+			pos[i] += vel[i] * t;
+	}
+
+	SCALAR_FUNCTION void distanceLoop(const Vec2& from, const Vec2* points, float* out, int count)
+	{
+		SCALAR_LOOP
+		for (int i = 0; i < count; i++)
+			out[i] = (points[i] - from).length();
+	}
+
+	SCALAR_FUNCTION void sinCosLoop(const float* angles, float* sines, float* cosines, int count)
+	{
+		SCALAR_LOOP
+		for (int i = 0; i < count; i++)
+		{
+			sines[i] = std::sin(angles[i]);
+			cosines[i] = std::cos(angles[i]);
+		}
+	}
+
+	SCALAR_FUNCTION void cornerLoop(const QuadTransform* quads, Vec2* corners, int count)
+	{
+		SCALAR_LOOP
+		for (int i = 0; i < count; i++)
+		{
+			const QuadTransform& q = quads[i];
+			float s = std::sin(q.angle), c = std::cos(q.angle);
+			for (int k = 0; k < 4; k++)
+			{
+				float dx = (k & 1) ? q.hw : -q.hw, dy = (k & 2) ? q.hh : -q.hh;
+				corners[i * 4 + k] = Vec2(q.cx + (dx * c - dy * s), q.cy + (dx * s + dy * c));
+			}
+		}
+	}
+}
+
+//=============================================================================
+// Time frames calls of each math kernel on a 4096 element batch against a
+// loop that is not vectorized, of vectorMath and the C library, and print the ns per element
+// of both. The kernel set is chosen at compile time, build with -mavx2 or
+// /arch:AVX2 to time AVX2 instead of SSE2.
+// Returns false if a kernel does not match its loop: transformPoints(),
+// integrate() and distances() must be bit identical, sinCos() within 2e-7.
+//=============================================================================
+bool headlessBench::math(UINT64 frames)
+{
+	if (frames == 0)
+		return true;
+	std::vector<Vec2> points(BATCH), out(BATCH), ref(BATCH);
+	std::vector<float> angles(BATCH), sines(BATCH), cosines(BATCH), refSines(BATCH), refCosines(BATCH);
+	std::vector<float> dist(BATCH), refDist(BATCH);
+	std::vector<QuadTransform> quads(BATCH);
+	std::vector<Vec2> corners(BATCH * 4), refCorners(BATCH * 4);
+	for (int i = 0; i < BATCH; i++)
+	{
+		points[i] = Vec2((float)(i % 640) + 0.25f, (float)(i / 640) * 3.5f);
+		angles[i] = (i - BATCH / 2) * 0.01f;
+		QuadTransform q = { points[i].x, points[i].y, 8.0f + i % 16, 4.0f + i % 8, angles[i] };
+		quads[i] = q;
+	}
+	const Mat3 m = Mat3::rotation(0.3f) * Mat3::translation(10, 20);
+	const double elements = (double)BATCH * frames;
+	bool passed = true;
+
+	// transformPoints
+	double start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		mathKernels::transformPoints(m, &points[0], &out[0], BATCH);
+	double kernel = FramePacer::now() - start;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		transformLoop(m, &points[0], &ref[0], BATCH);
+	double scalar = FramePacer::now() - start;
+	bool ok = memcmp(&out[0], &ref[0], BATCH * sizeof(Vec2)) == 0;
+	report("transformPoints", kernel, scalar, elements, ok);
+	passed = passed && ok;
+
+	// integrate, both start from the same positions
+	out = points;
+	ref = points;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		mathKernels::integrate(&out[0].x, &points[0].x, BATCH * 2, 0.005f);
+	kernel = FramePacer::now() - start;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		integrateLoop(&ref[0].x, &points[0].x, BATCH * 2, 0.005f);
+	scalar = FramePacer::now() - start;
+	ok = memcmp(&out[0], &ref[0], BATCH * sizeof(Vec2)) == 0;
+	report("integrate", kernel, scalar, elements, ok);
+	passed = passed && ok;
+
+	// distances
+	const Vec2 from(320, 240);
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		mathKernels::distances(from, &points[0], &dist[0], BATCH);
+	kernel = FramePacer::now() - start;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		distanceLoop(from, &points[0], &refDist[0], BATCH);
+	scalar = FramePacer::now() - start;
+	ok = memcmp(&dist[0], &refDist[0], BATCH * sizeof(float)) == 0;
+	report("distances", kernel, scalar, elements, ok);
+	passed = passed && ok;
+
+	// sinCos
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		mathKernels::sinCos(&angles[0], &sines[0], &cosines[0], BATCH);
+	kernel = FramePacer::now() - start;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		sinCosLoop(&angles[0], &refSines[0], &refCosines[0], BATCH);
+	scalar = FramePacer::now() - start;
+	ok = true;
+	for (int i = 0; i < BATCH; i++)
+		ok = ok && std::fabs(sines[i] - refSines[i]) <= SIN_TOLERANCE &&
+			std::fabs(cosines[i] - refCosines[i]) <= SIN_TOLERANCE;
+	report("sinCos", kernel, scalar, elements, ok);
+	passed = passed && ok;
+
+	// quadCorners, the loop rotates with the C library
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		mathKernels::quadCorners(&quads[0], &corners[0], BATCH);
+	kernel = FramePacer::now() - start;
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+		cornerLoop(&quads[0], &refCorners[0], BATCH);
+	scalar = FramePacer::now() - start;
+	ok = true;
+	for (int i = 0; i < BATCH * 4; i++)
+		ok = ok && std::fabs(corners[i].x - refCorners[i].x) <= CORNER_TOLERANCE &&
+			std::fabs(corners[i].y - refCorners[i].y) <= CORNER_TOLERANCE;
+	report("quadCorners", kernel, scalar, elements, ok);
+	passed = passed && ok;
+	return passed;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include "headlessBench.h"
+
+//=============================================================================
+// Run the game frames more frames after it warmed up and print the general
+// purpose heap allocations they made, with the frame arena and tagged memory.
+// Returns false if the heap allocations grew or the runner was built
+// without BEX_TRACK_HEAP.
+// Throws GameError
+//=============================================================================
+bool headlessBench::heapCheck(HeadlessPlatform& platform, Game& game, UINT64 frames)
+{
+	if (!TaggedAllocator::isHeapTracked())
+	{
+		printf("heapcheck: build with BEX_TRACK_HEAP defined to count heap allocations\n");
+		return false;
+	}
+	UINT64 before = TaggedAllocator::getHeapAllocations();
+	platform.run(frames);
+	UINT64 allocations = TaggedAllocator::getHeapAllocations() - before;
+	const FrameArena& arena = game.getFrameArena();
+	printf("heapcheck: %llu heap allocations in %llu frames, frame arena peak %.1f KB of %.0f KB\n",
+		(unsigned long long)allocations, (unsigned long long)frames, arena.getPeak() / 1024.0,
+		arena.getCapacity() / 1024.0);
+	for (int tag = 0; tag < memoryNS::TAG_COUNT; tag++)
+	{
+		if (TaggedAllocator::getAllocations(tag) > 0)
+			printf("heapcheck: %-10s %8.1f KB, peak %8.1f KB, %llu allocations\n", TaggedAllocator::getTagName(tag),
+				TaggedAllocator::getBytes(tag) / 1024.0, TaggedAllocator::getPeakBytes(tag) / 1024.0,
+				(unsigned long long)TaggedAllocator::getAllocations(tag));
+	}
+	printf("heapcheck: steady state %s\n", allocations == 0 ? "allocation free" : "ALLOCATES");
+	return allocations == 0;
+}
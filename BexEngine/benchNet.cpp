@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "spacewar.h"
+#include <vector>
+#include <algorithm>
+
+//=============================================================================
+// Replicate the game to clients clients for frames frames over a loopback
+// network that loses loss of the datagrams, or over UDP on localhost, and
+// print the snapshot sizes, the encode and decode time per entity and if
+// the clients decoded the state of the server. Under loss a client may end
+// a few ticks behind, its newest tick is compared with the server's state
+// of that tick.
+// Returns false if a client did not decode a state of the server.
+// Throws GameError
+//=============================================================================
+bool headlessBench::net(HeadlessPlatform& platform, Game& game, UINT clients, float loss, bool udp, UINT64 frames)
+{
+	LoopbackNetwork network(loss);
+	ReplicationServer& server = game.getNetServer();
+	NetAddress address;
+	if (udp)
+	{
+		UdpTransport* t = new UdpTransport;
+		try
+		{
+			t->open(0);                 // throws GameError
+		}
+		catch (...)
+		{
+			delete t;
+			throw;
+		}
+		address = t->getAddress();
+		server.initialize(t, &game.getNetSchema());
+	}
+	else
+	{
+		LoopbackTransport* t = new LoopbackTransport(network, 1);
+		address = t->getAddress();
+		server.initialize(t, &game.getNetSchema());
+	}
+	std::vector<World> worlds(clients);
+	std::vector<ReplicationClient> ends(clients);
+	for (UINT i = 0; i < clients; i++)
+	{
+		NetTransport* t;
+		if (udp)
+		{
+			UdpTransport* u = new UdpTransport;
+			try
+			{
+				u->open(0);             // throws GameError
+			}
+			catch (...)
+			{
+				delete u;
+				throw;
+			}
+			t = u;
+		}
+		else
+			t = new LoopbackTransport(network, (uint16_t)(100 + i));
+		ends[i].initialize(t, &game.getNetSchema(), address);
+	}
+
+	// the checksum of every tick, the server keeps only the last frames
+	std::vector<uint32_t> sums;
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		platform.run(1);
+		for (uint32_t t = (uint32_t)sums.size(); t != server.getTick() + 1; t++)
+			sums.push_back(server.getChecksum(t));
+		for (UINT i = 0; i < clients; i++)
+			ends[i].update(worlds[i], MIN_FRAME_TIME);
+	}
+
+	NetStats ss = server.getStats();
+	double seconds = frames * (double)MIN_FRAME_TIME;
+	printf("net: %u of %u clients over %s, %.0f%% loss, %llu snapshots, %llu full\n", ss.clients, clients,
+		udp ? "udp" : "loopback", loss * 100, (unsigned long long)ss.snapshots, (unsigned long long)ss.fullSnapshots);
+	if (ss.snapshots == 0)
+	{
+		server.release();
+		return false;
+	}
+	printf("server: %.0f bytes and %.2f datagrams per snapshot, %.1f kbit/s per client, "
+		"capture %.3f us and encode %.3f us per entity\n",
+		(double)ss.bytes / ss.snapshots, (double)ss.datagrams / ss.snapshots,
+		ss.bytes * 8 / 1000.0 / seconds / clients,
+		ss.captureTime * 1e6 / ((double)ss.entities / ss.snapshots * (server.getTick() + 1)),
+		ss.encodedEntities ? ss.time * 1e6 / ss.encodedEntities : 0);
+	UINT matched = 0, shown = 0, behind = 0;
+	NetStats cs;
+	memset(&cs, 0, sizeof(cs));
+	for (UINT i = 0; i < clients; i++)
+	{
+		NetStats s = ends[i].getStats();
+		cs.snapshots += s.snapshots;
+		cs.fullSnapshots += s.fullSnapshots;
+		cs.entities += s.entities;
+		cs.time += s.time;
+		cs.applyTime += s.applyTime;
+		cs.dropped += s.dropped;
+		uint32_t tick = ends[i].getNewestTick();
+		uint32_t sum = ends[i].getChecksum(tick);
+		if (tick < sums.size() && sum != 0 && sum == sums[tick])
+		{
+			++matched;
+			behind = std::max(behind, (UINT)(sums.size() - 1 - tick));
+		}
+		worlds[i].each<Position>([&](Entity, Position&) { ++shown; });
+	}
+	printf("clients: %llu snapshots decoded, %llu dropped, %llu datagrams lost, decode %.3f us per entity, "
+		"apply %.3f ms per frame, %u entities shown\n", (unsigned long long)cs.snapshots,
+		(unsigned long long)cs.dropped, (unsigned long long)network.getDropped(),
+		cs.entities ? cs.time * 1e6 / cs.entities : 0, cs.applyTime * 1000 / (frames * clients), shown / clients);
+	printf("clients with the state of the server: %u of %u, at most %u ticks behind\n", matched, clients, behind);
+	server.release();                   // the transport uses network
+	return matched == clients;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include "headlessBench.h"
+
+namespace
+{
+	const double MAX_P50 = 0.0001;      // seconds of pacing error half the frames may exceed
+	// A shared or single core machine preempts the final spin for up to a
+	// scheduler time slice now and then, so the p99 limit catches a pacer
+	// that misses frames but not that jitter.
+	const double MAX_P99 = 0.002;
+}
+
+//=============================================================================
+// Run the game frames more frames with frame pacing on and print the frame
+// rate and the p50 and p99 pacing error of the pacer.
+// Returns false if the frames were not recorded, the p50 error is over
+// 100 us or the p99 error over 2 ms.
+// Throws GameError
+//=============================================================================
+bool headlessBench::pacing(HeadlessPlatform& platform, Game& game, UINT64 frames)
+{
+	if (frames == 0)
+		return true;
+	FramePacer& pacer = game.getFramePacer();
+	pacer.resetStats();
+	game.setFramePacing(true);
+	double start = FramePacer::now();
+	platform.run(frames);
+	double time = FramePacer::now() - start;
+	game.setFramePacing(false);
+
+	double p50 = pacer.getErrorP50();
+	double p99 = pacer.getErrorP99();
+	printf("paced: %u frames at %.1f fps, target %.1f fps\n", pacer.getFrameCount(),
+		frames / time, 1 / MIN_FRAME_TIME);
+	printf("paced: pacing error p50 %.1f us, p99 %.1f us\n", p50 * 1e6, p99 * 1e6);
+	return pacer.getFrameCount() == frames && p50 <= MAX_P50 && p99 <= MAX_P99;
+}
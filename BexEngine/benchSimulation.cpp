@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include "headlessBench.h"
+#include "spacewar.h"
+#include "mathKernels.h"
+#include <vector>
+#include <cmath>
+
+namespace
+{
+	// An entity as one object with all its data, the layout before the World:
+	// moving it loads the unused fields in the same cache lines.
+	struct GameObject
+	{
+		Position position;
+		Velocity velocity;
+		Appearance appearance;
+		float   scale, angle, spin, radius;
+		float   edge[4];                // collision box
+		bool    active;
+		char    name[31];
+	};
+
+	// Run frames frames of frameTime seconds in fixed timestep mode and print
+	// the ticks run and dropped. Returns false if they and the part of a tick
+	// left over do not add up to the time run, or a frame ran too many ticks.
+	bool runTicks(HeadlessPlatform& platform, Game& game, float frameTime, UINT maxTicks, UINT64 frames)
+	{
+		game.setSimulatedFrameTime(frameTime);
+		UINT64 run = game.getTicksRun(), dropped = game.getTicksDropped();
+		float interpolation = game.getInterpolation();
+		platform.run(frames);
+		run = game.getTicksRun() - run;
+		dropped = game.getTicksDropped() - dropped;
+		// the float accumulator drifts by far less than a hundredth of a tick
+		double ticks = run + dropped + (double)game.getInterpolation() - interpolation;
+		double expected = frames * (double)frameTime / game.getTickTime();
+		bool adds = std::fabs(ticks - expected) < 0.01;
+		bool limited = run <= frames * maxTicks;
+		printf("fixed %g Hz, %.1f ms frames: %llu ticks run, %llu dropped, interpolation %.3f, "
+			"%.2f ticks due, %s\n", 1 / game.getTickTime(), frameTime * 1000, (unsigned long long)run,
+			(unsigned long long)dropped, game.getInterpolation(), expected,
+			adds && limited ? "matches" : "DOES NOT MATCH");
+		return adds && limited;
+	}
+
+	// Return the sum of the x and y positions of n objects of p, stride bytes apart.
+	double positionSum(const unsigned char* p, size_t stride, UINT n)
+	{
+		double sum = 0;
+		for (UINT i = 0; i < n; i++, p += stride)
+		{
+			const Position* pos = (const Position*)p;
+			sum += pos->x + pos->y;
+		}
+		return sum;
+	}
+}
+
+//=============================================================================
+// Rewind the game steps simulation steps, simulate them again and print if
+// the state is the same. Then time the snapshots of a 10000 entity world.
+// Returns false if the state differs.
+// Throws GameError
+//=============================================================================
+bool headlessBench::rollback(Game& game, UINT steps)
+{
+	const UINT ENTITIES = 10000, STEPS = 100;
+	SnapshotHistory& history = game.getSnapshots();
+	UINT64 end = game.getStepCount();
+	if (steps > end || !history.has(end - steps))
+	{
+		printf("rollback: step %llu is not in the history\n", (unsigned long long)(end - steps));
+		return false;
+	}
+	std::vector<unsigned char> before, after;
+	history.capture(before);
+	game.rollback(end - steps);         // throws GameError
+	double restoreTime = history.getStats().restoreTime;
+	game.resimulate(steps);
+	history.capture(after);
+	SnapshotStats ss = history.getStats();
+	printf("rollback %u steps: state of %llu bytes with %u particles %s, restore %.3f ms, %u steps in %.1f KB\n",
+		steps, (unsigned long long)after.size(), game.getParticles().getCount(),
+		before == after ? "identical" : "DIFFERENT", restoreTime * 1000, ss.steps, ss.storedBytes / 1024.0);
+
+	// half of the entities move every step
+	World world;
+	for (UINT i = 0; i < ENTITIES; i++)
+	{
+		Position p = { (float)(i % 640), (float)(i / 640) };
+		Velocity v = { i % 2 ? 1.0f : 0.0f, 0 };
+		Appearance a = { i % 4, 0xFFFFFFFF };
+		world.create(p, v, a);
+	}
+	SnapshotHistory h;
+	h.initialize(&world);
+	double saveTime = 0, keyTime = 0, maxRestore = 0;
+	UINT keyframes = 0;
+	for (UINT s = 1; s <= STEPS; s++)
+	{
+		world.each<Position, Velocity>([](Entity, Position& p, Velocity& v) { p.x += v.x; });
+		h.save(s);
+		if (s % snapshotNS::KEYFRAME_INTERVAL == 0)
+		{
+			keyTime += h.getStats().saveTime;
+			++keyframes;
+		}
+		else
+			saveTime += h.getStats().saveTime;
+	}
+	// the step before a keyframe applies the most deltas
+	for (UINT s = STEPS - snapshotNS::KEYFRAME_INTERVAL * 2; s < STEPS; s++)
+	{
+		h.restore(s);                   // throws GameError
+		if (h.getStats().restoreTime > maxRestore)
+			maxRestore = h.getStats().restoreTime;
+		h.save(s + 1);
+	}
+	SnapshotStats hs = h.getStats();
+	printf("snapshots of %u entities: %.0f KB state, keyframe save %.3f ms, delta save %.3f ms, "
+		"restore %.3f ms max, %.0f KB for %u steps\n", ENTITIES, hs.stateBytes / 1024.0,
+		keyTime * 1000 / keyframes, saveTime * 1000 / (STEPS - keyframes), maxRestore * 1000,
+		hs.storedBytes / 1024.0, hs.steps);
+	return before == after;
+}
+
+//=============================================================================
+// Move entities entities for frames 200 Hz steps stored as an array of game
+// objects (array of structures), as World chunks (structure of arrays) with
+// the same scalar loop, and with the World chunks and the SIMD kernel of
+// Spacewar::update(), and print the ns per entity of each.
+// Returns false if the layouts end with different positions.
+// Throws GameError
+//=============================================================================
+bool headlessBench::iteration(UINT entities, UINT64 frames)
+{
+	const float t = 0.005f;
+	if (entities == 0 || frames == 0)
+		return true;
+
+	std::vector<GameObject> objects(entities);
+	World world;
+	for (UINT i = 0; i < entities; i++)
+	{
+		GameObject& o = objects[i];
+		memset(&o, 0, sizeof(o));
+		o.position.x = (float)(i % 640);
+		o.position.y = (float)(i / 640 % 480);
+		o.velocity.x = (float)(i % 7) - 3;
+		o.velocity.y = (float)(i % 5) - 2;
+		o.appearance.image = i % 4;
+		o.appearance.color = 0xFFFFFFFF;
+		o.active = true;
+		world.create(o.position, o.velocity, o.appearance);
+	}
+	World simd;
+	world.eachChunk<Position, Velocity, Appearance>([&simd](UINT count, const Entity*, Position* p,
+		Velocity* v, Appearance* a)
+	{
+		for (UINT i = 0; i < count; i++)
+			simd.create(p[i], v[i], a[i]);
+	});
+
+	double start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		for (UINT i = 0; i < entities; i++)
+		{
+			GameObject& o = objects[i];
+			if (o.active)
+			{
+				o.position.x += o.velocity.x * t;
+				o.position.y += o.velocity.y * t;
+			}
+		}
+	}
+	double aosTime = FramePacer::now() - start;
+
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		world.eachChunk<Position, Velocity>([t](UINT count, const Entity*, Position* p, Velocity* v)
+		{
+			for (UINT i = 0; i < count; i++)
+			{
+				p[i].x += v[i].x * t;
+				p[i].y += v[i].y * t;
+			}
+		});
+	}
+	double soaTime = FramePacer::now() - start;
+
+	start = FramePacer::now();
+	for (UINT64 f = 0; f < frames; f++)
+	{
+		simd.eachChunk<Position, Velocity>([t](UINT count, const Entity*, Position* p, Velocity* v)
+		{
+			mathKernels::integrate(&p[0].x, &v[0].x, (int)count * 2, t);
+		});
+	}
+	double simdTime = FramePacer::now() - start;
+
+	// the worlds keep the entities in creation order
+	double aosSum = positionSum((const unsigned char*)&objects[0], sizeof(GameObject), entities);
+	double soaSum = 0, simdSum = 0;
+	world.eachChunk<Position>([&soaSum](UINT count, const Entity*, Position* p)
+	{
+		soaSum += positionSum((const unsigned char*)p, sizeof(Position), count);
+	});
+	simd.eachChunk<Position>([&simdSum](UINT count, const Entity*, Position* p)
+	{
+		simdSum += positionSum((const unsigned char*)p, sizeof(Position), count);
+	});
+	bool same = aosSum == soaSum && soaSum == simdSum;
+	double steps = (double)entities * frames;
+	printf("iterate %u entities: array of %u byte objects %.2f ns, world chunks %.2f ns, "
+		"world chunks simd %.2f ns per entity, speedup %.2f and %.2f, positions %s\n", entities,
+		(UINT)sizeof(GameObject), aosTime * 1e9 / steps, soaTime * 1e9 / steps, simdTime * 1e9 / steps,
+		aosTime / soaTime, aosTime / simdTime, same ? "identical" : "DIFFERENT");
+	return same;
+}
+
+//=============================================================================
+// Run frames frames of the game in fixed timestep mode at hz ticks per
+// second with the frame time of the runner, then frames frames of
+// MAX_FRAME_TIME that need the catch-up limit.
+// Returns false if the ticks run and dropped do not add up to the time run,
+// or a frame ran more than maxTicks ticks.
+// Throws GameError
+//=============================================================================
+bool headlessBench::fixedTimestep(HeadlessPlatform& platform, Game& game, float hz, UINT maxTicks, UINT64 frames)
+{
+	if (frames == 0)
+		return true;
+	if (!game.isFixedTimestep())
+		game.setFixedTimestep(true, hz, maxTicks);  // throws GameError
+	bool passed = runTicks(platform, game, MIN_FRAME_TIME, maxTicks, frames);
+	passed = runTicks(platform, game, MAX_FRAME_TIME, maxTicks, frames) && passed;
+	game.setSimulatedFrameTime(MIN_FRAME_TIME);
+	return passed;
+}
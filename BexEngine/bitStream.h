@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Writes values of 1 to 32 bits into a byte buffer, least significant bit first.
+class BitWriter final
+{
+public:
+	// Constructor
+	BitWriter() : scratch(0), bits(0) {}
+
+	// Forget the bits written, keeps the buffer memory.
+	void reset() { bytes.clear(); scratch = 0; bits = 0; }
+
+	// Write the low count bits of value.
+	// Pre: count = 1..32
+	void write(uint32_t value, unsigned int count)
+	{
+		scratch |= (uint64_t)(value & (0xFFFFFFFFu >> (32 - count))) << bits;
+		bits += count;
+		if (bits >= 32)
+		{
+			uint32_t w = (uint32_t)scratch;
+			size_t at = bytes.size();
+			bytes.resize(at + 4);
+			memcpy(&bytes[at], &w, 4);
+			scratch >>= 32;
+			bits -= 32;
+		}
+	}
+
+	// Write one bit.
+	void writeBit(bool bit) { write(bit ? 1 : 0, 1); }
+
+	// Write the bits still buffered, the last byte is padded with 0 bits.
+	// Returns the bytes written.
+	const std::vector<uint8_t>& finish()
+	{
+		for (; bits > 0; bits = bits > 8 ? bits - 8 : 0)
+		{
+			bytes.push_back((uint8_t)scratch);
+			scratch >>= 8;
+		}
+		scratch = 0;
+		return bytes;
+	}
+
+	// Return number of bits written.
+	size_t getBitCount() const { return bytes.size() * 8 + bits; }
+
+private:
+	std::vector<uint8_t> bytes;
+	uint64_t scratch;                       // bits not yet in bytes
+	unsigned int bits;                      // bits in scratch
+};
+
+// Reads values written by BitWriter. Reading past the end returns 0 bits
+// and sets the overflow flag.
+class BitReader final
+{
+public:
+	// Constructor
+	BitReader(const uint8_t* data, size_t size) : p(data), end(data + size), scratch(0), bits(0), overflow(false) {}
+
+	// Read count bits.
+	// Pre: count = 1..32
+	uint32_t read(unsigned int count)
+	{
+		while (bits < count)
+		{
+			if (p == end)
+			{
+				overflow = true;
+				bits = count;
+				break;
+			}
+			scratch |= (uint64_t)*p++ << bits;
+			bits += 8;
+		}
+		uint32_t value = (uint32_t)scratch & (0xFFFFFFFFu >> (32 - count));
+		scratch >>= count;
+		bits -= count;
+		return value;
+	}
+
+	// Read one bit.
+	bool readBit() { return read(1) != 0; }
+
+	// Return true if more bits were read than written.
+	bool isOverflow() const { return overflow; }
+
+private:
+	const uint8_t* p;
+	const uint8_t* end;
+	uint64_t scratch;                       // bits read from the buffer not yet returned
+	unsigned int bits;                      // bits in scratch
+	bool    overflow;
+};
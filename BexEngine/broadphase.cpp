@@ -0,0 +1,394 @@
+#include "broadphase.h"
+
+namespace
+{
+	// Return the hash map key of cell x, y.
+	uint64_t cellKey(int x, int y)
+	{
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+	}
+
+	// Add pair a, b with the smaller user data first.
+	void addPair(std::vector<CollisionPair>& pairs, uint32_t a, uint32_t b)
+	{
+		CollisionPair p;
+		p.a = a < b ? a : b;
+		p.b = a < b ? b : a;
+		pairs.push_back(p);
+	}
+}
+
+//=============================================================================
+// SpatialHash constructor
+//=============================================================================
+SpatialHash::SpatialHash(float size)
+{
+	cellSize = size > 0 ? size : broadphaseNS::DEFAULT_CELL_SIZE;
+	invCellSize = 1.0f / cellSize;
+	proxyCount = 0;
+	pairsTested = 0;
+	pairsFound = 0;
+	clear();
+}
+
+//=============================================================================
+// Add a proxy
+//=============================================================================
+uint32_t SpatialHash::add(const AABB& box, uint32_t userData)
+{
+	uint32_t id;
+	if (freeProxies.empty())
+	{
+		id = (uint32_t)proxies.size();
+		proxies.push_back(Proxy());
+		boxes.push_back(box);
+	}
+	else
+	{
+		id = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	Proxy& p = proxies[id];
+	boxes[id] = box;
+	p.userData = userData;
+	p.x0 = cellOf(box.minX);
+	p.y0 = cellOf(box.minY);
+	p.x1 = cellOf(box.maxX);
+	p.y1 = cellOf(box.maxY);
+	insertCells(id, p.x0, p.y0, p.x1, p.y1);
+	++proxyCount;
+	return id;
+}
+
+//=============================================================================
+// Move a proxy, cells change only when the box crosses a cell border
+//=============================================================================
+void SpatialHash::update(uint32_t id, const AABB& box)
+{
+	Proxy& p = proxies[id];
+	boxes[id] = box;
+	int x0 = cellOf(box.minX);
+	int y0 = cellOf(box.minY);
+	int x1 = cellOf(box.maxX);
+	int y1 = cellOf(box.maxY);
+	if (x0 == p.x0 && y0 == p.y0 && x1 == p.x1 && y1 == p.y1)
+		return;
+	removeCells(id, p.x0, p.y0, p.x1, p.y1);
+	insertCells(id, x0, y0, x1, y1);
+	p.x0 = x0;
+	p.y0 = y0;
+	p.x1 = x1;
+	p.y1 = y1;
+}
+
+//=============================================================================
+// Remove a proxy
+//=============================================================================
+void SpatialHash::remove(uint32_t id)
+{
+	Proxy& p = proxies[id];
+	if (p.x1 < p.x0)
+		return;                         // already free
+	removeCells(id, p.x0, p.y0, p.x1, p.y1);
+	p.x0 = 0;
+	p.x1 = -1;
+	freeProxies.push_back(id);
+	--proxyCount;
+}
+
+//=============================================================================
+// Remove all proxies
+//=============================================================================
+void SpatialHash::clear()
+{
+	boxes.clear();
+	proxies.clear();
+	freeProxies.clear();
+	cells.clear();
+	freeCells.clear();
+	Slot empty = { 0, broadphaseNS::INVALID };
+	table.assign(1024, empty);
+	tableUsed = 0;
+	proxyCount = 0;
+}
+
+//=============================================================================
+// Create free cells up to cellCount and grow the table for them
+//=============================================================================
+void SpatialHash::reserve(uint32_t cellCount)
+{
+	cells.reserve(cellCount);
+	freeCells.reserve(cellCount);
+	while (cells.size() < cellCount)
+	{
+		freeCells.push_back((uint32_t)cells.size());
+		cells.push_back(Cell());
+		cells.back().proxies.reserve(broadphaseNS::CELL_RESERVE);
+	}
+	while ((cellCount + 1) * 2 > table.size())
+		growTable();
+}
+
+//=============================================================================
+// Return the table slot of key or the empty slot where it belongs
+//=============================================================================
+uint32_t SpatialHash::findSlot(uint64_t key) const
+{
+	uint32_t mask = (uint32_t)table.size() - 1;
+	uint32_t s = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while (table[s].cell != broadphaseNS::INVALID && table[s].key != key)
+		s = (s + 1) & mask;
+	return s;
+}
+
+//=============================================================================
+// Remove the key in slot s, shifting back the keys probed past it
+//=============================================================================
+void SpatialHash::eraseSlot(uint32_t s)
+{
+	uint32_t mask = (uint32_t)table.size() - 1;
+	uint32_t hole = s;
+	for (uint32_t i = (s + 1) & mask; table[i].cell != broadphaseNS::INVALID; i = (i + 1) & mask)
+	{
+		uint32_t home = (uint32_t)((table[i].key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		// move the key into the hole if the hole lies on its probe path
+		if (((i - home) & mask) >= ((i - hole) & mask))
+		{
+			table[hole] = table[i];
+			hole = i;
+		}
+	}
+	table[hole].cell = broadphaseNS::INVALID;
+	--tableUsed;
+}
+
+//=============================================================================
+// Double the table size
+//=============================================================================
+void SpatialHash::growTable()
+{
+	std::vector<Slot> old;
+	old.swap(table);
+	Slot empty = { 0, broadphaseNS::INVALID };
+	table.assign(old.size() * 2, empty);
+	for (size_t i = 0; i < old.size(); i++)
+		if (old[i].cell != broadphaseNS::INVALID)
+			table[findSlot(old[i].key)] = old[i];
+}
+
+//=============================================================================
+// Insert proxy id in the cells x0..x1, y0..y1
+//=============================================================================
+void SpatialHash::insertCells(uint32_t id, int x0, int y0, int x1, int y1)
+{
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+		{
+			uint64_t key = cellKey(x, y);
+			uint32_t s = findSlot(key);
+			if (table[s].cell == broadphaseNS::INVALID)
+			{
+				// keep the load factor below one half
+				if ((tableUsed + 1) * 2 > table.size())
+				{
+					growTable();
+					s = findSlot(key);
+				}
+				// reuse an empty cell, keeps its proxy array capacity
+				uint32_t c;
+				if (freeCells.empty())
+				{
+					c = (uint32_t)cells.size();
+					cells.push_back(Cell());
+					cells[c].proxies.reserve(broadphaseNS::CELL_RESERVE);
+				}
+				else
+				{
+					c = freeCells.back();
+					freeCells.pop_back();
+				}
+				cells[c].x = x;
+				cells[c].y = y;
+				table[s].key = key;
+				table[s].cell = c;
+				++tableUsed;
+			}
+			cells[table[s].cell].proxies.push_back(id);
+		}
+}
+
+//=============================================================================
+// Remove proxy id from the cells x0..x1, y0..y1
+//=============================================================================
+void SpatialHash::removeCells(uint32_t id, int x0, int y0, int x1, int y1)
+{
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+		{
+			uint32_t s = findSlot(cellKey(x, y));
+			uint32_t c = table[s].cell;
+			if (c == broadphaseNS::INVALID)
+				continue;
+			std::vector<uint32_t>& list = cells[c].proxies;
+			for (size_t i = 0; i < list.size(); i++)
+				if (list[i] == id)
+				{
+					list[i] = list.back();
+					list.pop_back();
+					break;
+				}
+			if (list.empty())
+			{
+				freeCells.push_back(c);
+				eraseSlot(s);
+			}
+		}
+}
+
+//=============================================================================
+// Find the pairs of overlapping proxies
+//=============================================================================
+void SpatialHash::findPairs(std::vector<CollisionPair>& pairs)
+{
+	pairs.clear();
+	pairsTested = 0;
+	for (size_t c = 0; c < cells.size(); c++)
+	{
+		const Cell& cell = cells[c];
+		const std::vector<uint32_t>& list = cell.proxies;
+		for (size_t i = 0; i + 1 < list.size(); i++)
+		{
+			const AABB& a = boxes[list[i]];
+			for (size_t j = i + 1; j < list.size(); j++)
+			{
+				const AABB& b = boxes[list[j]];
+				++pairsTested;
+				if (!collision::overlaps(a, b))
+					continue;
+				// report the pair only in the cell of the top left corner of the overlap
+				float ox = a.minX > b.minX ? a.minX : b.minX;
+				float oy = a.minY > b.minY ? a.minY : b.minY;
+				if (cellOf(ox) == cell.x && cellOf(oy) == cell.y)
+					addPair(pairs, proxies[list[i]].userData, proxies[list[j]].userData);
+			}
+		}
+	}
+	pairsFound = pairs.size();
+}
+
+//=============================================================================
+// SweepAndPrune constructor
+//=============================================================================
+SweepAndPrune::SweepAndPrune()
+{
+	proxyCount = 0;
+	pairsTested = 0;
+	pairsFound = 0;
+}
+
+//=============================================================================
+// Add a proxy, sorted in by the next findPairs()
+//=============================================================================
+uint32_t SweepAndPrune::add(const AABB& box, uint32_t userData)
+{
+	uint32_t id;
+	if (freeProxies.empty())
+	{
+		id = (uint32_t)proxies.size();
+		proxies.push_back(Proxy());
+	}
+	else
+	{
+		id = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	proxies[id].box = box;
+	proxies[id].userData = userData;
+	proxies[id].alive = true;
+	order.push_back(id);
+	++proxyCount;
+	return id;
+}
+
+//=============================================================================
+// Move a proxy
+//=============================================================================
+void SweepAndPrune::update(uint32_t id, const AABB& box)
+{
+	proxies[id].box = box;
+}
+
+//=============================================================================
+// Remove a proxy, dropped from the order by the next findPairs()
+//=============================================================================
+void SweepAndPrune::remove(uint32_t id)
+{
+	if (!proxies[id].alive)
+		return;
+	proxies[id].alive = false;
+	removedProxies.push_back(id);
+	--proxyCount;
+}
+
+//=============================================================================
+// Remove all proxies
+//=============================================================================
+void SweepAndPrune::clear()
+{
+	proxies.clear();
+	freeProxies.clear();
+	removedProxies.clear();
+	order.clear();
+	proxyCount = 0;
+}
+
+//=============================================================================
+// Find the pairs of overlapping proxies
+//=============================================================================
+void SweepAndPrune::findPairs(std::vector<CollisionPair>& pairs)
+{
+	pairs.clear();
+	pairsTested = 0;
+
+	// drop removed proxies, their ids can be reused now
+	if (!removedProxies.empty())
+	{
+		size_t n = 0;
+		for (size_t i = 0; i < order.size(); i++)
+			if (proxies[order[i]].alive)
+				order[n++] = order[i];
+		order.resize(n);
+		freeProxies.insert(freeProxies.end(), removedProxies.begin(), removedProxies.end());
+		removedProxies.clear();
+	}
+
+	// insertion sort, nearly linear for the small changes between frames
+	for (size_t i = 1; i < order.size(); i++)
+	{
+		uint32_t id = order[i];
+		float x = proxies[id].box.minX;
+		size_t j = i;
+		while (j > 0 && proxies[order[j - 1]].box.minX > x)
+		{
+			order[j] = order[j - 1];
+			--j;
+		}
+		order[j] = id;
+	}
+
+	// sweep along x
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Proxy& a = proxies[order[i]];
+		for (size_t j = i + 1; j < order.size(); j++)
+		{
+			const Proxy& b = proxies[order[j]];
+			if (b.box.minX > a.box.maxX)
+				break;
+			++pairsTested;
+			if (a.box.minY <= b.box.maxY && b.box.minY <= a.box.maxY)
+				addPair(pairs, a.userData, b.userData);
+		}
+	}
+	pairsFound = pairs.size();
+}
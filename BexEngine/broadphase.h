@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "collision.h"
+
+namespace broadphaseNS
+{
+	const float DEFAULT_CELL_SIZE = 64.0f;  // spatial hash cell size in pixels
+	const size_t CELL_RESERVE = 16;         // proxies a new spatial hash cell has room for
+	const uint32_t INVALID = 0xFFFFFFFF;
+}
+
+// Candidate pair found by a broadphase, user data of the two proxies.
+struct CollisionPair
+{
+	uint32_t a;
+	uint32_t b;
+};
+
+// Interface of a broadphase.
+// Every body is a proxy with a bounding box that is updated when the body
+// moves. findPairs() reports each pair of overlapping boxes once; the pairs
+// are then tested with the narrowphase functions of collision.h.
+class Broadphase
+{
+public:
+	// Destructor
+	virtual ~Broadphase() {}
+
+	// Add a proxy. Returns the proxy id.
+	// Pre: userData = value reported in the pairs, usually an entity or array index
+	virtual uint32_t add(const AABB& box, uint32_t userData) = 0;
+
+	// Move proxy id to box.
+	virtual void update(uint32_t id, const AABB& box) = 0;
+
+	// Remove proxy id.
+	virtual void remove(uint32_t id) = 0;
+
+	// Remove all proxies.
+	virtual void clear() = 0;
+
+	// Replace pairs with the pairs of overlapping proxies.
+	virtual void findPairs(std::vector<CollisionPair>& pairs) = 0;
+
+	// Return number of box tests done by the last findPairs().
+	virtual UINT64 getPairsTested() const = 0;
+
+	// Return number of pairs found by the last findPairs().
+	virtual UINT64 getPairsFound() const = 0;
+
+	// Return number of proxies.
+	virtual uint32_t getProxyCount() const = 0;
+};
+
+// Uniform grid broadphase with hashed cells.
+// A proxy is stored in every cell its box touches; a moving proxy only
+// changes cells when its box crosses a cell border. Pairs are tested per
+// cell and reported by the one cell holding the top left corner of the
+// overlap, so no pair is reported twice. Works best when the cell size is
+// about the size of the typical body.
+class SpatialHash final : public Broadphase
+{
+public:
+	// Constructor
+	explicit SpatialHash(float cellSize = broadphaseNS::DEFAULT_CELL_SIZE);
+
+	uint32_t add(const AABB& box, uint32_t userData) override;
+	void    update(uint32_t id, const AABB& box) override;
+	void    remove(uint32_t id) override;
+	void    clear() override;
+	void    findPairs(std::vector<CollisionPair>& pairs) override;
+	UINT64  getPairsTested() const override { return pairsTested; }
+	UINT64  getPairsFound() const override { return pairsFound; }
+	uint32_t getProxyCount() const override { return proxyCount; }
+
+	// Make room for cellCount cells holding proxies, so proxies moving
+	// within them do not allocate.
+	void    reserve(uint32_t cellCount);
+
+	// Return number of cells holding proxies.
+	uint32_t getCellCount() const { return (uint32_t)(cells.size() - freeCells.size()); }
+
+private:
+	struct Proxy
+	{
+		uint32_t userData;
+		int  x0, y0, x1, y1;                // covered cells, x1 < x0 if free
+	};
+	struct Cell
+	{
+		int  x, y;
+		std::vector<uint32_t> proxies;
+	};
+	// slot of the open addressing cell table
+	struct Slot
+	{
+		uint64_t key;                       // packed cell coordinates
+		uint32_t cell;                      // index in cells, INVALID if empty
+	};
+
+	float cellSize;
+	float invCellSize;
+	std::vector<AABB> boxes;                // proxy boxes, dense for the pair tests
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	std::vector<Cell> cells;
+	std::vector<uint32_t> freeCells;        // unused entries of cells
+	std::vector<Slot> table;                // cell coordinates to cells index, linear probing
+	uint32_t tableUsed;                     // used slots
+	uint32_t proxyCount;
+	UINT64 pairsTested;
+	UINT64 pairsFound;
+
+	// Return the cell coordinate of position v.
+	int     cellOf(float v) const { return (int)floorf(v * invCellSize); }
+	// Insert or remove proxy id in the cells x0..x1, y0..y1.
+	void    insertCells(uint32_t id, int x0, int y0, int x1, int y1);
+	void    removeCells(uint32_t id, int x0, int y0, int x1, int y1);
+	// Return the table slot of key, the empty slot to insert it if not found.
+	uint32_t findSlot(uint64_t key) const;
+	// Remove the key in slot s from the table.
+	void    eraseSlot(uint32_t s);
+	// Double the table size.
+	void    growTable();
+};
+
+// Sort and sweep broadphase.
+// Proxies are kept sorted by the left edge of their box. The order changes
+// little between frames, so it is restored with an insertion sort in nearly
+// linear time. The sweep tests only proxies whose x ranges overlap. Works
+// best when bodies are spread along the x axis and vary in size.
+class SweepAndPrune final : public Broadphase
+{
+public:
+	// Constructor
+	SweepAndPrune();
+
+	uint32_t add(const AABB& box, uint32_t userData) override;
+	void    update(uint32_t id, const AABB& box) override;
+	void    remove(uint32_t id) override;
+	void    clear() override;
+	void    findPairs(std::vector<CollisionPair>& pairs) override;
+	UINT64  getPairsTested() const override { return pairsTested; }
+	UINT64  getPairsFound() const override { return pairsFound; }
+	uint32_t getProxyCount() const override { return proxyCount; }
+
+private:
+	struct Proxy
+	{
+		AABB box;
+		uint32_t userData;
+		bool alive;
+	};
+
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	std::vector<uint32_t> removedProxies;   // removed but still in order, reused after the next sort
+	std::vector<uint32_t> order;            // proxies sorted by box.minX
+	uint32_t proxyCount;
+	UINT64 pairsTested;
+	UINT64 pairsFound;
+};
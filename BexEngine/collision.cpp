@@ -0,0 +1,239 @@
+#include "collision.h"
+
+namespace
+{
+	// Flip the normal of a contact, for tests run with the shapes swapped.
+	bool flipped(bool hit, Contact* contact)
+	{
+		if (hit && contact)
+		{
+			contact->normalX = -contact->normalX;
+			contact->normalY = -contact->normalY;
+		}
+		return hit;
+	}
+
+	// Set a contact if not nullptr.
+	void setContact(Contact* contact, float nx, float ny, float depth)
+	{
+		if (contact)
+		{
+			contact->normalX = nx;
+			contact->normalY = ny;
+			contact->depth = depth;
+		}
+	}
+}
+
+//=============================================================================
+// Circle against circle
+//=============================================================================
+bool collision::circleCircle(const Circle& a, const Circle& b, Contact* contact)
+{
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	float r = a.radius + b.radius;
+	float dist2 = dx * dx + dy * dy;
+	if (dist2 > r * r)
+		return false;
+	if (contact)
+	{
+		float dist = sqrtf(dist2);
+		if (dist > 0)
+			setContact(contact, dx / dist, dy / dist, r - dist);
+		else
+			setContact(contact, 1, 0, r);   // same center, separate along x
+	}
+	return true;
+}
+
+//=============================================================================
+// Box against box
+//=============================================================================
+bool collision::aabbAabb(const AABB& a, const AABB& b, Contact* contact)
+{
+	if (!overlaps(a, b))
+		return false;
+	if (contact)
+	{
+		// separate along the axis of least overlap
+		float ox = (a.maxX < b.maxX ? a.maxX : b.maxX) - (a.minX > b.minX ? a.minX : b.minX);
+		float oy = (a.maxY < b.maxY ? a.maxY : b.maxY) - (a.minY > b.minY ? a.minY : b.minY);
+		if (ox < oy)
+			setContact(contact, (b.minX + b.maxX) >= (a.minX + a.maxX) ? 1.0f : -1.0f, 0, ox);
+		else
+			setContact(contact, 0, (b.minY + b.maxY) >= (a.minY + a.maxY) ? 1.0f : -1.0f, oy);
+	}
+	return true;
+}
+
+//=============================================================================
+// Circle against box
+//=============================================================================
+bool collision::circleAabb(const Circle& a, const AABB& b, Contact* contact)
+{
+	// closest point of the box to the circle center
+	float qx = a.x < b.minX ? b.minX : (a.x > b.maxX ? b.maxX : a.x);
+	float qy = a.y < b.minY ? b.minY : (a.y > b.maxY ? b.maxY : a.y);
+	float dx = qx - a.x;
+	float dy = qy - a.y;
+	float dist2 = dx * dx + dy * dy;
+	if (dist2 > a.radius * a.radius)
+		return false;
+	if (contact == nullptr)
+		return true;
+
+	if (dist2 > 0)
+	{
+		float dist = sqrtf(dist2);
+		setContact(contact, dx / dist, dy / dist, a.radius - dist);
+		return true;
+	}
+
+	// center inside the box, push the box out through the nearest side
+	float left = a.x - b.minX;
+	float right = b.maxX - a.x;
+	float top = a.y - b.minY;
+	float bottom = b.maxY - a.y;
+	float nx = 1, ny = 0, d = left;
+	if (right < d) { nx = -1; ny = 0; d = right; }
+	if (top < d) { nx = 0; ny = 1; d = top; }
+	if (bottom < d) { nx = 0; ny = -1; d = bottom; }
+	setContact(contact, nx, ny, a.radius + d);
+	return true;
+}
+
+//=============================================================================
+// Circle against oriented box, tested in the space of the box
+//=============================================================================
+bool collision::circleObb(const Circle& a, const OBB& b, Contact* contact)
+{
+	float c = cosf(b.angle);
+	float s = sinf(b.angle);
+	float dx = a.x - b.x;
+	float dy = a.y - b.y;
+	Circle local = { dx * c + dy * s, -dx * s + dy * c, a.radius };
+	AABB box = { -b.halfWidth, -b.halfHeight, b.halfWidth, b.halfHeight };
+	if (!circleAabb(local, box, contact))
+		return false;
+	if (contact)
+	{
+		// normal back to world space
+		float nx = contact->normalX;
+		float ny = contact->normalY;
+		contact->normalX = nx * c - ny * s;
+		contact->normalY = nx * s + ny * c;
+	}
+	return true;
+}
+
+//=============================================================================
+// Oriented box against oriented box, separating axis test
+//=============================================================================
+bool collision::obbObb(const OBB& a, const OBB& b, Contact* contact)
+{
+	float ca = cosf(a.angle), sa = sinf(a.angle);
+	float cb = cosf(b.angle), sb = sinf(b.angle);
+	// the candidate separating axes are the box axes
+	const float axes[4][2] = { { ca, sa }, { -sa, ca }, { cb, sb }, { -sb, cb } };
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+
+	float best = 0, bestX = 0, bestY = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		float nx = axes[i][0], ny = axes[i][1];
+		float ra = a.halfWidth * fabsf(ca * nx + sa * ny) + a.halfHeight * fabsf(-sa * nx + ca * ny);
+		float rb = b.halfWidth * fabsf(cb * nx + sb * ny) + b.halfHeight * fabsf(-sb * nx + cb * ny);
+		float dist = dx * nx + dy * ny;
+		float overlap = ra + rb - fabsf(dist);
+		if (overlap < 0)
+			return false;                   // separating axis found
+		if (i == 0 || overlap < best)
+		{
+			best = overlap;
+			bestX = dist >= 0 ? nx : -nx;
+			bestY = dist >= 0 ? ny : -ny;
+		}
+	}
+	setContact(contact, bestX, bestY, best);
+	return true;
+}
+
+//=============================================================================
+// Test two colliders of any shape
+//=============================================================================
+bool collision::collide(const Collider& a, const Collider& b, Contact* contact)
+{
+	switch (a.shape)
+	{
+	case collisionNS::SHAPE_CIRCLE:
+		switch (b.shape)
+		{
+		case collisionNS::SHAPE_CIRCLE: return circleCircle(a.circle, b.circle, contact);
+		case collisionNS::SHAPE_AABB:   return circleAabb(a.circle, b.box, contact);
+		case collisionNS::SHAPE_OBB:    return circleObb(a.circle, b.obb, contact);
+		}
+		break;
+	case collisionNS::SHAPE_AABB:
+		switch (b.shape)
+		{
+		case collisionNS::SHAPE_CIRCLE: return flipped(circleAabb(b.circle, a.box, contact), contact);
+		case collisionNS::SHAPE_AABB:   return aabbAabb(a.box, b.box, contact);
+		case collisionNS::SHAPE_OBB:    return obbObb(toObb(a.box), b.obb, contact);
+		}
+		break;
+	case collisionNS::SHAPE_OBB:
+		switch (b.shape)
+		{
+		case collisionNS::SHAPE_CIRCLE: return flipped(circleObb(b.circle, a.obb, contact), contact);
+		case collisionNS::SHAPE_AABB:   return obbObb(a.obb, toObb(b.box), contact);
+		case collisionNS::SHAPE_OBB:    return obbObb(a.obb, b.obb, contact);
+		}
+		break;
+	}
+	return false;
+}
+
+//=============================================================================
+// Return the bounding box of a collider
+//=============================================================================
+AABB collision::bounds(const Collider& c)
+{
+	AABB box = { 0, 0, 0, 0 };
+	switch (c.shape)
+	{
+	case collisionNS::SHAPE_CIRCLE:
+		box.minX = c.circle.x - c.circle.radius;
+		box.minY = c.circle.y - c.circle.radius;
+		box.maxX = c.circle.x + c.circle.radius;
+		box.maxY = c.circle.y + c.circle.radius;
+		break;
+	case collisionNS::SHAPE_AABB:
+		box = c.box;
+		break;
+	case collisionNS::SHAPE_OBB:
+	{
+		float cs = fabsf(cosf(c.obb.angle));
+		float sn = fabsf(sinf(c.obb.angle));
+		float ex = c.obb.halfWidth * cs + c.obb.halfHeight * sn;
+		float ey = c.obb.halfWidth * sn + c.obb.halfHeight * cs;
+		box.minX = c.obb.x - ex;
+		box.minY = c.obb.y - ey;
+		box.maxX = c.obb.x + ex;
+		box.maxY = c.obb.y + ey;
+		break;
+	}
+	}
+	return box;
+}
+
+//=============================================================================
+// Convert a box to an OBB without rotation
+//=============================================================================
+OBB collision::toObb(const AABB& b)
+{
+	OBB o = { (b.minX + b.maxX) * 0.5f, (b.minY + b.maxY) * 0.5f,
+		(b.maxX - b.minX) * 0.5f, (b.maxY - b.minY) * 0.5f, 0 };
+	return o;
+}
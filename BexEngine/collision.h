@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmath>
+#include "constants.h"
+
+// Axis aligned bounding box.
+struct AABB
+{
+	float minX, minY;
+	float maxX, maxY;
+};
+
+// Circle.
+struct Circle
+{
+	float x, y;                 // center
+	float radius;
+};
+
+// Oriented bounding box.
+struct OBB
+{
+	float x, y;                 // center
+	float halfWidth, halfHeight;
+	float angle;                // rotation in radians
+};
+
+// Result of a narrowphase test.
+// normal points from the first shape to the second, moving the second shape
+// by normal * depth separates the shapes.
+struct Contact
+{
+	float normalX, normalY;
+	float depth;                // penetration depth, >= 0
+};
+
+namespace collisionNS
+{
+	// collider shapes
+	const int SHAPE_CIRCLE = 0;
+	const int SHAPE_AABB = 1;
+	const int SHAPE_OBB = 2;
+}
+
+// Collision shape of a body.
+struct Collider
+{
+	int  shape;                 // collisionNS shape
+	union
+	{
+		Circle circle;
+		AABB  box;
+		OBB   obb;
+	};
+};
+
+// Narrowphase tests.
+// Each test returns true if the shapes overlap and, when contact is not
+// nullptr, fills in the separating normal and depth.
+namespace collision
+{
+	// Return true if a and b overlap, touching boxes overlap.
+	inline bool overlaps(const AABB& a, const AABB& b)
+	{
+		return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+	}
+
+	bool circleCircle(const Circle& a, const Circle& b, Contact* contact = nullptr);
+	bool aabbAabb(const AABB& a, const AABB& b, Contact* contact = nullptr);
+	bool circleAabb(const Circle& a, const AABB& b, Contact* contact = nullptr);
+	bool circleObb(const Circle& a, const OBB& b, Contact* contact = nullptr);
+	bool obbObb(const OBB& a, const OBB& b, Contact* contact = nullptr);
+
+	// Test two colliders of any shape.
+	bool collide(const Collider& a, const Collider& b, Contact* contact = nullptr);
+
+	// Return the bounding box of a collider, used as broadphase proxy.
+	AABB bounds(const Collider& c);
+
+	// Convert a box to an OBB without rotation.
+	OBB  toObb(const AABB& b);
+}
@@ -2,7 +2,7 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
 
-#include <windows.h>
+#include "platform.h"
 #include <string>
 
 //-----------------------------------------------
@@ -31,6 +31,8 @@ const float FRAME_RATE = 200.0f;               // the target frame rate (frames/
 const float MIN_FRAME_RATE = 10.0f;             // the minimum frame rate
 const float MIN_FRAME_TIME = 1.0f / FRAME_RATE;   // minimum desired time for 1 frame
 const float MAX_FRAME_TIME = 1.0f / MIN_FRAME_RATE; // maximum time used in calculations
+const float TICK_RATE = 60.0f;                  // simulation ticks/sec in fixed timestep mode
+const UINT MAX_TICKS_PER_FRAME = 5;             // max catch-up ticks per frame, excess ticks are dropped
 
 // key mappings
 // In this game simple constants are used for key mappings. If variables were used
@@ -0,0 +1,284 @@
+#include "controllerService.h"
+#include "framePacer.h"
+#include <chrono>
+#include <cstring>
+
+//=============================================================================
+// Constructor
+//=============================================================================
+FakeControllerDevice::FakeControllerDevice()
+{
+	memset(states, 0, sizeof(states));
+	memset(vibrations, 0, sizeof(vibrations));
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+		connected[i] = false;
+	probeDelay = 0;
+	stateCalls = 0;
+	vibrationCalls = 0;
+}
+
+//=============================================================================
+// Connect or disconnect controller n
+//=============================================================================
+void FakeControllerDevice::connect(DWORD n, bool c)
+{
+	if (n >= MAX_CONTROLLERS)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	connected[n] = c;
+}
+
+//=============================================================================
+// Set the gamepad of controller n
+//=============================================================================
+void FakeControllerDevice::setGamepad(DWORD n, const XINPUT_GAMEPAD& gamepad)
+{
+	if (n >= MAX_CONTROLLERS)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	states[n].Gamepad = gamepad;
+	++states[n].dwPacketNumber;
+}
+
+//=============================================================================
+// Return the motor speeds last set on controller n
+//=============================================================================
+XINPUT_VIBRATION FakeControllerDevice::getVibration(DWORD n) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return vibrations[n < MAX_CONTROLLERS ? n : MAX_CONTROLLERS - 1];
+}
+
+//=============================================================================
+// Read the state of controller n, an empty slot takes the probe delay
+//=============================================================================
+DWORD FakeControllerDevice::getState(DWORD n, XINPUT_STATE* state)
+{
+	++stateCalls;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (n < MAX_CONTROLLERS && connected[n])
+		{
+			*state = states[n];
+			return ERROR_SUCCESS;
+		}
+	}
+	double end = FramePacer::now() + probeDelay;
+	while (FramePacer::now() < end)
+		;
+	return ERROR_DEVICE_NOT_CONNECTED;
+}
+
+//=============================================================================
+// Set the motor speeds of controller n
+//=============================================================================
+DWORD FakeControllerDevice::setState(DWORD n, XINPUT_VIBRATION* vibration)
+{
+	++vibrationCalls;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (n >= MAX_CONTROLLERS || !connected[n])
+		return ERROR_DEVICE_NOT_CONNECTED;
+	vibrations[n] = *vibration;
+	return ERROR_SUCCESS;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+ControllerService::ControllerService()
+{
+	device = &xinput;
+	pollRate = 0;
+	quit = false;
+	memset(snapshots, 0, sizeof(snapshots));
+	back = 0;
+	ready = 1;
+	front = 2;
+	memset(states, 0, sizeof(states));
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	{
+		connected[i] = false;
+		nextProbe[i] = 0;
+		sent[i] = 0;
+		resend[i] = false;
+		vibration[i] = 0;
+	}
+	lastRescan = 0;
+	rescanRequested = false;
+	polls = 0;
+	probes = 0;
+	vibrations = 0;
+	pollNanos = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+ControllerService::~ControllerService()
+{
+	stop();
+}
+
+//=============================================================================
+// Probe all slots and start polling device
+// Throws GameError
+//=============================================================================
+void ControllerService::start(ControllerDevice* dev, double rate)
+{
+	stop();
+	device = dev ? dev : &xinput;
+	pollRate = rate > 0 ? rate : 0;
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+		connected[i] = false;
+	// the first poll probes every slot
+	lastRescan = FramePacer::now() - controllerNS::RESCAN_INTERVAL;
+	rescanRequested = true;
+	poll();
+	if (pollRate == 0)
+		return;
+	quit = false;
+	try{
+		thread = std::thread(&ControllerService::pollLoop, this);
+	}
+	catch (...)
+	{
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error starting the controller thread"));
+	}
+}
+
+//=============================================================================
+// Stop the thread
+//=============================================================================
+void ControllerService::stop()
+{
+	if (!thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+//=============================================================================
+// Polling thread main loop, polls at pollRate until stop()
+//=============================================================================
+void ControllerService::pollLoop()
+{
+	const std::chrono::nanoseconds period((long long)(1e9 / pollRate));
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		next += period;
+		// a long stall skips the missed polls instead of catching up
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (next < now)
+			next = now;
+		if (wake.wait_until(lock, next, [this] { return quit; }))
+			return;
+		lock.unlock();
+		poll();
+		lock.lock();
+	}
+}
+
+//=============================================================================
+// Read the controllers, send changed motor speeds and publish a snapshot
+//=============================================================================
+void ControllerService::poll()
+{
+	double start = FramePacer::now();
+	bool rescan = false;
+	if (start - lastRescan >= controllerNS::RESCAN_INTERVAL && rescanRequested.exchange(false))
+	{
+		lastRescan = start;
+		rescan = true;
+	}
+
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	{
+		if (connected[i])
+		{
+			if (device->getState(i, &states[i]) != ERROR_SUCCESS)
+			{
+				connected[i] = false;
+				nextProbe[i] = start + controllerNS::PROBE_INTERVAL;
+			}
+		}
+		else if (rescan || start >= nextProbe[i])
+		{
+			++probes;
+			if (device->getState(i, &states[i]) == ERROR_SUCCESS)
+			{
+				connected[i] = true;
+				resend[i] = true;       // send the motor speeds once
+			}
+			// after a rescan the probes of the empty slots are spread over the interval
+			if (rescan)
+				nextProbe[i] = start + controllerNS::PROBE_INTERVAL * (i + 1) / MAX_CONTROLLERS;
+			else
+				nextProbe[i] = start + controllerNS::PROBE_INTERVAL;
+		}
+
+		DWORD wanted = vibration[i];
+		if (connected[i] && (wanted != sent[i] || resend[i]))
+		{
+			XINPUT_VIBRATION v;
+			v.wLeftMotorSpeed = (WORD)(wanted >> 16);
+			v.wRightMotorSpeed = (WORD)wanted;
+			device->setState(i, &v);
+			sent[i] = wanted;
+			resend[i] = false;
+			++vibrations;
+		}
+	}
+
+	ControllerSnapshot& s = snapshots[back];
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	{
+		s.connected[i] = connected[i];
+		if (connected[i])
+			s.state[i] = states[i];
+		else
+			memset(&s.state[i], 0, sizeof(XINPUT_STATE));
+	}
+	s.poll = ++polls;
+	back = ready.exchange(back | controllerNS::SNAPSHOT_NEW, std::memory_order_acq_rel) & 3;
+	pollNanos += (UINT64)((FramePacer::now() - start) * 1e9);
+}
+
+//=============================================================================
+// Return the newest snapshot
+//=============================================================================
+const ControllerSnapshot& ControllerService::read()
+{
+	if (ready.load(std::memory_order_acquire) & controllerNS::SNAPSHOT_NEW)
+		front = ready.exchange(front, std::memory_order_acq_rel) & 3;
+	return snapshots[front];
+}
+
+//=============================================================================
+// Set the motor speeds of controller n
+//=============================================================================
+void ControllerService::setVibration(UINT n, WORD left, WORD right)
+{
+	if (n >= MAX_CONTROLLERS)
+		return;
+	vibration[n] = (DWORD)left << 16 | right;
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+ControllerStats ControllerService::getStats() const
+{
+	ControllerStats s;
+	s.polls = polls;
+	s.probes = probes;
+	s.vibrations = vibrations;
+	s.pollTime = pollNanos / 1e9;
+	s.pollRate = thread.joinable() ? pollRate : 0;
+	return s;
+}
@@ -0,0 +1,216 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#ifdef _WIN32
+#include <XInput.h>
+#endif
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "constants.h"
+#include "gameError.h"
+
+#ifndef _WIN32
+// XInput types for platforms without XInput. No controller is ever connected.
+typedef struct _XINPUT_GAMEPAD
+{
+	WORD  wButtons;
+	BYTE  bLeftTrigger;
+	BYTE  bRightTrigger;
+	SHORT sThumbLX;
+	SHORT sThumbLY;
+	SHORT sThumbRX;
+	SHORT sThumbRY;
+} XINPUT_GAMEPAD;
+
+typedef struct _XINPUT_STATE
+{
+	DWORD dwPacketNumber;
+	XINPUT_GAMEPAD Gamepad;
+} XINPUT_STATE;
+
+typedef struct _XINPUT_VIBRATION
+{
+	WORD wLeftMotorSpeed;
+	WORD wRightMotorSpeed;
+} XINPUT_VIBRATION;
+
+inline DWORD XInputGetState(DWORD, XINPUT_STATE*)     { return ERROR_DEVICE_NOT_CONNECTED; }
+inline DWORD XInputSetState(DWORD, XINPUT_VIBRATION*) { return ERROR_DEVICE_NOT_CONNECTED; }
+#endif
+
+const DWORD MAX_CONTROLLERS = 4;                                // Maximum number of controllers supported by XInput
+
+namespace controllerNS
+{
+	const double POLL_RATE = 250;           // default polls per second
+	const double PROBE_INTERVAL = 2.0;      // seconds between probes of an empty slot
+	const double RESCAN_INTERVAL = 0.25;    // least seconds between rescans of all empty slots
+	const UINT SNAPSHOT_NEW = 4;            // flag of a published snapshot index
+}
+
+// Interface to the controller hardware, XInputGetState and XInputSetState.
+// Called by the polling thread only.
+class ControllerDevice
+{
+public:
+	// Destructor
+	virtual ~ControllerDevice() {}
+
+	// Read the state of controller n.
+	// Returns ERROR_SUCCESS or ERROR_DEVICE_NOT_CONNECTED
+	virtual DWORD getState(DWORD n, XINPUT_STATE* state) = 0;
+
+	// Set the motor speeds of controller n.
+	virtual DWORD setState(DWORD n, XINPUT_VIBRATION* vibration) = 0;
+};
+
+// The XInput controllers.
+class XInputDevice final : public ControllerDevice
+{
+public:
+	DWORD getState(DWORD n, XINPUT_STATE* state) override { return XInputGetState(n, state); }
+	DWORD setState(DWORD n, XINPUT_VIBRATION* vibration) override { return XInputSetState(n, vibration); }
+};
+
+// Controllers set by the program, to run and test gamepad input without
+// hardware. An empty slot may be made slow to probe like XInput.
+// Thread safe.
+class FakeControllerDevice final : public ControllerDevice
+{
+public:
+	// Constructor, no controller connected.
+	FakeControllerDevice();
+
+	// Connect or disconnect controller n.
+	void    connect(DWORD n, bool connected);
+
+	// Set the buttons, triggers and thumbsticks of controller n, advances its packet number.
+	void    setGamepad(DWORD n, const XINPUT_GAMEPAD& gamepad);
+
+	// Return the motor speeds last set on controller n.
+	XINPUT_VIBRATION getVibration(DWORD n) const;
+
+	// Busy wait sec seconds in every probe of an empty slot.
+	void    setProbeDelay(double sec) { probeDelay = sec; }
+
+	// Return number of getState() calls.
+	UINT64  getStateCalls() const { return stateCalls; }
+
+	// Return number of setState() calls.
+	UINT64  getVibrationCalls() const { return vibrationCalls; }
+
+	DWORD   getState(DWORD n, XINPUT_STATE* state) override;
+	DWORD   setState(DWORD n, XINPUT_VIBRATION* vibration) override;
+
+private:
+	mutable std::mutex mutex;               // guards the controllers
+	XINPUT_STATE states[MAX_CONTROLLERS];
+	XINPUT_VIBRATION vibrations[MAX_CONTROLLERS];
+	bool    connected[MAX_CONTROLLERS];
+	std::atomic<double> probeDelay;
+	std::atomic<UINT64> stateCalls;
+	std::atomic<UINT64> vibrationCalls;
+};
+
+// State of all controllers at one poll.
+struct ControllerSnapshot
+{
+	XINPUT_STATE state[MAX_CONTROLLERS];
+	bool    connected[MAX_CONTROLLERS];
+	UINT64  poll;                           // number of the poll
+};
+
+// Controller service statistics.
+struct ControllerStats
+{
+	UINT64  polls;
+	UINT64  probes;                         // getState() calls on empty slots
+	UINT64  vibrations;                     // setState() calls
+	double  pollTime;                       // seconds spent polling
+	double  pollRate;                       // polls per second, 0 when polled by the game
+};
+
+// Reads the controllers on a thread of its own at a fixed rate.
+// Every poll publishes a snapshot through a triple buffer, so the game takes
+// the newest one with one atomic exchange and never waits for the device.
+// Connected controllers are read every poll. Empty slots are slow to probe,
+// each is probed every PROBE_INTERVAL seconds, staggered, and rescan() probes
+// all of them at the next poll at most every RESCAN_INTERVAL seconds. The
+// game sets the wanted motor speeds, the thread sends them only when they
+// changed or the controller reconnected.
+class ControllerService final
+{
+public:
+	// Constructor
+	ControllerService();
+
+	// Destructor, stops the thread.
+	~ControllerService();
+
+	// Probe all slots and start polling device, nullptr for XInput.
+	// With pollRate 0 there is no thread and poll() is called by the game.
+	// Throws GameError if the thread can not be started
+	void    start(ControllerDevice* device, double pollRate = controllerNS::POLL_RATE);
+
+	// Stop the thread.
+	void    stop();
+
+	// Read the controllers and publish a snapshot. Called by the thread,
+	// or by the game when started with pollRate 0.
+	void    poll();
+
+	// Return the newest snapshot. The reference is valid until the next read().
+	// Call from one thread only, the game thread.
+	const ControllerSnapshot& read();
+
+	// Set the motor speeds of controller n, sent by the next poll. Any thread.
+	void    setVibration(UINT n, WORD left, WORD right);
+
+	// Probe all empty slots at the next poll, after WM_DEVICECHANGE. Any thread.
+	void    rescan() { rescanRequested = true; }
+
+	// Return true while the polling thread runs.
+	bool    isThreaded() const { return thread.joinable(); }
+
+	// Return statistics.
+	ControllerStats getStats() const;
+
+private:
+	XInputDevice xinput;
+	ControllerDevice* device;               // xinput or set by start()
+	double  pollRate;
+	std::thread thread;
+	std::mutex mutex;                       // for the wait between polls
+	std::condition_variable wake;
+	bool    quit;                           // guarded by mutex
+
+	// triple buffer, the poll thread fills back and swaps it with ready
+	ControllerSnapshot snapshots[3];
+	std::atomic<UINT> ready;                // index, SNAPSHOT_NEW when the game did not take it
+	UINT    back;                           // poll thread
+	UINT    front;                          // game thread
+
+	// poll thread state
+	XINPUT_STATE states[MAX_CONTROLLERS];
+	bool    connected[MAX_CONTROLLERS];
+	double  nextProbe[MAX_CONTROLLERS];     // time of the next probe of an empty slot
+	DWORD   sent[MAX_CONTROLLERS];          // motor speeds last sent, left << 16 | right
+	bool    resend[MAX_CONTROLLERS];        // send the motor speeds even if unchanged
+	double  lastRescan;
+	std::atomic<DWORD> vibration[MAX_CONTROLLERS];  // wanted motor speeds
+	std::atomic<bool> rescanRequested;
+
+	std::atomic<UINT64> polls;
+	std::atomic<UINT64> probes;
+	std::atomic<UINT64> vibrations;
+	std::atomic<UINT64> pollNanos;
+
+	ControllerService(const ControllerService&);    // no copies
+	ControllerService& operator=(const ControllerService&);
+
+	// Polling thread main loop.
+	void    pollLoop();
+};
@@ -0,0 +1,434 @@
+#include "d3d9Backend.h"
+#include <cstring>
+
+#ifdef _WIN32
+
+//=============================================================================
+// Constructor
+//=============================================================================
+D3D9Backend::D3D9Backend()
+{
+	direct3d = nullptr;
+	device3d = nullptr;
+	spriteVB = nullptr;
+	spriteIB = nullptr;
+	fullscreen = false;
+	hwnd = nullptr;
+	// width & height are replaced in initialize()
+	width = GAME_WIDTH;    
+	height = GAME_HEIGHT;
+	result = E_FAIL;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+D3D9Backend::~D3D9Backend()
+{
+	releaseAll();
+}
+
+//=============================================================================
+// Release all
+//=============================================================================
+void D3D9Backend::releaseAll()
+{
+	SAFE_RELEASE(spriteVB);
+	SAFE_RELEASE(spriteIB);
+	SAFE_RELEASE(device3d);
+	SAFE_RELEASE(direct3d);
+}
+
+//=============================================================================
+// Initialize DirectX graphics
+// throws GameError on error
+//=============================================================================
+void D3D9Backend::initialize(HWND hw, int w, int h, bool full)
+{
+	hwnd = hw;
+	width = w;
+	height = h;
+	fullscreen = full;
+
+	//initialize Direct3D
+	direct3d = Direct3DCreate9(D3D_SDK_VERSION);
+	if (!direct3d)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error initializing Direct3D"));
+
+	// init D3D presentation parameters
+	initD3DPresentaionParameters();
+
+	// handle any graphics compatibility issues and return concluded device behavior
+	DWORD behavior = handleGraphicsCompatibility();
+
+	//create Direct3D device
+	result = direct3d->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hwnd, behavior, &d3dpp, &device3d);
+
+	if (FAILED(result))
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error creating Direct3D device"));
+
+	if (FAILED(createSpriteBuffers()))
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error creating sprite buffers"));
+}
+
+//=============================================================================
+// Initialize D3D presentation parameters
+//=============================================================================
+void D3D9Backend::initD3DPresentaionParameters()
+{
+	try{
+		// fill the structure with 0
+		ZeroMemory(&d3dpp, sizeof(d3dpp));
+		// fill in the parameters we need
+		d3dpp.BackBufferWidth = width;
+		d3dpp.BackBufferHeight = height;
+		// if fullscreen
+		if (fullscreen)
+			// 24 bit color                                 
+			d3dpp.BackBufferFormat = D3DFMT_X8R8G8B8;
+		else
+			// use desktop setting
+			d3dpp.BackBufferFormat = D3DFMT_UNKNOWN;
+		d3dpp.BackBufferCount = 1;
+		d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+		d3dpp.hDeviceWindow = hwnd;
+		d3dpp.Windowed = (!fullscreen);
+		d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+	}
+	catch (...)
+	{
+		throw(GameError(gameErrorNS::FATAL_ERROR,
+			"Error initializing D3D presentation parameters"));
+
+	}
+}
+
+//=============================================================================
+// Clear backbuffer and BeginScene()
+//=============================================================================
+HRESULT D3D9Backend::beginScene(COLOR_ARGB backColor)
+{
+	result = E_FAIL;
+	if (device3d == nullptr)
+		return result;
+	// clear backbuffer to backColor
+	device3d->Clear(0, nullptr, D3DCLEAR_TARGET, backColor, 1.0F, 0);
+	result = device3d->BeginScene();          // begin scene for drawing
+	return result;
+}
+
+//=============================================================================
+// EndScene()
+//=============================================================================
+HRESULT D3D9Backend::endScene()
+{
+	result = E_FAIL;
+	if (device3d)
+		result = device3d->EndScene();
+	return result;
+}
+
+//=============================================================================
+// Display the backbuffer
+//=============================================================================
+HRESULT D3D9Backend::present()
+{
+	// default to fail, replace on success
+	result = E_FAIL;
+	if (device3d == nullptr)
+		return result;
+	// Display backbuffer to screen
+	result = device3d->Present(nullptr, nullptr, nullptr, nullptr);
+	return result;
+}
+
+//=============================================================================
+// Checks the adapter to see if it is compatible with the BackBuffer height,
+// width and refresh rate specified in d3dpp. Fills in the pMode structure with
+// the format of the compatible mode, if found.
+// Pre: d3dpp is initialized.
+// Post: Returns true if compatible mode found and pMode structure is filled.
+//       Returns false if no compatible mode found.
+//=============================================================================
+bool D3D9Backend::isAdapterCompatible()
+{
+	UINT modes = direct3d->GetAdapterModeCount(D3DADAPTER_DEFAULT, d3dpp.BackBufferFormat);
+	for (UINT i = 0; i < modes; ++i)
+	{
+		result = direct3d->EnumAdapterModes(D3DADAPTER_DEFAULT, d3dpp.BackBufferFormat, i, &pMode);
+		if (pMode.Height == d3dpp.BackBufferHeight && pMode.Width == d3dpp.BackBufferWidth && pMode.RefreshRate >= d3dpp.FullScreen_RefreshRateInHz)
+			return true;
+	}
+	return false;
+}
+
+//=============================================================================
+// Test for lost device
+//=============================================================================
+HRESULT D3D9Backend::getDeviceState()
+{
+	// default to fail, replace on success
+	result = E_FAIL;    
+	if (device3d == nullptr)
+		return  result;
+	result = device3d->TestCooperativeLevel();
+	return result;
+}
+
+//=============================================================================
+// Reset the graphics device
+//=============================================================================
+HRESULT D3D9Backend::reset()
+{
+	// default to fail, replace on success
+	result = E_FAIL;    
+	// init D3D presentation parameters
+	initD3DPresentaionParameters();                        
+	// D3DPOOL_DEFAULT resources must be released before reset
+	SAFE_RELEASE(spriteVB);
+	// attempt to reset graphics device
+	result = device3d->Reset(&d3dpp);   
+	if (FAILED(result))
+		return result;
+	// recreate the ring vertex buffer
+	result = createSpriteBuffers();
+	return result;
+}
+
+//=============================================================================
+// Handle any graphics compatibility issues and return concluded device behavior
+//=============================================================================
+DWORD D3D9Backend::handleGraphicsCompatibility()
+{
+	// if full-screen mode
+	if (fullscreen)
+	{
+		// is the adapter compatible
+		if (isAdapterCompatible())
+			// set the refresh rate with a compatible one
+			d3dpp.FullScreen_RefreshRateInHz = pMode.RefreshRate;
+		else
+			throw(GameError(gameErrorNS::FATAL_ERROR,
+			"The graphics device does not support the specified resolution and/or format."));
+	}
+
+	// determine if graphics card supports hardware texturing and lighting and vertex shaders
+	D3DCAPS9 caps;
+	result = direct3d->GetDeviceCaps(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &caps);
+	// If device doesn't support HW T&L or doesn't support 1.1 vertex 
+	// shaders in hardware, then switch to software vertex processing.
+	if ((caps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT) == 0 || caps.VertexShaderVersion < D3DVS_VERSION(1, 1))
+		// use software only processing
+		 return D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+	else
+		// use hardware only processing
+		return D3DCREATE_HARDWARE_VERTEXPROCESSING;
+}
+
+
+//=============================================================================
+// Create the sprite vertex and index buffers if they do not exist.
+// The vertex buffer is a dynamic ring written by SpriteBatch, the index buffer
+// holds the indices of MAX_BATCH_QUADS quads and survives a device reset.
+//=============================================================================
+HRESULT D3D9Backend::createSpriteBuffers()
+{
+	if (spriteVB == nullptr)
+	{
+		result = device3d->CreateVertexBuffer(spriteBatchNS::RING_VERTICES * sizeof(SpriteVertex),
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, SPRITE_FVF, D3DPOOL_DEFAULT, &spriteVB, nullptr);
+		if (FAILED(result))
+			return result;
+	}
+
+	if (spriteIB == nullptr)
+	{
+		const UINT indexCount = spriteBatchNS::MAX_BATCH_QUADS * 6;
+		result = device3d->CreateIndexBuffer(indexCount * sizeof(WORD), D3DUSAGE_WRITEONLY,
+			D3DFMT_INDEX16, D3DPOOL_MANAGED, &spriteIB, nullptr);
+		if (FAILED(result))
+			return result;
+
+		WORD* indices = nullptr;
+		result = spriteIB->Lock(0, 0, (void**)&indices, 0);
+		if (FAILED(result))
+			return result;
+		// quad vertices are top left, top right, bottom left, bottom right
+		for (UINT q = 0; q < spriteBatchNS::MAX_BATCH_QUADS; q++)
+		{
+			WORD v = (WORD)(q * 4);
+			indices[q * 6 + 0] = v;
+			indices[q * 6 + 1] = v + 1;
+			indices[q * 6 + 2] = v + 2;
+			indices[q * 6 + 3] = v + 2;
+			indices[q * 6 + 4] = v + 1;
+			indices[q * 6 + 5] = v + 3;
+		}
+		result = spriteIB->Unlock();
+	}
+	return result;
+}
+
+//=============================================================================
+// Set the fixed function state shared by all sprite draws
+//=============================================================================
+void D3D9Backend::beginSprites()
+{
+	if (device3d == nullptr)
+		return;
+	device3d->SetFVF(SPRITE_FVF);
+	device3d->SetStreamSource(0, spriteVB, 0, sizeof(SpriteVertex));
+	device3d->SetIndices(spriteIB);
+	device3d->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device3d->SetRenderState(D3DRS_LIGHTING, FALSE);
+	device3d->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+	device3d->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+	device3d->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+}
+
+//=============================================================================
+// Draw a one pixel wide, alpha blended line
+//=============================================================================
+void D3D9Backend::drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color)
+{
+	if (device3d == nullptr)
+		return;
+	SpriteVertex v[2] = {
+		{ x1 - 0.5f, y1 - 0.5f, 0.0f, 1.0f, color, 0.0f, 0.0f },
+		{ x2 - 0.5f, y2 - 0.5f, 0.0f, 1.0f, color, 0.0f, 0.0f } };
+	device3d->SetFVF(SPRITE_FVF);
+	setSpriteState(nullptr, spriteBatchNS::BLEND_ALPHA);
+	device3d->DrawPrimitiveUP(D3DPT_LINELIST, 1, v, sizeof(SpriteVertex));
+}
+
+//=============================================================================
+// Create a texture
+// Returns nullptr on failure
+//=============================================================================
+void* D3D9Backend::createTexture(int w, int h, const uint32_t* pixels, int pool)
+{
+	if (device3d == nullptr || w <= 0 || h <= 0 || pixels == nullptr)
+		return nullptr;
+	bool video = pool == graphicsNS::POOL_DEFAULT;
+	LP_TEXTURE texture = nullptr;
+	result = device3d->CreateTexture(w, h, 1, video ? D3DUSAGE_DYNAMIC : 0, D3DFMT_A8R8G8B8,
+		video ? D3DPOOL_DEFAULT : D3DPOOL_MANAGED, &texture, nullptr);
+	if (FAILED(result))
+		return nullptr;
+
+	D3DLOCKED_RECT rect;
+	result = texture->LockRect(0, &rect, nullptr, video ? D3DLOCK_DISCARD : 0);
+	if (FAILED(result))
+	{
+		texture->Release();
+		return nullptr;
+	}
+	for (int y = 0; y < h; y++)
+		memcpy((BYTE*)rect.pBits + y * rect.Pitch, pixels + (size_t)y * w, w * sizeof(uint32_t));
+	texture->UnlockRect(0);
+	return texture;
+}
+
+//=============================================================================
+// Copy pixels into a texture created by createTexture()
+// Returns false on failure
+//=============================================================================
+bool D3D9Backend::updateTexture(void* t, const uint32_t* pixels)
+{
+	LP_TEXTURE texture = (LP_TEXTURE)t;
+	D3DSURFACE_DESC desc;
+	if (texture == nullptr || pixels == nullptr || FAILED(texture->GetLevelDesc(0, &desc)))
+		return false;
+	D3DLOCKED_RECT rect;
+	result = texture->LockRect(0, &rect, nullptr, desc.Pool == D3DPOOL_DEFAULT ? D3DLOCK_DISCARD : 0);
+	if (FAILED(result))
+		return false;
+	for (UINT y = 0; y < desc.Height; y++)
+		memcpy((BYTE*)rect.pBits + y * rect.Pitch, pixels + (size_t)y * desc.Width, desc.Width * sizeof(uint32_t));
+	texture->UnlockRect(0);
+	return true;
+}
+
+//=============================================================================
+// Release a texture created by createTexture()
+//=============================================================================
+void D3D9Backend::releaseTexture(void* texture)
+{
+	if (texture)
+		((LP_TEXTURE)texture)->Release();
+}
+
+//=============================================================================
+// Lock count vertices of the sprite ring vertex buffer starting at offset
+//=============================================================================
+SpriteVertex* D3D9Backend::lockVertices(unsigned int offset, unsigned int count, bool discard)
+{
+	if (spriteVB == nullptr)
+		return nullptr;
+	void* data = nullptr;
+	// no overwrite promises the driver that the vertices in use are not touched
+	DWORD flags = discard ? D3DLOCK_DISCARD : D3DLOCK_NOOVERWRITE;
+	result = spriteVB->Lock(offset * sizeof(SpriteVertex), count * sizeof(SpriteVertex), &data, flags);
+	if (FAILED(result))
+		return nullptr;
+	return (SpriteVertex*)data;
+}
+
+//=============================================================================
+// Unlock the sprite ring vertex buffer
+//=============================================================================
+void D3D9Backend::unlockVertices()
+{
+	spriteVB->Unlock();
+}
+
+//=============================================================================
+// Set the texture and blend state of the following sprite draws
+//=============================================================================
+void D3D9Backend::setSpriteState(void* texture, int blend)
+{
+	device3d->SetTexture(0, (LP_TEXTURE)texture);
+	if (texture)
+	{
+		// texture color and alpha modulated by the vertex color
+		device3d->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_MODULATE);
+		device3d->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_MODULATE);
+	}
+	else
+	{
+		// solid rectangles use the vertex color only
+		device3d->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG2);
+		device3d->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG2);
+	}
+	device3d->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+	device3d->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_DIFFUSE);
+	device3d->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+	device3d->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+
+	switch (blend)
+	{
+	case spriteBatchNS::BLEND_OPAQUE:
+		device3d->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+		break;
+	case spriteBatchNS::BLEND_ADDITIVE:
+		device3d->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+		device3d->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+		device3d->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_ONE);
+		break;
+	default:
+		device3d->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+		device3d->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+		device3d->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+		break;
+	}
+}
+
+//=============================================================================
+// Draw quadCount quads starting at vertex baseVertex of the ring
+//=============================================================================
+void D3D9Backend::drawQuads(unsigned int baseVertex, unsigned int quadCount)
+{
+	device3d->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, baseVertex, 0, quadCount * 4, 0, quadCount * 2);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#ifdef _WIN32
+
+#ifdef _DEBUG
+#define D3D_DEBUG_INFO
+#endif
+#include <d3d9.h>
+#include <d3dx9.h>
+#include "renderBackend.h"
+
+// DirectX pointer types
+#define LP_3DDEVICE LPDIRECT3DDEVICE9
+#define LP_3D       LPDIRECT3D9
+#define LP_TEXTURE  LPDIRECT3DTEXTURE9
+#define LP_VERTEXBUFFER LPDIRECT3DVERTEXBUFFER9
+#define LP_INDEXBUFFER  LPDIRECT3DINDEXBUFFER9
+
+// Vertex format of SpriteVertex
+#define SPRITE_FVF (D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1)
+
+// Direct3D 9 rendering backend
+class D3D9Backend final : public RenderBackend
+{
+public:
+	// Constructor
+	D3D9Backend();
+
+	// Destructor
+	virtual ~D3D9Backend();
+
+	// Initialize DirectX graphics
+	// Throws GameError on error
+	// Pre: hw = handle to window
+	//      width = width in pixels
+	//      height = height in pixels
+	//      fullscreen = true for full screen, false for window
+	void    initialize(HWND hw, int width, int height, bool fullscreen) override;
+
+	// Releases direct3d and device3d.
+	void    releaseAll() override;
+
+	// Clear backbuffer and BeginScene()
+	HRESULT beginScene(COLOR_ARGB backColor) override;
+
+	// EndScene()
+	HRESULT endScene() override;
+
+	// Display the offscreen backbuffer to the screen.
+	HRESULT present() override;
+
+	// Test for lost device
+	HRESULT getDeviceState() override;
+
+	// Reset the graphics device.
+	HRESULT reset() override;
+
+	// Set the fixed function state shared by all sprite draws.
+	void    beginSprites() override;
+
+	// Draw a line with DrawPrimitiveUP.
+	void    drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color) override;
+
+	// Create an A8R8G8B8 texture, dynamic in D3DPOOL_DEFAULT or in D3DPOOL_MANAGED.
+	void*   createTexture(int width, int height, const uint32_t* pixels, int pool) override;
+
+	// Lock the texture and copy the pixels, discarding a dynamic texture.
+	bool    updateTexture(void* texture, const uint32_t* pixels) override;
+
+	// Release a texture created by createTexture().
+	void    releaseTexture(void* texture) override;
+
+	// SpriteBatchBackend
+	SpriteVertex* lockVertices(unsigned int offset, unsigned int count, bool discard) override;
+	void unlockVertices() override;
+	void setSpriteState(void* texture, int blend) override;
+	void drawQuads(unsigned int baseVertex, unsigned int quadCount) override;
+	// D3D9 maps pixel centers at integer coordinates minus 0.5
+	float getPixelOffset() const override { return -0.5f; }
+
+	// get functions
+	// Return direct3d.
+	LP_3D   get3D()             { return direct3d; }
+
+	// Return device3d.
+	LP_3DDEVICE get3Ddevice()   { return device3d; }
+
+private:
+	// DirectX pointers and stuff
+	LP_3D       direct3d;
+	LP_3DDEVICE device3d;
+	D3DPRESENT_PARAMETERS d3dpp;
+	D3DDISPLAYMODE pMode;
+	LP_VERTEXBUFFER spriteVB;   // dynamic ring vertex buffer, D3DPOOL_DEFAULT
+	LP_INDEXBUFFER  spriteIB;   // static quad indices, D3DPOOL_MANAGED
+
+	// other variables
+	HRESULT     result;         // standard Windows return codes
+	HWND        hwnd;
+	bool        fullscreen;
+	int         width;
+	int         height;
+
+	// (For internal engine use only. No user serviceable parts inside.)
+	// Initialize D3D presentation parameters
+	void initD3DPresentaionParameters();
+	// Handle any graphics compatibility issues and return concluded device behavior
+	DWORD handleGraphicsCompatibility();
+	// Checks the adapter to see if it is compatible with the BackBuffer height,
+	// width and refresh rate specified in d3dpp. Fills in the pMode structure with
+	// the format of the compatible mode, if found.
+	// Pre: d3dpp is initialized.
+	// Post: Returns true if compatible mode found and pMode structure is filled.
+	//       Returns false if no compatible mode found.
+	bool    isAdapterCompatible();
+	// Create the sprite vertex and index buffers if they do not exist.
+	HRESULT createSpriteBuffers();
+};
+
+#endif
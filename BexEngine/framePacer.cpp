@@ -0,0 +1,224 @@
+#include "framePacer.h"
+#include "gameError.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#ifdef _WIN32
+#include <Mmsystem.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#ifdef _WIN32
+// high resolution waitable timers, Windows 10 1803 and later
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+//=============================================================================
+// Constructor
+//=============================================================================
+FramePacer::FramePacer()
+{
+#ifdef _WIN32
+	timer = nullptr;
+	highResTimer = false;
+	timerPeriodSet = false;
+#endif
+	// start with a pessimistic guess, learned in waitUntil()
+	sleepSlack = 0.001;
+	errors.resize(framePacerNS::ERROR_SAMPLES, 0.0f);
+	errorIndex = 0;
+	frameCount = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if (timer)
+		CloseHandle(timer);
+	if (timerPeriodSet)
+		timeEndPeriod(1);           // End 1mS timer resolution
+#endif
+}
+
+//=============================================================================
+// Create the timer resources
+// Throws GameError
+//=============================================================================
+void FramePacer::initialize()
+{
+#ifdef _WIN32
+	if (timer)
+		return;
+	// prefer a high resolution timer, it does not need the global timer period
+	timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	highResTimer = (timer != nullptr);
+	if (!highResTimer)
+	{
+		timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		if (!timer)
+			throw(GameError(gameErrorNS::FATAL_ERROR, "Error creating frame pacer timer"));
+		// Request 1mS resolution for windows timer once, not on every frame
+		timerPeriodSet = (timeBeginPeriod(1) == TIMERR_NOERROR);
+	}
+#endif
+}
+
+//=============================================================================
+// Return the current time in seconds from a monotonic high resolution clock
+//=============================================================================
+double FramePacer::now()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq = { 0 };
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+//=============================================================================
+// Return true if the message queue of the calling thread has input or a message
+//=============================================================================
+bool FramePacer::hasMessages()
+{
+#ifdef _WIN32
+	return HIWORD(GetQueueStatus(QS_ALLINPUT)) != 0;
+#else
+	return false;
+#endif
+}
+
+//=============================================================================
+// Sleep the calling thread for sec seconds with the coarse OS timer
+// Returns false if wakeOnMessages and a message arrived first
+//=============================================================================
+bool FramePacer::sleep(double sec, bool wakeOnMessages)
+{
+#ifdef _WIN32
+	// input already in the queue wakes the wait at once
+	const DWORD wakeMask = QS_ALLINPUT;
+	if (timer)
+	{
+		// relative due time in 100 nanosecond intervals
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)(sec * 1e7);
+		if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE))
+		{
+			if (!wakeOnMessages)
+			{
+				WaitForSingleObject(timer, INFINITE);
+				return true;
+			}
+			DWORD r = MsgWaitForMultipleObjectsEx(1, &timer, INFINITE, wakeMask, MWMO_INPUTAVAILABLE);
+			if (r == WAIT_OBJECT_0 + 1)
+			{
+				CancelWaitableTimer(timer);
+				return false;
+			}
+			return true;
+		}
+	}
+	if (!wakeOnMessages)
+	{
+		Sleep((DWORD)(sec * 1000));
+		return true;
+	}
+	return MsgWaitForMultipleObjectsEx(0, nullptr, (DWORD)(sec * 1000), wakeMask, MWMO_INPUTAVAILABLE) != WAIT_OBJECT_0;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	long long ns = (long long)ts.tv_nsec + (long long)(sec * 1e9);
+	ts.tv_sec += (time_t)(ns / 1000000000LL);
+	ts.tv_nsec = (long)(ns % 1000000000LL);
+	// absolute deadline, restart if interrupted by a signal
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+		;
+	return true;
+#endif
+}
+
+//=============================================================================
+// Wait until the time returned by now() reaches deadline.
+// Sleeps until the learned oversleep plus a margin before the deadline,
+// then yields the cpu in a spin loop for the final part.
+// Returns false if wakeOnMessages and a message arrived first
+//=============================================================================
+bool FramePacer::waitUntil(double deadline, bool wakeOnMessages)
+{
+	double t = now();
+	double sleepTime = deadline - t - sleepSlack - framePacerNS::SPIN_MARGIN;
+	if (sleepTime > 0)
+	{
+		// an early wake teaches nothing about the oversleep
+		if (!sleep(sleepTime, wakeOnMessages))
+			return false;
+		double woke = now();
+		// learn how late the coarse sleep wakes up, rise fast and decay slowly
+		double late = (woke - t) - sleepTime;
+		if (late < 0)
+			late = 0;
+		if (late > sleepSlack)
+			sleepSlack = late;
+		else
+			sleepSlack = sleepSlack * 0.95 + late * 0.05;
+		if (sleepSlack > framePacerNS::MAX_SLEEP_SLACK)
+			sleepSlack = framePacerNS::MAX_SLEEP_SLACK;
+	}
+
+	// spin for the final sub-millisecond
+	while (now() < deadline)
+	{
+		if (wakeOnMessages && hasMessages())
+			return false;
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+//=============================================================================
+// Record the duration of a completed frame
+//=============================================================================
+void FramePacer::recordFrame(double frameTime, double target)
+{
+	errors[errorIndex] = (float)std::fabs(frameTime - target);
+	errorIndex = (errorIndex + 1) % framePacerNS::ERROR_SAMPLES;
+	++frameCount;
+}
+
+//=============================================================================
+// Return the pacing error in seconds that p percent of the last recorded frames are within
+//=============================================================================
+double FramePacer::getErrorPercentile(double p) const
+{
+	unsigned int samples = frameCount < framePacerNS::ERROR_SAMPLES ? frameCount : framePacerNS::ERROR_SAMPLES;
+	if (samples == 0)
+		return 0;
+	sorted.assign(errors.begin(), errors.begin() + samples);
+	size_t n = (size_t)(p / 100.0 * (samples - 1) + 0.5);
+	if (n >= samples)
+		n = samples - 1;
+	std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+	return sorted[n];
+}
+
+//=============================================================================
+// Clear recorded pacing errors
+//=============================================================================
+void FramePacer::resetStats()
+{
+	errorIndex = 0;
+	frameCount = 0;
+}
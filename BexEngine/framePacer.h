@@ -0,0 +1,90 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <vector>
+
+namespace framePacerNS
+{
+	const double SPIN_MARGIN = 0.0002;      // seconds always spun before the deadline
+	const double MAX_SLEEP_SLACK = 0.004;   // upper limit of the expected oversleep
+	const unsigned int ERROR_SAMPLES = 1024;   // number of pacing error samples kept
+}
+
+// Frame pacer. Waits for frame deadlines with a hybrid wait: the thread sleeps
+// until shortly before the deadline and then spins/yields the final part.
+// The expected oversleep of the coarse sleep is learned so the spin stays short.
+// Windows uses a high resolution waitable timer when available, Linux uses
+// clock_nanosleep on CLOCK_MONOTONIC. A game loop with a window waits with
+// wakeOnMessages, so window messages arriving during the wait end it early.
+class FramePacer final
+{
+public:
+	// Constructor
+	FramePacer();
+
+	// Destructor
+	~FramePacer();
+
+	// Create the timer resources.
+	// Throws GameError
+	void initialize();
+
+	// Return the current time in seconds from a monotonic high resolution clock.
+	static double now();
+
+	// Wait until the time returned by now() reaches deadline.
+	// With wakeOnMessages, returns false as soon as the message queue of the
+	// calling thread has input or a message (Windows only), so the caller can
+	// pump it and wait again. Returns true at the deadline.
+	bool waitUntil(double deadline, bool wakeOnMessages = false);
+
+	// Wait for sec seconds.
+	void wait(double sec) { waitUntil(now() + sec); }
+
+	// Record the duration of a completed frame.
+	// The pacing error is the absolute difference to the target frame time.
+	// Pre: frameTime = measured frame time in seconds
+	//      target = desired frame time in seconds
+	void recordFrame(double frameTime, double target);
+
+	// Return the pacing error in seconds that p percent of the last
+	// ERROR_SAMPLES recorded frames are within.
+	// Pre: 0 <= p <= 100
+	double getErrorPercentile(double p) const;
+
+	// Return median pacing error in seconds.
+	double getErrorP50() const { return getErrorPercentile(50); }
+
+	// Return 99th percentile pacing error in seconds.
+	double getErrorP99() const { return getErrorPercentile(99); }
+
+	// Return number of frames recorded since resetStats(), the percentiles
+	// cover the last ERROR_SAMPLES of them.
+	unsigned int getFrameCount() const { return frameCount; }
+
+	// Clear recorded pacing errors.
+	void resetStats();
+
+private:
+#ifdef _WIN32
+	HANDLE timer;                       // waitable timer, nullptr if not available
+	bool   highResTimer;                // true if timer has high resolution
+	bool   timerPeriodSet;              // true if timeBeginPeriod is in effect
+#endif
+	double sleepSlack;                  // learned oversleep of the coarse sleep
+	std::vector<float> errors;          // ring buffer of pacing errors
+	unsigned int errorIndex;            // next write position in errors
+	unsigned int frameCount;            // number of recorded frames, not capped
+	mutable std::vector<float> sorted;  // scratch buffer for percentiles
+
+	// Sleep the calling thread for sec seconds with the coarse OS timer.
+	// Returns false if wakeOnMessages and a message arrived first.
+	bool sleep(double sec, bool wakeOnMessages);
+
+	// Return true if the message queue of the calling thread has input or a
+	// message, always false without Windows.
+	static bool hasMessages();
+};
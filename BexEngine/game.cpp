@@ -5,7 +5,13 @@
 //=============================================================================
 // Constructor
 //=============================================================================
-Game::Game() : paused(false), initialized(false)
+Game::Game() : frameTime(0), fps(0), paused(false), initialized(false), fixedTimestep(false),
+	tickTime(1.0f / TICK_RATE), maxTicksPerFrame(MAX_TICKS_PER_FRAME),
+	accumulator(0), interpolation(1.0f), ticksRun(0), ticksDropped(0),
+	framePacing(true), simulatedFrameTime(0), exitRequested(false),
+	frameLimit(0), frameCount(0), windowlessBackend(graphicsNS::BACKEND_HEADLESS),
+	jobThreads(0), renderThread(false), telemetryOverlay(false), audioSink(nullptr),
+	snapshotSteps(0), stepCount(0)
 {
 	// additional initialization is handled in later call to input.initialize()
 }
@@ -16,9 +22,13 @@ Game::Game() : paused(false), initialized(false)
 Game::~Game()
 {
 	deleteAll();                // free all reserved memory
+	delete audioSink;           // set but never initialized
+#ifdef _WIN32
 	ShowCursor(true);           // show cursor
+#endif
 }
 
+#ifdef _WIN32
 //=============================================================================
 // Window message handler
 //=============================================================================
@@ -31,57 +41,52 @@ LRESULT Game::messageHandler(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		case WM_DESTROY:
 			PostQuitMessage(0);        //tell Windows to kill this program
 			return 0;
+		// input is queued and applied by the next simulation tick
 		case WM_KEYDOWN: case WM_SYSKEYDOWN:    // key down
-			input.keyDown(wParam);
+			input.postEvent(inputNS::EVENT_KEY_DOWN, wParam, lParam);
 			return 0;
 		case WM_KEYUP: case WM_SYSKEYUP:        // key up
-			input.keyUp(wParam);
+			input.postEvent(inputNS::EVENT_KEY_UP, wParam, lParam);
 			return 0;
 		case WM_CHAR:                           // character entered
-			input.keyIn(wParam);
+			input.postEvent(inputNS::EVENT_CHAR, wParam, lParam);
 			return 0;
 		case WM_MOUSEMOVE:                      // mouse moved
-			input.mouseIn(lParam);
+			input.postEvent(inputNS::EVENT_MOUSE_MOVE, wParam, lParam);
 			return 0;
-		case WM_INPUT:                          // raw mouse data in
-			input.mouseRawIn(lParam);
+		case WM_INPUT:                          // raw mouse data in, also drains the queued reports
+			input.postRawInput(lParam);
 			return 0;
 		case WM_LBUTTONDOWN:                    // left mouse button down
-			input.setMouseLButton(true);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_LBUTTON_DOWN, wParam, lParam);
 			return 0;
 		case WM_LBUTTONUP:                      // left mouse button up
-			input.setMouseLButton(false);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_LBUTTON_UP, wParam, lParam);
 			return 0;
 		case WM_MBUTTONDOWN:                    // middle mouse button down
-			input.setMouseMButton(true);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_MBUTTON_DOWN, wParam, lParam);
 			return 0;
 		case WM_MBUTTONUP:                      // middle mouse button up
-			input.setMouseMButton(false);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_MBUTTON_UP, wParam, lParam);
 			return 0;
 		case WM_RBUTTONDOWN:                    // right mouse button down
-			input.setMouseRButton(true);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_RBUTTON_DOWN, wParam, lParam);
 			return 0;
 		case WM_RBUTTONUP:                      // right mouse button up
-			input.setMouseRButton(false);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_RBUTTON_UP, wParam, lParam);
 			return 0;
 		case WM_XBUTTONDOWN: case WM_XBUTTONUP: // mouse X button down/up
-			input.setMouseXButton(wParam);
-			input.mouseIn(lParam);             // mouse position
+			input.postEvent(inputNS::EVENT_XBUTTON, wParam, lParam);
 			return 0;
 		case WM_DEVICECHANGE:                   // check for controller insert
-			input.checkControllers();
+			input.postEvent(inputNS::EVENT_DEVICE_CHANGE, wParam, lParam);
 			return 0;
 		}
 	}
 	// let Windows handle it
 	return DefWindowProc(hwnd, msg, wParam, lParam);    
 }
+#endif
 
 //=============================================================================
 // Initializes the game
@@ -91,9 +96,13 @@ void Game::initialize(HWND hw)
 {
 	// save window handle
 	hwnd = hw;                                  
+	exitRequested = false;
 
+	// without a window graphics are headless or software rendered
 	// throws GameError
-	graphics.initialize(hwnd, GAME_WIDTH, GAME_HEIGHT, FULLSCREEN);
+	graphics.setRenderThread(renderThread);
+	graphics.initialize(hwnd, GAME_WIDTH, GAME_HEIGHT, FULLSCREEN,
+		hwnd ? graphicsNS::BACKEND_D3D9 : windowlessBackend);
 
 	// initialize input, do not capture mouse
 	// throws GameError
@@ -103,6 +112,47 @@ void Game::initialize(HWND hw)
 	if (QueryPerformanceFrequency(&timerFreq) == false)
 		throw(GameError(gameErrorNS::FATAL_ERROR, "Error initializing high resolution timer"));
 
+	// throws GameError
+	pacer.initialize();
+
+	// start the job threads
+	// throws GameError
+	jobs.initialize(jobThreads);
+
+	// start the asset I/O threads
+	// throws GameError
+	assets.initialize();
+
+	// throws GameError
+	frameArena.initialize();
+
+	// throws GameError
+	particles.initialize(particleNS::DEFAULT_CAPACITY);
+
+	// keep the world and the particles of the last steps for rollback
+	stepCount = 0;
+	if (snapshotSteps > 0)
+	{
+		snapshots.initialize(&world, snapshotSteps);
+		snapshots.addState(&particles);
+	}
+
+	// start the mixer, the game runs silent without a sound device
+	AudioSink* sink = audioSink;
+	audioSink = nullptr;
+#ifdef _WIN32
+	if (sink == nullptr && hwnd)
+		sink = new WaveOutSink;
+#endif
+	try
+	{
+		audio.initialize(sink);
+	}
+	catch (const GameError&)
+	{
+		audio.initialize(nullptr);  // throws GameError
+	}
+
 	// get starting time
 	QueryPerformanceCounter(&timeStart);        
 
@@ -114,21 +164,34 @@ void Game::initialize(HWND hw)
 //=============================================================================
 void Game::renderGame()
 {
+	PROFILE_ZONE("renderGame");
 	//start rendering
 	if (SUCCEEDED(graphics.beginScene()))
 	{
 		// render is a pure virtual function that must be provided in the
 		// inheriting class.
 		// call render in derived class
-		render();               
+		PROFILE_ZONE("render");
+		render(interpolation);
+		// in fixed timestep mode the particles are drawn where they were
+		// at the interpolated time
+		particles.draw(graphics, jobs, fixedTimestep ? (1 - interpolation) * tickTime : 0);
+		if (telemetryOverlay)
+			telemetry.drawOverlay(graphics);
 
 		//stop rendering
 		graphics.endScene();
 	}
+	telemetry.mark(telemetryNS::PHASE_RENDER);
 	handleLostGraphicsDevice();
 
 	//display the back buffer on the screen
-	graphics.showBackbuffer();
+	{
+		PROFILE_ZONE("showBackbuffer");
+		graphics.showBackbuffer();
+	}
+	telemetry.mark(telemetryNS::PHASE_PRESENT);
+	++frameCount;
 }
 
 //=============================================================================
@@ -142,14 +205,14 @@ void Game::handleLostGraphicsDevice()
 	if (FAILED(hr))                  
 	{
 		// if the device is lost and not available for reset
-		if (hr == D3DERR_DEVICELOST)
+		if (hr == graphicsNS::DEVICE_LOST)
 		{
 			// yield cpu time (100 mili-seconds)
 			Sleep(100);             
 			return;
 		}
 		// the device was lost but is now available for reset
-		else if (hr == D3DERR_DEVICENOTRESET)
+		else if (hr == graphicsNS::DEVICE_NOT_RESET)
 		{
 			releaseAll();
 			// attempt to reset graphics device
@@ -170,27 +233,83 @@ void Game::handleLostGraphicsDevice()
 //=============================================================================
 WPARAM Game::gameLoop(HWND hwnd)
 {
-	MSG msg;
-	// main message loop
-	bool running = true;
-	while (running)
+#ifdef _WIN32
+	if (hwnd)
 	{
-		if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		MSG msg;
+		// main message loop
+		bool running = true;
+		while (running)
 		{
-			// look for quit message
-			if (msg.message == WM_QUIT)
-				running = false;
+			if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+			{
+				// look for quit message
+				if (msg.message == WM_QUIT)
+					running = false;
 
-			// decode and pass messages on to WinProc
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
-		else
-		{
-			run(hwnd);
+				// decode and pass messages on to WinProc
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+			else
+			{
+				run(hwnd);
+			}
 		}
+		return msg.wParam;
+	}
+#endif
+	// no window, no messages
+	while (!exitRequested && (frameLimit == 0 || frameCount < frameLimit))
+		run(hwnd);
+	return 0;
+}
+
+//=============================================================================
+// Exit the game
+//=============================================================================
+void Game::exitGame()
+{
+#ifdef _WIN32
+	if (hwnd)
+	{
+		PostMessage(hwnd, WM_DESTROY, 0, 0);
+		return;
 	}
-	return msg.wParam;
+#endif
+	exitRequested = true;
+}
+
+//=============================================================================
+// Record the input of the game to filename
+// Throws GameError
+//=============================================================================
+void Game::startRecording(const std::string& filename)
+{
+	RecordingSettings settings;
+	settings.fixedTimestep = fixedTimestep;
+	settings.tickTime = tickTime;
+	settings.maxTicks = maxTicksPerFrame;
+	input.startRecording(filename, settings);
+}
+
+//=============================================================================
+// Replay recorded input as fast as possible
+// Throws GameError
+//=============================================================================
+void Game::startReplay(const std::string& filename)
+{
+	RecordingSettings settings = input.startReplay(filename);
+	// the exact tick time of the recording, not one derived from a tick rate
+	fixedTimestep = settings.fixedTimestep;
+	if (fixedTimestep)
+	{
+		tickTime = settings.tickTime;
+		maxTicksPerFrame = settings.maxTicks;
+	}
+	accumulator = 0;
+	interpolation = fixedTimestep ? 0.0f : 1.0f;
+	framePacing = false;
 }
 
 //=============================================================================
@@ -200,29 +319,217 @@ void Game::run(HWND hwnd) {
 	// Check if its time to update, if not just return
 	if (!timeToUpdate())
 		return;
+	// the time since the previous frame ended is waiting
+	telemetry.beginFrame();
+
+	// recorded frame time when replaying input
+	frameTime = input.beginFrame(frameTime);
+	if (input.isReplayDone())
+	{
+		input.stopRecording();
+		exitGame();
+		return;
+	}
+
+	// collect the profiler zones of the previous frame
+	Profiler::endFrame();
+	PROFILE_ZONE("frame");
+
+	// complete the assets loaded since the last frame
+	{
+		PROFILE_ZONE("assets");
+		assets.update();
+	}
+	telemetry.mark(telemetryNS::PHASE_OTHER);
 
-	// update(), ai(), and collisions() are pure virtual functions.
-	// These functions must be provided in the class that inherits from Game.
 	// if not paused
 	if (!paused)                    
 	{
-		// update all game items
-		update();
-		// artificial intelligence                   
-		ai(); 
-		// handle collisions                      
-		collisions();     
-		// handle controller vibration          
-		input.vibrateControllers(frameTime); 
+		if (fixedTimestep)
+			// run the ticks due this frame, sets interpolation
+			runFixedTicks();
+		else
+		{
+			// one simulation step per frame
+			simulate(timeEnd.QuadPart);
+			interpolation = 1.0f;
+		}
 	}
+	else
+	{
+		// keep the input state current for the paused game
+		input.processEvents(timeEnd.QuadPart);
+		actions.update(input);
+	}
+	// show the entities of the replication server
+	if (netClient.isActive())
+	{
+		PROFILE_ZONE("replicate");
+		netClient.update(world, frameTime);
+	}
+	telemetry.mark(telemetryNS::PHASE_SIMULATE);
 	// draw all game items
 	renderGame();       
 	// read state of controllers            
-	input.readControllers();       
+	{
+		PROFILE_ZONE("readControllers");
+		input.readControllers();
+	}
+	// free the voices that finished
+	audio.update();
 
 	// Clear input
-	// Call this after all key checks are done
-	input.clear(inputNS::KEYS_PRESSED);
+	// Call this after all key checks are done.
+	// In fixed timestep mode the ticks clear the key presses they have seen,
+	// presses made on frames without a tick are kept for the next tick.
+	if (!fixedTimestep || paused)
+		input.clear(inputNS::KEYS_PRESSED);
+
+	// frees the frame arena memory of the previous frame
+	frameArena.endFrame();
+	telemetry.mark(telemetryNS::PHASE_OTHER);
+}
+
+//=============================================================================
+// Apply the input events posted until inputTime, then run update(), ai(),
+// collisions(), the particles, the replication server and controller
+// vibration once
+//=============================================================================
+void Game::simulate(LONGLONG inputTime)
+{
+	input.processEvents(inputTime);
+	actions.update(input);
+	simulateStep();
+	// send the step to the replication clients, not the resimulated ones
+	if (netServer.isActive())
+	{
+		PROFILE_ZONE("replicate");
+		netServer.tick(world, frameTime);
+	}
+	// handle controller vibration          
+	input.vibrateControllers(frameTime); 
+}
+
+//=============================================================================
+// Run update(), ai(), collisions(), the particles and world.flush() once and
+// save the snapshot of the step
+//=============================================================================
+void Game::simulateStep()
+{
+	// update(), ai(), and collisions() are pure virtual functions.
+	// These functions must be provided in the class that inherits from Game.
+	// update all game items
+	{
+		PROFILE_ZONE("update");
+		update();
+	}
+	// artificial intelligence                   
+	{
+		PROFILE_ZONE("ai");
+		ai();
+	}
+	// handle collisions                      
+	{
+		PROFILE_ZONE("collisions");
+		collisions();
+	}
+	particles.update(frameTime, jobs);
+	// destroy the entities passed to world.destroyLater()
+	world.flush();
+	++stepCount;
+	if (snapshots.isEnabled())
+	{
+		PROFILE_ZONE("snapshot");
+		snapshots.save(stepCount);
+	}
+}
+
+//=============================================================================
+// Restore the simulation state after step
+// Throws GameError if the step is not in the snapshot history
+//=============================================================================
+void Game::rollback(UINT64 step)
+{
+	snapshots.restore(step);    // throws GameError
+	stepCount = step;
+}
+
+//=============================================================================
+// Run steps simulation steps again after rollback()
+//=============================================================================
+void Game::resimulate(UINT steps)
+{
+	// the steps see the frameTime simulate() gives them
+	float realFrameTime = frameTime;
+	if (fixedTimestep)
+		frameTime = tickTime;
+	// only the frame arena memory of the last step is kept, so any number of
+	// steps fit in the arena
+	size_t mark = frameArena.getUsed();
+	for (UINT i = 0; i < steps; i++)
+	{
+		frameArena.rewind(mark);
+		simulateStep();
+	}
+	frameTime = realFrameTime;
+}
+
+//=============================================================================
+// Run the fixed timestep ticks due this frame.
+// At most maxTicksPerFrame ticks are run, the remaining whole ticks are
+// dropped so a slow frame can not cause an ever growing backlog.
+// The leftover fraction of a tick becomes the render interpolation.
+//=============================================================================
+void Game::runFixedTicks()
+{
+	accumulator += frameTime;
+
+	// the simulation sees the constant tick time as its frameTime
+	float realFrameTime = frameTime;
+	frameTime = tickTime;
+
+	UINT ticks = 0;
+	while (accumulator >= tickTime && ticks < maxTicksPerFrame)
+	{
+		accumulator -= tickTime;
+		// the tick sees the input posted before the time it ends at,
+		// the time not yet simulated is accumulator
+		LONGLONG tickEnd = timeEnd.QuadPart - (LONGLONG)(accumulator * timerFreq.QuadPart);
+		simulate(tickEnd);
+		++ticks;
+		// key presses are only seen by the tick they were applied to
+		input.clear(inputNS::KEYS_PRESSED);
+	}
+	ticksRun += ticks;
+
+	// drop the ticks the catch-up limit did not allow
+	if (accumulator >= tickTime)
+	{
+		UINT dropped = (UINT)(accumulator / tickTime);
+		ticksDropped += dropped;
+		accumulator -= dropped * tickTime;
+	}
+
+	frameTime = realFrameTime;
+	interpolation = accumulator / tickTime;
+}
+
+//=============================================================================
+// Enable or disable fixed timestep simulation
+// throws GameError on invalid tick rate
+//=============================================================================
+void Game::setFixedTimestep(bool enable, float tickRate, UINT maxTicks)
+{
+	if (tickRate <= 0)
+		throw(GameError(gameErrorNS::WARNING, "Invalid fixed timestep tick rate"));
+
+	fixedTimestep = enable;
+	tickTime = 1.0f / tickRate;
+	// at least one tick must be allowed per frame
+	maxTicksPerFrame = (maxTicks > 0) ? maxTicks : 1;
+	accumulator = 0;
+	// no time is left over, render() shows the state of the last tick
+	interpolation = enable ? 0.0f : 1.0f;
 }
 
 //=============================================================================
@@ -233,22 +540,29 @@ bool Game::timeToUpdate() {
 	QueryPerformanceCounter(&timeEnd);
 	frameTime = (float)(timeEnd.QuadPart - timeStart.QuadPart) / (float)timerFreq.QuadPart;
 
-	// Power saving code, requires winmm.lib
 	// if not enough time has elapsed for desired frame rate
-	// Will wastly decrease overall cpu cycles
-	if (frameTime < MIN_FRAME_TIME)
+	if (framePacing && frameTime < MIN_FRAME_TIME)
 	{
-		sleepTime = (DWORD)((MIN_FRAME_TIME - frameTime) * 1000);
-		timeBeginPeriod(1);         // Request 1mS resolution for windows timer
-		Sleep(sleepTime);           // release cpu for sleepTime
-		timeEndPeriod(1);           // End 1mS timer resolution
-		return false;
+		// Sleep most of the remaining time to save cpu cycles and
+		// spin the final part to hit the frame time precisely.
+		// A window message ends the wait, gameLoop() pumps it and calls
+		// run() again, which waits for the rest of the frame.
+		if (!pacer.waitUntil(FramePacer::now() + (MIN_FRAME_TIME - frameTime), hwnd != nullptr))
+			return false;
+		QueryPerformanceCounter(&timeEnd);
+		frameTime = (float)(timeEnd.QuadPart - timeStart.QuadPart) / (float)timerFreq.QuadPart;
 	}
+	if (framePacing)
+		pacer.recordFrame(frameTime, MIN_FRAME_TIME);
 
 	if (frameTime > 0.0)
 		// average fps
 		fps = (fps*0.99f) + (0.01f / frameTime);  
 	
+	// constant simulation time, e.g. when running without a window
+	if (simulatedFrameTime > 0)
+		frameTime = simulatedFrameTime;
+
 	// if frame rate is very slow
 	if (frameTime > MAX_FRAME_TIME) 
 		// limit maximum frameTime
@@ -277,5 +591,14 @@ void Game::resetAll()
 void Game::deleteAll()
 {
 	releaseAll();               // call onLostDevice() for every graphics item
+	input.stopRecording();      // finish the input recording file
+	jobs.shutdown();            // finish queued jobs and stop the job threads
+	assets.shutdown();          // stop the asset I/O threads and unmap the packs
+	snapshots.release();        // free the snapshot history
+	netServer.release();        // close the replication transports
+	netClient.release();
+	world.clear();              // destroy all entities
+	particles.release();        // free the particles
+	audio.release();            // stop the mixer and free the sounds
 	initialized = false;
 }
\ No newline at end of file
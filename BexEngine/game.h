@@ -1,11 +1,22 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
 
-#include <windows.h>
-#include <Mmsystem.h>
+#include "platform.h"
 #include <memory>
 #include "graphics.h"
 #include "input.h"
+#include "inputActions.h"
+#include "framePacer.h"
+#include "world.h"
+#include "jobSystem.h"
+#include "assetStreamer.h"
+#include "allocators.h"
+#include "profiler.h"
+#include "telemetry.h"
+#include "particleSystem.h"
+#include "audio.h"
+#include "snapshotHistory.h"
+#include "replication.h"
 #include "constants.h"
 #include "gameError.h"
 
@@ -19,21 +30,28 @@ public:
 
 	// Member functions
 
+#ifdef _WIN32
 	// Window message handler
 	LRESULT messageHandler(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+#endif
 
 	// Initialize the game
-	// Pre: hwnd is handle to window
+	// Pre: hwnd is handle to window, nullptr runs without a window
+	//      using the headless graphics backend
 	virtual void initialize(HWND hwnd);
 
 	// Game loop
-	WPARAM Game::gameLoop(HWND hwnd);
+	// Pre: hwnd is handle to window, nullptr runs without a window until
+	//      exitGame() is called or the frame limit is reached
+	WPARAM gameLoop(HWND hwnd);
 
 	// Calls to update are repeatedly done by the game loop 
 	virtual void run(HWND);
 
 	// Call when the graphics device was lost.
 	// Release all reserved video memory so graphics device may be reset.
+	// Textures of graphics.getTextures() are released and recreated by the
+	// graphics system.
 	virtual void releaseAll();
 
 	// Recreate all surfaces and reset all entities.
@@ -51,8 +69,145 @@ public:
 	// Return ref to Input.
 	InputSystem& getInput() { return input; }
 
+	// Return ref to the input actions, resolved before every update().
+	InputActions& getActions() { return actions; }
+
+	// Return ref to the frame pacer, reports frame pacing error.
+	FramePacer& getFramePacer() { return pacer; }
+
+	// Return ref to the entity world.
+	World& getWorld() { return world; }
+
+	// Return ref to the job system, runs work of update(), ai() and
+	// collisions() on all cpu cores.
+	JobSystem& getJobs() { return jobs; }
+
+	// Return ref to the asset streamer, loads pack file assets in the background.
+	AssetStreamer& getAssets() { return assets; }
+
+	// Return ref to the frame arena for data that lives one frame.
+	FrameArena& getFrameArena() { return frameArena; }
+
+	// Return ref to the frame time telemetry, percentiles, hitches and phases
+	// of the real frame times.
+	Telemetry& getTelemetry() { return telemetry; }
+
+	// Return ref to the particles, updated after collisions() and drawn over
+	// the game after render().
+	ParticleSystem& getParticles() { return particles; }
+
+	// Return ref to the audio mixer.
+	AudioSystem& getAudio() { return audio; }
+
+	// Play the audio on sink instead of the sound device, call before initialize().
+	// The game owns sink. Without a window the default is a NullAudioSink.
+	void setAudioSink(AudioSink* sink) { audioSink = sink; }
+
+	// Return ref to the snapshot history of the simulation state. Games add
+	// the state they keep outside the world with addBlock() after initialize().
+	SnapshotHistory& getSnapshots() { return snapshots; }
+
+	// Save the world and the particles after every simulation step and keep
+	// the last steps steps for rollback(), call before initialize(). 0 saves
+	// nothing.
+	void setSnapshotSteps(UINT steps) { snapshotSteps = steps; }
+
+	// Return number of simulation steps run, the step of the newest snapshot.
+	UINT64 getStepCount() const { return stepCount; }
+
+	// Restore the simulation state after step, the following steps are lost
+	// until resimulate() runs them again.
+	// Throws GameError if step is not in the snapshot history
+	void rollback(UINT64 step);
+
+	// Run update(), ai() and collisions() steps times without applying new
+	// input events, e.g. after rollback() with the input the game corrected.
+	// The steps use the tick time, or the frameTime of the current frame
+	// without fixed timestep.
+	void resimulate(UINT steps);
+
+	// Return ref to the components and fields replicated to clients. Games
+	// register them in initialize(), the same on the server and the clients.
+	ReplicationSchema& getNetSchema() { return netSchema; }
+
+	// Return ref to the replication server. After netServer.initialize()
+	// every simulation step sends a snapshot of the world to the clients.
+	ReplicationServer& getNetServer() { return netServer; }
+
+	// Return ref to the replication client. After netClient.initialize()
+	// every frame shows the entities of the server in the world before
+	// render().
+	ReplicationClient& getNetClient() { return netClient; }
+
+	// Draw the frame time graph of the telemetry over the game.
+	void setTelemetryOverlay(bool enable) { telemetryOverlay = enable; }
+
+	// Set number of job threads including the game thread, call before initialize().
+	// Pre: threads = 0 for one per cpu core, 1 runs all jobs on the game thread
+	void setJobThreads(UINT threads) { jobThreads = threads; }
+
+	// Draw and present the frames on a render thread, call before initialize().
+	// Off by default. When on, render() records the frame and the game thread
+	// simulates the next frame while the render thread presents it.
+	void setRenderThread(bool enable) { renderThread = enable; }
+
+	// Record the input of the game and its fixed timestep setting to filename,
+	// start right after initialize() and setFixedTimestep().
+	// Throws GameError
+	void startRecording(const std::string& filename);
+
+	// Replay the input recorded in filename as fast as possible, start right
+	// after initialize() with the fixed timestep setting of the recording.
+	// Frame pacing is disabled and every frame runs with its recorded frame
+	// time, the game exits when the replay ends.
+	// Throws GameError
+	void startReplay(const std::string& filename);
+
 	// Exit the game
-	void exitGame() { PostMessage(hwnd, WM_DESTROY, 0, 0); }
+	void exitGame();
+
+	// Enable or disable the frame rate limit of FRAME_RATE.
+	// Runs without a window disable it to run at full speed.
+	void setFramePacing(bool enable) { framePacing = enable; }
+
+	// Use a constant frameTime of sec seconds instead of the measured time.
+	// Together with setFramePacing(false) the game runs as fast as possible
+	// on a deterministic timeline. 0 measures the real frame time.
+	void setSimulatedFrameTime(float sec) { simulatedFrameTime = sec; }
+
+	// Stop a game loop without a window after the frame count reaches frames.
+	// 0 for no limit.
+	void setFrameLimit(UINT64 frames) { frameLimit = frames; }
+
+	// Return number of frames rendered.
+	UINT64 getFrameCount() const { return frameCount; }
+
+	// Select the graphics backend used without a window, call before initialize().
+	// Pre: type = graphicsNS::BACKEND_HEADLESS or BACKEND_SOFTWARE
+	void setWindowlessBackend(int type) { windowlessBackend = type; }
+
+	// Enable or disable fixed timestep simulation.
+	// When enabled update(), ai() and collisions() run tickRate times per second
+	// independent of the frame rate and frameTime is the constant tick time.
+	// Throws GameError on invalid tick rate.
+	// Pre: tickRate = simulation ticks per second, > 0
+	//      maxTicks = max ticks run in one frame, further ticks are dropped
+	void setFixedTimestep(bool enable, float tickRate = TICK_RATE, UINT maxTicks = MAX_TICKS_PER_FRAME);
+
+	// Return true if fixed timestep simulation is enabled.
+	bool isFixedTimestep() const { return fixedTimestep; }
+
+	// Return number of simulation ticks run in fixed timestep mode.
+	UINT64 getTicksRun() const { return ticksRun; }
+
+	// Return number of simulation ticks dropped by the catch-up limit.
+	UINT64 getTicksDropped() const { return ticksDropped; }
+
+	// Return the seconds of one tick in fixed timestep mode.
+	float getTickTime() const { return tickTime; }
+
+	// Return the part of a tick not simulated yet, 0..1, passed to render().
+	float getInterpolation() const { return interpolation; }
 protected:
 	// Pure virtual function declarations
 	// These functions MUST be written in any class that inherits from Game
@@ -69,11 +224,22 @@ protected:
 	//   draw sprites
 	// Call graphics->spriteEnd();
 	//   draw non-sprites
-	virtual void render() = 0;
+	// Pre: alpha = interpolation factor 0..1 between the previous and the
+	//      current simulation tick. Always 1 when not in fixed timestep mode.
+	virtual void render(float alpha) = 0;
 
 	// common game properties
 	GraphicsSystem graphics;			// Graphics
 	InputSystem input;					// Input
+	InputActions actions;				// named actions bound to keys and buttons
+	FramePacer pacer;					// waits for the frame rate limit
+	World   world;						// entities and their components
+	JobSystem jobs;						// work stealing job threads
+	AssetStreamer assets;				// streams assets from pack files
+	FrameArena frameArena;				// memory freed one frame after it was allocated
+	Telemetry telemetry;				// frame time percentiles and hitches
+	ParticleSystem particles;			// particles drawn over the game
+	AudioSystem audio;					// software mixer on its own thread
 	HWND    hwnd;						// window handle
 	HRESULT hr;							// standard return type
 	LARGE_INTEGER timeStart;			// Performance Counter start value
@@ -81,13 +247,44 @@ protected:
 	LARGE_INTEGER timerFreq;			// Performance Counter frequency
 	float   frameTime;					// time required for last frame
 	float   fps;						// frames per second
-	DWORD   sleepTime;					// number of milli-seconds to sleep between frames
 	bool    paused;						// true if game is paused
 	bool    initialized;
+	bool    fixedTimestep;				// true if simulation runs at a fixed tick rate
+	float   tickTime;					// time of one simulation tick in fixed timestep mode
+	UINT    maxTicksPerFrame;			// catch-up limit in fixed timestep mode
+	float   accumulator;				// simulation time not yet consumed by ticks
+	float   interpolation;				// alpha passed to render()
+	UINT64  ticksRun;					// number of fixed ticks run
+	UINT64  ticksDropped;				// number of fixed ticks dropped by the catch-up limit
+	bool    framePacing;				// true to limit the frame rate to FRAME_RATE
+	float   simulatedFrameTime;			// constant frameTime, 0 to measure
+	bool    exitRequested;				// true when a game without a window should exit
+	UINT64  frameLimit;					// frames to run without a window, 0 for no limit
+	UINT64  frameCount;					// number of frames rendered
+	int     windowlessBackend;			// graphicsNS backend used without a window
+	UINT    jobThreads;					// job threads, 0 for one per cpu core
+	bool    renderThread;				// true to draw on a render thread
+	bool    telemetryOverlay;			// true to draw the telemetry graph
+	AudioSink* audioSink;				// set by setAudioSink(), nullptr for the default
+	SnapshotHistory snapshots;			// simulation state of the last steps
+	UINT    snapshotSteps;				// steps kept, 0 for no snapshots
+	UINT64  stepCount;					// simulation steps run
+	ReplicationSchema netSchema;		// components replicated
+	ReplicationServer netServer;		// sends snapshots when initialized
+	ReplicationClient netClient;		// receives snapshots when initialized
 
 private:
 	// Checks if its time to update. Also updates timers and fps.
 	bool timeToUpdate();
 	// Handle lost graphics device
 	void handleLostGraphicsDevice();
+	// Apply the input events posted until performance counter time inputTime,
+	// then run update(), ai(), collisions(), the particles, world.flush(),
+	// the replication server and controller vibration once.
+	void simulate(LONGLONG inputTime);
+	// Run update(), ai(), collisions(), the particles and world.flush() once
+	// without new input and save the snapshot of the step.
+	void simulateStep();
+	// Run the fixed timestep ticks due this frame and compute interpolation.
+	void runFixedTicks();
 };
@@ -1,18 +1,36 @@
 #include "graphics.h"
+#include "headlessBackend.h"
+#include "softwareBackend.h"
+#include "framePacer.h"
+#include "profiler.h"
 
 //=============================================================================
 // Constructor
 //=============================================================================
 GraphicsSystem::GraphicsSystem()
 {
-	direct3d = nullptr;
-	device3d = nullptr;
-	fullscreen = false;
-	// width & height are replaced in initialize()
-	width = GAME_WIDTH;    
-	height = GAME_HEIGHT;
+	backend = nullptr;
+	backendType = graphicsNS::BACKEND_D3D9;
+#ifdef _WIN32
+	d3d9 = nullptr;
+#endif
+	result = E_FAIL;
+	hwnd = nullptr;
 	// dark blue
-	backColor = SETCOLOR_ARGB(255, 0, 0, 128); 
+	backColor = SETCOLOR_ARGB(255, 0, 0, 128);
+	resetTime = 0;
+	quadCount = 0;
+	threaded = false;
+	recording = nullptr;
+	drawing = false;
+	renderQuit = false;
+	deviceState = S_OK;
+	frameStart = 0;
+	framesPresented = 0;
+	latencySum = 0;
+	maxLatency = 0;
+	waitTime = 0;
+	renderTime = 0;
 }
 
 //=============================================================================
@@ -28,102 +46,353 @@ GraphicsSystem::~GraphicsSystem()
 //=============================================================================
 void GraphicsSystem::releaseAll()
 {
-	SAFE_RELEASE(device3d);
-	SAFE_RELEASE(direct3d);
+	stopRenderThread();
+	// textures go before the backend that created them
+	textures.initialize(nullptr);
+	if (backend)
+		backend->releaseAll();
+	SAFE_DELETE(backend);
+#ifdef _WIN32
+	d3d9 = nullptr;
+#endif
 }
 
 //=============================================================================
-// Initialize DirectX graphics
+// Initialize graphics
 // throws GameError on error
 //=============================================================================
-void GraphicsSystem::initialize(HWND hw, int w, int h, bool full)
+void GraphicsSystem::initialize(HWND hw, int w, int h, bool full, int type)
 {
 	hwnd = hw;
-	width = w;
-	height = h;
-	fullscreen = full;
+	backendType = type;
+
+	switch (backendType)
+	{
+	case graphicsNS::BACKEND_HEADLESS:
+		backend = new HeadlessBackend();
+		break;
+	case graphicsNS::BACKEND_SOFTWARE:
+		backend = new SoftwareBackend();
+		break;
+#ifdef _WIN32
+	case graphicsNS::BACKEND_D3D9:
+		d3d9 = new D3D9Backend();
+		backend = d3d9;
+		break;
+#endif
+	default:
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Graphics backend not available on this platform"));
+	}
 
-	//initialize Direct3D
-	direct3d = Direct3DCreate9(D3D_SDK_VERSION);
-	if (!direct3d)
-		throw(GameError(gameErrorNS::FATAL_ERROR, "Error initializing Direct3D"));
+	// throws GameError
+	backend->initialize(hwnd, w, h, full);
+	// the backend starts with an empty vertex ring
+	spriteBatch.resetRing();
+	textures.initialize(backend);
 
-	// init D3D presentation parameters
-	initD3DPresentaionParameters();
+	if (threaded)
+	{
+		freeBuffers.clear();
+		for (UINT i = 0; i < renderCommandNS::FRAME_BUFFERS; i++)
+			freeBuffers.push_back(&buffers[i]);
+		// both lists hold at most every buffer, frames do not allocate
+		submitted.reserve(renderCommandNS::FRAME_BUFFERS);
+		renderQuit = false;
+		deviceState = S_OK;
+		try{
+			renderThread = std::thread(&GraphicsSystem::renderLoop, this);
+		}
+		catch (...)
+		{
+			throw(GameError(gameErrorNS::FATAL_ERROR, "Error starting the render thread"));
+		}
+	}
+}
 
-	// handle any graphics compatibility issues and return concluded device behavior
-	DWORD behavior = handleGraphicsCompatibility();
+//=============================================================================
+// Stop the render thread, frames not drawn are dropped
+//=============================================================================
+void GraphicsSystem::stopRenderThread()
+{
+	if (!renderThread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		renderQuit = true;
+	}
+	renderWake.notify_all();
+	renderThread.join();
+	submitted.clear();
+	freeBuffers.clear();
+	recording = nullptr;
+}
 
-	//create Direct3D device
-	result = direct3d->CreateDevice(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, hwnd, behavior, &d3dpp, &device3d);
+//=============================================================================
+// Render thread main loop
+//=============================================================================
+void GraphicsSystem::renderLoop()
+{
+	for (;;)
+	{
+		RenderCommandBuffer* frame;
+		{
+			std::unique_lock<std::mutex> lock(renderMutex);
+			while (!renderQuit && submitted.empty())
+				renderWake.wait(lock);
+			if (renderQuit)
+				break;
+			frame = submitted.front();
+			submitted.erase(submitted.begin());
+			drawing = true;
+		}
 
-	if (FAILED(result))
-		throw(GameError(gameErrorNS::FATAL_ERROR, "Error creating Direct3D device"));
+		double start = FramePacer::now();
+		execute(*frame);
+		HRESULT state = backend->getDeviceState();
+		double busy = FramePacer::now() - start;
 
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			deviceState = state;
+			countFrame(frame->getTime(), busy);
+			freeBuffers.push_back(frame);
+			drawing = false;
+		}
+		renderDone.notify_all();
+	}
+	Profiler::releaseThread();
 }
 
 //=============================================================================
-// Initialize D3D presentation parameters
+// Draw and present a recorded frame on the render thread
 //=============================================================================
-void GraphicsSystem::initD3DPresentaionParameters()
+void GraphicsSystem::execute(const RenderCommandBuffer& frame)
 {
-	try{
-		// fill the structure with 0
-		ZeroMemory(&d3dpp, sizeof(d3dpp));
-		// fill in the parameters we need
-		d3dpp.BackBufferWidth = width;
-		d3dpp.BackBufferHeight = height;
-		// if fullscreen
-		if (fullscreen)
-			// 24 bit color                                 
-			d3dpp.BackBufferFormat = D3DFMT_X8R8G8B8;
-		else
-			// use desktop setting
-			d3dpp.BackBufferFormat = D3DFMT_UNKNOWN;
-		d3dpp.BackBufferCount = 1;
-		d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
-		d3dpp.hDeviceWindow = hwnd;
-		d3dpp.Windowed = (!fullscreen);
-		d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
-	}
-	catch (...)
+	PROFILE_ZONE("renderThread");
+	bool scene = false;                 // true if beginScene succeeded
+	for (UINT i = 0; i < frame.getCount(); i++)
 	{
-		throw(GameError(gameErrorNS::FATAL_ERROR,
-			"Error initializing D3D presentation parameters"));
+		const RenderCommand& c = frame.getCommand(i);
+		switch (c.type)
+		{
+		case renderCommandNS::CMD_BEGIN_SCENE:
+			spriteBatch.resetFrameStats();
+			scene = SUCCEEDED(backend->beginScene(c.color));
+			break;
+		case renderCommandNS::CMD_SPRITE_END:
+			if (scene)
+			{
+				backend->beginSprites();
+				spriteBatch.drawSprites(frame.getSprites() + c.first, c.count, c.arg, *backend);
+			}
+			break;
+		case renderCommandNS::CMD_QUADS:
+			if (scene)
+			{
+				backend->beginSprites();
+				spriteBatch.drawVertices(frame.getVertices() + c.first * 4, c.count, c.texture, c.arg, *backend);
+			}
+			break;
+		case renderCommandNS::CMD_LINE:
+			if (scene)
+				backend->drawLine(c.x1, c.y1, c.x2, c.y2, c.color);
+			break;
+		case renderCommandNS::CMD_END_SCENE:
+			if (scene)
+				backend->endScene();
+			scene = false;
+			break;
+		case renderCommandNS::CMD_PRESENT:
+		{
+			PROFILE_ZONE("present");
+			backend->present();
+			break;
+		}
+		}
+	}
+}
 
+//=============================================================================
+// Wait until the render thread presented the submitted frames
+//=============================================================================
+void GraphicsSystem::flush()
+{
+	std::unique_lock<std::mutex> lock(renderMutex);
+	while (!submitted.empty() || drawing)
+		renderDone.wait(lock);
+}
+
+//=============================================================================
+// Count a presented frame
+//=============================================================================
+void GraphicsSystem::countFrame(double start, double busy)
+{
+	double latency = FramePacer::now() - start;
+	++framesPresented;
+	latencySum += latency;
+	if (latency > maxLatency)
+		maxLatency = latency;
+	renderTime += busy;
+}
+
+//=============================================================================
+// Return frame statistics
+//=============================================================================
+RenderStats GraphicsSystem::getRenderStats() const
+{
+	std::lock_guard<std::mutex> lock(renderMutex);
+	RenderStats s;
+	s.frames = framesPresented;
+	s.avgLatency = framesPresented > 0 ? latencySum / framesPresented : 0;
+	s.maxLatency = maxLatency;
+	s.waitTime = waitTime;
+	s.renderTime = renderTime;
+	return s;
+}
+
+//=============================================================================
+// Clear backbuffer and BeginScene()
+//=============================================================================
+HRESULT GraphicsSystem::beginScene()
+{
+	result = E_FAIL;
+	if (backend == nullptr)
+		return result;
+	if (!threaded)
+	{
+		frameStart = FramePacer::now();
+		// new frame statistics
+		spriteBatch.resetFrameStats();
+		// clear backbuffer to backColor and begin scene for drawing
+		result = backend->beginScene(backColor);
+		return result;
 	}
+
+	// wait for a free frame buffer, the render thread is at most
+	// FRAME_BUFFERS - 1 frames behind
+	double start = FramePacer::now();
+	std::unique_lock<std::mutex> lock(renderMutex);
+	while (freeBuffers.empty())
+		renderDone.wait(lock);
+	double now = FramePacer::now();
+	waitTime += now - start;
+	if (FAILED(deviceState))
+		return result;                  // the device must be reset first
+	recording = freeBuffers.back();
+	freeBuffers.pop_back();
+	lock.unlock();
+
+	recording->clear(now);
+	recording->beginScene(backColor);
+	result = S_OK;
+	return result;
 }
 
 //=============================================================================
-// Display the backbuffer
+// EndScene()
 //=============================================================================
-HRESULT GraphicsSystem::showBackbuffer()
+HRESULT GraphicsSystem::endScene()
 {
-	// default to fail, replace on success
 	result = E_FAIL;
-	// Display backbuffer to screen
-	result = device3d->Present(nullptr, nullptr, nullptr, nullptr);
+	if (recording)
+	{
+		recording->endScene();
+		result = S_OK;
+	}
+	else if (backend && !threaded)
+		result = backend->endScene();
 	return result;
 }
 
 //=============================================================================
-// Checks the adapter to see if it is compatible with the BackBuffer height,
-// width and refresh rate specified in d3dpp. Fills in the pMode structure with
-// the format of the compatible mode, if found.
-// Pre: d3dpp is initialized.
-// Post: Returns true if compatible mode found and pMode structure is filled.
-//       Returns false if no compatible mode found.
+// Upload new textures and begin queueing sprites
+//=============================================================================
+void GraphicsSystem::spriteBegin(int sortMode)
+{
+	if (recording)
+	{
+		// pages are uploaded while the render thread does not use the backend
+		if (textures.hasChanges())
+		{
+			flush();
+			textures.commit();
+		}
+		recording->spriteBegin(sortMode);
+	}
+	else if (!threaded)
+	{
+		textures.commit();
+		spriteBatch.begin(sortMode);
+	}
+}
+
+//=============================================================================
+// Return room for the vertices of quadCount quads
+//=============================================================================
+SpriteVertex* GraphicsSystem::beginQuads(UINT count)
+{
+	// upload new textures like spriteBegin()
+	if (recording)
+	{
+		if (textures.hasChanges())
+		{
+			flush();
+			textures.commit();
+		}
+		return recording->beginQuads(count);
+	}
+	quadCount = 0;
+	if (backend == nullptr || threaded || count == 0)
+		return nullptr;
+	textures.commit();
+	if (count * 4 > quadVertices.size())
+		quadVertices.resize(count * 4);
+	quadCount = count;
+	return &quadVertices[0];
+}
+
+//=============================================================================
+// Draw the quads of beginQuads()
+//=============================================================================
+void GraphicsSystem::endQuads(void* texture, int blend)
+{
+	if (recording)
+	{
+		recording->endQuads(texture, blend);
+		return;
+	}
+	if (quadCount == 0)
+		return;
+	backend->beginSprites();
+	spriteBatch.drawVertices(&quadVertices[0], quadCount, texture, blend, *backend);
+	quadCount = 0;
+}
+
+//=============================================================================
+// Display the backbuffer
 //=============================================================================
-bool GraphicsSystem::isAdapterCompatible()
+HRESULT GraphicsSystem::showBackbuffer()
 {
-	UINT modes = direct3d->GetAdapterModeCount(D3DADAPTER_DEFAULT, d3dpp.BackBufferFormat);
-	for (UINT i = 0; i < modes; ++i)
+	// default to fail, replace on success
+	result = E_FAIL;
+	if (recording)
+	{
+		// the render thread presents the frame
+		recording->present();
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			submitted.push_back(recording);
+		}
+		recording = nullptr;
+		renderWake.notify_one();
+		result = S_OK;
+	}
+	else if (backend && !threaded)
 	{
-		result = direct3d->EnumAdapterModes(D3DADAPTER_DEFAULT, d3dpp.BackBufferFormat, i, &pMode);
-		if (pMode.Height == d3dpp.BackBufferHeight && pMode.Width == d3dpp.BackBufferWidth && pMode.RefreshRate >= d3dpp.FullScreen_RefreshRateInHz)
-			return true;
+		result = backend->present();
+		countFrame(frameStart, FramePacer::now() - frameStart);
 	}
-	return false;
+	return result;
 }
 
 //=============================================================================
@@ -132,10 +401,25 @@ bool GraphicsSystem::isAdapterCompatible()
 HRESULT GraphicsSystem::getDeviceState()
 {
 	// default to fail, replace on success
-	result = E_FAIL;    
-	if (device3d == nullptr)
+	result = E_FAIL;
+	if (backend == nullptr)
 		return  result;
-	result = device3d->TestCooperativeLevel();
+	if (threaded)
+	{
+		// the render thread tests the device after every present
+		std::unique_lock<std::mutex> lock(renderMutex);
+		result = deviceState;
+		lock.unlock();
+		if (SUCCEEDED(result))
+			return result;
+		// test again while the render thread is idle
+		flush();
+		result = backend->getDeviceState();
+		lock.lock();
+		deviceState = result;
+		return result;
+	}
+	result = backend->getDeviceState();
 	return result;
 }
 
@@ -145,41 +429,54 @@ HRESULT GraphicsSystem::getDeviceState()
 HRESULT GraphicsSystem::reset()
 {
 	// default to fail, replace on success
-	result = E_FAIL;    
-	// init D3D presentation parameters
-	initD3DPresentaionParameters();                        
-	// attempt to reset graphics device
-	result = device3d->Reset(&d3dpp);   
+	result = E_FAIL;
+	if (backend == nullptr)
+		return result;
+	if (threaded)
+	{
+		flush();
+		// the frame being recorded refers to textures about to be released
+		if (recording)
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			freeBuffers.push_back(recording);
+			recording = nullptr;
+		}
+	}
+	double start = FramePacer::now();
+	// video memory textures must be released before the reset
+	textures.onLostDevice();
+	result = backend->reset();
+	if (FAILED(result))
+		return result;
+	// the vertex ring was recreated
+	spriteBatch.resetRing();
+	textures.onResetDevice();
+	resetTime = FramePacer::now() - start;
+	if (threaded)
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		deviceState = result;
+	}
 	return result;
 }
 
 //=============================================================================
-// Handle any graphics compatibility issues and return concluded device behavior
+// Draw all sprites queued since spriteBegin()
 //=============================================================================
-DWORD GraphicsSystem::handleGraphicsCompatibility()
+void GraphicsSystem::spriteEnd()
 {
-	// if full-screen mode
-	if (fullscreen)
+	if (recording)
 	{
-		// is the adapter compatible
-		if (isAdapterCompatible())
-			// set the refresh rate with a compatible one
-			d3dpp.FullScreen_RefreshRateInHz = pMode.RefreshRate;
-		else
-			throw(GameError(gameErrorNS::FATAL_ERROR,
-			"The graphics device does not support the specified resolution and/or format."));
+		recording->spriteEnd();
+		return;
 	}
-
-	// determine if graphics card supports hardware texturing and lighting and vertex shaders
-	D3DCAPS9 caps;
-	result = direct3d->GetDeviceCaps(D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &caps);
-	// If device doesn't support HW T&L or doesn't support 1.1 vertex 
-	// shaders in hardware, then switch to software vertex processing.
-	if ((caps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT) == 0 || caps.VertexShaderVersion < D3DVS_VERSION(1, 1))
-		// use software only processing
-		 return D3DCREATE_SOFTWARE_VERTEXPROCESSING;
-	else
-		// use hardware only processing
-		return D3DCREATE_HARDWARE_VERTEXPROCESSING;
+	if (backend == nullptr || threaded)
+	{
+		// nothing can be drawn, drop the queued sprites
+		spriteBatch.cancel();
+		return;
+	}
+	backend->beginSprites();
+	spriteBatch.end(*backend);
 }
-
@@ -1,23 +1,37 @@
 #pragma once
 #define WIN32_LEAN_AND_MEAN
 
-#ifdef _DEBUG
-#define D3D_DEBUG_INFO
-#endif
-#include <d3d9.h>
-#include <d3dx9.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "constants.h"
 #include "gameError.h"
+#include "renderBackend.h"
+#include "spriteBatch.h"
+#include "textureCache.h"
+#include "renderCommands.h"
+#ifdef _WIN32
+#include "d3d9Backend.h"
+#endif
 
-// DirectX pointer types
-#define LP_3DDEVICE LPDIRECT3DDEVICE9
-#define LP_3D       LPDIRECT3D9
-
-// Color defines
-#define COLOR_ARGB DWORD
-#define SETCOLOR_ARGB(a,r,g,b) \
-	((COLOR_ARGB)((((a)& 0xff) << 24) | (((r)& 0xff) << 16) | (((g)& 0xff) << 8) | ((b)& 0xff)))
+// Frame statistics of GraphicsSystem.
+struct RenderStats
+{
+	UINT64 frames;                      // frames presented
+	double avgLatency;                  // seconds from beginScene() to the end of the present
+	double maxLatency;
+	double waitTime;                    // seconds the game thread waited for a free frame buffer
+	double renderTime;                  // seconds spent drawing and presenting
+};
 
+// Graphics of the game.
+// With the render thread enabled the drawing functions record the frame into
+// a RenderCommandBuffer and showBackbuffer() hands it to a render thread that
+// draws and presents it, so the game thread simulates the next frame while
+// the previous one is presented. Up to FRAME_BUFFERS frames are recorded,
+// waiting or drawn; beginScene() waits for a free buffer, which bounds the
+// added latency. The game thread touches the backend only while the render
+// thread is idle, see flush().
 class GraphicsSystem final
 {
 
@@ -28,32 +42,63 @@ public:
 	// Destructor
 	virtual ~GraphicsSystem();
 
-	// Releases direct3d and device3d.
+	// Releases the rendering backend.
 	void    releaseAll();
 
-	// Initialize DirectX graphics
+	// Draw on a render thread, call before initialize().
+	void    setRenderThread(bool enable) { threaded = enable; }
+
+	// Return true if a render thread draws the frames.
+	bool    hasRenderThread() const { return threaded; }
+
+	// Wait until the render thread drew and presented the submitted frames.
+	// The backend may be used directly until the next showBackbuffer().
+	void    flush();
+
+	// Initialize graphics, starts the render thread if enabled
 	// Throws GameError on error
-	// Pre: hw = handle to window
+	// Pre: hw = handle to window, may be nullptr for BACKEND_HEADLESS and BACKEND_SOFTWARE
 	//      width = width in pixels
 	//      height = height in pixels
 	//      fullscreen = true for full screen, false for window
-	void    initialize(HWND hw, int width, int height, bool fullscreen);
+	//      backendType = graphicsNS::BACKEND_D3D9, BACKEND_HEADLESS or BACKEND_SOFTWARE
+	void    initialize(HWND hw, int width, int height, bool fullscreen,
+		int backendType = graphicsNS::BACKEND_D3D9);
 
 	// Display the offscreen backbuffer to the screen.
+	// With the render thread the frame is submitted and presented later.
 	HRESULT showBackbuffer();
 
 	// Reset the graphics device.
+	// The textures of the texture cache lost with the device are recreated.
 	HRESULT reset();
 
 	// get functions
-	// Return direct3d.
-	LP_3D   get3D()             { return direct3d; }
+	// Return the rendering backend.
+	RenderBackend* getBackend()   { return backend; }
+
+	// Return the type of the rendering backend.
+	int     getBackendType() const { return backendType; }
 
-	// Return device3d.
-	LP_3DDEVICE get3Ddevice()   { return device3d; }
+	// Return the texture cache, owns the textures of the game.
+	TextureCache& getTextures() { return textures; }
+
+	// Return seconds the last successful reset() took.
+	double  getResetTime() const { return resetTime; }
+
+	// Return frame statistics.
+	RenderStats getRenderStats() const;
+
+#ifdef _WIN32
+	// Return direct3d, nullptr if not using BACKEND_D3D9.
+	LP_3D   get3D()             { return d3d9 ? d3d9->get3D() : nullptr; }
+
+	// Return device3d, nullptr if not using BACKEND_D3D9.
+	LP_3DDEVICE get3Ddevice()   { return d3d9 ? d3d9->get3Ddevice() : nullptr; }
 
 	// Return handle to device context (window).
 	HDC     getDC()             { return GetDC(hwnd); }
+#endif
 
 	// Test for lost device
 	HRESULT getDeviceState();
@@ -66,57 +111,111 @@ public:
 	// Set color used to clear screen
 	void setBackColor(COLOR_ARGB c) { backColor = c; }
 
-	//=============================================================================
-	// Clear backbuffer and BeginScene()
-	//=============================================================================
-	HRESULT beginScene()
+	// Upload new textures and begin queueing sprites.
+	// Pre: sortMode = spriteBatchNS::SORT_TEXTURE or SORT_NONE
+	void spriteBegin(int sortMode = spriteBatchNS::SORT_TEXTURE);
+
+	// Queue a sprite, drawn by spriteEnd().
+	void drawSprite(const SpriteData& sd)
 	{
-		result = E_FAIL;
-		if (device3d == nullptr)
-			return result;
-		// clear backbuffer to backColor
-		device3d->Clear(0, nullptr, D3DCLEAR_TARGET, backColor, 1.0F, 0);
-		result = device3d->BeginScene();          // begin scene for drawing
-		return result;
+		if (recording)
+			recording->drawSprite(sd);
+		else
+			spriteBatch.draw(sd);
 	}
 
-	//=============================================================================
-	// EndScene()
-	//=============================================================================
-	HRESULT endScene()
+	// Queue a solid color rectangle, drawn by spriteEnd().
+	void drawRect(float x, float y, float w, float h, COLOR_ARGB color)
+	{
+		if (recording)
+			recording->drawRect(x, y, w, h, color);
+		else
+			spriteBatch.drawRect(x, y, w, h, color);
+	}
+
+	// Draw all sprites queued since spriteBegin() with as few draw calls as possible.
+	void spriteEnd();
+
+	// Return room for the four vertices of quadCount quads in the order of
+	// SpriteBatch::buildQuad(), to be filled and drawn by endQuads(). Call
+	// between beginScene and endScene, outside spriteBegin and spriteEnd.
+	// The vertices may be written by several threads; the memory is valid
+	// until endQuads(). New textures are uploaded first, look up the texture
+	// afterwards. Return nullptr if nothing can be drawn.
+	SpriteVertex* beginQuads(UINT quadCount);
+
+	// Draw the quads of beginQuads() with texture and spriteBatchNS blend state.
+	void endQuads(void* texture, int blend);
+
+	// Draw a line, not batched. Call between beginScene and endScene.
+	void drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color)
 	{
-		result = E_FAIL;
-		if (device3d)
-			result = device3d->EndScene();
-		return result;
+		if (recording)
+			recording->drawLine(x1, y1, x2, y2, color);
+		else if (backend && !threaded)
+			backend->drawLine(x1, y1, x2, y2, color);
 	}
-	
+
+	// Return the sprite batch, reports draw calls and vertices of the current frame.
+	// With the render thread call flush() first.
+	const SpriteBatch& getSpriteBatch() const { return spriteBatch; }
+
+	// Clear backbuffer and BeginScene()
+	HRESULT beginScene();
+
+	// EndScene()
+	HRESULT endScene();
+
 private:
-	// DirectX pointers and stuff
-	LP_3D       direct3d;
-	LP_3DDEVICE device3d;
-	D3DPRESENT_PARAMETERS d3dpp;
-	D3DDISPLAYMODE pMode;
+	RenderBackend* backend;     // active rendering backend
+	int         backendType;    // graphicsNS backend type
+#ifdef _WIN32
+	D3D9Backend* d3d9;          // backend if BACKEND_D3D9, else nullptr
+#endif
 
 	// other variables
 	HRESULT     result;         // standard Windows return codes
 	HWND        hwnd;
-	bool        fullscreen;
-	int         width;
-	int         height;
 	COLOR_ARGB  backColor;      // background color
 
-	// (For internal engine use only. No user serviceable parts inside.)
-	// Initialize D3D presentation parameters
-	void initD3DPresentaionParameters();
-	// Handle any graphics compatibility issues and return concluded device behavior
-	DWORD handleGraphicsCompatibility();
-	// Checks the adapter to see if it is compatible with the BackBuffer height,
-	// width and refresh rate specified in d3dpp. Fills in the pMode structure with
-	// the format of the compatible mode, if found.
-	// Pre: d3dpp is initialized.
-	// Post: Returns true if compatible mode found and pMode structure is filled.
-	//       Returns false if no compatible mode found.
-	bool    isAdapterCompatible();
+	// sprite rendering
+	SpriteBatch spriteBatch;
+	std::vector<SpriteVertex> quadVertices; // beginQuads() without the render thread
+	UINT        quadCount;
+	TextureCache textures;
+	double      resetTime;      // seconds of the last reset
+
+	// render thread
+	bool        threaded;       // true to draw on the render thread
+	std::thread renderThread;
+	mutable std::mutex renderMutex;         // guards the buffer lists, deviceState and statistics
+	std::condition_variable renderWake;     // a frame was submitted
+	std::condition_variable renderDone;     // a frame was presented
+	RenderCommandBuffer buffers[renderCommandNS::FRAME_BUFFERS];
+	std::vector<RenderCommandBuffer*> freeBuffers;
+	std::vector<RenderCommandBuffer*> submitted;    // frames waiting for the render thread, oldest first
+	RenderCommandBuffer* recording;         // frame of the game thread, nullptr outside a scene
+	bool        drawing;        // true while the render thread draws a frame
+	bool        renderQuit;     // true to stop the render thread
+	HRESULT     deviceState;    // after the last present of the render thread
+
+	// frame statistics
+	double      frameStart;     // beginScene() time without the render thread
+	UINT64      framesPresented;
+	double      latencySum;
+	double      maxLatency;
+	double      waitTime;
+	double      renderTime;
+
+	GraphicsSystem(const GraphicsSystem&);  // no copies
+	GraphicsSystem& operator=(const GraphicsSystem&);
+
+	// Render thread main loop.
+	void    renderLoop();
+	// Draw and present a recorded frame.
+	void    execute(const RenderCommandBuffer& frame);
+	// Stop the render thread, frames not drawn are dropped.
+	void    stopRenderThread();
+	// Count a presented frame that began at start and took busy seconds to draw.
+	void    countFrame(double start, double busy);
 };
-
@@ -0,0 +1,178 @@
+#include "headlessBackend.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+//=============================================================================
+// Constructor
+//=============================================================================
+HeadlessBackend::HeadlessBackend(int m)
+{
+	mode = m;
+	width = GAME_WIDTH;
+	height = GAME_HEIGHT;
+	texture = nullptr;
+	blend = spriteBatchNS::BLEND_ALPHA;
+	backColor = 0;
+	frameCount = 0;
+	totalDrawCalls = 0;
+	totalQuads = 0;
+	totalLines = 0;
+	lost = false;
+	presentWait = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+HeadlessBackend::~HeadlessBackend()
+{
+	releaseAll();
+}
+
+//=============================================================================
+// Initialize, hw is ignored
+//=============================================================================
+void HeadlessBackend::initialize(HWND /*hw*/, int w, int h, bool /*full*/)
+{
+	width = w;
+	height = h;
+	try{
+		ring.resize(spriteBatchNS::RING_VERTICES);
+	}
+	catch (...)
+	{
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error initializing headless graphics"));
+	}
+}
+
+//=============================================================================
+// Release the vertex ring
+//=============================================================================
+void HeadlessBackend::releaseAll()
+{
+	std::vector<SpriteVertex>().swap(ring);
+	drawCalls.clear();
+	for (size_t i = 0; i < textures.size(); i++)
+		SAFE_DELETE(textures[i]);
+	textures.clear();
+}
+
+//=============================================================================
+// Reset the lost device
+//=============================================================================
+HRESULT HeadlessBackend::reset()
+{
+	// like Direct3D 9, video memory resources must be released first
+	for (size_t i = 0; i < textures.size(); i++)
+		if (textures[i]->pool == graphicsNS::POOL_DEFAULT)
+			return E_FAIL;
+	lost = false;
+	return S_OK;
+}
+
+//=============================================================================
+// Begin a frame
+//=============================================================================
+HRESULT HeadlessBackend::beginScene(COLOR_ARGB c)
+{
+	if (ring.empty())
+		return E_FAIL;
+	backColor = c;
+	drawCalls.clear();
+	return S_OK;
+}
+
+//=============================================================================
+// End the scene
+//=============================================================================
+HRESULT HeadlessBackend::endScene()
+{
+	return S_OK;
+}
+
+//=============================================================================
+// Count the presented frame
+//=============================================================================
+HRESULT HeadlessBackend::present()
+{
+	if (presentWait > 0)
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)(presentWait * 1000000)));
+	++frameCount;
+	return S_OK;
+}
+
+//=============================================================================
+// Return a pointer into the vertex ring
+//=============================================================================
+SpriteVertex* HeadlessBackend::lockVertices(unsigned int offset, unsigned int count, bool /*discard*/)
+{
+	if (offset + count > ring.size())
+		return nullptr;
+	return &ring[offset];
+}
+
+//=============================================================================
+// Save the sprite state of the following draws
+//=============================================================================
+void HeadlessBackend::setSpriteState(void* t, int b)
+{
+	texture = t;
+	blend = b;
+}
+
+//=============================================================================
+// Count and, in RECORD mode, record a sprite draw
+//=============================================================================
+void HeadlessBackend::drawQuads(unsigned int baseVertex, unsigned int quadCount)
+{
+	++totalDrawCalls;
+	totalQuads += quadCount;
+	if (mode == headlessNS::RECORD)
+	{
+		HeadlessDrawCall dc = { texture, blend, baseVertex, quadCount };
+		drawCalls.push_back(dc);
+	}
+}
+
+//=============================================================================
+// Create a texture
+// Returns nullptr on failure
+//=============================================================================
+void* HeadlessBackend::createTexture(int w, int h, const uint32_t* pixels, int pool)
+{
+	if (w <= 0 || h <= 0 || pixels == nullptr || (lost && pool == graphicsNS::POOL_DEFAULT))
+		return nullptr;
+	HeadlessTexture* t = new HeadlessTexture;
+	t->width = w;
+	t->height = h;
+	t->pool = pool;
+	t->updates = 0;
+	textures.push_back(t);
+	return t;
+}
+
+//=============================================================================
+// Update a texture
+// Returns false on failure
+//=============================================================================
+bool HeadlessBackend::updateTexture(void* t, const uint32_t* pixels)
+{
+	HeadlessTexture* texture = (HeadlessTexture*)t;
+	if (texture == nullptr || pixels == nullptr || (lost && texture->pool == graphicsNS::POOL_DEFAULT))
+		return false;
+	++texture->updates;
+	return true;
+}
+
+//=============================================================================
+// Release a texture created by createTexture()
+//=============================================================================
+void HeadlessBackend::releaseTexture(void* t)
+{
+	std::vector<HeadlessTexture*>::iterator it = std::find(textures.begin(), textures.end(), t);
+	if (it == textures.end())
+		return;
+	delete *it;
+	textures.erase(it);
+}
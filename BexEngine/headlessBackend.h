@@ -0,0 +1,133 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <vector>
+#include "renderBackend.h"
+
+namespace headlessNS
+{
+	// what the headless backend does with draw work
+	const int DISCARD = 0;                  // count draw work only
+	const int RECORD = 1;                   // keep the draw calls of the current frame
+}
+
+// One recorded sprite draw call.
+struct HeadlessDrawCall
+{
+	void* texture;                          // texture of the draw
+	int   blend;                            // spriteBatchNS blend state
+	unsigned int baseVertex;                // first vertex in the ring
+	unsigned int quadCount;                 // number of quads drawn
+};
+
+// Texture of the headless backend, size and pool only.
+struct HeadlessTexture
+{
+	int width;
+	int height;
+	int pool;                               // graphicsNS::POOL_
+	UINT updates;                           // updateTexture() calls
+};
+
+// Rendering backend without a window or GPU.
+// Draw work is counted and, in RECORD mode, the draw calls and vertices of
+// the current frame are kept so they can be inspected. loseDevice() simulates
+// a lost device with the rules of Direct3D 9, so device loss handling can be
+// tested and timed.
+class HeadlessBackend final : public RenderBackend
+{
+public:
+	// Constructor
+	// Pre: mode = headlessNS::DISCARD or headlessNS::RECORD
+	explicit HeadlessBackend(int mode = headlessNS::DISCARD);
+
+	// Destructor
+	virtual ~HeadlessBackend();
+
+	// Initialize, hw is ignored
+	void    initialize(HWND hw, int width, int height, bool fullscreen) override;
+
+	// Release the vertex ring.
+	void    releaseAll() override;
+
+	// Begin a frame, clears the recorded draw calls.
+	HRESULT beginScene(COLOR_ARGB backColor) override;
+
+	// End the scene.
+	HRESULT endScene() override;
+
+	// Count the presented frame, waits like a blocking present if set.
+	HRESULT present() override;
+
+	// Block every present for sec seconds, like a present that waits for the GPU
+	// or the vertical blank. 0 returns at once.
+	void    setPresentWait(double sec) { presentWait = sec; }
+
+	// Returns graphicsNS::DEVICE_NOT_RESET after loseDevice(), else S_OK.
+	HRESULT getDeviceState() override { return lost ? graphicsNS::DEVICE_NOT_RESET : S_OK; }
+
+	// Reset the lost device, fails while POOL_DEFAULT textures exist.
+	HRESULT reset() override;
+
+	// Lose the device, POOL_DEFAULT textures must be released and reset() called.
+	void    loseDevice() { lost = true; }
+
+	// SpriteBatchBackend
+	SpriteVertex* lockVertices(unsigned int offset, unsigned int count, bool discard) override;
+	void unlockVertices() override {}
+	void setSpriteState(void* texture, int blend) override;
+	void drawQuads(unsigned int baseVertex, unsigned int quadCount) override;
+
+	// Count a line.
+	void drawLine(float /*x1*/, float /*y1*/, float /*x2*/, float /*y2*/, COLOR_ARGB /*color*/) override { ++totalLines; }
+
+	// Create a HeadlessTexture, fails for POOL_DEFAULT while the device is lost.
+	void* createTexture(int width, int height, const uint32_t* pixels, int pool) override;
+
+	// Count the update, fails for POOL_DEFAULT while the device is lost.
+	bool updateTexture(void* texture, const uint32_t* pixels) override;
+
+	// Release a texture created by createTexture().
+	void releaseTexture(void* texture) override;
+
+	// Return number of textures.
+	UINT getTextureCount() const { return (UINT)textures.size(); }
+
+	// Return draw calls recorded in the current frame, empty in DISCARD mode.
+	const std::vector<HeadlessDrawCall>& getDrawCalls() const { return drawCalls; }
+
+	// Return the vertex ring the sprite batch writes to.
+	const std::vector<SpriteVertex>& getVertices() const { return ring; }
+
+	// Return the color the current frame was cleared to.
+	COLOR_ARGB getBackColor() const { return backColor; }
+
+	// Return number of presented frames.
+	UINT64 getFrameCount() const { return frameCount; }
+
+	// Return total number of draw calls.
+	UINT64 getTotalDrawCalls() const { return totalDrawCalls; }
+
+	// Return total number of quads drawn.
+	UINT64 getTotalQuads() const { return totalQuads; }
+
+	// Return total number of lines drawn.
+	UINT64 getTotalLines() const { return totalLines; }
+
+private:
+	int   mode;
+	int   width;
+	int   height;
+	std::vector<SpriteVertex> ring;         // vertex ring written by the sprite batch
+	std::vector<HeadlessDrawCall> drawCalls;// draw calls of the current frame
+	std::vector<HeadlessTexture*> textures;
+	bool  lost;                             // true after loseDevice() until reset()
+	double presentWait;                     // seconds present() blocks
+	void* texture;                          // current sprite state
+	int   blend;
+	COLOR_ARGB backColor;
+	UINT64 frameCount;
+	UINT64 totalDrawCalls;
+	UINT64 totalQuads;
+	UINT64 totalLines;
+};
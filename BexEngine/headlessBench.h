@@ -0,0 +1,106 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "game.h"
+#include "headlessPlatform.h"
+
+// Benchmarks and checks of the headless runner, one source file per module.
+// Each prints its results and returns false if a check failed, which makes
+// headless exit with 1.
+namespace headlessBench
+{
+	// benchGraphics.cpp
+
+	// Scroll over a size x size tile map for frames frames.
+	bool tilemap(Game& game, UINT size, UINT64 frames);
+
+	// Feed a sprite batch known sprite sequences through the headless backend.
+	// Fails if texture changes, the ring wrap or the split at the 16 bit index
+	// limit drew other draw calls, vertices or state changes.
+	bool spriteBatch();
+
+	// Add video memory images, lose the headless device and run frames frames.
+	// Fails if a changed atlas page got a new texture or the reset did not
+	// recreate the video memory textures.
+	bool deviceLoss(HeadlessPlatform& platform, Game& game, UINT64 frames);
+
+	// Render a fixed scene with the software backend and compare it with the
+	// reference .ppm image, or write the reference if update is true.
+	// Fails if the reference is missing or the images differ beyond the tolerance.
+	bool golden(const char* reference, bool update);
+
+	// benchCollision.cpp
+
+	// Move bodies circles for steps 200 Hz steps through both broadphases.
+	// Fails if they, or brute force, find different pairs.
+	bool broadphase(UINT bodies, UINT64 steps);
+
+	// benchJobs.cpp
+
+	// Run frames frames of a fixed job graph on 1 to threads threads, 0 for
+	// one per cpu core. Fails if the results differ or a job's exception was lost.
+	bool jobs(UINT threads, UINT64 frames);
+
+	// benchMath.cpp
+
+	// Time frames calls of each math kernel against a scalar loop.
+	// Fails if a kernel does not match its loop.
+	bool math(UINT64 frames);
+
+	// benchInput.cpp
+
+	// Time the key events, action bindings and key queries of frames frames.
+	bool input(UINT64 frames);
+
+	// Poll a fake gamepad on the game thread and on the controller thread.
+	bool controllers(UINT64 frames);
+
+	// Post frames frames of a rate Hz synthetic mouse per report and batched.
+	// Fails if motion was lost.
+	bool mouse(double rate, UINT64 frames);
+
+	// benchAudio.cpp
+
+	// Mix 10 s of voices looping voices, to filename if not nullptr.
+	// Fails if mixer blocks were dropped.
+	bool audio(UINT voices, const char* filename);
+
+	// benchAssets.cpp
+
+	// Round trip blocks through LZ4, then write count assets to a pack and
+	// stream them and a missing asset. Fails if a block or asset comes back
+	// different or the missing asset does not fail.
+	bool assets(UINT count);
+
+	// benchSimulation.cpp
+
+	// Rewind the game steps steps and simulate them again.
+	// Fails if the state is not bit-identical.
+	bool rollback(Game& game, UINT steps);
+
+	// Run frames frames at hz fixed ticks per second, then frames slow frames.
+	// Fails if the ticks run and dropped do not add up to the time run.
+	bool fixedTimestep(HeadlessPlatform& platform, Game& game, float hz, UINT maxTicks, UINT64 frames);
+
+	// Move entities entities for frames steps as an array of objects and as
+	// World chunks. Fails if the positions differ.
+	bool iteration(UINT entities, UINT64 frames);
+
+	// benchMemory.cpp
+
+	// Run frames more frames of the warmed up game.
+	// Fails if they made a heap allocation or BEX_TRACK_HEAP is not defined.
+	bool heapCheck(HeadlessPlatform& platform, Game& game, UINT64 frames);
+
+	// benchPacing.cpp
+
+	// Run frames more frames with frame pacing on and print the pacing error.
+	// Fails if the p50 error is over 100 us or the p99 error over 2 ms.
+	bool pacing(HeadlessPlatform& platform, Game& game, UINT64 frames);
+
+	// benchNet.cpp
+
+	// Replicate the game to clients clients for frames frames.
+	// Fails if a client did not decode the state of the server.
+	bool net(HeadlessPlatform& platform, Game& game, UINT clients, float loss, bool udp, UINT64 frames);
+}
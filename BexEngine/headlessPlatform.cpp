@@ -0,0 +1,60 @@
+#include "headlessPlatform.h"
+
+//=============================================================================
+// Constructor
+//=============================================================================
+HeadlessPlatform::HeadlessPlatform()
+{
+	game = nullptr;
+	elapsed = 0;
+	framesRun = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+HeadlessPlatform::~HeadlessPlatform()
+{}
+
+//=============================================================================
+// Initialize the game without a window
+// Throws GameError
+//=============================================================================
+void HeadlessPlatform::initialize(Game* g, float frameTime, int backendType)
+{
+	if (g == nullptr)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "No game to run headless"));
+	game = g;
+
+	// run at full speed on a constant timeline
+	game->setFramePacing(false);
+	game->setSimulatedFrameTime(frameTime);
+	game->setWindowlessBackend(backendType);
+
+	// a null window selects the windowless graphics backend
+	// throws GameError
+	game->initialize(nullptr);
+}
+
+//=============================================================================
+// Run the game loop for frames frames or until the game exits
+//=============================================================================
+UINT64 HeadlessPlatform::run(UINT64 frames)
+{
+	if (game == nullptr || frames == 0)
+		return 0;
+
+	UINT64 start = game->getFrameCount();
+	game->setFrameLimit(start + frames);
+
+	double t = FramePacer::now();
+	game->gameLoop(nullptr);
+	// the last frames are presented by the render thread
+	game->getGraphics().flush();
+	elapsed += FramePacer::now() - t;
+
+	UINT64 count = game->getFrameCount() - start;
+	framesRun += count;
+	game->setFrameLimit(0);
+	return count;
+}
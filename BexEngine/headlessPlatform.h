@@ -0,0 +1,44 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "game.h"
+
+// Platform layer that runs a game without a window.
+// The game loop runs at full speed with the headless graphics backend and a
+// constant simulated frame time, for simulations, soak tests and benchmarks
+// on machines without a display or GPU.
+class HeadlessPlatform final
+{
+public:
+	// Constructor
+	HeadlessPlatform();
+
+	// Destructor
+	~HeadlessPlatform();
+
+	// Initialize the game without a window.
+	// Throws GameError
+	// Pre: game = created game, not initialized
+	//      frameTime = simulated seconds per frame, 0 to use the real frame time
+	//      backendType = graphicsNS::BACKEND_HEADLESS or BACKEND_SOFTWARE
+	void initialize(Game* game, float frameTime = MIN_FRAME_TIME,
+		int backendType = graphicsNS::BACKEND_HEADLESS);
+
+	// Run the game loop for frames frames or until the game exits.
+	// Returns when the frames are presented, with the number of frames run.
+	UINT64 run(UINT64 frames);
+
+	// Return wall clock seconds spent in run().
+	double getElapsedTime() const { return elapsed; }
+
+	// Return number of frames run.
+	UINT64 getFramesRun() const { return framesRun; }
+
+	// Return average frames per second of run().
+	double getFramesPerSecond() const { return elapsed > 0 ? framesRun / elapsed : 0; }
+
+private:
+	Game*  game;
+	double elapsed;             // wall clock seconds in run()
+	UINT64 framesRun;           // frames run by run()
+};
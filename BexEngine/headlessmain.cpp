@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spacewar.h"
+#include "headlessPlatform.h"
+#include "softwareBackend.h"
+#include "headlessBackend.h"
+#include "headlessBench.h"
+
+//=============================================================================
+// Starting point of the headless runner.
+// Runs the game without a window for a number of frames at full speed.
+// With "software" the frames are rendered by the CPU rasterizer and the last
+// frame may be saved as .png or .ppm image.
+// With "-profile" the profiler zone table is printed and the zones may be
+// saved as Chrome trace.
+// With "-record" the input is recorded to a file, "-replay" runs the frames
+// of a recording, all of them when no frame count is given.
+// "-noatlas" gives every image a texture of its own to compare the draw calls,
+// "-lose" adds video memory images after the game ran, loses the headless
+// device, runs frames more frames and checks the textures were recreated.
+// "-renderthread" draws on a render thread, the game thread draws otherwise.
+// "-present ms" blocks every headless present like a GPU or vsync wait.
+// "-telemetry" prints the frame time percentiles and phases and may save the
+// last frames as .csv or the statistics and histogram as .json, "-overlay"
+// draws the frame time graph into the frames.
+// "-particles count" keeps about count particles alive and prints the time
+// per frame of their update and vertices.
+// "-tilemap size" scrolls over a size x size tile map after the game ran and
+// prints the chunks, tiles and time per frame of its draw.
+// "-inputbench" times the key events, action bindings and key queries of a
+// frame after the game ran.
+// "-controllers" polls a fake gamepad on the game thread and on the
+// controller thread for frames 1 ms frames and prints the cost of both.
+// "-mouse rate" posts frames frames of a rate Hz synthetic mouse one message
+// per report and batched, and prints the input handling time per second.
+// "-assets count" round trips blocks through LZ4, writes count assets to a
+// pack, streams them and a missing asset, and prints the asset statistics.
+// "-rollback steps" saves a snapshot of every step, runs a particle emitter,
+// rewinds steps steps after the game ran and simulates them again, prints if
+// the state is the same and times the snapshots of 10000 entities.
+// "-fixed hz" runs the game at hz fixed simulation ticks per second, then
+// frames more frames and frames 0.1 s frames that drop ticks, and checks that
+// the ticks run and dropped add up to the time run.
+// "-iterate entities" moves entities entities for frames steps stored as an
+// array of game objects and as World chunks and prints the time per entity.
+// "-mathbench" times frames calls of each math kernel on a 4096 element
+// batch and a scalar loop doing the same, and prints the ns per element.
+// "-audio voices" mixes 10 s of voices looping voices faster than real time,
+// to a .wav file if one is given, and prints the voices mixed per cpu ms.
+// "-broadphase bodies" moves bodies circles for 1 s of 200 Hz steps through
+// the spatial hash and sweep and prune and prints the pairs tested and found
+// and the time per step of each.
+// "-jobs [threads]" runs frames frames of a fixed job graph on 1 to threads
+// threads, one per cpu core by default, and prints the speedup.
+// "-heapcheck" runs frames more frames after the game warmed up and fails if
+// they allocate from the heap; it needs a build with BEX_TRACK_HEAP defined.
+// "-spritebatch" draws known sprite sequences with a sprite batch on a
+// recording headless backend and checks the draw calls and vertices.
+// "-golden [file.ppm] [update]" renders a fixed scene with the software
+// backend and compares it with the reference image, golden/software.ppm by
+// default, within a small tolerance; with update it writes the reference.
+// "-paced" runs frames more frames with frame pacing on, which the runner
+// otherwise turns off, and prints the p50 and p99 pacing error.
+// "-net clients" replicates the game to clients clients for frames frames
+// over a loopback network that loses loss percent of the datagrams, or over
+// UDP on localhost, and prints the snapshot sizes and times.
+// Exits with 1 if a bench check fails; the checks are in headlessBench.h.
+// Usage: headless [frames] [software [image]] [-profile [trace.json]]
+//                 [-record file | -replay file] [-noatlas] [-lose]
+//                 [-renderthread] [-present ms]
+//                 [-telemetry [file.csv|file.json]] [-overlay]
+//                 [-particles count] [-tilemap size] [-inputbench]
+//                 [-controllers] [-mouse rate] [-audio voices [file.wav]]
+//                 [-assets count]
+//                 [-rollback steps] [-iterate entities] [-mathbench]
+//                 [-fixed hz]
+//                 [-net clients [loss] [udp]]
+//                 [-broadphase bodies] [-jobs [threads]] [-heapcheck]
+//                 [-paced] [-spritebatch] [-golden [file.ppm] [update]]
+//=============================================================================
+int main(int argc, char* argv[])
+{
+	bool profile = false;
+	const char* trace = nullptr;
+	const char* record = nullptr;
+	const char* replay = nullptr;
+	bool atlas = true;
+	bool lose = false;
+	bool renderThread = false;
+	double presentWait = 0;
+	bool telemetry = false;
+	const char* telemetryFile = nullptr;
+	bool overlay = false;
+	UINT particles = 0;
+	UINT tilemapSize = 0;
+	bool inputBench = false;
+	bool controllerBench = false;
+	double mouseRate = 0;
+	UINT audioVoices = 0;
+	const char* audioFile = nullptr;
+	UINT assetCount = 0;
+	UINT rollbackSteps = 0;
+	UINT netClients = 0;
+	float netLoss = 0;
+	bool netUdp = false;
+	UINT broadphaseBodies = 0;
+	UINT iterateEntities = 0;
+	float fixedRate = 0;
+	bool mathBench = false;
+	bool jobBench = false;
+	UINT jobThreads = 0;
+	bool heapCheck = false;
+	bool paced = false;
+	bool spriteBatch = false;
+	const char* golden = nullptr;
+	bool goldenUpdate = false;
+	int positional = argc;              // arguments before the first option
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] != '-')
+			continue;
+		if (positional == argc)
+			positional = i;
+		const char* value = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : nullptr;
+		if (strcmp(argv[i], "-profile") == 0)
+		{
+			profile = true;
+			trace = value;
+		}
+		else if (strcmp(argv[i], "-record") == 0)
+			record = value;
+		else if (strcmp(argv[i], "-replay") == 0)
+			replay = value;
+		else if (strcmp(argv[i], "-noatlas") == 0)
+			atlas = false;
+		else if (strcmp(argv[i], "-lose") == 0)
+			lose = true;
+		else if (strcmp(argv[i], "-renderthread") == 0)
+			renderThread = true;
+		else if (strcmp(argv[i], "-present") == 0 && value)
+			presentWait = atof(value) / 1000;
+		else if (strcmp(argv[i], "-telemetry") == 0)
+		{
+			telemetry = true;
+			telemetryFile = value;
+		}
+		else if (strcmp(argv[i], "-overlay") == 0)
+			overlay = true;
+		else if (strcmp(argv[i], "-particles") == 0 && value)
+			particles = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-tilemap") == 0 && value)
+			tilemapSize = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-inputbench") == 0)
+			inputBench = true;
+		else if (strcmp(argv[i], "-controllers") == 0)
+			controllerBench = true;
+		else if (strcmp(argv[i], "-mouse") == 0 && value)
+			mouseRate = atof(value);
+		else if (strcmp(argv[i], "-audio") == 0 && value)
+		{
+			audioVoices = (UINT)strtoul(value, nullptr, 10);
+			audioFile = i + 2 < argc && argv[i + 2][0] != '-' ? argv[i + 2] : nullptr;
+		}
+		else if (strcmp(argv[i], "-assets") == 0 && value)
+			assetCount = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-rollback") == 0 && value)
+			rollbackSteps = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-iterate") == 0 && value)
+			iterateEntities = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-fixed") == 0 && value)
+			fixedRate = (float)atof(value);
+		else if (strcmp(argv[i], "-mathbench") == 0)
+			mathBench = true;
+		else if (strcmp(argv[i], "-broadphase") == 0 && value)
+			broadphaseBodies = (UINT)strtoul(value, nullptr, 10);
+		else if (strcmp(argv[i], "-jobs") == 0)
+		{
+			jobBench = true;
+			jobThreads = value ? (UINT)strtoul(value, nullptr, 10) : 0;
+		}
+		else if (strcmp(argv[i], "-heapcheck") == 0)
+			heapCheck = true;
+		else if (strcmp(argv[i], "-paced") == 0)
+			paced = true;
+		else if (strcmp(argv[i], "-spritebatch") == 0)
+			spriteBatch = true;
+		else if (strcmp(argv[i], "-golden") == 0)
+		{
+			golden = "golden/software.ppm";
+			for (int k = i + 1; k < argc && k < i + 3 && argv[k][0] != '-'; k++)
+			{
+				if (strcmp(argv[k], "update") == 0)
+					goldenUpdate = true;
+				else
+					golden = argv[k];
+			}
+		}
+		else if (strcmp(argv[i], "-net") == 0 && value)
+		{
+			netClients = (UINT)strtoul(value, nullptr, 10);
+			for (int k = i + 2; k < argc && k < i + 4 && argv[k][0] != '-'; k++)
+			{
+				if (strcmp(argv[k], "udp") == 0)
+					netUdp = true;
+				else
+					netLoss = (float)atof(argv[k]) / 100;
+			}
+		}
+	}
+	argc = positional;
+
+	UINT64 frames = 1000;
+	if (argc > 1)
+		frames = strtoull(argv[1], nullptr, 10);
+	else if (replay)
+		frames = 0xFFFFFFFF;            // until the recording ends
+	int backendType = graphicsNS::BACKEND_HEADLESS;
+	if (argc > 2 && strcmp(argv[2], "software") == 0)
+		backendType = graphicsNS::BACKEND_SOFTWARE;
+	const char* image = argc > 3 ? argv[3] : nullptr;
+
+	// Create the game
+	Game* game = new Spacewar;
+	HeadlessPlatform platform;
+	bool passed = true;                 // no bench check failed
+
+	try{
+		game->getGraphics().getTextures().setAtlasing(atlas);
+		game->setRenderThread(renderThread);
+		game->setTelemetryOverlay(overlay);
+		if (rollbackSteps > 0)
+			game->setSnapshotSteps(rollbackSteps + snapshotNS::KEYFRAME_INTERVAL);
+		platform.initialize(game, MIN_FRAME_TIME, backendType);  // throws GameError
+		if (backendType == graphicsNS::BACKEND_HEADLESS)
+		{
+			HeadlessBackend* headless = (HeadlessBackend*)game->getGraphics().getBackend();
+			headless->setPresentWait(presentWait);
+		}
+		if (particles > 0)
+		{
+			// lives of 2 to 6 s, the emitter replaces the particles that die
+			ParticleSystem& ps = game->getParticles();
+			ps.initialize(particles);   // throws GameError
+			ParticleEmitter e;
+			e.x = GAME_WIDTH / 2.0f;
+			e.y = GAME_HEIGHT / 2.0f;
+			e.lifeMin = 2;
+			e.lifeMax = 6;
+			e.rate = particles / 4.0f;
+			e.color = SETCOLOR_ARGB(255, 255, 160, 64);
+			e.active = true;
+			ps.emit(e, particles);
+			ps.addEmitter(e);
+		}
+		if (rollbackSteps > 0)
+		{
+			// falling sparks of 0.1 to 0.5 s, spawned and removed in every step
+			ParticleSystem& ps = game->getParticles();
+			ParticleEmitter e;
+			e.x = GAME_WIDTH / 2.0f;
+			e.y = GAME_HEIGHT / 4.0f;
+			e.rate = 2000;
+			e.speedMin = 50;
+			e.speedMax = 200;
+			e.lifeMin = 0.1f;
+			e.lifeMax = 0.5f;
+			e.active = true;
+			ps.addEmitter(e);
+			ps.setAcceleration(0, 400);
+		}
+		if (fixedRate > 0)
+			game->setFixedTimestep(true, fixedRate);    // throws GameError
+		if (record)
+			game->startRecording(record);   // throws GameError
+		if (replay)
+			game->startReplay(replay);      // throws GameError
+		if (trace)
+			Profiler::beginCapture();
+		platform.run(frames);
+		// the benches throw GameError
+		if (heapCheck)
+			passed = headlessBench::heapCheck(platform, *game, frames) && passed;
+		if (lose && backendType == graphicsNS::BACKEND_HEADLESS)
+			passed = headlessBench::deviceLoss(platform, *game, frames) && passed;
+		if (tilemapSize > 0)
+			passed = headlessBench::tilemap(*game, tilemapSize, frames) && passed;
+		if (inputBench)
+			passed = headlessBench::input(frames) && passed;
+		if (controllerBench)
+			passed = headlessBench::controllers(frames) && passed;
+		if (mouseRate > 0)
+			passed = headlessBench::mouse(mouseRate, frames) && passed;
+		if (rollbackSteps > 0)
+			passed = headlessBench::rollback(*game, rollbackSteps) && passed;
+		if (fixedRate > 0)
+			passed = headlessBench::fixedTimestep(platform, *game, fixedRate, MAX_TICKS_PER_FRAME, frames) && passed;
+		if (iterateEntities > 0)
+			passed = headlessBench::iteration(iterateEntities, frames) && passed;
+		if (mathBench)
+			passed = headlessBench::math(frames) && passed;
+		if (audioVoices > 0)
+			passed = headlessBench::audio(audioVoices, audioFile) && passed;
+		if (assetCount > 0)
+			passed = headlessBench::assets(assetCount) && passed;
+		if (broadphaseBodies > 0)
+			passed = headlessBench::broadphase(broadphaseBodies, 200) && passed;
+		if (jobBench)
+			passed = headlessBench::jobs(jobThreads, frames) && passed;
+		if (spriteBatch)
+			passed = headlessBench::spriteBatch() && passed;
+		if (golden)
+			passed = headlessBench::golden(golden, goldenUpdate) && passed;
+		if (paced)
+			passed = headlessBench::pacing(platform, *game, frames) && passed;
+		if (netClients > 0)
+			passed = headlessBench::net(platform, *game, netClients, netLoss, netUdp, frames) && passed;
+
+		printf("frames: %llu\n", (unsigned long long)platform.getFramesRun());
+		printf("time:   %.3f s\n", platform.getElapsedTime());
+		printf("fps:    %.1f\n", platform.getFramesPerSecond());
+		RenderStats rs = game->getGraphics().getRenderStats();
+		printf("latency: %.3f ms avg, %.3f ms max, render thread %s\n", rs.avgLatency * 1000,
+			rs.maxLatency * 1000, renderThread ? "on" : "off");
+
+		TextureCacheStats ts = game->getGraphics().getTextures().getStats();
+		printf("textures: %u images, %u in %u atlas pages, %u textures\n",
+			ts.images, ts.atlasImages, ts.atlasPages, ts.pages);
+		printf("draw calls: %u per frame\n", game->getGraphics().getSpriteBatch().getDrawCalls());
+		if (ts.resets > 0)
+			printf("reset:  %.3f ms, %u textures recreated in %.3f ms\n",
+				game->getGraphics().getResetTime() * 1000, ts.recreated, ts.recreateTime * 1000);
+
+		if (backendType == graphicsNS::BACKEND_SOFTWARE)
+		{
+			SoftwareBackend* sw = (SoftwareBackend*)game->getGraphics().getBackend();
+			printf("threads: %u\n", sw->getThreadCount());
+			printf("pixels/s: %.0f\n", sw->getPixelsPerSecond());
+			if (image)
+			{
+				size_t len = strlen(image);
+				bool ppm = len > 4 && strcmp(image + len - 4, ".ppm") == 0;
+				if (!(ppm ? sw->savePPM(image) : sw->savePNG(image)))
+					fprintf(stderr, "Error: cannot write %s\n", image);
+			}
+		}
+
+		if (particles > 0)
+		{
+			ParticleStats ps = game->getParticles().getStats();
+			printf("particles: %u alive, update %.3f ms, vertices %.3f ms per frame, %u threads\n", ps.count,
+				ps.updates ? ps.updateTime * 1000 / ps.updates : 0, ps.draws ? ps.vertexTime * 1000 / ps.draws : 0,
+				game->getJobs().getThreadCount());
+		}
+
+		if (telemetry)
+		{
+			const Telemetry& t = game->getTelemetry();
+			t.printStats(stdout);
+			if (telemetryFile)
+			{
+				size_t len = strlen(telemetryFile);
+				bool csv = len > 4 && strcmp(telemetryFile + len - 4, ".csv") == 0;
+				if (!(csv ? t.saveCSV(telemetryFile) : t.saveJSON(telemetryFile)))
+					fprintf(stderr, "Error: cannot write %s\n", telemetryFile);
+			}
+		}
+
+		if (profile)
+		{
+			Profiler::printStats(stdout);
+			if (trace && !Profiler::saveTrace(trace))
+				fprintf(stderr, "Error: cannot write %s\n", trace);
+		}
+	}
+	catch (const GameError &err)
+	{
+		game->deleteAll();
+		SAFE_DELETE(game);
+		fprintf(stderr, "Error: %s\n", err.getMessage());
+		return 1;
+	}
+	SAFE_DELETE(game);     // free memory before exit
+	if (!passed)
+	{
+		fprintf(stderr, "Error: a bench check failed\n");
+		return 1;
+	}
+	return 0;
+}
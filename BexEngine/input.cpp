@@ -1,17 +1,20 @@
 #include "input.h"
+#include "inputRecording.h"
+#include <cstring>
 
 //=============================================================================
 // default constructor
 //=============================================================================
-InputSystem::InputSystem()
+InputSystem::InputSystem() : events(inputNS::EVENT_QUEUE_SIZE), eventsDropped(0)
 {
-	// clear key down array
+	// key sets are constructed empty
 	for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
-		keysDown[i] = false;
-	// clear key pressed array
-	for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
-		keysPressed[i] = false;
+	{
+		keyPressTime[i] = 0;
+		keyRepeats[i] = 0;
+	}
 	newLine = true;                     // start new line
+	textIn.reserve(inputNS::TEXT_IN_CAPACITY);  // typing does not allocate
 	textIn = "";                        // clear textIn
 	charIn = 0;                         // clear charIn
 
@@ -20,17 +23,27 @@ InputSystem::InputSystem()
 	mouseY = 0;                         // screen Y
 	mouseRawX = 0;                      // high-definition X
 	mouseRawY = 0;                      // high-definition Y
+	mouseHistory = false;
+	mouseSamples.reserve(rawMouseNS::HISTORY);
+	rawReports = 0;
+	lastRawTime = 0;
 	mouseLButton = false;               // true if left mouse button is down
 	mouseMButton = false;               // true if middle mouse button is down
 	mouseRButton = false;               // true if right mouse button is down
 	mouseX1Button = false;              // true if X1 mouse button is down
 	mouseX2Button = false;              // true if X2 mouse button is down
+	mouseCaptured = false;
+	lastEventTime = 0;
+	recording = new InputRecording;
+	replayDone = false;
 
-	for (int i = 0; i < MAX_CONTROLLERS; i++)
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
 	{
 		controllers[i].vibrateTimeLeft = 0;
 		controllers[i].vibrateTimeRight = 0;
 	}
+	controllerDevice = nullptr;
+	controllerPollRate = controllerNS::POLL_RATE;
 }
 
 //=============================================================================
@@ -38,8 +51,11 @@ InputSystem::InputSystem()
 //=============================================================================
 InputSystem::~InputSystem()
 {
+	SAFE_DELETE(recording);
+#ifdef _WIN32
 	if (mouseCaptured)
 		ReleaseCapture();               // release mouse
+#endif
 }
 
 //=============================================================================
@@ -50,22 +66,30 @@ InputSystem::~InputSystem()
 void InputSystem::initialize(HWND hwnd, bool capture)
 {
 	try{
-		mouseCaptured = capture;
+		// without a window there is no mouse to capture
+		mouseCaptured = capture && hwnd != nullptr;
 
-		// register high-definition mouse
-		Rid[0].usUsagePage = HID_USAGE_PAGE_GENERIC;
-		Rid[0].usUsage = HID_USAGE_GENERIC_MOUSE;
-		Rid[0].dwFlags = RIDEV_INPUTSINK;
-		Rid[0].hwndTarget = hwnd;
-		RegisterRawInputDevices(Rid, 1, sizeof(Rid[0]));
+#ifdef _WIN32
+		if (hwnd)
+		{
+			// register high-definition mouse
+			Rid[0].usUsagePage = HID_USAGE_PAGE_GENERIC;
+			Rid[0].usUsage = HID_USAGE_GENERIC_MOUSE;
+			Rid[0].dwFlags = RIDEV_INPUTSINK;
+			Rid[0].hwndTarget = hwnd;
+			RegisterRawInputDevices(Rid, 1, sizeof(Rid[0]));
+		}
 
 		if (mouseCaptured)
 			SetCapture(hwnd);           // capture mouse
+#endif
 
 		// Clear controllers state
 		ZeroMemory(controllers, sizeof(ControllerState)* MAX_CONTROLLERS);
 
-		checkControllers();             // check for connected controllers
+		// probe all slots and start the controller thread
+		controllerService.start(controllerDevice, controllerPollRate);
+		readControllers();
 	}
 	catch (...)
 	{
@@ -74,30 +98,51 @@ void InputSystem::initialize(HWND hwnd, bool capture)
 }
 
 //=============================================================================
-// Set true in the keysDown and keysPessed array for this key
+// Set the key down, a press if it was up, a repeat if it was down
 // Pre: wParam contains the virtual key code (0--255)
 //=============================================================================
-void InputSystem::keyDown(WPARAM wParam)
+void InputSystem::keyDown(WPARAM wParam, LONGLONG time)
 {
 	// make sure key code is within buffer range
-	if (wParam < inputNS::KEYS_ARRAY_LEN)
+	if (wParam >= inputNS::KEYS_ARRAY_LEN)
+		return;
+	UCHAR vkey = (UCHAR)wParam;
+	if (keysDown.test(vkey))
+	{
+		// keyboard auto repeat, erased by clear()
+		keysRepeated.set(vkey);
+		++keyRepeats[vkey];
+		return;
+	}
+	if (time == 0)
 	{
-		keysDown[wParam] = true;    // update keysDown array
-		// key has been "pressed, erased by clear()
-		keysPressed[wParam] = true; // update keysPressed array
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		time = now.QuadPart;
 	}
+	keysDown.set(vkey);
+	// key has been pressed, erased by clear()
+	keysPressed.set(vkey);
+	keyPressTime[vkey] = time;
+	keyRepeats[vkey] = 0;
 }
 
 //=============================================================================
-// Set false in the keysDown array for this key
+// Set the key up, a release if it was down
 // Pre: wParam contains the virtual key code (0--255)
 //=============================================================================
 void InputSystem::keyUp(WPARAM wParam)
 {
 	// make sure key code is within buffer range
-	if (wParam < inputNS::KEYS_ARRAY_LEN)
-		// update state table
-		keysDown[wParam] = false;
+	if (wParam >= inputNS::KEYS_ARRAY_LEN)
+		return;
+	UCHAR vkey = (UCHAR)wParam;
+	if (keysDown.test(vkey))
+	{
+		keysDown.reset(vkey);
+		// erased by clear()
+		keysReleased.set(vkey);
+	}
 }
 
 //=============================================================================
@@ -119,7 +164,8 @@ void InputSystem::keyIn(WPARAM wParam)
 	}
 	else
 	{
-		textIn += wParam;                   // add character to textIn
+		if (textIn.size() < inputNS::TEXT_IN_CAPACITY)  // keep within the reserved buffer
+			textIn += wParam;               // add character to textIn
 		charIn = wParam;                    // save last char entered
 	}
 
@@ -132,34 +178,7 @@ void InputSystem::keyIn(WPARAM wParam)
 //=============================================================================
 bool InputSystem::isKeyDown(UCHAR vkey) const
 {
-	if (vkey < inputNS::KEYS_ARRAY_LEN)
-		return keysDown[vkey];
-	else
-		return false;
-}
-
-//=============================================================================
-// Return true if the specified VIRTUAL KEY has been pressed in the most recent
-// frame. Key presses are erased at the end of each frame.
-//=============================================================================
-bool InputSystem::wasKeyPressed(UCHAR vkey) const
-{
-	if (vkey < inputNS::KEYS_ARRAY_LEN)
-		return keysPressed[vkey];
-	else
-		return false;
-}
-
-//=============================================================================
-// Return true if any key was pressed in the most recent frame.
-// Key presses are erased at the end of each frame.
-//=============================================================================
-bool InputSystem::anyKeyPressed() const
-{
-	for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
-	if (keysPressed[i] == true)
-		return true;
-	return false;
+	return keysDown.test(vkey);
 }
 
 //=============================================================================
@@ -167,8 +186,7 @@ bool InputSystem::anyKeyPressed() const
 //=============================================================================
 void InputSystem::clearKeyPress(UCHAR vkey)
 {
-	if (vkey < inputNS::KEYS_ARRAY_LEN)
-		keysPressed[vkey] = false;
+	keysPressed.reset(vkey);
 }
 
 //=============================================================================
@@ -178,14 +196,12 @@ void InputSystem::clearKeyPress(UCHAR vkey)
 void InputSystem::clear(UCHAR what)
 {
 	if (what & inputNS::KEYS_DOWN)       // if clear keys down
-	{
-		for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
-			keysDown[i] = false;
-	}
+		keysDown.clear();
 	if (what & inputNS::KEYS_PRESSED)    // if clear keys pressed
 	{
-		for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
-			keysPressed[i] = false;
+		keysPressed.clear();
+		keysReleased.clear();
+		keysRepeated.clear();
 	}
 	if (what & inputNS::MOUSE)           // if clear mouse
 	{
@@ -208,57 +224,338 @@ void InputSystem::mouseIn(LPARAM lParam)
 }
 
 //=============================================================================
-// Reads raw mouse data into mouseRawX, mouseRawY
-// This routine is compatible with a high-definition mouse
+// Post the reports of a WM_INPUT message and the reports queued behind it
+// Called by the window message thread
+//=============================================================================
+UINT InputSystem::postRawInput(LPARAM lParam)
+{
+	rawInput.setMessage(lParam);
+	return postRawMotion(rawInput);
+}
+
+//=============================================================================
+// Post the reports of source as EVENT_MOUSE_RAW events
+// Called by the window message thread
+//=============================================================================
+UINT InputSystem::postRawMotion(RawMotionSource& source)
+{
+	InputEvent e;
+	e.type = inputNS::EVENT_MOUSE_RAW;
+	e.wParam = 0;
+	e.lParam = 0;
+	UINT total = 0, n;
+	while ((n = source.read(rawBatch, rawMouseNS::BATCH)) > 0)
+	{
+		total += n;
+		if (mouseHistory)
+		{
+			// one event per report keeps its time, never earlier than the
+			// last posted one so processEvents() applies them in order
+			for (UINT i = 0; i < n; i++)
+			{
+				if (rawBatch[i].time > lastRawTime)
+					lastRawTime = rawBatch[i].time;
+				e.time = lastRawTime;
+				e.rawX = rawBatch[i].dx;
+				e.rawY = rawBatch[i].dy;
+				if (!events.push(e))
+					++eventsDropped;
+			}
+		}
+		else
+		{
+			if (rawBatch[n - 1].time > lastRawTime)
+				lastRawTime = rawBatch[n - 1].time;
+			e.time = lastRawTime;
+			e.rawX = 0;
+			e.rawY = 0;
+			for (UINT i = 0; i < n; i++)
+			{
+				e.rawX += rawBatch[i].dx;
+				e.rawY += rawBatch[i].dy;
+			}
+			if (!events.push(e))
+				++eventsDropped;
+		}
+	}
+	rawReports += total;
+	return total;
+}
+
+//=============================================================================
+// Queue an input event with the current time
+// Called by the window message thread
+//=============================================================================
+bool InputSystem::postEvent(UINT type, WPARAM wParam, LPARAM lParam)
+{
+	InputEvent e;
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	e.time = now.QuadPart;
+	e.type = type;
+	e.wParam = wParam;
+	e.lParam = lParam;
+	e.rawX = 0;
+	e.rawY = 0;
+	// raw input data must be read before the message returns
+	if (type == inputNS::EVENT_MOUSE_RAW)
+	{
+		UINT64 dropped = eventsDropped;
+		postRawInput(lParam);
+		return eventsDropped == dropped;
+	}
+	if (!events.push(e))
+	{
+		++eventsDropped;
+		return false;
+	}
+	return true;
+}
+
+//=============================================================================
+// Apply the queued events posted at or before until
+// Called by the simulation thread
+//=============================================================================
+UINT InputSystem::processEvents(LONGLONG until)
+{
+	UINT count = 0;
+	const InputEvent* e;
+	// the raw mouse movement is summed over the events of one step
+	mouseRawX = 0;
+	mouseRawY = 0;
+	mouseSamples.clear();
+	if (recording->isReplaying())
+	{
+		// the posted events are ignored, apply the events of the recorded step
+		while (events.front() != nullptr)
+			events.pop();
+		for (;;)
+		{
+			UCHAR type = recording->peek();
+			if (type == inputRecordingNS::RECORD_EVENT)
+			{
+				InputEvent r;
+				recording->readEvent(r);
+				applyEvent(r);
+				lastEventTime = r.time;
+				++count;
+			}
+			else if (type == inputRecordingNS::RECORD_CONTROLLER)
+				replayControllers();
+			else
+			{
+				if (type == inputRecordingNS::RECORD_STEP)
+					recording->readStep();
+				return count;
+			}
+		}
+	}
+
+	while ((e = events.front()) != nullptr && e->time <= until)
+	{
+		applyEvent(*e);
+		recording->writeEvent(*e);
+		lastEventTime = e->time;
+		events.pop();
+		++count;
+	}
+	recording->writeStep();
+	return count;
+}
+
+//=============================================================================
+// Record the input applied from now on to filename
+// Throws GameError
+//=============================================================================
+void InputSystem::startRecording(const std::string& filename, const RecordingSettings& settings)
+{
+	recording->startRecording(filename, settings);
+	// the replay starts from the controller state of now
+	for (UINT i = 0; i < MAX_CONTROLLERS; i++)
+	{
+		recording->writeController(i, controllers[i].connected, controllers[i].state);
+		recordedControllers[i] = controllers[i];
+	}
+}
+
+//=============================================================================
+// Replay the input recorded in filename, returns the settings of the recording
+// Throws GameError
 //=============================================================================
-void InputSystem::mouseRawIn(LPARAM lParam)
+RecordingSettings InputSystem::startReplay(const std::string& filename)
 {
-	UINT dwSize = 40;
-	static BYTE lpb[40];
+	recording->startReplay(filename);
+	replayDone = false;
+	// start from the same input state as the recording
+	clearAll();
+	setMouseLButton(false);
+	setMouseMButton(false);
+	setMouseRButton(false);
+	setMouseXButton(0);
+	replayControllers();
+	return recording->getSettings();
+}
 
-	GetRawInputData((HRAWINPUT)lParam, RID_INPUT,
-		lpb, &dwSize, sizeof(RAWINPUTHEADER));
+//=============================================================================
+// Finish recording or replay
+// Throws GameError
+//=============================================================================
+void InputSystem::stopRecording()
+{
+	recording->stop();
+}
 
-	RAWINPUT* raw = (RAWINPUT*)lpb;
+bool InputSystem::isRecording() const { return recording->isRecording(); }
+bool InputSystem::isReplaying() const { return recording->isReplaying(); }
 
-	if (raw->header.dwType == RIM_TYPEMOUSE)
+//=============================================================================
+// Start a frame of recording or replay
+// Returns the frame time to simulate
+// Throws GameError
+//=============================================================================
+float InputSystem::beginFrame(float frameTime)
+{
+	if (recording->isRecording())
+		recording->writeFrame(frameTime);
+	else if (recording->isReplaying())
 	{
-		mouseRawX = raw->data.mouse.lLastX;
-		mouseRawY = raw->data.mouse.lLastY;
+		// skip what the last frame did not use, e.g. the steps of a paused game
+		UCHAR type;
+		while ((type = recording->peek()) != inputRecordingNS::RECORD_FRAME &&
+			type != inputRecordingNS::RECORD_END)
+		{
+			InputEvent skipped;
+			if (type == inputRecordingNS::RECORD_EVENT)
+				recording->readEvent(skipped);
+			else if (type == inputRecordingNS::RECORD_CONTROLLER)
+				replayControllers();
+			else
+				recording->readStep();
+		}
+		if (type == inputRecordingNS::RECORD_FRAME)
+			return recording->readFrame();
+		replayDone = true;
 	}
+	return frameTime;
 }
 
 //=============================================================================
-// Check for connected controllers
+// Record the controllers whose state changed since they were last recorded
 //=============================================================================
-void InputSystem::checkControllers()
+void InputSystem::recordControllers()
 {
-	DWORD result;
-	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	if (!recording->isRecording())
+		return;
+	for (UINT i = 0; i < MAX_CONTROLLERS; i++)
 	{
-		result = XInputGetState(i, &controllers[i].state);
-		if (result == ERROR_SUCCESS)
-			controllers[i].connected = true;
-		else
-			controllers[i].connected = false;
+		ControllerState& last = recordedControllers[i];
+		if (controllers[i].connected != last.connected ||
+			memcmp(&controllers[i].state, &last.state, sizeof(XINPUT_STATE)) != 0)
+		{
+			recording->writeController(i, controllers[i].connected, controllers[i].state);
+			last = controllers[i];
+		}
 	}
 }
 
 //=============================================================================
-// Read state of connected controllers
+// Apply the controller records that come next in the replay
 //=============================================================================
-void InputSystem::readControllers()
+void InputSystem::replayControllers()
 {
-	DWORD result;
-	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	while (recording->peek() == inputRecordingNS::RECORD_CONTROLLER)
 	{
-		if (controllers[i].connected)
+		bool connected;
+		XINPUT_STATE state;
+		UINT n = recording->readController(connected, state);
+		controllers[n].connected = connected;
+		controllers[n].state = state;
+	}
+}
+
+//=============================================================================
+// Apply one event to the input state
+//=============================================================================
+void InputSystem::applyEvent(const InputEvent& e)
+{
+	switch (e.type)
+	{
+	case inputNS::EVENT_KEY_DOWN:
+		keyDown(e.wParam, e.time);
+		break;
+	case inputNS::EVENT_KEY_UP:
+		keyUp(e.wParam);
+		break;
+	case inputNS::EVENT_CHAR:
+		keyIn(e.wParam);
+		break;
+	case inputNS::EVENT_MOUSE_MOVE:
+		mouseIn(e.lParam);
+		break;
+	case inputNS::EVENT_MOUSE_RAW:
+		mouseRawX += e.rawX;
+		mouseRawY += e.rawY;
+		if (mouseHistory && mouseSamples.size() < rawMouseNS::HISTORY)
 		{
-			result = XInputGetState(i, &controllers[i].state);
-			if (result == ERROR_DEVICE_NOT_CONNECTED)    // if controller disconnected
-				controllers[i].connected = false;
+			RawMotion m;
+			m.time = e.time;
+			m.dx = e.rawX;
+			m.dy = e.rawY;
+			mouseSamples.push_back(m);
 		}
+		break;
+	case inputNS::EVENT_LBUTTON_DOWN: case inputNS::EVENT_LBUTTON_UP:
+		setMouseLButton(e.type == inputNS::EVENT_LBUTTON_DOWN);
+		mouseIn(e.lParam);              // mouse position
+		break;
+	case inputNS::EVENT_MBUTTON_DOWN: case inputNS::EVENT_MBUTTON_UP:
+		setMouseMButton(e.type == inputNS::EVENT_MBUTTON_DOWN);
+		mouseIn(e.lParam);              // mouse position
+		break;
+	case inputNS::EVENT_RBUTTON_DOWN: case inputNS::EVENT_RBUTTON_UP:
+		setMouseRButton(e.type == inputNS::EVENT_RBUTTON_DOWN);
+		mouseIn(e.lParam);              // mouse position
+		break;
+	case inputNS::EVENT_XBUTTON:
+		setMouseXButton(e.wParam);
+		mouseIn(e.lParam);              // mouse position
+		break;
+	case inputNS::EVENT_DEVICE_CHANGE:
+		checkControllers();
+		break;
+	}
+}
+
+//=============================================================================
+// Probe the empty controller slots at the next poll
+//=============================================================================
+void InputSystem::checkControllers()
+{
+	// a replay sets the recorded controller state
+	if (recording->isReplaying())
+		return;
+	controllerService.rescan();
+}
+
+//=============================================================================
+// Take the newest controller state published by the controller thread
+//=============================================================================
+void InputSystem::readControllers()
+{
+	if (recording->isReplaying())
+	{
+		replayControllers();
+		return;
 	}
+	if (!controllerService.isThreaded())
+		controllerService.poll();
+	const ControllerSnapshot& s = controllerService.read();
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+	{
+		controllers[i].connected = s.connected[i];
+		controllers[i].state = s.state[i];
+	}
+	recordControllers();
 }
 
 //=============================================================================
@@ -266,7 +563,7 @@ void InputSystem::readControllers()
 //=============================================================================
 void InputSystem::vibrateControllers(float frameTime)
 {
-	for (int i = 0; i < MAX_CONTROLLERS; i++)
+	for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
 	{
 		if (controllers[i].connected)
 		{
@@ -282,7 +579,8 @@ void InputSystem::vibrateControllers(float frameTime)
 				controllers[i].vibrateTimeRight = 0;
 				controllers[i].vibration.wRightMotorSpeed = 0;
 			}
-			XInputSetState(i, &controllers[i].vibration);
+			controllerService.setVibration(i, controllers[i].vibration.wLeftMotorSpeed,
+				controllers[i].vibration.wRightMotorSpeed);
 		}
 	}
 }
@@ -2,11 +2,18 @@
 #define WIN32_LEAN_AND_MEAN
 
 class InputSystem;
+class InputRecording;
 
-#include <windows.h>
+#include "platform.h"
+#ifdef _WIN32
 #include <WindowsX.h>
+#endif
 #include <string>
-#include <XInput.h>
+#include <vector>
+#include <atomic>
+#include "spscQueue.h"
+#include "controllerService.h"
+#include "rawMouse.h"
 #include "constants.h"
 #include "gameError.h"
 
@@ -24,17 +31,108 @@ namespace inputNS
 {
 	const int KEYS_ARRAY_LEN = 256;     // size of key arrays
 
+	const int KEY_WORDS = KEYS_ARRAY_LEN / 64;  // 64 bit words of a KeyBits
+
 	// what values for clear(), bit flag
 	const UCHAR KEYS_DOWN = 1;
-	const UCHAR KEYS_PRESSED = 2;
+	const UCHAR KEYS_PRESSED = 2;           // also clears the released and repeated keys
 	const UCHAR MOUSE = 4;
 	const UCHAR TEXT_IN = 8;
 	const UCHAR KEYS_MOUSE_TEXT = KEYS_DOWN + KEYS_PRESSED + MOUSE + TEXT_IN;
+
+	const size_t TEXT_IN_CAPACITY = 256;    // characters kept in textIn, reserved up front
+
+	// input event types for postEvent()
+	const UINT EVENT_KEY_DOWN = 0;          // wParam = virtual key
+	const UINT EVENT_KEY_UP = 1;            // wParam = virtual key
+	const UINT EVENT_CHAR = 2;              // wParam = character
+	const UINT EVENT_MOUSE_MOVE = 3;        // lParam = mouse position
+	const UINT EVENT_MOUSE_RAW = 4;         // lParam = raw input handle, posted as the rawX, rawY of its reports
+	const UINT EVENT_LBUTTON_DOWN = 5;      // lParam = mouse position
+	const UINT EVENT_LBUTTON_UP = 6;
+	const UINT EVENT_MBUTTON_DOWN = 7;
+	const UINT EVENT_MBUTTON_UP = 8;
+	const UINT EVENT_RBUTTON_DOWN = 9;
+	const UINT EVENT_RBUTTON_UP = 10;
+	const UINT EVENT_XBUTTON = 11;          // wParam = X button state, lParam = mouse position
+	const UINT EVENT_DEVICE_CHANGE = 12;    // controller inserted or removed
+
+	const size_t EVENT_QUEUE_SIZE = 1024;   // events queued between simulation ticks
 }
 
+// Set of virtual keys, one bit per key.
+// Whole sets are tested with a few word operations instead of a scan of an
+// array, e.g. any key or every key of a chord.
+struct KeyBits
+{
+	UINT64 bits[inputNS::KEY_WORDS];
+
+	// Constructor, no keys.
+	KeyBits() { clear(); }
+
+	// Constructor of a chord of up to four keys, 0 ends the list.
+	explicit KeyBits(UCHAR k1, UCHAR k2 = 0, UCHAR k3 = 0, UCHAR k4 = 0)
+	{
+		clear();
+		UCHAR keys[4] = { k1, k2, k3, k4 };
+		for (int i = 0; i < 4 && keys[i] != 0; i++)
+			set(keys[i]);
+	}
+
+	void set(UCHAR key)        { bits[key >> 6] |= (UINT64)1 << (key & 63); }
+	void reset(UCHAR key)      { bits[key >> 6] &= ~((UINT64)1 << (key & 63)); }
+	bool test(UCHAR key) const { return (bits[key >> 6] >> (key & 63) & 1) != 0; }
+	void clear()               { bits[0] = bits[1] = bits[2] = bits[3] = 0; }
+	bool any() const           { return (bits[0] | bits[1] | bits[2] | bits[3]) != 0; }
+
+	// Return true if every key of k is in the set.
+	bool contains(const KeyBits& k) const
+	{
+		return (bits[0] & k.bits[0]) == k.bits[0] && (bits[1] & k.bits[1]) == k.bits[1] &&
+			(bits[2] & k.bits[2]) == k.bits[2] && (bits[3] & k.bits[3]) == k.bits[3];
+	}
+
+	// Return true if a key of k is in the set.
+	bool intersects(const KeyBits& k) const
+	{
+		return ((bits[0] & k.bits[0]) | (bits[1] & k.bits[1]) |
+			(bits[2] & k.bits[2]) | (bits[3] & k.bits[3])) != 0;
+	}
+
+	KeyBits operator|(const KeyBits& k) const
+	{
+		KeyBits r;
+		for (int i = 0; i < inputNS::KEY_WORDS; i++)
+			r.bits[i] = bits[i] | k.bits[i];
+		return r;
+	}
+
+	bool operator==(const KeyBits& k) const
+	{
+		return bits[0] == k.bits[0] && bits[1] == k.bits[1] && bits[2] == k.bits[2] && bits[3] == k.bits[3];
+	}
+};
+
+// Input event queued by the window message thread.
+struct InputEvent
+{
+	LONGLONG time;                      // performance counter when the event was posted
+	UINT     type;                      // inputNS::EVENT_
+	WPARAM   wParam;
+	LPARAM   lParam;
+	int      rawX, rawY;                // mouse movement of EVENT_MOUSE_RAW, the sum of a batch of reports
+};
+
+// Simulation settings stored in an input recording, a replay runs with them.
+struct RecordingSettings
+{
+	bool     fixedTimestep;             // true if the game ran at a fixed tick rate
+	float    tickTime;                  // seconds of one tick
+	UINT     maxTicks;                  // ticks run in one frame before ticks are dropped
+};
+
 const DWORD GAMEPAD_THUMBSTICK_DEADZONE = (DWORD)(0.20f * 0X7FFF);    // default to 20% of range as deadzone
 const DWORD GAMEPAD_TRIGGER_DEADZONE = 30;                      // trigger range 0-255
-const DWORD MAX_CONTROLLERS = 4;                                // Maximum number of controllers supported by XInput
 
 // Bit corresponding to gamepad button in state.Gamepad.wButtons
 const DWORD GAMEPAD_DPAD_UP = 0x0001;
@@ -72,12 +170,96 @@ public:
 
 	// Initialize mouse and controller input.
 	// Throws GameError
-	// Pre: hwnd = window handle
+	// Pre: hwnd = window handle, nullptr when running without a window
 	//      capture = true to capture mouse.
 	void initialize(HWND hwnd, bool capture);
 
-	// Save key down state
-	void keyDown(WPARAM);
+	// Read the controllers from device at pollRate polls per second on the
+	// controller thread, call before initialize(). device nullptr is XInput,
+	// pollRate 0 polls on the game thread in readControllers().
+	// Pre: device stays valid until the InputSystem is destroyed
+	void setControllerDevice(ControllerDevice* device, double pollRate = controllerNS::POLL_RATE)
+	{
+		controllerDevice = device;
+		controllerPollRate = pollRate;
+	}
+
+	// Return statistics of the controller thread.
+	ControllerStats getControllerStats() const { return controllerService.getStats(); }
+
+	// Queue an input event with the current time.
+	// The window message thread posts events and the simulation applies them
+	// with processEvents(), so the message pump and the simulation do not
+	// share input state and may run on different threads.
+	// Returns false if the queue is full and the event was dropped.
+	// Pre: type = inputNS::EVENT_, wParam and lParam of the window message
+	bool postEvent(UINT type, WPARAM wParam = 0, LPARAM lParam = 0);
+
+	// Apply the queued events posted at or before performance counter time until.
+	// Later events stay queued for the next call. Returns number of events applied.
+	// Call from the simulation thread only.
+	UINT processEvents(LONGLONG until);
+
+	// Post the reports of a WM_INPUT message and every report still queued
+	// behind it, see postRawMotion(). Returns number of reports.
+	// Called by the window message thread
+	UINT postRawInput(LPARAM lParam);
+
+	// Post all reports source has as EVENT_MOUSE_RAW events, one event with
+	// the sum of each batch, or one event per report with the mouse history
+	// on. Returns number of reports.
+	// Called by the window message thread
+	UINT postRawMotion(RawMotionSource& source);
+
+	// Keep the reports applied by each processEvents(), up to
+	// rawMouseNS::HISTORY, for getMouseSamples(). Set before input is posted.
+	void setMouseHistory(bool on) { mouseHistory = on; }
+
+	// Return the mouse reports of the last processEvents(), oldest first.
+	// A replay restores the times relative to the start of their frame.
+	const std::vector<RawMotion>& getMouseSamples() const { return mouseSamples; }
+
+	// Return number of raw mouse reports posted.
+	UINT64 getRawReports() const { return rawReports.load(); }
+
+	// Return number of events dropped because the queue was full.
+	UINT64 getEventsDropped() const { return eventsDropped.load(); }
+
+	// Return the posting time of the last applied event, 0 if none.
+	LONGLONG getLastEventTime() const { return lastEventTime; }
+
+	// Record the input applied from now on and the settings to filename.
+	// Throws GameError if the file can not be created
+	void startRecording(const std::string& filename, const RecordingSettings& settings);
+
+	// Replay the input recorded in filename instead of the posted events.
+	// Returns the settings of the recording.
+	// Throws GameError if the file can not be read
+	RecordingSettings startReplay(const std::string& filename);
+
+	// Finish recording or replay.
+	// Throws GameError if the recording can not be written
+	void stopRecording();
+
+	// Return true while recording.
+	bool isRecording() const;
+
+	// Return true while replaying.
+	bool isReplaying() const;
+
+	// Return true if beginFrame() found no more frames to replay.
+	bool isReplayDone() const { return replayDone; }
+
+	// Start a frame of recording or replay, call before the frame's simulation.
+	// Returns the frame time to simulate: frameTime, or the recorded frame time
+	// when replaying. Sets isReplayDone() at the end of the replay.
+	// Throws GameError if the recording can not be written
+	float beginFrame(float frameTime);
+
+	// Save key down state.
+	// A key that was up is pressed at time, a performance counter value; a
+	// key already down is repeated by the keyboard auto repeat.
+	void keyDown(WPARAM vkey, LONGLONG time = 0);
 
 	// Save key up state
 	void keyUp(WPARAM);
@@ -89,12 +271,50 @@ public:
 	bool isKeyDown(UCHAR vkey) const;
 
 	// Return true if the specified VIRTUAL KEY has been pressed in the most recent frame.
+	// Only the change from up to down is a press, not the auto repeat.
 	// Key presses are erased at the end of each frame.
-	bool wasKeyPressed(UCHAR vkey) const;
+	bool wasKeyPressed(UCHAR vkey) const { return keysPressed.test(vkey); }
+
+	// Return true if the key was released in the most recent frame.
+	bool wasKeyReleased(UCHAR vkey) const { return keysReleased.test(vkey); }
+
+	// Return true if the keyboard auto repeat sent the key in the most recent frame.
+	bool wasKeyRepeated(UCHAR vkey) const { return keysRepeated.test(vkey); }
+
+	// Return true if the key is down and was down before the most recent frame.
+	bool isKeyHeld(UCHAR vkey) const { return keysDown.test(vkey) && !keysPressed.test(vkey); }
+
+	// Return performance counter time of the last press of the key, 0 if never pressed.
+	LONGLONG getKeyPressTime(UCHAR vkey) const { return keyPressTime[vkey]; }
+
+	// Return number of auto repeats since the last press of the key.
+	UINT getKeyRepeatCount(UCHAR vkey) const { return keyRepeats[vkey]; }
 
 	// Return true if any key was pressed in the most recent frame.
 	// Key presses are erased at the end of each frame.
-	bool anyKeyPressed() const;
+	bool anyKeyPressed() const { return keysPressed.any(); }
+
+	// Return true if any key is down.
+	bool anyKeyDown() const { return keysDown.any(); }
+
+	// Return true if every key of chord is down.
+	bool isChordDown(const KeyBits& chord) const { return keysDown.contains(chord); }
+
+	// Return true if every key of chord is down and one of them was pressed
+	// in the most recent frame, so holding the chord triggers once.
+	bool wasChordPressed(const KeyBits& chord) const
+	{
+		return keysDown.contains(chord) && keysPressed.intersects(chord);
+	}
+
+	// Return the keys that are down.
+	const KeyBits& getKeysDown() const { return keysDown; }
+
+	// Return the keys pressed in the most recent frame.
+	const KeyBits& getKeysPressed() const { return keysPressed; }
+
+	// Return the keys released in the most recent frame.
+	const KeyBits& getKeysReleased() const { return keysReleased; }
 
 	// Clear the specified key press
 	void clearKeyPress(UCHAR vkey);
@@ -111,7 +331,7 @@ public:
 	void clearTextIn() { textIn.clear(); }
 
 	// Return text input as a string
-	std::string getTextIn() { return textIn; }
+	const std::string& getTextIn() const { return textIn; }
 
 	// Return last character entered
 	char getCharIn()        { return charIn; }
@@ -119,10 +339,6 @@ public:
 	// Reads mouse screen position into mouseX, mouseY
 	void mouseIn(LPARAM);
 
-	// Reads raw mouse data into mouseRawX, mouseRawY
-	// This routine is compatible with a high-definition mouse
-	void mouseRawIn(LPARAM);
-
 	// Save state of mouse button
 	void setMouseLButton(bool b) { mouseLButton = b; }
 
@@ -143,12 +359,12 @@ public:
 	// Return mouse Y position
 	int  getMouseY()        const { return mouseY; }
 
-	// Return raw mouse X movement. Left is <0, Right is >0
-	// Compatible with high-definition mouse.
+	// Return raw mouse X movement of the last processEvents(). Left is <0, Right is >0
+	// Compatible with high-definition mouse, all reports are summed.
 	int  getMouseRawX()     const { return mouseRawX; }
 
-	// Return raw mouse Y movement. Up is <0, Down is >0
-	// Compatible with high-definition mouse.
+	// Return raw mouse Y movement of the last processEvents(). Up is <0, Down is >0
+	// Compatible with high-definition mouse, all reports are summed.
 	int  getMouseRawY()     const { return mouseRawY; }
 
 	// Return state of left mouse button.
@@ -166,10 +382,10 @@ public:
 	// Return state of X2 mouse button.
 	bool getMouseX2Button() const { return mouseX2Button; }
 
-	// Update connection status of game controllers.
+	// Probe the empty controller slots soon, after a device change.
 	void checkControllers();
 
-	// Save input from connected game controllers.
+	// Take the newest controller state of the controller thread.
 	void readControllers();
 
 	// Return state of specified game controller.
@@ -373,16 +589,29 @@ public:
 	}
 
 	// Vibrates the connected controllers for the desired time.
+	// The controller thread sends the motor speeds when they change.
 	void vibrateControllers(float frameTime);
 private:
-	bool keysDown[inputNS::KEYS_ARRAY_LEN];				// true if specified key is down
-	bool keysPressed[inputNS::KEYS_ARRAY_LEN];			// true if specified key was pressed
+	KeyBits keysDown;									// keys that are down
+	KeyBits keysPressed;								// keys that went down since the last clear
+	KeyBits keysReleased;								// keys that went up since the last clear
+	KeyBits keysRepeated;								// keys auto repeated since the last clear
+	LONGLONG keyPressTime[inputNS::KEYS_ARRAY_LEN];		// time of the last press
+	UINT keyRepeats[inputNS::KEYS_ARRAY_LEN];			// auto repeats since the last press
 	std::string textIn;									// user entered text
 	char charIn;										// last character entered
 	bool newLine;										// true on start of new line
 	int  mouseX, mouseY;								// mouse screen coordinates
 	int  mouseRawX, mouseRawY;							// high-definition mouse data
+	std::vector<RawMotion> mouseSamples;				// reports of the last processEvents()
+	bool mouseHistory;									// true to keep mouseSamples
+	RawInputSource rawInput;							// message thread
+	RawMotion rawBatch[rawMouseNS::BATCH];				// message thread
+	LONGLONG lastRawTime;								// message thread, time of the last report posted
+	std::atomic<UINT64> rawReports;						// raw mouse reports posted
+#ifdef _WIN32
 	RAWINPUTDEVICE Rid[1];								// for high-definition mouse
+#endif
 	bool mouseCaptured;									// true if mouse captured
 	bool mouseLButton;									// true if left mouse button down
 	bool mouseMButton;									// true if middle mouse button down
@@ -390,4 +619,20 @@ private:
 	bool mouseX1Button;									// true if X1 mouse button down
 	bool mouseX2Button;									// true if X2 mouse button down
 	ControllerState controllers[MAX_CONTROLLERS];		// state of controllers
+	ControllerService controllerService;				// polls the controllers on its own thread
+	ControllerDevice* controllerDevice;					// nullptr for XInput
+	double controllerPollRate;
+	SpscQueue<InputEvent> events;						// posted events not yet applied
+	std::atomic<UINT64> eventsDropped;					// events lost to a full queue
+	LONGLONG lastEventTime;								// time of the last applied event
+	InputRecording* recording;							// input recording and replay
+	bool replayDone;									// true when a replay found no more frames
+	ControllerState recordedControllers[MAX_CONTROLLERS];	// controller state last recorded
+
+	// Apply one event to the input state.
+	void applyEvent(const InputEvent& e);
+	// Record the controllers whose state changed since they were last recorded.
+	void recordControllers();
+	// Apply the controller records that come next in the replay.
+	void replayControllers();
 };
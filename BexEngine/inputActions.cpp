@@ -0,0 +1,113 @@
+#include "inputActions.h"
+
+//=============================================================================
+// Constructor
+//=============================================================================
+InputActions::InputActions()
+{
+	down = 0;
+	pressed = 0;
+	released = 0;
+}
+
+//=============================================================================
+// Add an action, returns its id
+// Throws GameError
+//=============================================================================
+UINT InputActions::add(const std::string& name)
+{
+	UINT id = find(name);
+	if (id != inputActionsNS::INVALID)
+		return id;
+	if (names.size() >= inputActionsNS::MAX_ACTIONS)
+		throw(GameError(gameErrorNS::WARNING, "Too many input actions, " + name));
+	names.push_back(name);
+	return (UINT)names.size() - 1;
+}
+
+//=============================================================================
+// Return id of the action name
+//=============================================================================
+UINT InputActions::find(const std::string& name) const
+{
+	for (size_t i = 0; i < names.size(); i++)
+		if (names[i] == name)
+			return (UINT)i;
+	return inputActionsNS::INVALID;
+}
+
+//=============================================================================
+// Bind a chord of keys to action id
+//=============================================================================
+void InputActions::bindKeys(UINT id, const KeyBits& chord)
+{
+	if (id >= names.size() || !chord.any())
+		return;
+	Binding b;
+	b.action = id;
+	b.keys = chord;
+	b.buttons = 0;
+	b.controller = 0;
+	bindings.push_back(b);
+}
+
+//=============================================================================
+// Bind gamepad buttons of controller n to action id
+//=============================================================================
+void InputActions::bindGamepad(UINT id, WORD buttons, UINT n)
+{
+	if (id >= names.size() || buttons == 0)
+		return;
+	Binding b;
+	b.action = id;
+	b.buttons = buttons;
+	b.controller = n < MAX_CONTROLLERS ? n : MAX_CONTROLLERS - 1;
+	bindings.push_back(b);
+}
+
+//=============================================================================
+// Remove all bindings of action id
+//=============================================================================
+void InputActions::unbind(UINT id)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < bindings.size(); i++)
+		if (bindings[i].action != id)
+			bindings[n++] = bindings[i];
+	bindings.resize(n);
+}
+
+//=============================================================================
+// Resolve the bindings against the current input.
+// A binding is down when all of its keys or buttons are down. A key chord
+// also presses its action if all of its keys went down during the step,
+// even if some were released again before this update.
+//=============================================================================
+void InputActions::update(InputSystem& input)
+{
+	const KeyBits& keysDown = input.getKeysDown();
+	const KeyBits& keysPressed = input.getKeysPressed();
+	const KeyBits seen = keysDown | keysPressed;
+	WORD buttons[MAX_CONTROLLERS];
+	for (UINT i = 0; i < MAX_CONTROLLERS; i++)
+		buttons[i] = input.getControllerState(i)->connected ? input.getGamepadButtons(i) : 0;
+
+	UINT64 now = 0, tapped = 0;
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		const Binding& b = bindings[i];
+		const UINT64 bit = (UINT64)1 << b.action;
+		if (b.buttons)
+		{
+			if ((buttons[b.controller] & b.buttons) == b.buttons)
+				now |= bit;
+		}
+		else if (keysDown.contains(b.keys))
+			now |= bit;
+		else if (seen.contains(b.keys) && keysPressed.intersects(b.keys))
+			tapped |= bit;
+	}
+	pressed = (now & ~down) | (tapped & ~down);
+	released = (down & ~now) | tapped;
+	down = now;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "input.h"
+
+namespace inputActionsNS
+{
+	const UINT MAX_ACTIONS = 64;            // actions, one bit of a 64 bit mask each
+	const UINT INVALID = 0xFFFFFFFF;
+}
+
+// Named game actions bound to key chords and gamepad buttons.
+// update() resolves all bindings once per simulation step into bit masks of
+// the actions that are down, pressed and released, so the game asks for an
+// action with a shift instead of walking its bindings on every query. An
+// action is down while any of its bindings is held: every key of a chord,
+// or every gamepad button of a binding on its controller.
+class InputActions final
+{
+public:
+	// Constructor, no actions.
+	InputActions();
+
+	// Add an action, returns its id. An existing action of that name is returned.
+	// Throws GameError if there are MAX_ACTIONS actions
+	UINT    add(const std::string& name);
+
+	// Return id of the action name, inputActionsNS::INVALID if there is none.
+	UINT    find(const std::string& name) const;
+
+	// Return name of action id.
+	const std::string& getName(UINT id) const { return names[id]; }
+
+	// Return number of actions.
+	UINT    getCount() const { return (UINT)names.size(); }
+
+	// Bind a chord of keys to action id, e.g. KeyBits(VK_CONTROL, 'S').
+	void    bindKeys(UINT id, const KeyBits& chord);
+
+	// Bind gamepad buttons of controller n to action id.
+	// Pre: buttons = GAMEPAD_ bits, all must be down
+	void    bindGamepad(UINT id, WORD buttons, UINT n = 0);
+
+	// Remove all bindings of action id.
+	void    unbind(UINT id);
+
+	// Resolve the bindings against the current input, once per simulation
+	// step after InputSystem::processEvents(). A chord that was pressed and
+	// released within the step still counts as a press.
+	void    update(InputSystem& input);
+
+	// Return true while action id is down.
+	bool    isDown(UINT id) const     { return (down >> id & 1) != 0; }
+
+	// Return true if action id went down in the last update().
+	bool    wasPressed(UINT id) const { return (pressed >> id & 1) != 0; }
+
+	// Return true if action id went up in the last update().
+	bool    wasReleased(UINT id) const { return (released >> id & 1) != 0; }
+
+	// Return the actions that are down, bit n is action n.
+	UINT64  getDown() const { return down; }
+
+	// Return the actions pressed in the last update().
+	UINT64  getPressed() const { return pressed; }
+
+private:
+	// One way to trigger an action.
+	struct Binding
+	{
+		UINT    action;
+		KeyBits keys;                   // chord, empty for a gamepad binding
+		WORD    buttons;                // GAMEPAD_ bits
+		UINT    controller;
+	};
+
+	std::vector<std::string> names;     // action names by id
+	std::vector<Binding> bindings;
+	UINT64  down;                       // bit masks of the actions
+	UINT64  pressed;
+	UINT64  released;
+};
@@ -0,0 +1,367 @@
+#include "inputRecording.h"
+#include <cstring>
+
+namespace
+{
+	const char MAGIC[4] = { 'B', 'E', 'X', 'R' };
+	const LONGLONG MICROSECONDS = 1000000;  // unit of the recorded event times
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+InputRecording::InputRecording()
+{
+	file = nullptr;
+	settings.fixedTimestep = false;
+	settings.tickTime = 0;
+	settings.maxTicks = 0;
+	frameStart = 0;
+	lastFrameTicks = 0;
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	frequency = freq.QuadPart > 0 ? freq.QuadPart : 1;
+	pos = 0;
+	replaying = false;
+	frames = 0;
+	bytes = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+InputRecording::~InputRecording()
+{
+	try{
+		stop();
+	}
+	catch (...)
+	{}                                  // a destructor must not throw
+}
+
+//=============================================================================
+// Start writing a recording to filename
+// Throws GameError
+//=============================================================================
+void InputRecording::startRecording(const std::string& name, const RecordingSettings& s)
+{
+	stop();
+	file = fopen(name.c_str(), "wb");
+	if (file == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Error creating input recording " + name));
+	filename = name;
+	settings = s;
+	frames = 0;
+	bytes = 0;
+	data.reserve(inputRecordingNS::FLUSH_BYTES * 2);
+	for (int i = 0; i < 4; i++)
+		putByte(MAGIC[i]);
+	putByte(inputRecordingNS::VERSION);
+	putByte(settings.fixedTimestep ? 1 : 0);
+	putFloat(settings.tickTime);
+	putVarint(settings.maxTicks);
+}
+
+//=============================================================================
+// Load a recording for replay
+// Throws GameError
+//=============================================================================
+void InputRecording::startReplay(const std::string& name)
+{
+	stop();
+	FILE* in = fopen(name.c_str(), "rb");
+	if (in == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Error opening input recording " + name));
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(in);
+	pos = 5;
+	bool valid = data.size() > 10 && memcmp(&data[0], MAGIC, 4) == 0 && data[4] == inputRecordingNS::VERSION;
+	if (valid)
+	{
+		settings.fixedTimestep = getByte() != 0;
+		settings.tickTime = getFloat();
+		settings.maxTicks = (UINT)getVarint();
+		valid = !settings.fixedTimestep || (settings.tickTime > 0 && settings.maxTicks > 0);
+	}
+	if (!valid)
+	{
+		data.clear();
+		pos = 0;
+		throw(GameError(gameErrorNS::WARNING, "Not an input recording " + name));
+	}
+	filename = name;
+	// the replay clock starts at 1 s, time 0 means no time to keyDown()
+	frameStart = frequency;
+	lastFrameTicks = 0;
+	frames = 0;
+	bytes = data.size();
+	replaying = true;
+}
+
+//=============================================================================
+// Finish the recording or replay
+//=============================================================================
+void InputRecording::stop()
+{
+	if (file)
+	{
+		putByte(inputRecordingNS::RECORD_END);
+		try{
+			flush();                    // throws GameError
+		}
+		catch (...)
+		{
+			fclose(file);
+			file = nullptr;
+			data.clear();
+			throw;
+		}
+		// buffered data is written by fclose
+		bool closed = fclose(file) == 0;
+		file = nullptr;
+		if (!closed)
+		{
+			data.clear();
+			throw(GameError(gameErrorNS::WARNING, "Error writing input recording " + filename));
+		}
+	}
+	data.clear();
+	pos = 0;
+	replaying = false;
+}
+
+//=============================================================================
+// Write the buffered records to the file
+// Throws GameError
+//=============================================================================
+void InputRecording::flush()
+{
+	if (file && !data.empty() && fwrite(&data[0], 1, data.size(), file) != data.size())
+	{
+		data.clear();
+		throw(GameError(gameErrorNS::WARNING, "Error writing input recording " + filename));
+	}
+	bytes += data.size();
+	data.clear();
+}
+
+//=============================================================================
+// Write the exact bits of a float
+//=============================================================================
+void InputRecording::putFloat(float f)
+{
+	UINT bits;
+	memcpy(&bits, &f, sizeof(bits));
+	for (int i = 0; i < 4; i++)
+		putByte((UCHAR)(bits >> (i * 8)));
+}
+
+//=============================================================================
+// Write an unsigned variable length integer, 7 bits per byte
+//=============================================================================
+void InputRecording::putVarint(UINT64 v)
+{
+	while (v >= 0x80)
+	{
+		putByte((UCHAR)(v | 0x80));
+		v >>= 7;
+	}
+	putByte((UCHAR)v);
+}
+
+//=============================================================================
+// Write a signed variable length integer, small magnitudes take one byte
+//=============================================================================
+void InputRecording::putSigned(LONGLONG v)
+{
+	putVarint(((UINT64)v << 1) ^ (UINT64)(v >> 63));
+}
+
+//=============================================================================
+// Read a byte, 0 past the end
+//=============================================================================
+UCHAR InputRecording::getByte()
+{
+	return pos < data.size() ? data[pos++] : 0;
+}
+
+//=============================================================================
+// Read the bits of a float
+//=============================================================================
+float InputRecording::getFloat()
+{
+	UINT bits = 0;
+	for (int i = 0; i < 4; i++)
+		bits |= (UINT)getByte() << (i * 8);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+//=============================================================================
+// Read an unsigned variable length integer
+//=============================================================================
+UINT64 InputRecording::getVarint()
+{
+	UINT64 v = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		UCHAR b = getByte();
+		v |= (UINT64)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			break;
+	}
+	return v;
+}
+
+//=============================================================================
+// Read a signed variable length integer
+//=============================================================================
+LONGLONG InputRecording::getSigned()
+{
+	UINT64 v = getVarint();
+	return (LONGLONG)(v >> 1) ^ -(LONGLONG)(v & 1);
+}
+
+//=============================================================================
+// Start a frame
+// Throws GameError
+//=============================================================================
+void InputRecording::writeFrame(float frameTime)
+{
+	if (file == nullptr)
+		return;
+	if (data.size() >= inputRecordingNS::FLUSH_BYTES)
+		flush();                        // throws GameError
+	// the event times of the frame are relative to now
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	frameStart = now.QuadPart;
+	// the exact bits, so a replay runs the same frame times
+	putByte(inputRecordingNS::RECORD_FRAME);
+	putFloat(frameTime);
+	++frames;
+}
+
+//=============================================================================
+// Add an applied input event
+//=============================================================================
+void InputRecording::writeEvent(const InputEvent& e)
+{
+	if (file == nullptr)
+		return;
+	putByte(inputRecordingNS::RECORD_EVENT);
+	putSigned((e.time - frameStart) * MICROSECONDS / frequency);
+	putVarint(e.type);
+	putVarint(e.wParam);
+	putSigned(e.lParam);
+	if (e.type == inputNS::EVENT_MOUSE_RAW)
+	{
+		putSigned(e.rawX);
+		putSigned(e.rawY);
+	}
+}
+
+//=============================================================================
+// End the events of one simulation step
+//=============================================================================
+void InputRecording::writeStep()
+{
+	if (file)
+		putByte(inputRecordingNS::RECORD_STEP);
+}
+
+//=============================================================================
+// Add the state of controller n
+//=============================================================================
+void InputRecording::writeController(UINT n, bool connected, const XINPUT_STATE& state)
+{
+	if (file == nullptr)
+		return;
+	putByte(inputRecordingNS::RECORD_CONTROLLER);
+	putByte((UCHAR)(n | (connected ? 0x80 : 0)));
+	putVarint(state.dwPacketNumber);
+	putVarint(state.Gamepad.wButtons);
+	putByte(state.Gamepad.bLeftTrigger);
+	putByte(state.Gamepad.bRightTrigger);
+	putSigned(state.Gamepad.sThumbLX);
+	putSigned(state.Gamepad.sThumbLY);
+	putSigned(state.Gamepad.sThumbRX);
+	putSigned(state.Gamepad.sThumbRY);
+}
+
+//=============================================================================
+// Return the type of the next record
+//=============================================================================
+UCHAR InputRecording::peek() const
+{
+	if (!replaying || pos >= data.size())
+		return inputRecordingNS::RECORD_END;
+	return data[pos];
+}
+
+//=============================================================================
+// Read a frame record, returns its frame time
+//=============================================================================
+float InputRecording::readFrame()
+{
+	getByte();
+	float frameTime = getFloat();
+	// the replay clock starts the next frame after the previous one
+	if (frames > 0)
+		frameStart += lastFrameTicks;
+	lastFrameTicks = (LONGLONG)((double)frameTime * frequency);
+	++frames;
+	return frameTime;
+}
+
+//=============================================================================
+// Read an event record
+//=============================================================================
+void InputRecording::readEvent(InputEvent& e)
+{
+	getByte();
+	e.time = frameStart + getSigned() * frequency / MICROSECONDS;
+	if (e.time <= 0)
+		e.time = 1;
+	e.type = (UINT)getVarint();
+	e.wParam = (WPARAM)getVarint();
+	e.lParam = (LPARAM)getSigned();
+	e.rawX = 0;
+	e.rawY = 0;
+	if (e.type == inputNS::EVENT_MOUSE_RAW)
+	{
+		e.rawX = (int)getSigned();
+		e.rawY = (int)getSigned();
+	}
+}
+
+//=============================================================================
+// Read a step record
+//=============================================================================
+void InputRecording::readStep()
+{
+	getByte();
+}
+
+//=============================================================================
+// Read a controller record, returns the controller number
+//=============================================================================
+UINT InputRecording::readController(bool& connected, XINPUT_STATE& state)
+{
+	getByte();
+	UCHAR n = getByte();
+	connected = (n & 0x80) != 0;
+	state.dwPacketNumber = (DWORD)getVarint();
+	state.Gamepad.wButtons = (WORD)getVarint();
+	state.Gamepad.bLeftTrigger = getByte();
+	state.Gamepad.bRightTrigger = getByte();
+	state.Gamepad.sThumbLX = (SHORT)getSigned();
+	state.Gamepad.sThumbLY = (SHORT)getSigned();
+	state.Gamepad.sThumbRX = (SHORT)getSigned();
+	state.Gamepad.sThumbRY = (SHORT)getSigned();
+	return (n & 0x7F) < MAX_CONTROLLERS ? (n & 0x7F) : MAX_CONTROLLERS - 1;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "input.h"
+
+namespace inputRecordingNS
+{
+	const UCHAR VERSION = 2;
+	const size_t FLUSH_BYTES = 64 * 1024;   // recorded bytes buffered before they are written
+
+	// record types
+	const UCHAR RECORD_END = 0;             // end of the recording
+	const UCHAR RECORD_FRAME = 1;           // start of a frame and its frame time
+	const UCHAR RECORD_EVENT = 2;           // input event
+	const UCHAR RECORD_STEP = 3;            // end of the events of one processEvents()
+	const UCHAR RECORD_CONTROLLER = 4;      // changed controller state
+}
+
+// Compact binary recording of the input applied by InputSystem.
+// A recording is a header with the RecordingSettings followed by records:
+// every frame starts with its frame time, the events applied by each
+// simulation step follow in order with their time relative to the start of
+// the frame and end with a step record, controller state is stored when it
+// changes. A replay stamps the events from a clock that advances by the
+// recorded frame times, so the event times are the same in every replay.
+// Numbers are stored as variable length integers, so most records take a
+// few bytes.
+class InputRecording final
+{
+public:
+	// Constructor
+	InputRecording();
+
+	// Destructor, finishes the recording, write errors are ignored.
+	~InputRecording();
+
+	// Start writing a recording with settings to filename.
+	// Throws GameError if the file can not be created
+	void startRecording(const std::string& filename, const RecordingSettings& settings);
+
+	// Load a recording from filename for replay.
+	// Throws GameError if the file can not be read or is not a recording
+	void startReplay(const std::string& filename);
+
+	// Finish the recording or replay, the frame and byte counts are kept.
+	// Throws GameError if the recording can not be written
+	void stop();
+
+	// Return the settings of the recording or replay.
+	const RecordingSettings& getSettings() const { return settings; }
+
+	// Return true while recording.
+	bool isRecording() const { return file != nullptr; }
+
+	// Return true while replaying.
+	bool isReplaying() const { return replaying; }
+
+	// Return number of frames recorded or replayed.
+	UINT64 getFrames() const { return frames; }
+
+	// Return number of bytes recorded or loaded.
+	UINT64 getBytes() const { return file ? bytes + data.size() : bytes; }
+
+	// Add records, while recording.
+	// writeFrame() throws GameError if the records can not be written.
+	void writeFrame(float frameTime);
+	void writeEvent(const InputEvent& e);
+	void writeStep();
+	void writeController(UINT n, bool connected, const XINPUT_STATE& state);
+
+	// Return the type of the next record, RECORD_END at the end of a replay.
+	UCHAR peek() const;
+
+	// Read the next record, while replaying.
+	// Pre: peek() returned the type of the record
+	float readFrame();
+	void  readEvent(InputEvent& e);
+	void  readStep();
+	// Returns the controller number of the state.
+	UINT  readController(bool& connected, XINPUT_STATE& state);
+
+private:
+	FILE*  file;                        // file being recorded, nullptr if none
+	std::string filename;
+	RecordingSettings settings;
+	LONGLONG frameStart;                // performance counter of the current frame
+	LONGLONG frequency;                 // performance counter ticks per second
+	LONGLONG lastFrameTicks;            // replay: counter ticks of the previous frame
+	std::vector<unsigned char> data;    // record buffer
+	size_t pos;                         // read position when replaying
+	bool   replaying;
+	UINT64 frames;
+	UINT64 bytes;
+
+	InputRecording(const InputRecording&);  // no copies
+	InputRecording& operator=(const InputRecording&);
+
+	// Write the buffered records to the file.
+	// Throws GameError if they can not be written
+	void flush();
+	void putByte(UCHAR b) { data.push_back(b); }
+	void putVarint(UINT64 v);
+	void putSigned(LONGLONG v);
+	void putFloat(float f);
+	UCHAR getByte();
+	UINT64 getVarint();
+	LONGLONG getSigned();
+	float getFloat();
+};
@@ -0,0 +1,298 @@
+#include "jobSystem.h"
+#include "gameError.h"
+#include "profiler.h"
+
+// thread local storage of plain values, VS2013 has no thread_local
+#ifdef _MSC_VER
+#define JOB_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+	// job system whose worker the calling thread is, and its queue index
+	JOB_THREAD_LOCAL const JobSystem* currentSystem = nullptr;
+	JOB_THREAD_LOCAL UINT currentIndex = 0;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+JobSystem::JobSystem()
+{
+	queued = 0;
+	quit = false;
+	jobsRun = 0;
+	jobsStolen = 0;
+	jobsFailed = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+JobSystem::~JobSystem()
+{
+	shutdown();
+}
+
+//=============================================================================
+// Start the workers
+// Throws GameError
+//=============================================================================
+void JobSystem::initialize(UINT threads)
+{
+	shutdown();
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	if (threads > jobSystemNS::MAX_THREADS)
+		threads = jobSystemNS::MAX_THREADS;
+
+	quit = false;
+	for (UINT i = 0; i < threads; i++)
+		queues.push_back(new Queue);
+	try{
+		for (UINT i = 1; i < threads; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+	catch (...)
+	{
+		shutdown();
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error starting job threads"));
+	}
+}
+
+//=============================================================================
+// Finish the queued jobs and stop the workers
+//=============================================================================
+void JobSystem::shutdown()
+{
+	// run what is left on this thread
+	Job job;
+	while (!queues.empty() && pop(0, job))
+		execute(job);
+
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		quit = true;
+	}
+	idle.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+	queues.clear();
+}
+
+//=============================================================================
+// Return the queue index of the calling thread
+//=============================================================================
+UINT JobSystem::threadIndex() const
+{
+	return currentSystem == this ? currentIndex : 0;
+}
+
+//=============================================================================
+// Queue a job
+//=============================================================================
+void JobSystem::run(const JobFunction& function, JobCounter* counter)
+{
+	Job job = { function, counter };
+	if (counter)
+		++counter->count;
+	if (queues.empty())
+	{
+		// not initialized, run now
+		execute(job);
+		return;
+	}
+	push(job);
+}
+
+//=============================================================================
+// Queue a job that starts when dependency is done
+//=============================================================================
+void JobSystem::runAfter(JobCounter& dependency, const JobFunction& function, JobCounter* counter)
+{
+	if (counter)
+		++counter->count;
+	{
+		std::lock_guard<std::mutex> lock(dependency.mutex);
+		if (dependency.count.load() > 0)
+		{
+			JobCounter::Continuation c = { function, counter };
+			dependency.continuations.push_back(c);
+			return;
+		}
+	}
+	// dependency already done
+	Job job = { function, counter };
+	if (queues.empty())
+		execute(job);
+	else
+		push(job);
+}
+
+//=============================================================================
+// Run jobs until counter is done
+//=============================================================================
+void JobSystem::wait(JobCounter& counter)
+{
+	UINT index = threadIndex();
+	Job job;
+	while (!counter.isDone())
+	{
+		if (!queues.empty() && pop(index, job))
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+	std::exception_ptr error;
+	{
+		// the thread that finished the last job may still hold the lock,
+		// the counter may be destroyed when it is released
+		std::lock_guard<std::mutex> lock(counter.mutex);
+		error = counter.error;
+		counter.error = nullptr;
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+//=============================================================================
+// Add a job to the queue of the calling thread and wake a worker
+//=============================================================================
+void JobSystem::push(const Job& job)
+{
+	Queue* q = queues[threadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(q->mutex);
+		if (q->count == q->ring.size())
+		{
+			// full, double the ring with the jobs in order from the front
+			std::vector<Job> bigger(q->ring.size() * 2);
+			for (size_t i = 0; i < q->count; i++)
+				bigger[i] = q->ring[(q->head + i) % q->ring.size()];
+			q->ring.swap(bigger);
+			q->head = 0;
+		}
+		q->ring[(q->head + q->count) % q->ring.size()] = job;
+		++q->count;
+	}
+	++queued;
+	if (!workers.empty())
+	{
+		// the lock orders the notify after a worker's check of queued
+		std::lock_guard<std::mutex> lock(idleMutex);
+	}
+	idle.notify_one();
+}
+
+//=============================================================================
+// Take the newest job of the own queue or steal the oldest job of another
+//=============================================================================
+bool JobSystem::pop(UINT index, Job& job)
+{
+	if (queued.load() == 0)
+		return false;
+	{
+		Queue* q = queues[index];
+		std::lock_guard<std::mutex> lock(q->mutex);
+		if (q->count > 0)
+		{
+			--q->count;
+			Job& back = q->ring[(q->head + q->count) % q->ring.size()];
+			job = back;
+			back.function = nullptr;        // release what the job captured
+			--queued;
+			return true;
+		}
+	}
+	UINT n = (UINT)queues.size();
+	for (UINT i = 1; i < n; i++)
+	{
+		Queue* q = queues[(index + i) % n];
+		std::lock_guard<std::mutex> lock(q->mutex);
+		if (q->count > 0)
+		{
+			Job& front = q->ring[q->head];
+			job = front;
+			front.function = nullptr;
+			q->head = (q->head + 1) % q->ring.size();
+			--q->count;
+			--queued;
+			++jobsStolen;
+			return true;
+		}
+	}
+	return false;
+}
+
+//=============================================================================
+// Run a job, complete its counter and release the jobs waiting for it.
+// A job that throws completes its counter too, else wait() would never
+// return; the exception goes to the counter and the jobs waiting for it
+// still start.
+//=============================================================================
+void JobSystem::execute(Job& job)
+{
+	std::exception_ptr error;
+	{
+		PROFILE_ZONE("job");
+		try{
+			job.function();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+			++jobsFailed;
+		}
+	}
+	++jobsRun;
+	JobCounter* counter = job.counter;
+	if (counter == nullptr)
+		return;
+
+	std::vector<JobCounter::Continuation> ready;
+	{
+		// the lock keeps runAfter() from adding to a finished counter
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (error && !counter->error)
+			counter->error = error;
+		if (--counter->count == 0)
+			ready.swap(counter->continuations);
+	}
+	for (size_t i = 0; i < ready.size(); i++)
+	{
+		Job next = { ready[i].function, ready[i].counter };
+		if (queues.empty())
+			execute(next);
+		else
+			push(next);
+	}
+}
+
+//=============================================================================
+// Worker thread main loop
+//=============================================================================
+void JobSystem::workerLoop(UINT index)
+{
+	currentSystem = this;
+	currentIndex = index;
+	Job job;
+	while (!quit.load())
+	{
+		if (pop(index, job))
+		{
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(idleMutex);
+		if (queued.load() == 0 && !quit.load())
+			idle.wait_for(lock, std::chrono::milliseconds(jobSystemNS::IDLE_WAIT_MS));
+	}
+	Profiler::releaseThread();
+}
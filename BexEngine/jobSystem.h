@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include "constants.h"
+
+namespace jobSystemNS
+{
+	const UINT MAX_THREADS = 64;            // threads including the calling thread
+	const UINT IDLE_WAIT_MS = 2;            // idle workers check for work at least this often
+}
+
+class JobSystem;
+
+// Work function of a job.
+typedef std::function<void()> JobFunction;
+
+// Counts the unfinished jobs of a group.
+// A counter is passed to JobSystem::run() for each job of the group; the
+// group is done when the count drops to zero. Jobs started with runAfter()
+// wait for a counter, which turns a frame into a task graph.
+// A counter must outlive its jobs; wait for it with JobSystem::wait()
+// before it is destroyed. A job that throws still counts as finished, the
+// first exception of the group is rethrown by wait().
+class JobCounter final
+{
+public:
+	// Constructor
+	JobCounter() : count(0) {}
+
+	// Return true if all jobs of the group finished.
+	bool    isDone() const { return count.load() == 0; }
+
+	// Return number of unfinished jobs.
+	int     getCount() const { return count.load(); }
+
+private:
+	friend class JobSystem;
+
+	struct Continuation
+	{
+		JobFunction function;
+		JobCounter* counter;
+	};
+
+	std::atomic<int> count;
+	std::mutex mutex;
+	std::vector<Continuation> continuations;    // jobs waiting for this counter
+	std::exception_ptr error;                   // first exception of a job, nullptr if none
+
+	JobCounter(const JobCounter&);              // no copies
+	JobCounter& operator=(const JobCounter&);
+};
+
+// Work stealing job system.
+// Every thread owns a deque of jobs. A thread runs the newest job of its own
+// deque and, when that is empty, steals the oldest job of another deque,
+// which keeps the cache warm for the owner and hands out big work first.
+// The thread that calls initialize() is thread 0 and runs jobs while it
+// waits for a counter, so no core sits idle during wait().
+class JobSystem final
+{
+public:
+	// Constructor
+	JobSystem();
+
+	// Destructor, stops the workers.
+	~JobSystem();
+
+	// Start the workers.
+	// Throws GameError
+	// Pre: threads = threads including the calling thread, 0 for one per cpu core
+	void    initialize(UINT threads = 0);
+
+	// Finish the queued jobs and stop the workers.
+	void    shutdown();
+
+	// Queue a job. counter, if not nullptr, counts the job until it finished.
+	// The exception of a job without counter is only counted, see getJobsFailed().
+	void    run(const JobFunction& function, JobCounter* counter = nullptr);
+
+	// Queue a job that starts when dependency is done.
+	void    runAfter(JobCounter& dependency, const JobFunction& function, JobCounter* counter = nullptr);
+
+	// Run jobs until counter is done.
+	// Throws the first exception of a job of the group, once
+	void    wait(JobCounter& counter);
+
+	// Call f(first, last) for the ranges of at most grain indices that split
+	// begin..end-1, in parallel. Returns when all ranges are done.
+	template<class F> void parallelFor(UINT begin, UINT end, UINT grain, const F& f);
+
+	// Return number of threads running jobs, including the calling thread.
+	UINT    getThreadCount() const { return (UINT)queues.size(); }
+
+	// Return number of jobs run.
+	UINT64  getJobsRun() const { return jobsRun.load(); }
+
+	// Return number of jobs stolen from another thread.
+	UINT64  getJobsStolen() const { return jobsStolen.load(); }
+
+	// Return number of jobs that threw an exception.
+	UINT64  getJobsFailed() const { return jobsFailed.load(); }
+
+	// Reset the job statistics.
+	void    resetStats() { jobsRun = 0; jobsStolen = 0; jobsFailed = 0; }
+
+private:
+	struct Job
+	{
+		JobFunction function;
+		JobCounter* counter;
+	};
+	// deque of one thread as a ring that only grows, so steady state
+	// scheduling does not allocate; the owner uses the back, thieves the front
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Job> ring;
+		size_t head;                        // index of the front job
+		size_t count;                       // jobs in the ring
+		Queue() : ring(64), head(0), count(0) {}
+	};
+
+	std::vector<Queue*> queues;             // one per thread, 0 is the calling thread
+	std::vector<std::thread> workers;       // threads 1..n-1
+	std::mutex idleMutex;
+	std::condition_variable idle;           // signals new jobs to idle workers
+	std::atomic<int> queued;                // jobs in all queues
+	std::atomic<bool> quit;
+	std::atomic<UINT64> jobsRun;
+	std::atomic<UINT64> jobsStolen;
+	std::atomic<UINT64> jobsFailed;
+
+	JobSystem(const JobSystem&);            // no copies
+	JobSystem& operator=(const JobSystem&);
+
+	// Return the queue index of the calling thread, 0 for unknown threads.
+	UINT    threadIndex() const;
+	// Add a job to the queue of the calling thread.
+	void    push(const Job& job);
+	// Take a job, own queue first, then steal. Returns false if none.
+	bool    pop(UINT index, Job& job);
+	// Run a job and complete its counter, an exception is kept in the counter.
+	void    execute(Job& job);
+	// Worker thread main loop.
+	void    workerLoop(UINT index);
+};
+
+//=============================================================================
+// Call f(first, last) for ranges of begin..end-1 in parallel
+//=============================================================================
+template<class F> void JobSystem::parallelFor(UINT begin, UINT end, UINT grain, const F& f)
+{
+	if (begin >= end)
+		return;
+	if (grain == 0)
+		grain = 1;
+	// one range runs on the calling thread
+	if (end - begin <= grain || queues.size() <= 1)
+	{
+		for (UINT first = begin; first < end; first += grain)
+			f(first, end - first > grain ? first + grain : end);
+		return;
+	}
+	JobCounter counter;
+	for (UINT first = begin; first < end; first += grain)
+	{
+		UINT last = end - first > grain ? first + grain : end;
+		const F* fn = &f;
+		run([fn, first, last]() { (*fn)(first, last); }, &counter);
+	}
+	wait(counter);
+}
@@ -0,0 +1,180 @@
+#include "lz4.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const size_t MIN_MATCH = 4;
+	const size_t LAST_LITERALS = 5;         // the block ends with at least this many literals
+	const size_t MATCH_LIMIT = 12;          // no match starts in the last bytes
+	const size_t MAX_OFFSET = 65535;
+	const int HASH_BITS = 12;
+
+	uint32_t read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	uint32_t hash4(uint32_t v)
+	{
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// Write a length extension, 255 per byte.
+	uint8_t* putLength(uint8_t* op, size_t len)
+	{
+		while (len >= 255)
+		{
+			*op++ = 255;
+			len -= 255;
+		}
+		*op++ = (uint8_t)len;
+		return op;
+	}
+
+	// Write one sequence of literals followed by a match, matchLen 0 for none.
+	uint8_t* putSequence(uint8_t* op, const uint8_t* literals, size_t literalLen,
+		size_t offset, size_t matchLen)
+	{
+		uint8_t* token = op++;
+		*token = (uint8_t)((literalLen >= 15 ? 15 : literalLen) << 4);
+		if (literalLen >= 15)
+			op = putLength(op, literalLen - 15);
+		if (literalLen)
+			memcpy(op, literals, literalLen);   // literals is nullptr for an empty block
+		op += literalLen;
+		if (matchLen == 0)
+			return op;
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+		size_t len = matchLen - MIN_MATCH;
+		*token |= (uint8_t)(len >= 15 ? 15 : len);
+		if (len >= 15)
+			op = putLength(op, len - 15);
+		return op;
+	}
+}
+
+//=============================================================================
+// Return the largest compressed size of n bytes
+//=============================================================================
+size_t lz4::compressBound(size_t n)
+{
+	return n + n / 255 + 16;
+}
+
+//=============================================================================
+// Compress n bytes of src into dst
+//=============================================================================
+size_t lz4::compress(const void* source, size_t n, void* dest, size_t capacity)
+{
+	if (capacity < compressBound(n))
+		return 0;
+	const uint8_t* src = (const uint8_t*)source;
+	uint8_t* op = (uint8_t*)dest;
+
+	size_t anchor = 0;
+	if (n > MATCH_LIMIT)
+	{
+		// positions of the last 4 byte sequences, by hash
+		std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+		const size_t limit = n - MATCH_LIMIT;
+		size_t ip = 1;
+		while (ip < limit)
+		{
+			uint32_t seq = read32(src + ip);
+			uint32_t h = hash4(seq);
+			size_t ref = table[h];
+			table[h] = (uint32_t)ip;
+			if (ip - ref > MAX_OFFSET || read32(src + ref) != seq)
+			{
+				++ip;
+				continue;
+			}
+			// extend the match backwards over equal literals, then forwards
+			while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+			{
+				--ip;
+				--ref;
+			}
+			size_t len = MIN_MATCH;
+			while (ip + len < n - LAST_LITERALS && src[ip + len] == src[ref + len])
+				++len;
+			op = putSequence(op, src + anchor, ip - anchor, ip - ref, len);
+			ip += len;
+			anchor = ip;
+		}
+	}
+	// the rest are literals
+	op = putSequence(op, src + anchor, n - anchor, 0, 0);
+	return op - (uint8_t*)dest;
+}
+
+//=============================================================================
+// Decompress a block into exactly size bytes
+//=============================================================================
+bool lz4::decompress(const void* source, size_t n, void* dest, size_t size)
+{
+	const uint8_t* ip = (const uint8_t*)source;
+	const uint8_t* const end = ip + n;
+	uint8_t* op = (uint8_t*)dest;
+	uint8_t* const outEnd = op + size;
+
+	while (ip < end)
+	{
+		unsigned token = *ip++;
+		size_t len = token >> 4;
+		if (len == 15)
+		{
+			unsigned b;
+			do
+			{
+				if (ip >= end)
+					return false;
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		if ((size_t)(end - ip) < len || (size_t)(outEnd - op) < len)
+			return false;
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+		if (ip == end)
+			break;                      // last sequence has no match
+
+		if (end - ip < 2)
+			return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - (uint8_t*)dest))
+			return false;
+		len = token & 15;
+		if (len == 15)
+		{
+			unsigned b;
+			do
+			{
+				if (ip >= end)
+					return false;
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		len += MIN_MATCH;
+		if ((size_t)(outEnd - op) < len)
+			return false;
+		const uint8_t* match = op - offset;
+		if (offset >= len)
+			memcpy(op, match, len);
+		else
+			// byte by byte, the match overlaps the bytes it writes
+			for (size_t i = 0; i < len; i++)
+				op[i] = match[i];
+		op += len;
+	}
+	return op == outEnd;
+}
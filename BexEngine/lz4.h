@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// LZ4 block format compression.
+// The blocks are compatible with the LZ4 block format, so packs may also be
+// written by other LZ4 tools. The compressor is the fast greedy single hash
+// table kind; decompression checks every offset and length, a damaged block
+// fails instead of reading or writing out of bounds.
+namespace lz4
+{
+	// Return the largest compressed size of n bytes.
+	size_t compressBound(size_t n);
+
+	// Compress n bytes of src into dst.
+	// Returns the compressed size, 0 if dst is too small.
+	// Pre: capacity >= compressBound(n) always succeeds
+	size_t compress(const void* src, size_t n, void* dst, size_t capacity);
+
+	// Decompress a block of n bytes into exactly size bytes of dst.
+	// Returns false if the block is damaged or does not decompress to size bytes.
+	bool   decompress(const void* src, size_t n, void* dst, size_t size);
+}
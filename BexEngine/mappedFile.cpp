@@ -0,0 +1,94 @@
+#include "mappedFile.h"
+#include "gameError.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================
+// Constructor
+//=============================================================================
+MappedFile::MappedFile()
+{
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#endif
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+//=============================================================================
+// Map filename
+// Throws GameError
+//=============================================================================
+void MappedFile::open(const std::string& filename)
+{
+	close();
+#ifdef _WIN32
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	LARGE_INTEGER fileSize;
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Error opening " + filename));
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Error mapping " + filename));
+	}
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		if (fd >= 0)
+			::close(fd);
+		throw(GameError(gameErrorNS::WARNING, "Error opening " + filename));
+	}
+	void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);                        // the mapping keeps the file open
+	if (p == MAP_FAILED)
+		throw(GameError(gameErrorNS::WARNING, "Error mapping " + filename));
+	data = (const unsigned char*)p;
+	size = (size_t)st.st_size;
+#endif
+}
+
+//=============================================================================
+// Unmap the file
+//=============================================================================
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
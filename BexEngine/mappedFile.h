@@ -0,0 +1,47 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#include <string>
+#include <cstddef>
+
+// Read only memory mapping of a whole file.
+// Pages are read from disk by the OS when they are first touched, so a
+// mapped file costs no copy and reading it from several threads needs no
+// locking.
+class MappedFile final
+{
+public:
+	// Constructor
+	MappedFile();
+
+	// Destructor, unmaps the file.
+	~MappedFile();
+
+	// Map filename.
+	// Throws GameError if the file can not be opened or mapped
+	void open(const std::string& filename);
+
+	// Unmap the file.
+	void close();
+
+	// Return the mapped bytes, nullptr if not open.
+	const unsigned char* getData() const { return data; }
+
+	// Return size of the file in bytes.
+	size_t getSize() const { return size; }
+
+	// Return true if a file is mapped.
+	bool isOpen() const { return data != nullptr; }
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	MappedFile(const MappedFile&);      // no copies
+	MappedFile& operator=(const MappedFile&);
+};
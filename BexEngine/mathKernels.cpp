@@ -0,0 +1,336 @@
+#include "mathKernels.h"
+
+#if defined(__AVX2__)
+#define MATH_AVX2
+#include <immintrin.h>
+#elif defined(VECMATH_SSE2)
+#define MATH_SSE2
+#endif
+
+// Vec2 arrays are processed as packed x, y floats
+static_assert(sizeof(Vec2) == 2 * sizeof(float), "Vec2 must be two packed floats");
+
+namespace
+{
+	// sine and cosine polynomials on -pi/4..pi/4 after range reduction by
+	// multiples of pi/4, pi/4 = DP1 + DP2 + DP3 split for exact products
+	const float FOUR_OVER_PI = 1.27323954473516f;
+	const float DP1 = 0.78515625f;
+	const float DP2 = 2.4187564849853515625e-4f;
+	const float DP3 = 3.77489497744594108e-8f;
+	const float SIN0 = -1.9515295891e-4f;
+	const float SIN1 = 8.3321608736e-3f;
+	const float SIN2 = -1.6666654611e-1f;
+	const float COS0 = 2.443315711809948e-5f;
+	const float COS1 = -1.388731625493765e-3f;
+	const float COS2 = 4.166664568298827e-2f;
+
+	// Sine and cosine of a, every operation in the order of the SIMD versions.
+	inline void sinCos1(float a, float& sine, float& cosine)
+	{
+		float x = std::fabs(a);
+		int j = (int)(x * FOUR_OVER_PI);
+		j = (j + 1) & ~1;                   // even octant, x is reduced to -pi/4..pi/4
+		float y = (float)j;
+		x = ((x - y * DP1) - y * DP2) - y * DP3;
+		float z = x * x;
+		float yc = ((((COS0 * z + COS1) * z + COS2) * z) * z - z * 0.5f) + 1.0f;
+		float ys = (((SIN0 * z + SIN1) * z + SIN2) * z) * x + x;
+		bool swap = (j & 2) != 0;
+		sine = swap ? yc : ys;
+		cosine = swap ? ys : yc;
+		if (std::signbit(a) != ((j & 4) != 0))
+			sine = -sine;
+		if (((j - 2) & 4) == 0)
+			cosine = -cosine;
+	}
+
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+	// Sine and cosine of 4 angles.
+	inline void sinCos4(__m128 a, __m128& sine, __m128& cosine)
+	{
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+		__m128 x = _mm_andnot_ps(signMask, a);
+		__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+		j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		__m128 y = _mm_cvtepi32_ps(j);
+		x = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP1))),
+			_mm_mul_ps(y, _mm_set1_ps(DP2))), _mm_mul_ps(y, _mm_set1_ps(DP3)));
+		__m128 z = _mm_mul_ps(x, x);
+		__m128 yc = _mm_add_ps(_mm_set1_ps(COS1), _mm_mul_ps(_mm_set1_ps(COS0), z));
+		yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(COS2));
+		yc = _mm_mul_ps(_mm_mul_ps(yc, z), z);
+		yc = _mm_add_ps(_mm_sub_ps(yc, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+		__m128 ys = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN0), z), _mm_set1_ps(SIN1));
+		ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(SIN2));
+		ys = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ys, z), x), x);
+
+		const __m128i two = _mm_set1_epi32(2), four = _mm_set1_epi32(4);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, two), two));
+		__m128 signSin = _mm_xor_ps(_mm_and_ps(a, signMask),
+			_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29)));
+		__m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, two), four), 29));
+		sine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, yc), _mm_andnot_ps(swap, ys)), signSin);
+		cosine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ys), _mm_andnot_ps(swap, yc)), signCos);
+	}
+#endif
+
+#if defined(MATH_AVX2)
+	// Sine and cosine of 8 angles.
+	inline void sinCos8(__m256 a, __m256& sine, __m256& cosine)
+	{
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+		__m256 x = _mm256_andnot_ps(signMask, a);
+		__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+		j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+		__m256 y = _mm256_cvtepi32_ps(j);
+		x = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(DP1))),
+			_mm256_mul_ps(y, _mm256_set1_ps(DP2))), _mm256_mul_ps(y, _mm256_set1_ps(DP3)));
+		__m256 z = _mm256_mul_ps(x, x);
+		__m256 yc = _mm256_add_ps(_mm256_set1_ps(COS1), _mm256_mul_ps(_mm256_set1_ps(COS0), z));
+		yc = _mm256_add_ps(_mm256_mul_ps(yc, z), _mm256_set1_ps(COS2));
+		yc = _mm256_mul_ps(_mm256_mul_ps(yc, z), z);
+		yc = _mm256_add_ps(_mm256_sub_ps(yc, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+		__m256 ys = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN0), z), _mm256_set1_ps(SIN1));
+		ys = _mm256_add_ps(_mm256_mul_ps(ys, z), _mm256_set1_ps(SIN2));
+		ys = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ys, z), x), x);
+
+		const __m256i two = _mm256_set1_epi32(2), four = _mm256_set1_epi32(4);
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, two), two));
+		__m256 signSin = _mm256_xor_ps(_mm256_and_ps(a, signMask),
+			_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, four), 29)));
+		__m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, two), four), 29));
+		sine = _mm256_xor_ps(_mm256_blendv_ps(ys, yc, swap), signSin);
+		cosine = _mm256_xor_ps(_mm256_blendv_ps(yc, ys, swap), signCos);
+	}
+#endif
+
+	// Squared distances, or distances if root, of count points to from.
+	inline void distanceKernel(const Vec2& from, const Vec2* points, float* out, int count, bool root)
+	{
+		const float* p = &points[0].x;
+		int i = 0;
+#if defined(MATH_AVX2)
+		__m256 f8 = _mm256_setr_ps(from.x, from.y, from.x, from.y, from.x, from.y, from.x, from.y);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 a = _mm256_sub_ps(_mm256_loadu_ps(p + i * 2), f8);
+			__m256 b = _mm256_sub_ps(_mm256_loadu_ps(p + i * 2 + 8), f8);
+			a = _mm256_mul_ps(a, a);
+			b = _mm256_mul_ps(b, b);
+			// dx * dx + dy * dy of the points 0 1 4 5 | 2 3 6 7
+			__m256 d = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+			if (root)
+				d = _mm256_sqrt_ps(d);
+			d = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(d), _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm256_storeu_ps(out + i, d);
+		}
+#endif
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+		__m128 f4 = _mm_setr_ps(from.x, from.y, from.x, from.y);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 a = _mm_sub_ps(_mm_loadu_ps(p + i * 2), f4);
+			__m128 b = _mm_sub_ps(_mm_loadu_ps(p + i * 2 + 4), f4);
+			a = _mm_mul_ps(a, a);
+			b = _mm_mul_ps(b, b);
+			__m128 d = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+			if (root)
+				d = _mm_sqrt_ps(d);
+			_mm_storeu_ps(out + i, d);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float dx = points[i].x - from.x;
+			float dy = points[i].y - from.y;
+			float d = dx * dx + dy * dy;
+			out[i] = root ? std::sqrt(d) : d;
+		}
+	}
+}
+
+//=============================================================================
+// Return name of the compiled kernel set
+//=============================================================================
+const char* mathKernels::getKernelName()
+{
+#if defined(MATH_AVX2)
+	return "AVX2";
+#elif defined(MATH_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+//=============================================================================
+// Transform count points by m
+//=============================================================================
+void mathKernels::transformPoints(const Mat3& m, const Vec2* in, Vec2* out, int count)
+{
+	const float* src = &in[0].x;
+	float* dst = &out[0].x;
+	int i = 0;
+#if defined(MATH_AVX2)
+	// x' = x * m00 + y * m10 + m20 and y' = x * m01 + y * m11 + m21 of 4 points
+	__m256 a8 = _mm256_setr_ps(m.m[0][0], m.m[0][1], m.m[0][0], m.m[0][1], m.m[0][0], m.m[0][1], m.m[0][0], m.m[0][1]);
+	__m256 b8 = _mm256_setr_ps(m.m[1][0], m.m[1][1], m.m[1][0], m.m[1][1], m.m[1][0], m.m[1][1], m.m[1][0], m.m[1][1]);
+	__m256 t8 = _mm256_setr_ps(m.m[2][0], m.m[2][1], m.m[2][0], m.m[2][1], m.m[2][0], m.m[2][1], m.m[2][0], m.m[2][1]);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256 p = _mm256_loadu_ps(src + i * 2);
+		__m256 x = _mm256_moveldup_ps(p);
+		__m256 y = _mm256_movehdup_ps(p);
+		__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, a8), _mm256_mul_ps(y, b8)), t8);
+		_mm256_storeu_ps(dst + i * 2, r);
+	}
+#endif
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+	__m128 a4 = _mm_setr_ps(m.m[0][0], m.m[0][1], m.m[0][0], m.m[0][1]);
+	__m128 b4 = _mm_setr_ps(m.m[1][0], m.m[1][1], m.m[1][0], m.m[1][1]);
+	__m128 t4 = _mm_setr_ps(m.m[2][0], m.m[2][1], m.m[2][0], m.m[2][1]);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128 p = _mm_loadu_ps(src + i * 2);
+		__m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, a4), _mm_mul_ps(y, b4)), t4);
+		_mm_storeu_ps(dst + i * 2, r);
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = m.transformPoint(in[i]);
+}
+
+//=============================================================================
+// Explicit Euler step of count floats
+//=============================================================================
+void mathKernels::integrate(float* pos, const float* vel, int count, float t)
+{
+	int i = 0;
+#if defined(MATH_AVX2)
+	__m256 t8 = _mm256_set1_ps(t);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 p = _mm256_add_ps(_mm256_loadu_ps(pos + i), _mm256_mul_ps(_mm256_loadu_ps(vel + i), t8));
+		_mm256_storeu_ps(pos + i, p);
+	}
+#endif
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+	__m128 t4 = _mm_set1_ps(t);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 p = _mm_add_ps(_mm_loadu_ps(pos + i), _mm_mul_ps(_mm_loadu_ps(vel + i), t4));
+		_mm_storeu_ps(pos + i, p);
+	}
+#endif
+	for (; i < count; i++)
+		pos[i] += vel[i] * t;
+}
+
+//=============================================================================
+// Distance of count points to from
+//=============================================================================
+void mathKernels::distances(const Vec2& from, const Vec2* points, float* out, int count)
+{
+	distanceKernel(from, points, out, count, true);
+}
+
+//=============================================================================
+// Squared distance of count points to from
+//=============================================================================
+void mathKernels::distancesSquared(const Vec2& from, const Vec2* points, float* out, int count)
+{
+	distanceKernel(from, points, out, count, false);
+}
+
+//=============================================================================
+// Sine and cosine of count angles
+//=============================================================================
+void mathKernels::sinCos(const float* angles, float* sines, float* cosines, int count)
+{
+	int i = 0;
+#if defined(MATH_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 s, c;
+		sinCos8(_mm256_loadu_ps(angles + i), s, c);
+		_mm256_storeu_ps(sines + i, s);
+		_mm256_storeu_ps(cosines + i, c);
+	}
+#endif
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 s, c;
+		sinCos4(_mm_loadu_ps(angles + i), s, c);
+		_mm_storeu_ps(sines + i, s);
+		_mm_storeu_ps(cosines + i, c);
+	}
+#endif
+	for (; i < count; i++)
+		sinCos1(angles[i], sines[i], cosines[i]);
+}
+
+//=============================================================================
+// Write the corners of count rotated rectangles
+//=============================================================================
+void mathKernels::quadCorners(const QuadTransform* quads, Vec2* corners, int count)
+{
+	float* dst = &corners[0].x;
+	int i = 0;
+#if defined(MATH_SSE2) || defined(MATH_AVX2)
+	// four rectangles per iteration, also with AVX2
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	for (; i + 4 <= count; i += 4)
+	{
+		const QuadTransform* q = quads + i;
+		__m128 cx = _mm_setr_ps(q[0].cx, q[1].cx, q[2].cx, q[3].cx);
+		__m128 cy = _mm_setr_ps(q[0].cy, q[1].cy, q[2].cy, q[3].cy);
+		__m128 hw = _mm_setr_ps(q[0].hw, q[1].hw, q[2].hw, q[3].hw);
+		__m128 hh = _mm_setr_ps(q[0].hh, q[1].hh, q[2].hh, q[3].hh);
+		__m128 s, c;
+		sinCos4(_mm_setr_ps(q[0].angle, q[1].angle, q[2].angle, q[3].angle), s, c);
+
+		// corner k of the four rectangles
+		__m128 x[4], y[4];
+		for (int k = 0; k < 4; k++)
+		{
+			__m128 dx = (k & 1) ? hw : _mm_xor_ps(hw, signMask);
+			__m128 dy = (k & 2) ? hh : _mm_xor_ps(hh, signMask);
+			x[k] = _mm_add_ps(cx, _mm_sub_ps(_mm_mul_ps(dx, c), _mm_mul_ps(dy, s)));
+			y[k] = _mm_add_ps(cy, _mm_add_ps(_mm_mul_ps(dx, s), _mm_mul_ps(dy, c)));
+		}
+		// to x, y pairs, four corners per rectangle
+		__m128 c0lo = _mm_unpacklo_ps(x[0], y[0]), c0hi = _mm_unpackhi_ps(x[0], y[0]);
+		__m128 c1lo = _mm_unpacklo_ps(x[1], y[1]), c1hi = _mm_unpackhi_ps(x[1], y[1]);
+		__m128 c2lo = _mm_unpacklo_ps(x[2], y[2]), c2hi = _mm_unpackhi_ps(x[2], y[2]);
+		__m128 c3lo = _mm_unpacklo_ps(x[3], y[3]), c3hi = _mm_unpackhi_ps(x[3], y[3]);
+		float* d = dst + i * 8;
+		_mm_storeu_ps(d, _mm_movelh_ps(c0lo, c1lo));
+		_mm_storeu_ps(d + 4, _mm_movelh_ps(c2lo, c3lo));
+		_mm_storeu_ps(d + 8, _mm_movehl_ps(c1lo, c0lo));
+		_mm_storeu_ps(d + 12, _mm_movehl_ps(c3lo, c2lo));
+		_mm_storeu_ps(d + 16, _mm_movelh_ps(c0hi, c1hi));
+		_mm_storeu_ps(d + 20, _mm_movelh_ps(c2hi, c3hi));
+		_mm_storeu_ps(d + 24, _mm_movehl_ps(c1hi, c0hi));
+		_mm_storeu_ps(d + 28, _mm_movehl_ps(c3hi, c2hi));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		const QuadTransform& q = quads[i];
+		float s, c;
+		sinCos1(q.angle, s, c);
+		const float dx[4] = { -q.hw, q.hw, -q.hw, q.hw };
+		const float dy[4] = { -q.hh, -q.hh, q.hh, q.hh };
+		for (int k = 0; k < 4; k++)
+		{
+			corners[i * 4 + k].x = q.cx + (dx[k] * c - dy[k] * s);
+			corners[i * 4 + k].y = q.cy + (dx[k] * s + dy[k] * c);
+		}
+	}
+}
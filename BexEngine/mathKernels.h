@@ -0,0 +1,49 @@
+#pragma once
+
+#include "vectorMath.h"
+
+// Rectangle rotated around its center, input of mathKernels::quadCorners().
+struct QuadTransform
+{
+	float cx, cy;               // center
+	float hw, hh;               // half width and height
+	float angle;                // rotation in radians, |angle| < mathKernels::MAX_ANGLE
+};
+
+// Batch kernels of the vector math.
+// Each kernel processes count elements of packed arrays. All kernels produce
+// bit identical results in the scalar, SSE2 and AVX2 versions, they use no
+// fused multiply-add; the version is selected at compile time (AVX2 with
+// /arch:AVX2 or -mavx2, SSE2 on x86).
+namespace mathKernels
+{
+	const float MAX_ANGLE = 8192;           // larger angles lose the precision of sinCos()
+
+	// Return name of the compiled kernel set: "AVX2", "SSE2" or "scalar".
+	const char* getKernelName();
+
+	// Transform count points by m, out[i] = m.transformPoint(in[i]).
+	// in and out may be the same array.
+	void transformPoints(const Mat3& m, const Vec2* in, Vec2* out, int count);
+
+	// Explicit Euler step of count floats, pos[i] += vel[i] * t.
+	// Arrays of {x, y} structs are passed as 2 * count floats.
+	void integrate(float* pos, const float* vel, int count, float t);
+
+	// Distance of count points to from, out[i] = (points[i] - from).length().
+	void distances(const Vec2& from, const Vec2* points, float* out, int count);
+
+	// Squared distance of count points to from, cheaper for comparisons.
+	void distancesSquared(const Vec2& from, const Vec2* points, float* out, int count);
+
+	// Sine and cosine of count angles, within 2e-7 of sinf() and cosf().
+	// Angle 0 gives exactly 0 and 1.
+	// Pre: |angles[i]| < MAX_ANGLE
+	void sinCos(const float* angles, float* sines, float* cosines, int count);
+
+	// Write the corners of count rotated rectangles to corners, four per
+	// rectangle: top left, top right, bottom left, bottom right before rotation.
+	// corner = center + (dx * c - dy * s, dx * s + dy * c) for dx = -hw, hw
+	// and dy = -hh, hh, with c and s from sinCos() of the angle.
+	void quadCorners(const QuadTransform* quads, Vec2* corners, int count);
+}
@@ -0,0 +1,209 @@
+#include "netTransport.h"
+#ifdef _WIN32
+#include <winsock2.h>
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const intptr_t NO_SOCKET = -1;
+
+	inline void closeSocket(intptr_t s)
+	{
+#ifdef _WIN32
+		::closesocket((SOCKET)s);
+#else
+		::close((int)s);
+#endif
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+LoopbackNetwork::LoopbackNetwork(float l)
+{
+	loss = l;
+	seed = 12345;
+	dropped = 0;
+}
+
+//=============================================================================
+// Queue a datagram for to
+//=============================================================================
+bool LoopbackNetwork::send(const NetAddress& from, const NetAddress& to, const void* data, UINT bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (loss > 0)
+	{
+		seed = seed * 1103515245 + 12345;
+		if (((seed >> 8) & 0xFFFF) < (uint32_t)(loss * 65536))
+		{
+			++dropped;
+			return false;
+		}
+	}
+	Datagram d;
+	d.from = from;
+	d.data.assign((const uint8_t*)data, (const uint8_t*)data + bytes);
+	queues[to].push_back(d);
+	return true;
+}
+
+//=============================================================================
+// Take the next datagram for to
+//=============================================================================
+UINT LoopbackNetwork::receive(const NetAddress& to, NetAddress& from, void* data, UINT size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<NetAddress, std::deque<Datagram> >::iterator it = queues.find(to);
+	if (it == queues.end() || it->second.empty())
+		return 0;
+	Datagram& d = it->second.front();
+	UINT bytes = (UINT)d.data.size() < size ? (UINT)d.data.size() : size;
+	if (bytes > 0)
+		memcpy(data, &d.data[0], bytes);
+	from = d.from;
+	it->second.pop_front();
+	return bytes;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+LoopbackTransport::LoopbackTransport(LoopbackNetwork& net, uint16_t port) : network(net)
+{
+	address.host = netTransportNS::LOCALHOST;
+	address.port = port;
+}
+
+//=============================================================================
+// Send a datagram to to
+//=============================================================================
+bool LoopbackTransport::send(const NetAddress& to, const void* data, UINT bytes)
+{
+	return network.send(address, to, data, bytes);
+}
+
+//=============================================================================
+// Receive a datagram
+//=============================================================================
+UINT LoopbackTransport::receive(NetAddress& from, void* data, UINT size)
+{
+	return network.receive(address, from, data, size);
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+UdpTransport::UdpTransport()
+{
+	handle = NO_SOCKET;
+	address.host = netTransportNS::LOCALHOST;
+	address.port = 0;
+	started = false;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+UdpTransport::~UdpTransport()
+{
+	close();
+}
+
+//=============================================================================
+// Open a non-blocking socket on port
+// Throws GameError
+//=============================================================================
+void UdpTransport::open(uint16_t port)
+{
+	close();
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		throw(GameError(gameErrorNS::WARNING, "Error starting Winsock"));
+	started = true;
+#endif
+	intptr_t s = (intptr_t)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == NO_SOCKET)
+	{
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Error creating UDP socket"));
+	}
+	handle = s;
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_ANY);
+	a.sin_port = htons(port);
+	socklen_t length = sizeof(a);
+	bool ok = bind(s, (sockaddr*)&a, sizeof(a)) == 0 &&
+		getsockname(s, (sockaddr*)&a, &length) == 0;
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	ok = ok && ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+	ok = ok && fcntl((int)s, F_SETFL, fcntl((int)s, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+	if (!ok)
+	{
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Error binding UDP socket"));
+	}
+	address.port = ntohs(a.sin_port);
+}
+
+//=============================================================================
+// Close the socket
+//=============================================================================
+void UdpTransport::close()
+{
+	if (handle != NO_SOCKET)
+	{
+		closeSocket(handle);
+		handle = NO_SOCKET;
+	}
+#ifdef _WIN32
+	if (started)
+		WSACleanup();
+#endif
+	started = false;
+}
+
+//=============================================================================
+// Send a datagram to to
+//=============================================================================
+bool UdpTransport::send(const NetAddress& to, const void* data, UINT bytes)
+{
+	if (handle == NO_SOCKET || bytes > netTransportNS::MAX_DATAGRAM)
+		return false;
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(to.host);
+	a.sin_port = htons(to.port);
+	return sendto(handle, (const char*)data, (int)bytes, 0, (const sockaddr*)&a, sizeof(a)) == (int)bytes;
+}
+
+//=============================================================================
+// Receive a datagram, 0 if none is waiting
+//=============================================================================
+UINT UdpTransport::receive(NetAddress& from, void* data, UINT size)
+{
+	if (handle == NO_SOCKET)
+		return 0;
+	sockaddr_in a;
+	socklen_t length = sizeof(a);
+	int bytes = (int)recvfrom(handle, (char*)data, (int)size, 0, (sockaddr*)&a, &length);
+	if (bytes <= 0)
+		return 0;                       // nothing waiting, or an error of an earlier send
+	from.host = ntohl(a.sin_addr.s_addr);
+	from.port = ntohs(a.sin_port);
+	return (UINT)bytes;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "constants.h"
+#include "gameError.h"
+
+namespace netTransportNS
+{
+	const UINT MAX_DATAGRAM = 1400;         // largest datagram sent, below the common MTU
+	const uint32_t LOCALHOST = 0x7F000001;  // 127.0.0.1
+}
+
+// IPv4 address and port of a peer, in host byte order.
+struct NetAddress
+{
+	uint32_t host;
+	uint16_t port;
+
+	bool operator==(const NetAddress& a) const { return host == a.host && port == a.port; }
+	bool operator!=(const NetAddress& a) const { return !(*this == a); }
+	bool operator<(const NetAddress& a) const { return host != a.host ? host < a.host : port < a.port; }
+};
+
+// Unreliable datagram transport. Datagrams may be lost, but arrive whole.
+class NetTransport
+{
+public:
+	// Destructor
+	virtual ~NetTransport() {}
+
+	// Send bytes bytes to to, returns false if the datagram was not sent.
+	// Pre: bytes <= MAX_DATAGRAM
+	virtual bool send(const NetAddress& to, const void* data, UINT bytes) = 0;
+
+	// Receive a datagram of up to size bytes into data, does not wait.
+	// Returns its size, 0 if none is waiting.
+	virtual UINT receive(NetAddress& from, void* data, UINT size) = 0;
+
+	// Return the address of this end.
+	virtual NetAddress getAddress() const = 0;
+};
+
+// In-process network for LoopbackTransports, for tests and benchmarks.
+// Drops a share of the datagrams with a fixed random sequence.
+class LoopbackNetwork final
+{
+public:
+	// Constructor
+	// Pre: loss = share of datagrams dropped, 0..1
+	explicit LoopbackNetwork(float loss = 0);
+
+	// Queue a datagram for to, returns false if it was dropped.
+	bool    send(const NetAddress& from, const NetAddress& to, const void* data, UINT bytes);
+
+	// Take the next datagram for to, returns its size, 0 if none.
+	UINT    receive(const NetAddress& to, NetAddress& from, void* data, UINT size);
+
+	// Return number of datagrams dropped.
+	UINT64  getDropped() const { return dropped; }
+
+private:
+	// A datagram in flight.
+	struct Datagram
+	{
+		NetAddress from;
+		std::vector<uint8_t> data;
+	};
+
+	std::mutex mutex;
+	std::map<NetAddress, std::deque<Datagram> > queues;    // by receiver
+	float   loss;
+	uint32_t seed;                          // of the losses
+	UINT64  dropped;
+
+	LoopbackNetwork(const LoopbackNetwork&);        // no copies
+	LoopbackNetwork& operator=(const LoopbackNetwork&);
+};
+
+// End of a LoopbackNetwork at port on LOCALHOST.
+class LoopbackTransport final : public NetTransport
+{
+public:
+	// Constructor
+	LoopbackTransport(LoopbackNetwork& network, uint16_t port);
+
+	bool    send(const NetAddress& to, const void* data, UINT bytes) override;
+	UINT    receive(NetAddress& from, void* data, UINT size) override;
+	NetAddress getAddress() const override { return address; }
+
+private:
+	LoopbackNetwork& network;
+	NetAddress address;
+};
+
+// Non-blocking UDP socket.
+class UdpTransport final : public NetTransport
+{
+public:
+	// Constructor
+	UdpTransport();
+
+	// Destructor, closes the socket.
+	virtual ~UdpTransport();
+
+	// Open a socket on port of all interfaces, 0 for any free port.
+	// Throws GameError if the socket can not be opened
+	void    open(uint16_t port);
+
+	// Close the socket.
+	void    close();
+
+	bool    send(const NetAddress& to, const void* data, UINT bytes) override;
+	UINT    receive(NetAddress& from, void* data, UINT size) override;
+	NetAddress getAddress() const override { return address; }
+
+private:
+	intptr_t handle;                        // socket, -1 if closed
+	NetAddress address;                     // LOCALHOST and the bound port
+	bool    started;                        // Winsock was started
+
+	UdpTransport(const UdpTransport&);      // no copies
+	UdpTransport& operator=(const UdpTransport&);
+};
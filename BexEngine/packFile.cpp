@@ -0,0 +1,196 @@
+#include "packFile.h"
+#include "gameError.h"
+#include "lz4.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const char MAGIC[4] = { 'B', 'E', 'X', 'P' };
+
+	// Order entries by name hash.
+	bool hashLess(const PackEntry& a, const PackEntry& b) { return a.nameHash < b.nameHash; }
+
+	// Write n zero bytes.
+	bool writeZeros(FILE* f, size_t n)
+	{
+		static const unsigned char zeros[packNS::BLOB_ALIGN] = { 0 };
+		return n == 0 || fwrite(zeros, 1, n, f) == n;
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+PackFile::PackFile()
+{
+	entries = nullptr;
+	count = 0;
+	names = nullptr;
+}
+
+//=============================================================================
+// Return the FNV-1a hash of an entry name
+//=============================================================================
+UINT64 PackFile::hashName(const char* name)
+{
+	UINT64 h = 14695981039346656037ull;
+	for (; *name; name++)
+		h = (h ^ (unsigned char)*name) * 1099511628211ull;
+	return h;
+}
+
+//=============================================================================
+// Map and check a pack
+// Throws GameError
+//=============================================================================
+void PackFile::open(const std::string& name)
+{
+	close();
+	file.open(name);                    // throws GameError
+	filename = name;
+
+	const unsigned char* data = file.getData();
+	UINT64 size = file.getSize();
+	const PackHeader* h = (const PackHeader*)data;
+	bool ok = size >= sizeof(PackHeader) && memcmp(h->magic, MAGIC, 4) == 0 &&
+		h->version == packNS::VERSION && h->indexOffset % 8 == 0 &&
+		h->indexOffset <= size && (size - h->indexOffset) / sizeof(PackEntry) >= h->entryCount &&
+		h->namesOffset <= size && h->namesSize <= size - h->namesOffset &&
+		h->namesSize > 0 && data[h->namesOffset + h->namesSize - 1] == 0;
+	if (ok)
+	{
+		entries = (const PackEntry*)(data + h->indexOffset);
+		count = h->entryCount;
+		names = (const char*)data + h->namesOffset;
+		// every blob and name must lie in the file
+		for (UINT i = 0; i < count && ok; i++)
+		{
+			const PackEntry& e = entries[i];
+			ok = e.offset <= size && e.storedSize <= size - e.offset &&
+				e.nameOffset < h->namesSize && (i == 0 || entries[i - 1].nameHash <= e.nameHash) &&
+				((e.flags & packNS::FLAG_LZ4) || e.storedSize == e.size);
+		}
+	}
+	if (!ok)
+	{
+		close();
+		throw(GameError(gameErrorNS::WARNING, "Not a valid pack " + name));
+	}
+}
+
+//=============================================================================
+// Unmap the pack
+//=============================================================================
+void PackFile::close()
+{
+	file.close();
+	entries = nullptr;
+	count = 0;
+	names = nullptr;
+}
+
+//=============================================================================
+// Return the entry of name, nullptr if the pack does not have it
+//=============================================================================
+const PackEntry* PackFile::find(const std::string& name) const
+{
+	PackEntry key;
+	key.nameHash = hashName(name.c_str());
+	const PackEntry* e = std::lower_bound(entries, entries + count, key, hashLess);
+	for (; e < entries + count && e->nameHash == key.nameHash; e++)
+		if (name == getName(*e))
+			return e;
+	return nullptr;
+}
+
+//=============================================================================
+// Add a blob
+//=============================================================================
+void PackWriter::add(const std::string& name, const void* data, size_t size, bool compress)
+{
+	Item* item = nullptr;
+	for (size_t i = 0; i < items.size(); i++)
+		if (items[i].name == name)
+			item = &items[i];
+	if (item == nullptr)
+	{
+		items.push_back(Item());
+		item = &items.back();
+		item->name = name;
+	}
+	item->size = size;
+	item->flags = 0;
+	if (compress && size > 0)
+	{
+		item->blob.resize(lz4::compressBound(size));
+		size_t packed = lz4::compress(data, size, &item->blob[0], item->blob.size());
+		if (packed > 0 && packed <= size * (1.0 - packNS::MIN_SAVING))
+		{
+			item->blob.resize(packed);
+			item->flags = packNS::FLAG_LZ4;
+			return;
+		}
+	}
+	const unsigned char* bytes = (const unsigned char*)data;
+	item->blob.assign(bytes, bytes + size);
+}
+
+//=============================================================================
+// Write the pack
+// Throws GameError
+//=============================================================================
+void PackWriter::save(const std::string& filename) const
+{
+	PackHeader h;
+	memcpy(h.magic, MAGIC, 4);
+	h.version = packNS::VERSION;
+	h.entryCount = (UINT)items.size();
+	h.reserved = 0;
+
+	// lay out the blobs, then the index and the names
+	std::vector<PackEntry> index(items.size());
+	std::string names;
+	UINT64 offset = sizeof(PackHeader);
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		offset = (offset + packNS::BLOB_ALIGN - 1) & ~(UINT64)(packNS::BLOB_ALIGN - 1);
+		PackEntry& e = index[i];
+		e.nameHash = PackFile::hashName(items[i].name.c_str());
+		e.offset = offset;
+		e.storedSize = items[i].blob.size();
+		e.size = items[i].size;
+		e.nameOffset = (UINT)names.size();
+		e.flags = items[i].flags;
+		names += items[i].name;
+		names += '\0';
+		offset += e.storedSize;
+	}
+	if (names.empty())
+		names += '\0';
+	h.indexOffset = (offset + 7) & ~(UINT64)7;
+	h.namesOffset = h.indexOffset + index.size() * sizeof(PackEntry);
+	h.namesSize = names.size();
+
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Error creating pack " + filename));
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	UINT64 pos = sizeof(PackHeader);
+	for (size_t i = 0; i < items.size() && ok; i++)
+	{
+		ok = writeZeros(f, (size_t)(index[i].offset - pos));
+		if (ok && !items[i].blob.empty())
+			ok = fwrite(&items[i].blob[0], 1, items[i].blob.size(), f) == items[i].blob.size();
+		pos = index[i].offset + index[i].storedSize;
+	}
+	// the index is sorted after the blobs are laid out in the order they were added
+	std::stable_sort(index.begin(), index.end(), hashLess);
+	ok = ok && writeZeros(f, (size_t)(h.indexOffset - pos));
+	if (ok && !index.empty())
+		ok = fwrite(&index[0], sizeof(PackEntry), index.size(), f) == index.size();
+	ok = ok && fwrite(names.data(), 1, names.size(), f) == names.size();
+	if (fclose(f) != 0 || !ok)
+		throw(GameError(gameErrorNS::WARNING, "Error writing pack " + filename));
+}
@@ -0,0 +1,113 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <string>
+#include <vector>
+#include "mappedFile.h"
+#include "constants.h"
+
+namespace packNS
+{
+	const UINT VERSION = 1;
+	const UINT BLOB_ALIGN = 64;             // blobs start on cache line boundaries
+	const UINT FLAG_LZ4 = 1;                // blob is an LZ4 block
+	const double MIN_SAVING = 0.05;         // blobs are stored compressed if this fraction is saved
+}
+
+// Pack file header, little endian.
+struct PackHeader
+{
+	char   magic[4];                    // "BEXP"
+	UINT   version;
+	UINT   entryCount;
+	UINT   reserved;
+	UINT64 indexOffset;                 // PackEntry array sorted by nameHash
+	UINT64 namesOffset;                 // zero terminated names
+	UINT64 namesSize;
+};
+
+// Index entry of one blob.
+struct PackEntry
+{
+	UINT64 nameHash;
+	UINT64 offset;                      // of the blob from the start of the file
+	UINT64 storedSize;                  // bytes in the file
+	UINT64 size;                        // bytes after decompression
+	UINT   nameOffset;                  // in the names
+	UINT   flags;                       // packNS::FLAG_
+};
+
+// Read only pack file.
+// A pack is a header, the blobs aligned to BLOB_ALIGN, an index sorted by
+// the hash of the names and the names. The file is memory mapped; a blob
+// that is not compressed is used in place without a copy.
+class PackFile final
+{
+public:
+	// Constructor
+	PackFile();
+
+	// Map and check a pack.
+	// Throws GameError if the file can not be mapped or is not a valid pack
+	void open(const std::string& filename);
+
+	// Unmap the pack.
+	void close();
+
+	// Return the entry of name, nullptr if the pack does not have it.
+	const PackEntry* find(const std::string& name) const;
+
+	// Return the stored bytes of entry e.
+	const unsigned char* getBlob(const PackEntry& e) const { return file.getData() + e.offset; }
+
+	// Return the name of entry e.
+	const char* getName(const PackEntry& e) const { return names + e.nameOffset; }
+
+	// Return number of entries.
+	UINT getEntryCount() const { return count; }
+
+	// Return entry i in hash order.
+	const PackEntry& getEntry(UINT i) const { return entries[i]; }
+
+	// Return the file name of the pack.
+	const std::string& getFilename() const { return filename; }
+
+	// Return the hash of an entry name.
+	static UINT64 hashName(const char* name);
+
+private:
+	MappedFile file;
+	std::string filename;
+	const PackEntry* entries;
+	UINT count;
+	const char* names;
+
+	PackFile(const PackFile&);          // no copies
+	PackFile& operator=(const PackFile&);
+};
+
+// Builds pack files, for tools and tests.
+class PackWriter final
+{
+public:
+	// Add a blob, an existing blob with the same name is replaced.
+	// compress = true stores the blob LZ4 compressed if that saves space.
+	void add(const std::string& name, const void* data, size_t size, bool compress = true);
+
+	// Write the pack.
+	// Throws GameError if the file can not be written
+	void save(const std::string& filename) const;
+
+	// Remove all blobs.
+	void clear() { items.clear(); }
+
+private:
+	struct Item
+	{
+		std::string name;
+		std::vector<unsigned char> blob;    // stored bytes
+		UINT64 size;
+		UINT   flags;
+	};
+	std::vector<Item> items;
+};
@@ -0,0 +1,451 @@
+#include "particleSystem.h"
+#include "graphics.h"
+#include "framePacer.h"
+#include "profiler.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define PARTICLE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// arrays of the structure of arrays
+	const UINT ARRAYS = 8;
+
+	// Round count floats up to the array alignment.
+	size_t alignedBytes(UINT count)
+	{
+		return ((size_t)count * sizeof(float) + particleNS::ALIGN - 1) & ~(size_t)(particleNS::ALIGN - 1);
+	}
+
+	// Append bytes bytes at data to out.
+	void append(std::vector<unsigned char>& out, const void* data, size_t bytes)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		out.insert(out.end(), p, p + bytes);
+	}
+
+	// Copy bytes bytes at p to data, return p after them.
+	const unsigned char* read(const unsigned char* p, void* data, size_t bytes)
+	{
+		memcpy(data, p, bytes);
+		return p + bytes;
+	}
+
+#if defined(PARTICLE_AVX2) || defined(PARTICLE_SSE2)
+	// Store the 7 vectors of a quad to p. Streaming stores bypass the cache,
+	// the vertices of a large system are not read again before they left it.
+	// Pre: stream = false or p 16 byte aligned
+	inline void storeQuad(float* p, const __m128* q, bool stream)
+	{
+		if (stream)
+		{
+			for (int k = 0; k < 7; k++)
+				_mm_stream_ps(p + k * 4, q[k]);
+		}
+		else
+		{
+			for (int k = 0; k < 7; k++)
+				_mm_storeu_ps(p + k * 4, q[k]);
+		}
+	}
+#endif
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+ParticleSystem::ParticleSystem()
+{
+	block = nullptr;
+	posX = posY = velX = velY = life = fade = size = nullptr;
+	color = nullptr;
+	count = 0;
+	capacity = 0;
+	accelX = accelY = 0;
+	image = particleNS::NO_IMAGE;
+	blend = spriteBatchNS::BLEND_ADDITIVE;
+	seed = 1;
+	stats = ParticleStats();
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+ParticleSystem::~ParticleSystem()
+{
+	release();
+}
+
+//=============================================================================
+// Allocate room for capacity particles
+// Throws GameError
+//=============================================================================
+void ParticleSystem::initialize(UINT cap)
+{
+	release();
+	size_t bytes = alignedBytes(cap);
+	block = TaggedAllocator::allocate(bytes * ARRAYS, memoryNS::TAG_PARTICLES, particleNS::ALIGN);
+	unsigned char* p = (unsigned char*)block;
+	posX = (float*)p;
+	posY = (float*)(p + bytes);
+	velX = (float*)(p + bytes * 2);
+	velY = (float*)(p + bytes * 3);
+	life = (float*)(p + bytes * 4);
+	fade = (float*)(p + bytes * 5);
+	size = (float*)(p + bytes * 6);
+	color = (uint32_t*)(p + bytes * 7);
+	capacity = cap;
+	deadInJob.resize((cap + particleNS::JOB_PARTICLES - 1) / particleNS::JOB_PARTICLES);
+	stats = ParticleStats();
+}
+
+//=============================================================================
+// Free the particles and emitters
+//=============================================================================
+void ParticleSystem::release()
+{
+	TaggedAllocator::free(block);
+	block = nullptr;
+	posX = posY = velX = velY = life = fade = size = nullptr;
+	color = nullptr;
+	count = 0;
+	capacity = 0;
+	emitters.clear();
+	deadInJob.clear();
+}
+
+//=============================================================================
+// Add an emitter
+//=============================================================================
+UINT ParticleSystem::addEmitter(const ParticleEmitter& emitter)
+{
+	emitters.push_back(emitter);
+	return (UINT)emitters.size() - 1;
+}
+
+//=============================================================================
+// Return a random number 0..1
+//=============================================================================
+float ParticleSystem::random()
+{
+	// linear congruential generator
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) / 16777216.0f;
+}
+
+//=============================================================================
+// Spawn count particles of emitter e
+//=============================================================================
+void ParticleSystem::emit(const ParticleEmitter& e, UINT n)
+{
+	if (n > capacity - count)
+		n = capacity - count;
+	for (UINT k = 0; k < n; k++, count++)
+	{
+		float angle = e.direction + (random() * 2 - 1) * e.spread;
+		float speed = e.speedMin + random() * (e.speedMax - e.speedMin);
+		float l = e.lifeMin + random() * (e.lifeMax - e.lifeMin);
+		if (l <= 0)
+			l = 1e-3f;
+		posX[count] = e.x;
+		posY[count] = e.y;
+		velX[count] = std::cos(angle) * speed;
+		velY[count] = std::sin(angle) * speed;
+		life[count] = l;
+		fade[count] = 1 / l;
+		size[count] = e.size;
+		color[count] = e.color;
+	}
+	stats.spawned += n;
+}
+
+//=============================================================================
+// Spawn, move and remove particles.
+// The particles are moved in parallel jobs of JOB_PARTICLES particles, then
+// the jobs that found dead particles are compacted from the last one down,
+// so the particles moved into a hole come from the compacted, live end.
+//=============================================================================
+void ParticleSystem::update(float t, JobSystem& jobs)
+{
+	PROFILE_ZONE("particles");
+	double start = FramePacer::now();
+
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		ParticleEmitter& e = emitters[i];
+		if (!e.active)
+			continue;
+		e.pending += e.rate * t;
+		UINT n = (UINT)e.pending;
+		e.pending -= n;
+		emit(e, n);
+	}
+
+	if (count > 0)
+	{
+		unsigned char* dead = &deadInJob[0];
+		jobs.parallelFor(0, count, particleNS::JOB_PARTICLES, [this, dead, t](UINT first, UINT last)
+		{
+			dead[first / particleNS::JOB_PARTICLES] = integrate(first, last, t) ? 1 : 0;
+		});
+
+		UINT before = count;
+		for (UINT j = (count - 1) / particleNS::JOB_PARTICLES + 1; j-- > 0;)
+		{
+			if (dead[j])
+				compact(j * particleNS::JOB_PARTICLES, (j + 1) * particleNS::JOB_PARTICLES);
+		}
+		stats.died += before - count;
+	}
+
+	stats.updates++;
+	stats.updateTime += FramePacer::now() - start;
+}
+
+//=============================================================================
+// Move particles first..last-1 t seconds, return true if one died.
+// Velocity changes by the acceleration before it moves the particle
+// (semi-implicit Euler), particles die when their life drops to 0.
+//=============================================================================
+bool ParticleSystem::integrate(UINT first, UINT last, float t)
+{
+	const float ax = accelX * t, ay = accelY * t;
+	UINT i = first;
+	bool died = false;
+#if defined(PARTICLE_AVX2)
+	{
+		const __m256 t8 = _mm256_set1_ps(t), ax8 = _mm256_set1_ps(ax), ay8 = _mm256_set1_ps(ay);
+		const __m256 zero = _mm256_setzero_ps();
+		int mask = 0;
+		for (; i + 8 <= last; i += 8)
+		{
+			__m256 vx = _mm256_add_ps(_mm256_loadu_ps(velX + i), ax8);
+			__m256 vy = _mm256_add_ps(_mm256_loadu_ps(velY + i), ay8);
+			_mm256_storeu_ps(velX + i, vx);
+			_mm256_storeu_ps(velY + i, vy);
+			_mm256_storeu_ps(posX + i, _mm256_add_ps(_mm256_loadu_ps(posX + i), _mm256_mul_ps(vx, t8)));
+			_mm256_storeu_ps(posY + i, _mm256_add_ps(_mm256_loadu_ps(posY + i), _mm256_mul_ps(vy, t8)));
+			__m256 l = _mm256_sub_ps(_mm256_loadu_ps(life + i), t8);
+			_mm256_storeu_ps(life + i, l);
+			mask |= _mm256_movemask_ps(_mm256_cmp_ps(l, zero, _CMP_LE_OQ));
+		}
+		died = mask != 0;
+	}
+#elif defined(PARTICLE_SSE2)
+	{
+		const __m128 t4 = _mm_set1_ps(t), ax4 = _mm_set1_ps(ax), ay4 = _mm_set1_ps(ay);
+		const __m128 zero = _mm_setzero_ps();
+		int mask = 0;
+		for (; i + 4 <= last; i += 4)
+		{
+			__m128 vx = _mm_add_ps(_mm_loadu_ps(velX + i), ax4);
+			__m128 vy = _mm_add_ps(_mm_loadu_ps(velY + i), ay4);
+			_mm_storeu_ps(velX + i, vx);
+			_mm_storeu_ps(velY + i, vy);
+			_mm_storeu_ps(posX + i, _mm_add_ps(_mm_loadu_ps(posX + i), _mm_mul_ps(vx, t4)));
+			_mm_storeu_ps(posY + i, _mm_add_ps(_mm_loadu_ps(posY + i), _mm_mul_ps(vy, t4)));
+			__m128 l = _mm_sub_ps(_mm_loadu_ps(life + i), t4);
+			_mm_storeu_ps(life + i, l);
+			mask |= _mm_movemask_ps(_mm_cmple_ps(l, zero));
+		}
+		died = mask != 0;
+	}
+#endif
+	for (; i < last; i++)
+	{
+		velX[i] += ax;
+		velY[i] += ay;
+		posX[i] += velX[i] * t;
+		posY[i] += velY[i] * t;
+		life[i] -= t;
+		if (life[i] <= 0)
+			died = true;
+	}
+	return died;
+}
+
+//=============================================================================
+// Remove the dead particles of first..last-1.
+// A particle moved into a hole is checked again, it may be dead as well.
+//=============================================================================
+void ParticleSystem::compact(UINT first, UINT last)
+{
+	UINT i = first;
+	while (i < last && i < count)
+	{
+		if (life[i] > 0)
+			++i;
+		else if (--count != i)
+			move(count, i);
+	}
+}
+
+//=============================================================================
+// Move particle from to slot to
+//=============================================================================
+void ParticleSystem::move(UINT from, UINT to)
+{
+	posX[to] = posX[from];
+	posY[to] = posY[from];
+	velX[to] = velX[from];
+	velY[to] = velY[from];
+	life[to] = life[from];
+	fade[to] = fade[from];
+	size[to] = size[from];
+	color[to] = color[from];
+}
+
+//=============================================================================
+// Draw all particles.
+// The quads are written in parallel jobs into the vertices returned by
+// graphics.beginQuads() and drawn with one texture and blend state.
+//=============================================================================
+void ParticleSystem::draw(GraphicsSystem& graphics, JobSystem& jobs, float back)
+{
+	if (count == 0)
+		return;
+	PROFILE_ZONE("particleVertices");
+	double start = FramePacer::now();
+
+	SpriteVertex* v = graphics.beginQuads(count);
+	if (v == nullptr)
+		return;
+	void* texture = nullptr;
+	float uv[4] = { 0, 0, 1, 1 };
+	const TextureCache& textures = graphics.getTextures();
+	if (image >= 0 && (UINT)image < textures.getImageCount())
+	{
+		const TextureRegion& r = textures.get(image);
+		texture = r.texture;
+		uv[0] = r.u0;
+		uv[1] = r.v0;
+		uv[2] = r.u1;
+		uv[3] = r.v1;
+	}
+
+	jobs.parallelFor(0, count, particleNS::JOB_PARTICLES, [this, v, back, &uv](UINT first, UINT last)
+	{
+		buildQuads(first, last, v + first * 4, back, uv);
+	});
+	stats.draws++;
+	stats.vertexTime += FramePacer::now() - start;
+	graphics.endQuads(texture, blend);
+}
+
+//=============================================================================
+// Write the quads of particles first..last-1 to v.
+// Order is top left, top right, bottom left, bottom right like
+// SpriteBatch::buildQuad(); alpha fades with the life left.
+//=============================================================================
+void ParticleSystem::buildQuads(UINT first, UINT last, SpriteVertex* v, float back, const float* uv) const
+{
+	const float u0 = uv[0], v0 = uv[1], u1 = uv[2], v1 = uv[3];
+#if defined(PARTICLE_AVX2) || defined(PARTICLE_SSE2)
+	// a quad is 112 bytes, all quads are aligned if the first one is
+	const bool stream = ((uintptr_t)v & 15) == 0;
+#endif
+	for (UINT i = first; i < last; i++, v += 4)
+	{
+		float h = size[i] * 0.5f;
+		float x = posX[i] - velX[i] * back;
+		float y = posY[i] - velY[i] * back;
+		float f = life[i] * fade[i];
+		uint32_t c = color[i];
+		uint32_t a = (uint32_t)((c >> 24) * (f < 1 ? f : 1));
+		c = (c & 0x00FFFFFF) | (a << 24);
+#if defined(PARTICLE_AVX2) || defined(PARTICLE_SSE2)
+		// the 28 floats of the quad with 7 stores
+		float cf;
+		memcpy(&cf, &c, sizeof(cf));
+		float x0 = x - h, x1 = x + h, y0 = y - h, y1 = y + h;
+		__m128 q[7];
+		q[0] = _mm_setr_ps(x0, y0, 0, 1);
+		q[1] = _mm_setr_ps(cf, u0, v0, x1);
+		q[2] = _mm_setr_ps(y0, 0, 1, cf);
+		q[3] = _mm_setr_ps(u1, v0, x0, y1);
+		q[4] = _mm_setr_ps(0, 1, cf, u0);
+		q[5] = _mm_setr_ps(v1, x1, y1, 0);
+		q[6] = _mm_setr_ps(1, cf, u1, v1);
+		storeQuad(&v[0].x, q, stream);
+#else
+		v[0].x = x - h; v[0].y = y - h; v[0].z = 0; v[0].rhw = 1; v[0].color = c; v[0].u = u0; v[0].v = v0;
+		v[1].x = x + h; v[1].y = y - h; v[1].z = 0; v[1].rhw = 1; v[1].color = c; v[1].u = u1; v[1].v = v0;
+		v[2].x = x - h; v[2].y = y + h; v[2].z = 0; v[2].rhw = 1; v[2].color = c; v[2].u = u0; v[2].v = v1;
+		v[3].x = x + h; v[3].y = y + h; v[3].z = 0; v[3].rhw = 1; v[3].color = c; v[3].u = u1; v[3].v = v1;
+#endif
+	}
+#if defined(PARTICLE_AVX2) || defined(PARTICLE_SSE2)
+	// order the streaming stores before the job completes
+	if (stream)
+		_mm_sfence();
+#endif
+}
+
+//=============================================================================
+// Append the state to out: count, seed, acceleration, the emitters and the
+// first count entries of every array
+//=============================================================================
+void ParticleSystem::saveState(std::vector<unsigned char>& out) const
+{
+	UINT emitterCount = (UINT)emitters.size();
+	const void* data[ARRAYS] = { posX, posY, velX, velY, life, fade, size, color };
+	append(out, &count, sizeof(count));
+	append(out, &seed, sizeof(seed));
+	append(out, &accelX, sizeof(accelX));
+	append(out, &accelY, sizeof(accelY));
+	append(out, &emitterCount, sizeof(emitterCount));
+	if (emitterCount > 0)
+		append(out, &emitters[0], emitterCount * sizeof(ParticleEmitter));
+	for (UINT a = 0; a < ARRAYS; a++)
+		append(out, data[a], count * sizeof(float));
+}
+
+//=============================================================================
+// Set the state from the bytes saveState() appended at data
+// Throws GameError
+//=============================================================================
+size_t ParticleSystem::restoreState(const unsigned char* data, size_t bytes)
+{
+	// count, seed, acceleration and emitter count
+	const size_t HEADER = sizeof(UINT) * 3 + sizeof(float) * 2;
+	UINT n = 0, emitterCount = 0;
+	if (bytes >= HEADER)
+	{
+		memcpy(&n, data, sizeof(n));
+		memcpy(&emitterCount, data + HEADER - sizeof(emitterCount), sizeof(emitterCount));
+	}
+	if (bytes < HEADER || n > capacity ||
+		bytes < HEADER + emitterCount * sizeof(ParticleEmitter) + (size_t)n * sizeof(float) * ARRAYS)
+		throw(GameError(gameErrorNS::WARNING, "Particle snapshot does not fit the particle system"));
+
+	const unsigned char* p = read(data, &count, sizeof(count));
+	p = read(p, &seed, sizeof(seed));
+	p = read(p, &accelX, sizeof(accelX));
+	p = read(p, &accelY, sizeof(accelY));
+	p = read(p, &emitterCount, sizeof(emitterCount));
+	emitters.resize(emitterCount);
+	if (emitterCount > 0)
+		p = read(p, &emitters[0], emitterCount * sizeof(ParticleEmitter));
+	void* arrays[ARRAYS] = { posX, posY, velX, velY, life, fade, size, color };
+	for (UINT a = 0; a < ARRAYS; a++)
+		p = read(p, arrays[a], count * sizeof(float));
+	return p - data;
+}
+
+//=============================================================================
+// Return statistics since initialize()
+//=============================================================================
+ParticleStats ParticleSystem::getStats() const
+{
+	ParticleStats s = stats;
+	s.count = count;
+	s.capacity = capacity;
+	return s;
+}
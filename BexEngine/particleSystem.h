@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "constants.h"
+#include "jobSystem.h"
+#include "allocators.h"
+#include "spriteBatch.h"
+#include "snapshotHistory.h"
+
+class GraphicsSystem;
+
+namespace particleNS
+{
+	const UINT DEFAULT_CAPACITY = 65536;    // particles of Game::getParticles()
+	const UINT JOB_PARTICLES = 16384;       // particles per update or vertex job
+	const UINT ALIGN = 64;                  // alignment of every array, a cache line
+	const int  NO_IMAGE = -1;               // draw particles as solid squares
+}
+
+// Spawns particles at a constant rate, see ParticleSystem::addEmitter().
+struct ParticleEmitter
+{
+	float x, y;                 // screen location particles start at
+	float rate;                 // particles per second
+	float direction;            // center of the emission angle in radians
+	float spread;               // particles leave within direction +- spread
+	float speedMin, speedMax;   // pixels per second
+	float lifeMin, lifeMax;     // seconds
+	float size;                 // width and height in pixels
+	uint32_t color;             // ARGB color at spawn, alpha fades to 0 over the life
+	bool  active;               // false stops spawning
+	float pending;              // fraction of a particle not yet spawned
+
+	// Constructor, inactive emitter of 100 white particles per second in all directions
+	ParticleEmitter() : x(0), y(0), rate(100), direction(0), spread(3.14159265f),
+		speedMin(20), speedMax(60), lifeMin(1), lifeMax(2), size(2), color(0xFFFFFFFF),
+		active(false), pending(0) {}
+};
+
+// Statistics of a particle system since initialize().
+struct ParticleStats
+{
+	UINT   count;                       // particles alive
+	UINT   capacity;
+	UINT64 spawned;
+	UINT64 died;
+	UINT64 updates;                     // update() calls
+	double updateTime;                  // seconds in update()
+	UINT64 draws;                       // draw() calls
+	double vertexTime;                  // seconds generating vertices in draw()
+};
+
+// Particles stored as structure of arrays.
+// Position, velocity, remaining life, fade rate, size and color are separate
+// arrays, so update() streams them with SIMD (AVX2, SSE2 or scalar like the
+// math kernels) and splits the work into JOB_PARTICLES jobs. Dead particles
+// are removed by moving the last particle into their slot; only the jobs
+// that found a dead particle are scanned. draw() writes the quads straight
+// into a vertex buffer of the graphics system that the sprite batch copies
+// to the GPU, no SpriteData is built per particle.
+// As a SnapshotState the particles alive, the emitters and the random seed
+// are saved and restored with the world.
+class ParticleSystem final : public SnapshotState
+{
+public:
+	// Constructor, no memory until initialize().
+	ParticleSystem();
+
+	// Destructor
+	~ParticleSystem();
+
+	// Allocate room for capacity particles, drops all particles and emitters.
+	// Throws GameError
+	void    initialize(UINT capacity);
+
+	// Free the particles and emitters.
+	void    release();
+
+	// Add an emitter, returns its index for getEmitter().
+	UINT    addEmitter(const ParticleEmitter& emitter);
+
+	// Return emitter i.
+	ParticleEmitter& getEmitter(UINT i) { return emitters[i]; }
+
+	// Return number of emitters.
+	UINT    getEmitterCount() const { return (UINT)emitters.size(); }
+
+	// Spawn count particles of emitter e at once, particles over the capacity are dropped.
+	void    emit(const ParticleEmitter& e, UINT count);
+
+	// Set acceleration of all particles, pixels per second squared.
+	void    setAcceleration(float x, float y) { accelX = x; accelY = y; }
+
+	// Draw particles with image id of the texture cache, particleNS::NO_IMAGE for solid squares.
+	void    setImage(int id) { image = id; }
+
+	// Set spriteBatchNS blend state, BLEND_ADDITIVE by default.
+	void    setBlend(int b) { blend = b; }
+
+	// Spawn the particles of the emitters, move all particles t seconds and
+	// remove the dead ones.
+	void    update(float t, JobSystem& jobs);
+
+	// Draw all particles, call between beginScene() and endScene().
+	// Particles are drawn at their position back seconds ago, the
+	// interpolation of a fixed timestep game.
+	void    draw(GraphicsSystem& graphics, JobSystem& jobs, float back = 0);
+
+	// Remove all particles.
+	void    clear() { count = 0; }
+
+	// Return number of particles alive.
+	UINT    getCount() const { return count; }
+
+	// Return number of particles that fit.
+	UINT    getCapacity() const { return capacity; }
+
+	// Return statistics since initialize().
+	ParticleStats getStats() const;
+
+	// Append the particles alive, the emitters, the acceleration and the seed to out.
+	void    saveState(std::vector<unsigned char>& out) const override;
+
+	// Set the particles from the bytes saveState() appended at data.
+	// Throws GameError if they do not fit the capacity
+	size_t  restoreState(const unsigned char* data, size_t bytes) override;
+
+private:
+	void*   block;                      // memory of all arrays
+	float*  posX;                       // structure of arrays, capacity entries each
+	float*  posY;
+	float*  velX;
+	float*  velY;
+	float*  life;                       // seconds left, dead at <= 0
+	float*  fade;                       // 1 / total life
+	float*  size;
+	uint32_t* color;
+	UINT    count;
+	UINT    capacity;
+	std::vector<ParticleEmitter> emitters;
+	std::vector<unsigned char> deadInJob;   // per update job, true if a particle died
+	float   accelX, accelY;
+	int     image;
+	int     blend;
+	UINT    seed;                       // state of the random number generator
+	ParticleStats stats;
+
+	ParticleSystem(const ParticleSystem&);  // no copies
+	ParticleSystem& operator=(const ParticleSystem&);
+
+	// Return a random number 0..1.
+	float   random();
+	// Move particles first..last-1 t seconds, return true if one died.
+	bool    integrate(UINT first, UINT last, float t);
+	// Remove the dead particles of first..last-1 by moving the last particles into their slots.
+	void    compact(UINT first, UINT last);
+	// Move particle from to slot to.
+	void    move(UINT from, UINT to);
+	// Write the quads of particles first..last-1 to v, uv = u0, v0, u1, v1 of the image.
+	void    buildQuads(UINT first, UINT last, SpriteVertex* v, float back, const float* uv) const;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+//-----------------------------------------------
+// Platform layer
+// On Windows this is windows.h. On other platforms it defines the subset of
+// Win32 types and functions the engine core uses, so the engine can run
+// without a window with the headless graphics backend.
+//-----------------------------------------------
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+// basic types
+typedef uint8_t  BYTE;
+typedef uint8_t  UCHAR;
+typedef uint16_t WORD;
+typedef uint16_t USHORT;
+typedef int16_t  SHORT;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef int32_t  LONG;
+typedef int32_t  BOOL;
+typedef int64_t  LONGLONG;
+typedef uint64_t UINT64;
+typedef int32_t  HRESULT;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+typedef void*    HANDLE;
+typedef void*    HWND;
+
+typedef union _LARGE_INTEGER
+{
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+// return codes
+#define S_OK            ((HRESULT)0L)
+#define E_FAIL          ((HRESULT)0x80004005L)
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+#define ERROR_SUCCESS               0L
+#define ERROR_DEVICE_NOT_CONNECTED  1167L
+
+// message parameters
+#define LOWORD(l)       ((WORD)(((uintptr_t)(l)) & 0xffff))
+#define HIWORD(l)       ((WORD)((((uintptr_t)(l)) >> 16) & 0xffff))
+#define GET_X_LPARAM(lp)    ((int)(short)LOWORD(lp))
+#define GET_Y_LPARAM(lp)    ((int)(short)HIWORD(lp))
+#define MK_XBUTTON1     0x0020
+#define MK_XBUTTON2     0x0040
+
+// virtual key codes used by the engine
+#define VK_BACK         0x08
+#define VK_TAB          0x09
+#define VK_RETURN       0x0D
+#define VK_SHIFT        0x10
+#define VK_CONTROL      0x11
+#define VK_MENU         0x12
+#define VK_ESCAPE       0x1B
+#define VK_SPACE        0x20
+#define VK_LEFT         0x25
+#define VK_UP           0x26
+#define VK_RIGHT        0x27
+#define VK_DOWN         0x28
+
+#define ZeroMemory(dest, len)   memset((dest), 0, (len))
+
+// High resolution timer on CLOCK_MONOTONIC, counts nanoseconds
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq)
+{
+	freq->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	count->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+
+// Sleep for ms milli-seconds
+inline void Sleep(DWORD ms)
+{
+	timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+#endif
@@ -0,0 +1,364 @@
+#include "profiler.h"
+#include "allocators.h"
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+// thread local storage of a plain pointer, VS2013 has no thread_local
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+	// ring of the calling thread
+	PROFILER_THREAD_LOCAL void* currentRing = nullptr;
+
+	// performance counter ticks per second
+	LONGLONG frequency = 0;
+
+	double ticksToMs(LONGLONG ticks)
+	{
+		if (frequency == 0)
+		{
+			LARGE_INTEGER f;
+			QueryPerformanceFrequency(&f);
+			frequency = f.QuadPart > 0 ? f.QuadPart : 1;
+		}
+		return ticks * 1000.0 / frequency;
+	}
+
+	// Write s as JSON string contents.
+	void writeJsonString(FILE* file, const char* s)
+	{
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\')
+				fputc('\\', file);
+			if ((unsigned char)*s >= 0x20)
+				fputc(*s, file);
+		}
+	}
+}
+
+std::atomic<bool> Profiler::enabled(true);
+std::atomic<Profiler::Ring*> Profiler::rings[profilerNS::MAX_THREADS];
+std::atomic<UINT> Profiler::ringCount(0);
+std::atomic<UINT64> Profiler::dropped(0);
+std::vector<Profiler::Zone> Profiler::zones;
+std::vector<Profiler::TraceEvent> Profiler::trace;
+bool Profiler::capturing = false;
+UINT64 Profiler::frameCount = 0;
+UINT Profiler::historyIndex = 0;
+UINT Profiler::historyFrames = 0;
+
+//=============================================================================
+// Enable or disable recording
+//=============================================================================
+void Profiler::setEnabled(bool enable)
+{
+	enabled = enable;
+}
+
+//=============================================================================
+// Return the ring of the calling thread, a released ring is reused
+//=============================================================================
+Profiler::Ring* Profiler::threadRing()
+{
+	if (currentRing)
+		return (Ring*)currentRing;
+
+	UINT count = std::min(ringCount.load(), profilerNS::MAX_THREADS);
+	for (UINT i = 0; i < count; i++)
+	{
+		Ring* r = rings[i].load();
+		bool free = false;
+		if (r && r->inUse.compare_exchange_strong(free, true))
+		{
+			r->depth = 0;
+			currentRing = r;
+			return r;
+		}
+	}
+
+	UINT index = ringCount++;
+	if (index >= profilerNS::MAX_THREADS)
+		return nullptr;
+	Ring* r = new (TaggedAllocator::allocate(sizeof(Ring), memoryNS::TAG_PROFILER)) Ring;
+	r->head = 0;
+	r->tail = 0;
+	r->inUse = true;
+	r->depth = 0;
+	rings[index] = r;
+	currentRing = r;
+	return r;
+}
+
+//=============================================================================
+// Release the ring of the calling thread
+//=============================================================================
+void Profiler::releaseThread()
+{
+	Ring* r = (Ring*)currentRing;
+	if (r == nullptr)
+		return;
+	// the events still in the ring are collected by the next endFrame()
+	r->inUse.store(false);
+	currentRing = nullptr;
+}
+
+//=============================================================================
+// Open a zone on the calling thread, returns its nesting depth
+//=============================================================================
+UINT Profiler::enter()
+{
+	Ring* r = threadRing();
+	return r ? r->depth++ : 0;
+}
+
+//=============================================================================
+// Close a zone on the calling thread
+//=============================================================================
+void Profiler::leave()
+{
+	Ring* r = (Ring*)currentRing;
+	if (r && r->depth > 0)
+		--r->depth;
+}
+
+//=============================================================================
+// Add a zone event to the ring of the calling thread
+//=============================================================================
+void Profiler::record(const char* name, LONGLONG start, LONGLONG end, UINT depth)
+{
+	Ring* r = (Ring*)currentRing;
+	if (r == nullptr)
+		return;
+	UINT head = r->head.load(std::memory_order_relaxed);
+	if (head - r->tail.load(std::memory_order_acquire) >= profilerNS::RING_EVENTS)
+	{
+		++dropped;
+		return;
+	}
+	Event& e = r->events[head & (profilerNS::RING_EVENTS - 1)];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	e.depth = depth;
+	// publish the event to endFrame()
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+//=============================================================================
+// Return the zone index of name, added if new
+// Returns MAX_ZONES when there are too many zones
+//=============================================================================
+UINT Profiler::zoneIndex(const char* name, UINT depth, LONGLONG start)
+{
+	for (size_t i = 0; i < zones.size(); i++)
+		if (zones[i].name == name)
+			return (UINT)i;
+	// the same name may be stored more than once
+	for (size_t i = 0; i < zones.size(); i++)
+		if (strcmp(zones[i].name, name) == 0)
+			return (UINT)i;
+	if (zones.size() >= profilerNS::MAX_ZONES)
+		return profilerNS::MAX_ZONES;
+
+	if (zones.capacity() == 0)
+		zones.reserve(profilerNS::MAX_ZONES);
+	Zone z;
+	z.name = name;
+	z.depth = depth;
+	z.firstStart = start;
+	z.calls = 0;
+	z.ticks = 0;
+	z.history.assign(profilerNS::HISTORY_FRAMES, 0.0f);
+	z.historyCalls.assign(profilerNS::HISTORY_FRAMES, 0);
+	zones.push_back(z);
+	return (UINT)zones.size() - 1;
+}
+
+//=============================================================================
+// Collect the events of all threads and close the frame
+//=============================================================================
+void Profiler::endFrame()
+{
+	UINT count = std::min(ringCount.load(), profilerNS::MAX_THREADS);
+	for (UINT t = 0; t < count; t++)
+	{
+		Ring* r = rings[t].load();
+		if (r == nullptr)
+			continue;
+		UINT tail = r->tail.load(std::memory_order_relaxed);
+		UINT head = r->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++)
+		{
+			const Event& e = r->events[tail & (profilerNS::RING_EVENTS - 1)];
+			UINT z = zoneIndex(e.name, e.depth, e.start);
+			if (z == profilerNS::MAX_ZONES)
+				continue;
+			zones[z].calls++;
+			zones[z].ticks += e.end - e.start;
+			if (capturing && trace.size() < profilerNS::MAX_TRACE_EVENTS)
+			{
+				TraceEvent te = { z, t, e.start, e.end };
+				trace.push_back(te);
+			}
+		}
+		// hand the slots back to the thread
+		r->tail.store(tail, std::memory_order_release);
+	}
+
+	if (zones.empty())
+		return;
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		Zone& z = zones[i];
+		z.history[historyIndex] = (float)ticksToMs(z.ticks);
+		z.historyCalls[historyIndex] = z.calls;
+		z.calls = 0;
+		z.ticks = 0;
+	}
+	historyIndex = (historyIndex + 1) % profilerNS::HISTORY_FRAMES;
+	if (historyFrames < profilerNS::HISTORY_FRAMES)
+		++historyFrames;
+	++frameCount;
+}
+
+//=============================================================================
+// Start keeping events for saveTrace()
+//=============================================================================
+void Profiler::beginCapture()
+{
+	trace.clear();
+	capturing = true;
+}
+
+//=============================================================================
+// Stop keeping events
+//=============================================================================
+void Profiler::endCapture()
+{
+	capturing = false;
+}
+
+//=============================================================================
+// Write the captured events as Chrome trace event JSON
+//=============================================================================
+bool Profiler::saveTrace(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr)
+		return false;
+	LONGLONG origin = 0;
+	for (size_t i = 0; i < trace.size(); i++)
+		if (i == 0 || trace[i].start < origin)
+			origin = trace[i].start;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		const TraceEvent& e = trace[i];
+		// complete events, times in micro-seconds
+		fprintf(file, "%s{\"name\":\"", i == 0 ? "" : ",\n");
+		writeJsonString(file, zones[e.zone].name);
+		fprintf(file, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			e.thread, ticksToMs(e.start - origin) * 1000.0, ticksToMs(e.end - e.start) * 1000.0);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+//=============================================================================
+// Return the statistics of every zone
+//=============================================================================
+void Profiler::getStats(std::vector<ZoneStats>& stats)
+{
+	stats.clear();
+	// outer zones start before the zones nested in them
+	std::vector<std::pair<LONGLONG, UINT> > order;
+	for (UINT i = 0; i < (UINT)zones.size(); i++)
+		order.push_back(std::make_pair(zones[i].firstStart, i));
+	std::sort(order.begin(), order.end());
+
+	std::vector<float> sorted;
+	UINT n = historyFrames;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Zone& z = zones[order[i].second];
+		ZoneStats s;
+		s.name = z.name;
+		s.depth = z.depth;
+		s.frames = n;
+		s.calls = s.minMs = s.avgMs = s.p99Ms = s.maxMs = 0;
+		if (n > 0)
+		{
+			// the last n frames end before historyIndex
+			sorted.clear();
+			UINT64 calls = 0;
+			for (UINT f = 0; f < n; f++)
+			{
+				UINT h = (historyIndex + profilerNS::HISTORY_FRAMES - 1 - f) % profilerNS::HISTORY_FRAMES;
+				sorted.push_back(z.history[h]);
+				calls += z.historyCalls[h];
+			}
+			std::sort(sorted.begin(), sorted.end());
+			double sum = 0;
+			for (UINT f = 0; f < n; f++)
+				sum += sorted[f];
+			s.calls = (double)calls / n;
+			s.minMs = sorted[0];
+			s.avgMs = sum / n;
+			s.p99Ms = sorted[(size_t)((n - 1) * 0.99)];
+			s.maxMs = sorted[n - 1];
+		}
+		stats.push_back(s);
+	}
+}
+
+//=============================================================================
+// Write the statistics as a text table
+//=============================================================================
+void Profiler::printStats(FILE* file)
+{
+	std::vector<ZoneStats> stats;
+	getStats(stats);
+	fprintf(file, "%-28s %8s %9s %9s %9s %9s\n", "zone (ms per frame)", "calls", "min", "avg", "p99", "max");
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		const ZoneStats& s = stats[i];
+		int indent = (int)std::min(s.depth, 8U) * 2;
+		fprintf(file, "%*s%-*s %8.1f %9.3f %9.3f %9.3f %9.3f\n", indent, "", 28 - indent, s.name,
+			s.calls, s.minMs, s.avgMs, s.p99Ms, s.maxMs);
+	}
+	if (dropped.load() > 0)
+		fprintf(file, "%llu events dropped\n", (unsigned long long)dropped.load());
+}
+
+//=============================================================================
+// Clear the statistics and the capture
+// Call from the thread that calls endFrame()
+//=============================================================================
+void Profiler::reset()
+{
+	// drop the events not collected yet
+	UINT count = std::min(ringCount.load(), profilerNS::MAX_THREADS);
+	for (UINT t = 0; t < count; t++)
+	{
+		Ring* r = rings[t].load();
+		if (r)
+			r->tail.store(r->head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+	zones.clear();
+	trace.clear();
+	capturing = false;
+	historyIndex = 0;
+	historyFrames = 0;
+	frameCount = 0;
+	dropped = 0;
+}
@@ -0,0 +1,191 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#include <atomic>
+#include <vector>
+#include <cstdio>
+#include "constants.h"
+
+namespace profilerNS
+{
+	const UINT MAX_THREADS = 64;            // threads that may record zones
+	const UINT RING_EVENTS = 16384;         // zone events buffered per thread, power of 2
+	const UINT MAX_ZONES = 256;             // distinct zone names
+	const UINT HISTORY_FRAMES = 512;        // frames kept for the zone statistics
+	const UINT MAX_TRACE_EVENTS = 1000000;  // events kept by a trace capture
+}
+
+// Build with BEX_NO_PROFILE defined to compile the zones out.
+#ifdef BEX_NO_PROFILE
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE_JOIN2(a, b) a##b
+#define PROFILE_ZONE_JOIN(a, b) PROFILE_ZONE_JOIN2(a, b)
+// Time the rest of the enclosing scope as zone name.
+// Pre: name = string literal
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_JOIN(profileZone, __LINE__)(name)
+#endif
+
+// Statistics of one zone over the last HISTORY_FRAMES frames.
+// Times are the milli-seconds spent in the zone per frame, summed over all
+// calls and threads.
+struct ZoneStats
+{
+	const char* name;
+	UINT   depth;                       // nesting depth, 0 for outer zones
+	UINT   frames;                      // frames the statistics cover
+	double calls;                       // average calls per frame
+	double minMs;
+	double avgMs;
+	double p99Ms;
+	double maxMs;
+};
+
+// Hierarchical CPU profiler.
+// Zones are timed with PROFILE_ZONE, which is cheap enough to leave on in
+// release builds: entering and leaving a zone reads the performance counter
+// and writes one event to a ring buffer owned by the calling thread. The
+// rings are single producer, single consumer and are drained without locks
+// by endFrame(), which runs once per frame on the game thread and turns the
+// events into per-zone statistics and, while capturing, a Chrome trace.
+class Profiler final
+{
+public:
+	// Enable or disable recording, enabled by default.
+	static void setEnabled(bool enable);
+
+	// Return true if zones are recorded.
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	// Collect the events of all threads and close the frame.
+	// Call once per frame from one thread. Frames before the first zone
+	// event are not counted.
+	static void endFrame();
+
+	// Start keeping the events for saveTrace(), the previous capture is dropped.
+	static void beginCapture();
+
+	// Stop keeping events.
+	static void endCapture();
+
+	// Return true while capturing.
+	static bool isCapturing() { return capturing; }
+
+	// Write the captured events as Chrome trace event JSON, open it in
+	// chrome://tracing or ui.perfetto.dev. Returns false on error.
+	static bool saveTrace(const char* filename);
+
+	// Return the statistics of every zone in order of the first call.
+	static void getStats(std::vector<ZoneStats>& stats);
+
+	// Write the statistics as a text table, nested zones are indented.
+	static void printStats(FILE* file = stdout);
+
+	// Clear the statistics and the capture.
+	static void reset();
+
+	// Return number of frames closed by endFrame().
+	static UINT64 getFrameCount() { return frameCount; }
+
+	// Return number of events dropped because a ring was full.
+	static UINT64 getDroppedEvents() { return dropped.load(); }
+
+	// Release the ring of the calling thread before the thread exits.
+	static void releaseThread();
+
+	// Used by ProfileZone.
+	static LONGLONG now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t.QuadPart;
+	}
+	static void record(const char* name, LONGLONG start, LONGLONG end, UINT depth);
+	static UINT enter();
+	static void leave();
+
+private:
+	struct Event
+	{
+		const char* name;
+		LONGLONG start;
+		LONGLONG end;
+		UINT     depth;
+	};
+	// events of one thread, written by the owner and read by endFrame()
+	struct Ring
+	{
+		Event events[profilerNS::RING_EVENTS];
+		std::atomic<UINT> head;         // next write, owned by the thread
+		std::atomic<UINT> tail;         // next read, owned by endFrame()
+		std::atomic<bool> inUse;        // true while a thread owns the ring
+		UINT depth;                     // open zones of the owner
+	};
+	struct TraceEvent
+	{
+		UINT     zone;
+		UINT     thread;
+		LONGLONG start;
+		LONGLONG end;
+	};
+	struct Zone
+	{
+		const char* name;
+		UINT   depth;
+		LONGLONG firstStart;            // start of the first call, orders the table
+		UINT   calls;                   // calls this frame
+		LONGLONG ticks;                 // time this frame
+		std::vector<float> history;     // ms per frame, ring of HISTORY_FRAMES
+		std::vector<UINT> historyCalls;   // calls per frame, ring of HISTORY_FRAMES
+	};
+
+	static std::atomic<bool> enabled;
+	static std::atomic<Ring*> rings[profilerNS::MAX_THREADS];
+	static std::atomic<UINT> ringCount;
+	static std::atomic<UINT64> dropped;
+	static std::vector<Zone> zones;
+	static std::vector<TraceEvent> trace;
+	static bool capturing;
+	static UINT64 frameCount;
+	static UINT historyIndex;           // next frame in the zone histories
+	static UINT historyFrames;          // frames in the zone histories
+
+	// Return the ring of the calling thread, nullptr if none is left.
+	static Ring* threadRing();
+	// Return the zone index of name, added if new.
+	static UINT zoneIndex(const char* name, UINT depth, LONGLONG start);
+};
+
+// Times its scope as a profiler zone, use PROFILE_ZONE.
+class ProfileZone final
+{
+public:
+	// Constructor, starts the zone.
+	explicit ProfileZone(const char* zoneName) : name(zoneName), start(0), depth(0)
+	{
+		if (Profiler::isEnabled())
+		{
+			depth = Profiler::enter();
+			start = Profiler::now();
+		}
+	}
+
+	// Destructor, ends the zone.
+	~ProfileZone()
+	{
+		if (start != 0)
+		{
+			Profiler::record(name, start, Profiler::now(), depth);
+			Profiler::leave();
+		}
+	}
+
+private:
+	const char* name;
+	LONGLONG start;                     // 0 if not recorded
+	UINT depth;
+
+	ProfileZone(const ProfileZone&);    // no copies
+	ProfileZone& operator=(const ProfileZone&);
+};
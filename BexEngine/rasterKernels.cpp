@@ -0,0 +1,347 @@
+#include "rasterKernels.h"
+
+#if defined(__AVX2__)
+#define RASTER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// x / 255 rounded, x already contains the +128 rounding term
+	inline uint32_t div255(uint32_t x)
+	{
+		return (x + (x >> 8)) >> 8;
+	}
+
+	// one channel of src blended over dst with alpha a
+	inline uint32_t blendChannel(uint32_t s, uint32_t d, uint32_t a)
+	{
+		return div255(s * a + d * (255 - a) + 128);
+	}
+
+	// one channel of src scaled by a added to dst
+	inline uint32_t addChannel(uint32_t s, uint32_t d, uint32_t a)
+	{
+		uint32_t r = d + div255(s * a + 128);
+		return r > 255 ? 255 : r;
+	}
+
+	inline uint32_t blendPixel(uint32_t s, uint32_t d)
+	{
+		uint32_t a = s >> 24;
+		uint32_t r = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+			r |= blendChannel((s >> shift) & 0xff, (d >> shift) & 0xff, a) << shift;
+		return r;
+	}
+
+	inline uint32_t addPixel(uint32_t s, uint32_t d)
+	{
+		uint32_t a = s >> 24;
+		uint32_t r = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+			r |= addChannel((s >> shift) & 0xff, (d >> shift) & 0xff, a) << shift;
+		return r;
+	}
+
+	inline uint32_t modulatePixel(uint32_t s, uint32_t c)
+	{
+		uint32_t r = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+			r |= div255(((s >> shift) & 0xff) * ((c >> shift) & 0xff) + 128) << shift;
+		return r;
+	}
+
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	// x / 255 rounded on 16 bit lanes, x contains the +128 rounding term
+	inline __m128i div255_epu16(__m128i x)
+	{
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	}
+
+	// broadcast the alpha of each of the two pixels in x to its four lanes
+	inline __m128i alpha_epi16(__m128i x)
+	{
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+		return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	// blend two pixels unpacked to 16 bit lanes
+	inline __m128i blend2(__m128i s, __m128i d)
+	{
+		const __m128i c255 = _mm_set1_epi16(255);
+		const __m128i c128 = _mm_set1_epi16(128);
+		__m128i a = alpha_epi16(s);
+		__m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(c255, a)));
+		return div255_epu16(_mm_add_epi16(x, c128));
+	}
+
+	// src scaled by its alpha, two pixels unpacked to 16 bit lanes
+	inline __m128i scale2(__m128i s)
+	{
+		const __m128i c128 = _mm_set1_epi16(128);
+		return div255_epu16(_mm_add_epi16(_mm_mullo_epi16(s, alpha_epi16(s)), c128));
+	}
+
+	// four pixels of src blended over four pixels of dst
+	inline __m128i blend4(__m128i s, __m128i d)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = blend2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = blend2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	// four pixels of src scaled by alpha added to dst
+	inline __m128i add4(__m128i s, __m128i d)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = scale2(_mm_unpacklo_epi8(s, zero));
+		__m128i hi = scale2(_mm_unpackhi_epi8(s, zero));
+		return _mm_adds_epu8(d, _mm_packus_epi16(lo, hi));
+	}
+
+	// four pixels of s multiplied by the channels of c, c unpacked to 16 bit lanes
+	inline __m128i modulate4(__m128i s, __m128i c16)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i c128 = _mm_set1_epi16(128);
+		__m128i lo = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), c16), c128));
+		__m128i hi = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), c16), c128));
+		return _mm_packus_epi16(lo, hi);
+	}
+#endif
+
+#if defined(RASTER_AVX2)
+	inline __m256i div255_epu16x(__m256i x)
+	{
+		return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+	}
+
+	inline __m256i alpha_epi16x(__m256i x)
+	{
+		x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+		return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	inline __m256i blend4x(__m256i s, __m256i d)
+	{
+		const __m256i c255 = _mm256_set1_epi16(255);
+		const __m256i c128 = _mm256_set1_epi16(128);
+		__m256i a = alpha_epi16x(s);
+		__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)));
+		return div255_epu16x(_mm256_add_epi16(x, c128));
+	}
+
+	inline __m256i scale4x(__m256i s)
+	{
+		const __m256i c128 = _mm256_set1_epi16(128);
+		return div255_epu16x(_mm256_add_epi16(_mm256_mullo_epi16(s, alpha_epi16x(s)), c128));
+	}
+
+	// eight pixels of src blended over eight pixels of dst
+	inline __m256i blend8(__m256i s, __m256i d)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i lo = blend4x(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = blend4x(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		return _mm256_packus_epi16(lo, hi);
+	}
+
+	inline __m256i add8(__m256i s, __m256i d)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i lo = scale4x(_mm256_unpacklo_epi8(s, zero));
+		__m256i hi = scale4x(_mm256_unpackhi_epi8(s, zero));
+		return _mm256_adds_epu8(d, _mm256_packus_epi16(lo, hi));
+	}
+
+	inline __m256i modulate8(__m256i s, __m256i c16)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i c128 = _mm256_set1_epi16(128);
+		__m256i lo = div255_epu16x(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), c16), c128));
+		__m256i hi = div255_epu16x(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), c16), c128));
+		return _mm256_packus_epi16(lo, hi);
+	}
+#endif
+}
+
+//=============================================================================
+// Return name of the compiled kernel set
+//=============================================================================
+const char* rasterKernels::getKernelName()
+{
+#if defined(RASTER_AVX2)
+	return "AVX2";
+#elif defined(RASTER_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+//=============================================================================
+// Set count pixels of dst to color
+//=============================================================================
+void rasterKernels::fillSpan(uint32_t* dst, int count, uint32_t color)
+{
+	int i = 0;
+#if defined(RASTER_AVX2)
+	__m256i c8 = _mm256_set1_epi32((int)color);
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i*)(dst + i), c8);
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	__m128i c4 = _mm_set1_epi32((int)color);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i*)(dst + i), c4);
+#endif
+	for (; i < count; i++)
+		dst[i] = color;
+}
+
+//=============================================================================
+// Blend color over count pixels of dst
+//=============================================================================
+void rasterKernels::blendSpanSolid(uint32_t* dst, int count, uint32_t color)
+{
+	uint32_t a = color >> 24;
+	if (a == 255)
+	{
+		fillSpan(dst, count, color);
+		return;
+	}
+	// fully transparent leaves dst unchanged
+	if (a == 0)
+		return;
+	int i = 0;
+#if defined(RASTER_AVX2)
+	__m256i c8 = _mm256_set1_epi32((int)color);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), blend8(c8, d));
+	}
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	__m128i c4 = _mm_set1_epi32((int)color);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		_mm_storeu_si128((__m128i*)(dst + i), blend4(c4, d));
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = blendPixel(color, dst[i]);
+}
+
+//=============================================================================
+// Add color scaled by its alpha to count pixels of dst
+//=============================================================================
+void rasterKernels::addSpanSolid(uint32_t* dst, int count, uint32_t color)
+{
+	int i = 0;
+#if defined(RASTER_AVX2)
+	__m256i c8 = _mm256_set1_epi32((int)color);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), add8(c8, d));
+	}
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	__m128i c4 = _mm_set1_epi32((int)color);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		_mm_storeu_si128((__m128i*)(dst + i), add4(c4, d));
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = addPixel(color, dst[i]);
+}
+
+//=============================================================================
+// Blend src over dst using the alpha of each src pixel
+//=============================================================================
+void rasterKernels::blendSpan(uint32_t* dst, const uint32_t* src, int count)
+{
+	int i = 0;
+#if defined(RASTER_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), blend8(s, d));
+	}
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		_mm_storeu_si128((__m128i*)(dst + i), blend4(s, d));
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = blendPixel(src[i], dst[i]);
+}
+
+//=============================================================================
+// Add src scaled by its alpha to dst
+//=============================================================================
+void rasterKernels::addSpan(uint32_t* dst, const uint32_t* src, int count)
+{
+	int i = 0;
+#if defined(RASTER_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), add8(s, d));
+	}
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		_mm_storeu_si128((__m128i*)(dst + i), add4(s, d));
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = addPixel(src[i], dst[i]);
+}
+
+//=============================================================================
+// Multiply each channel of span by the channels of color
+//=============================================================================
+void rasterKernels::modulateSpan(uint32_t* span, int count, uint32_t color)
+{
+	// white leaves the span unchanged
+	if (color == 0xFFFFFFFF)
+		return;
+	int i = 0;
+#if defined(RASTER_AVX2)
+	__m256i c16x = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), _mm256_setzero_si256());
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(span + i));
+		_mm256_storeu_si256((__m256i*)(span + i), modulate8(s, c16x));
+	}
+#endif
+#if defined(RASTER_SSE2) || defined(RASTER_AVX2)
+	__m128i c16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), _mm_setzero_si128());
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(span + i));
+		_mm_storeu_si128((__m128i*)(span + i), modulate4(s, c16));
+	}
+#endif
+	for (; i < count; i++)
+		span[i] = modulatePixel(span[i], color);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Span kernels of the software rasterizer.
+// Pixels are 32 bit ARGB, the COLOR_ARGB format. All kernels produce bit
+// identical results in the scalar, SSE2 and AVX2 versions; the version is
+// selected at compile time (AVX2 with /arch:AVX2 or -mavx2, SSE2 on x86).
+// Blending treats the alpha channel like the color channels.
+namespace rasterKernels
+{
+	// Return name of the compiled kernel set: "AVX2", "SSE2" or "scalar".
+	const char* getKernelName();
+
+	// Set count pixels of dst to color.
+	void fillSpan(uint32_t* dst, int count, uint32_t color);
+
+	// Blend color over count pixels of dst using the alpha of color.
+	void blendSpanSolid(uint32_t* dst, int count, uint32_t color);
+
+	// Add color scaled by its alpha to count pixels of dst, saturating.
+	void addSpanSolid(uint32_t* dst, int count, uint32_t color);
+
+	// Blend src over dst using the alpha of each src pixel.
+	void blendSpan(uint32_t* dst, const uint32_t* src, int count);
+
+	// Add src scaled by its alpha to dst, saturating.
+	void addSpan(uint32_t* dst, const uint32_t* src, int count);
+
+	// Multiply each channel of count pixels of span by the channels of color.
+	void modulateSpan(uint32_t* span, int count, uint32_t color);
+}
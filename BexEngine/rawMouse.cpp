@@ -0,0 +1,99 @@
+#include "rawMouse.h"
+
+//=============================================================================
+// Constructor
+//=============================================================================
+RawInputSource::RawInputSource()
+{
+	message = 0;
+#ifdef _WIN32
+	buffer.resize(rawMouseNS::BATCH);
+#endif
+}
+
+//=============================================================================
+// Read the report of the current message and the queued reports
+//=============================================================================
+UINT RawInputSource::read(RawMotion* samples, UINT max)
+{
+	UINT n = 0;
+#ifdef _WIN32
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if (message && max > 0)
+	{
+		RAWINPUT raw;
+		UINT size = sizeof(raw);
+		if (GetRawInputData((HRAWINPUT)message, RID_INPUT, &raw, &size,
+			sizeof(RAWINPUTHEADER)) != (UINT)-1 &&
+			raw.header.dwType == RIM_TYPEMOUSE && !(raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE))
+		{
+			samples[n].time = now.QuadPart;
+			samples[n].dx = raw.data.mouse.lLastX;
+			samples[n].dy = raw.data.mouse.lLastY;
+			++n;
+		}
+		message = 0;
+	}
+	while (n < max)
+	{
+		UINT room = max - n < buffer.size() ? max - n : (UINT)buffer.size();
+		UINT size = room * sizeof(RAWINPUT);
+		UINT count = GetRawInputBuffer(&buffer[0], &size, sizeof(RAWINPUTHEADER));
+		if (count == 0 || count == (UINT)-1)
+			break;
+		RAWINPUT* raw = &buffer[0];
+		for (UINT i = 0; i < count; i++)
+		{
+			if (raw->header.dwType == RIM_TYPEMOUSE && !(raw->data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE))
+			{
+				samples[n].time = now.QuadPart;
+				samples[n].dx = raw->data.mouse.lLastX;
+				samples[n].dy = raw->data.mouse.lLastY;
+				++n;
+			}
+			raw = NEXTRAWINPUTBLOCK(raw);
+		}
+	}
+#else
+	message = 0;
+#endif
+	return n;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+SyntheticMotionSource::SyntheticMotionSource(double r)
+{
+	rate = r;
+	dueTime = 0;
+	reports = 0;
+	totalX = 0;
+	totalY = 0;
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	start = t.QuadPart;
+	QueryPerformanceFrequency(&t);
+	frequency = t.QuadPart;
+}
+
+//=============================================================================
+// Return the due reports, stamped with their time on the timeline
+//=============================================================================
+UINT SyntheticMotionSource::read(RawMotion* samples, UINT max)
+{
+	UINT64 due = (UINT64)(dueTime * rate);
+	UINT n = 0;
+	while (reports < due && n < max)
+	{
+		RawMotion& m = samples[n++];
+		m.time = start + (LONGLONG)(reports * frequency / rate);
+		m.dx = (int)(reports % 7) - 2;
+		m.dy = (int)(reports % 5) - 2;
+		totalX += m.dx;
+		totalY += m.dy;
+		++reports;
+	}
+	return n;
+}
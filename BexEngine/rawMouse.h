@@ -0,0 +1,91 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "platform.h"
+#include <vector>
+#include "constants.h"
+
+namespace rawMouseNS
+{
+	const UINT BATCH = 64;                  // reports read from a source at once
+	const UINT HISTORY = 4096;              // samples kept per simulation step
+}
+
+// One relative mouse report.
+struct RawMotion
+{
+	LONGLONG time;                          // performance counter when it was read
+	int      dx, dy;                        // movement in mouse counts
+};
+
+// Source of relative mouse reports, read by the window message thread.
+class RawMotionSource
+{
+public:
+	// Destructor
+	virtual ~RawMotionSource() {}
+
+	// Copy up to max reports that arrived since the last read into samples,
+	// oldest first. Returns number of reports copied.
+	virtual UINT read(RawMotion* samples, UINT max) = 0;
+};
+
+// Raw input mouse reports of Windows.
+// The report of the WM_INPUT message being handled is read first, then
+// GetRawInputBuffer drains the reports still queued, so one message handles
+// every report of a high rate mouse instead of one message per report. The
+// reports of one read share its time. Absolute moves, e.g. of a remote
+// desktop, are skipped. Other platforms have no reports.
+class RawInputSource final : public RawMotionSource
+{
+public:
+	// Constructor
+	RawInputSource();
+
+	// Set the raw input handle of the WM_INPUT message being handled,
+	// valid only until the message returns.
+	void    setMessage(LPARAM lParam) { message = lParam; }
+
+	UINT    read(RawMotion* samples, UINT max) override;
+
+private:
+	LPARAM  message;                        // raw input handle, 0 when read
+#ifdef _WIN32
+	std::vector<RAWINPUT> buffer;           // for GetRawInputBuffer
+#endif
+};
+
+// Reports of a mouse moving at rate reports per second, generated on a
+// simulated timeline to measure input handling at any report rate. The
+// movement repeats a fixed pattern, its sums are kept to check that no
+// motion is lost.
+class SyntheticMotionSource final : public RawMotionSource
+{
+public:
+	// Constructor
+	// Pre: rate > 0
+	explicit SyntheticMotionSource(double rate);
+
+	// Make the reports of the next sec seconds due.
+	void    advance(double sec) { dueTime += sec; }
+
+	// Return the due reports.
+	UINT    read(RawMotion* samples, UINT max) override;
+
+	// Return number of reports read.
+	UINT64  getReports() const { return reports; }
+
+	// Return sum of the x movement read.
+	LONGLONG getTotalX() const { return totalX; }
+
+	// Return sum of the y movement read.
+	LONGLONG getTotalY() const { return totalY; }
+
+private:
+	double  rate;
+	double  dueTime;                        // seconds of the timeline generated
+	UINT64  reports;
+	LONGLONG totalX, totalY;
+	LONGLONG start;                         // performance counter of report 0
+	LONGLONG frequency;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include "constants.h"
+#include "gameError.h"
+#include "spriteBatch.h"
+
+// Color defines
+#define COLOR_ARGB DWORD
+#define SETCOLOR_ARGB(a,r,g,b) \
+	((COLOR_ARGB)((((a)& 0xff) << 24) | (((r)& 0xff) << 16) | (((g)& 0xff) << 8) | ((b)& 0xff)))
+
+namespace graphicsNS
+{
+	// rendering backends
+	const int BACKEND_D3D9 = 0;             // Direct3D 9, requires a window
+	const int BACKEND_HEADLESS = 1;         // no window or GPU, records or discards draw work
+	const int BACKEND_SOFTWARE = 2;         // multithreaded CPU rasterizer into a memory framebuffer
+
+	// device states returned by getDeviceState(), same values as the D3DERR codes
+	const HRESULT DEVICE_LOST = (HRESULT)0x88760868L;       // D3DERR_DEVICELOST
+	const HRESULT DEVICE_NOT_RESET = (HRESULT)0x88760869L;  // D3DERR_DEVICENOTRESET
+
+	// texture pools
+	const int POOL_MANAGED = 0;             // the backend keeps a copy, survives a reset
+	const int POOL_DEFAULT = 1;             // video memory only, lost with the device
+}
+
+// Interface of a rendering backend behind GraphicsSystem.
+// A backend also draws the sprite batches of GraphicsSystem.
+class RenderBackend : public SpriteBatchBackend
+{
+public:
+	// Destructor
+	virtual ~RenderBackend() {}
+
+	// Initialize the backend
+	// Throws GameError on error
+	// Pre: hw = handle to window, may be nullptr for backends without a window
+	//      width = width in pixels
+	//      height = height in pixels
+	//      fullscreen = true for full screen, false for window
+	virtual void initialize(HWND hw, int width, int height, bool fullscreen) = 0;
+
+	// Release all backend resources.
+	virtual void releaseAll() = 0;
+
+	// Clear the backbuffer to backColor and begin a scene.
+	virtual HRESULT beginScene(COLOR_ARGB backColor) = 0;
+
+	// End the scene.
+	virtual HRESULT endScene() = 0;
+
+	// Display the backbuffer.
+	virtual HRESULT present() = 0;
+
+	// Test for lost device. Returns S_OK, graphicsNS::DEVICE_LOST or DEVICE_NOT_RESET.
+	virtual HRESULT getDeviceState() = 0;
+
+	// Reset a lost device.
+	virtual HRESULT reset() = 0;
+
+	// Set the device state shared by all sprite draws, called before a batch is drawn.
+	virtual void beginSprites() {}
+
+	// Draw a one pixel wide line, alpha blended. Call between beginScene and endScene.
+	virtual void drawLine(float /*x1*/, float /*y1*/, float /*x2*/, float /*y2*/, COLOR_ARGB /*color*/) {}
+
+	// Create a texture, use it as SpriteData::texture.
+	// Returns nullptr on failure.
+	// Pre: pixels = width * height ARGB pixels, rows top to bottom
+	//      pool = graphicsNS::POOL_MANAGED or POOL_DEFAULT. POOL_DEFAULT
+	//      textures must be released before reset().
+	virtual void* createTexture(int width, int height, const uint32_t* pixels, int pool) = 0;
+
+	// Replace the pixels of a texture created by createTexture(). The texture
+	// stays the same object, draws already queued with it use the new pixels.
+	// Returns false on failure.
+	// Pre: pixels = width * height ARGB pixels of the size it was created with
+	virtual bool updateTexture(void* texture, const uint32_t* pixels) = 0;
+
+	// Release a texture created by createTexture().
+	virtual void releaseTexture(void* texture) = 0;
+};
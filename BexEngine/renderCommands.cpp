@@ -0,0 +1,122 @@
+#include "renderCommands.h"
+
+//=============================================================================
+// Constructor
+//=============================================================================
+RenderCommandBuffer::RenderCommandBuffer()
+{
+	commands.reserve(renderCommandNS::INITIAL_COMMANDS);
+	sprites.reserve(renderCommandNS::INITIAL_SPRITES);
+	vertexCount = 0;
+	quadFirst = 0;
+	quadCount = 0;
+	spriteFirst = 0;
+	sortMode = spriteBatchNS::SORT_TEXTURE;
+	spriteOpen = false;
+	time = 0;
+}
+
+//=============================================================================
+// Start recording a frame
+//=============================================================================
+void RenderCommandBuffer::clear(double t)
+{
+	commands.clear();
+	sprites.clear();
+	vertexCount = 0;
+	quadCount = 0;
+	spriteOpen = false;
+	time = t;
+}
+
+//=============================================================================
+// Add a command
+//=============================================================================
+RenderCommand& RenderCommandBuffer::add(int type, int arg, COLOR_ARGB color)
+{
+	RenderCommand c = { type, arg, color, 0, 0, 0, 0, 0, 0, nullptr };
+	commands.push_back(c);
+	return commands.back();
+}
+
+//=============================================================================
+// Record the start of a sprite batch
+//=============================================================================
+void RenderCommandBuffer::spriteBegin(int mode)
+{
+	add(renderCommandNS::CMD_SPRITE_BEGIN, mode, 0);
+	spriteFirst = (UINT)sprites.size();
+	sortMode = mode;
+	spriteOpen = true;
+}
+
+//=============================================================================
+// Record a solid color rectangle of the open sprite batch
+//=============================================================================
+void RenderCommandBuffer::drawRect(float x, float y, float w, float h, COLOR_ARGB color)
+{
+	SpriteData sd;
+	sd.x = x;
+	sd.y = y;
+	sd.width = w;
+	sd.height = h;
+	sd.color = color;
+	drawSprite(sd);
+}
+
+//=============================================================================
+// Record the end of the sprite batch
+//=============================================================================
+void RenderCommandBuffer::spriteEnd()
+{
+	if (!spriteOpen)
+		return;
+	spriteOpen = false;
+	RenderCommand& c = add(renderCommandNS::CMD_SPRITE_END, sortMode, 0);
+	c.first = spriteFirst;
+	c.count = (UINT)sprites.size() - spriteFirst;
+}
+
+//=============================================================================
+// Record a line
+//=============================================================================
+void RenderCommandBuffer::drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color)
+{
+	RenderCommand& c = add(renderCommandNS::CMD_LINE, 0, color);
+	c.x1 = x1;
+	c.y1 = y1;
+	c.x2 = x2;
+	c.y2 = y2;
+}
+
+//=============================================================================
+// Return room for the vertices of quadCount quads.
+// The vertex array is resized only when it grows, so its vertices are not
+// cleared every frame.
+//=============================================================================
+SpriteVertex* RenderCommandBuffer::beginQuads(UINT count)
+{
+	quadCount = 0;
+	if (count == 0)
+		return nullptr;
+	if (vertexCount + count * 4 > vertices.size())
+		vertices.resize(vertexCount + count * 4);
+	quadFirst = vertexCount / 4;
+	quadCount = count;
+	vertexCount += count * 4;
+	return &vertices[quadFirst * 4];
+}
+
+//=============================================================================
+// Record the quads of the last beginQuads()
+//=============================================================================
+void RenderCommandBuffer::endQuads(void* texture, int blend)
+{
+	if (quadCount == 0)
+		return;
+	RenderCommand& c = add(renderCommandNS::CMD_QUADS, blend, 0);
+	c.first = quadFirst;
+	c.count = quadCount;
+	c.texture = texture;
+	quadCount = 0;
+}
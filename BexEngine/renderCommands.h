@@ -0,0 +1,110 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <vector>
+#include "renderBackend.h"
+
+namespace renderCommandNS
+{
+	const UINT FRAME_BUFFERS = 2;           // frames being recorded or drawn, 3 adds a waiting frame
+	const UINT INITIAL_COMMANDS = 256;      // reserved per buffer, grows if needed
+	const UINT INITIAL_SPRITES = 8192;
+
+	// commands
+	const int CMD_BEGIN_SCENE = 0;          // color = back color
+	const int CMD_SPRITE_BEGIN = 1;
+	const int CMD_SPRITE_END = 2;           // arg = sort mode, sprites first..first+count
+	const int CMD_LINE = 3;                 // x1,y1 to x2,y2 in color
+	const int CMD_END_SCENE = 4;
+	const int CMD_PRESENT = 5;
+	const int CMD_QUADS = 6;                // arg = blend, vertices of quads first..first+count
+}
+
+// One recorded graphics call.
+struct RenderCommand
+{
+	int   type;                         // renderCommandNS::CMD_
+	int   arg;
+	COLOR_ARGB color;
+	UINT  first;                        // sprite range of CMD_SPRITE_END, quad range of CMD_QUADS
+	UINT  count;
+	float x1, y1, x2, y2;               // line of CMD_LINE
+	void* texture;                      // texture of CMD_QUADS
+};
+
+// The graphics calls of one frame, recorded by the game thread and drawn by
+// the render thread. Sprites are stored once in a flat array that the sprite
+// batch draws in place, prepared quads in a flat vertex array. clear() keeps
+// the memory, so recording a frame does not allocate once the buffer has
+// grown to the size of a frame.
+class RenderCommandBuffer final
+{
+public:
+	// Constructor, reserves INITIAL_COMMANDS commands and INITIAL_SPRITES sprites.
+	RenderCommandBuffer();
+
+	// Start recording a frame that began at time seconds.
+	void clear(double time);
+
+	// Record the start of a scene cleared to backColor.
+	void beginScene(COLOR_ARGB backColor) { add(renderCommandNS::CMD_BEGIN_SCENE, 0, backColor); }
+
+	// Record the start of a sprite batch.
+	// Pre: sortMode = spriteBatchNS::SORT_TEXTURE or SORT_NONE
+	void spriteBegin(int sortMode);
+
+	// Record a sprite of the open sprite batch.
+	void drawSprite(const SpriteData& sd) { if (spriteOpen) sprites.push_back(sd); }
+
+	// Record a solid color rectangle of the open sprite batch.
+	void drawRect(float x, float y, float w, float h, COLOR_ARGB color);
+
+	// Record the end of the sprite batch.
+	void spriteEnd();
+
+	// Record a line.
+	void drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color);
+
+	// Return room for the four vertices of quadCount quads, recorded by endQuads().
+	// The memory is valid until the next beginQuads() or clear(), nullptr for 0 quads.
+	SpriteVertex* beginQuads(UINT quadCount);
+
+	// Record the quads of the last beginQuads() with texture and spriteBatchNS blend state.
+	void endQuads(void* texture, int blend);
+
+	// Record the end of the scene.
+	void endScene() { add(renderCommandNS::CMD_END_SCENE, 0, 0); }
+
+	// Record the display of the backbuffer.
+	void present() { add(renderCommandNS::CMD_PRESENT, 0, 0); }
+
+	// Return number of commands.
+	UINT getCount() const { return (UINT)commands.size(); }
+
+	// Return command i.
+	const RenderCommand& getCommand(UINT i) const { return commands[i]; }
+
+	// Return the sprites of the sprite batches.
+	const SpriteData* getSprites() const { return sprites.empty() ? nullptr : &sprites[0]; }
+
+	// Return the vertices of the quads, four per quad.
+	const SpriteVertex* getVertices() const { return vertices.empty() ? nullptr : &vertices[0]; }
+
+	// Return time in seconds the frame began.
+	double getTime() const { return time; }
+
+private:
+	std::vector<RenderCommand> commands;
+	std::vector<SpriteData> sprites;
+	std::vector<SpriteVertex> vertices;     // grows, never shrinks, vertexCount are used
+	UINT   vertexCount;
+	UINT   quadFirst;                   // first quad of the last beginQuads
+	UINT   quadCount;
+	UINT   spriteFirst;                 // first sprite of the open sprite batch
+	int    sortMode;
+	bool   spriteOpen;                  // true between spriteBegin and spriteEnd
+	double time;
+
+	// Add a command.
+	RenderCommand& add(int type, int arg, COLOR_ARGB color);
+};
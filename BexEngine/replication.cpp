@@ -0,0 +1,909 @@
+#include "replication.h"
+#include "framePacer.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	// datagram types, the first byte
+	const uint8_t PACKET_SNAPSHOT = 1;      // server: fragment of a snapshot
+	const uint8_t PACKET_ACK = 2;           // client: snapshot decoded
+	const uint8_t PACKET_HELLO = 3;         // client: connect
+
+	// Snapshot datagram header, HEADER_BYTES bytes.
+	struct SnapshotHeader
+	{
+		uint8_t  type;
+		uint8_t  fragment;
+		uint8_t  fragments;
+		uint8_t  unused;
+		uint32_t tick;
+		uint32_t baseline;                  // NONE for all entities
+		float    stepTime;
+	};
+	static_assert(sizeof(SnapshotHeader) == replicationNS::HEADER_BYTES, "snapshot header layout");
+
+	// Write 0 as one bit, else a 4, 8, 16 or 32 bit value with a 2 bit size.
+	inline void writeSmall(BitWriter& w, uint32_t v)
+	{
+		if (v == 0)
+		{
+			w.writeBit(false);
+			return;
+		}
+		w.writeBit(true);
+		if (v < 16)
+		{
+			w.write(0, 2);
+			w.write(v, 4);
+		}
+		else if (v < 256)
+		{
+			w.write(1, 2);
+			w.write(v, 8);
+		}
+		else if (v < 65536)
+		{
+			w.write(2, 2);
+			w.write(v, 16);
+		}
+		else
+		{
+			w.write(3, 2);
+			w.write(v, 32);
+		}
+	}
+
+	inline uint32_t readSmall(BitReader& r)
+	{
+		static const unsigned int SIZES[4] = { 4, 8, 16, 32 };
+		if (!r.readBit())
+			return 0;
+		return r.read(SIZES[r.read(2)]);
+	}
+
+	// Write the change of a field of bits bits from base to v: a 0 bit if it
+	// did not change, else a 1 bit and the difference in 4, 8 or 16 bits or
+	// the value itself.
+	inline void writeDelta(BitWriter& w, uint32_t v, uint32_t base, UINT bits)
+	{
+		if (v == base)
+		{
+			w.writeBit(false);
+			return;
+		}
+		w.writeBit(true);
+		int64_t d = (int64_t)v - base;
+		uint64_t zigzag = d < 0 ? (uint64_t)(-2 * d - 1) : (uint64_t)(2 * d);
+		if (zigzag < 16 && bits > 4)
+		{
+			w.write(0, 2);
+			w.write((uint32_t)zigzag, 4);
+		}
+		else if (zigzag < 256 && bits > 8)
+		{
+			w.write(1, 2);
+			w.write((uint32_t)zigzag, 8);
+		}
+		else if (zigzag < 65536 && bits > 16)
+		{
+			w.write(2, 2);
+			w.write((uint32_t)zigzag, 16);
+		}
+		else
+		{
+			w.write(3, 2);
+			w.write(v, bits);
+		}
+	}
+
+	inline uint32_t readDelta(BitReader& r, uint32_t base, UINT bits)
+	{
+		static const unsigned int SIZES[3] = { 4, 8, 16 };
+		if (!r.readBit())
+			return base;
+		uint32_t size = r.read(2);
+		if (size == 3)
+			return r.read(bits);
+		uint32_t zigzag = r.read(SIZES[size]);
+		int64_t d = (zigzag & 1) ? -(int64_t)((zigzag + 1) / 2) : (int64_t)(zigzag / 2);
+		return (uint32_t)((int64_t)base + d);
+	}
+
+	// Quantize the field at p.
+	inline uint32_t quantize(const NetField& f, const unsigned char* p)
+	{
+		if (!f.isFloat)
+		{
+			uint32_t v;
+			memcpy(&v, p, 4);
+			return f.bits < 32 ? v & ((1u << f.bits) - 1) : v;
+		}
+		float v;
+		memcpy(&v, p, 4);
+		float q = (v - f.min) * f.scale + 0.5f;
+		float top = (float)((1u << f.bits) - 1);
+		q = q < 0 ? 0 : (q > top ? top : q);
+		return (uint32_t)q;
+	}
+
+	// Value of quantized v.
+	inline float dequantize(const NetField& f, uint32_t v)
+	{
+		return f.min + v / f.scale;
+	}
+
+	// Hash of the quantized state of f, FNV-1a.
+	uint32_t frameHash(const NetFrame& f, UINT fieldCount)
+	{
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < f.generations.size(); i++)
+		{
+			if (f.generations[i] == 0)
+				continue;
+			uint32_t words[2] = { (uint32_t)i, f.masks[i] };
+			const uint8_t* p = (const uint8_t*)words;
+			for (int k = 0; k < 8; k++)
+				h = (h ^ p[k]) * 16777619u;
+			p = (const uint8_t*)&f.values[i * fieldCount];
+			for (UINT k = 0; k < fieldCount * 4; k++)
+				h = (h ^ p[k]) * 16777619u;
+		}
+		return h ? h : 1;
+	}
+
+	// Make room for entity index in f.
+	inline void growFrame(NetFrame& f, size_t index, UINT fieldCount)
+	{
+		if (index < f.generations.size())
+			return;
+		size_t size = std::max(index + 1, f.generations.size() * 2);
+		f.generations.resize(size, 0);
+		f.masks.resize(size, 0);
+		f.values.resize(size * fieldCount, 0);
+	}
+}
+
+//=============================================================================
+// Add a float to the last component
+// Throws GameError
+//=============================================================================
+void ReplicationSchema::addFloat(UINT offset, float min, float max, UINT bits)
+{
+	NetField f;
+	f.offset = offset;
+	f.bits = bits < 1 ? 1 : (bits > 24 ? 24 : bits);    // a float holds 24 bits exactly
+	f.isFloat = true;
+	f.min = min;
+	f.scale = max > min ? (float)(((1u << f.bits) - 1) / ((double)max - min)) : 1;
+	addField(f);
+}
+
+//=============================================================================
+// Add an integer to the last component
+// Throws GameError
+//=============================================================================
+void ReplicationSchema::addInt(UINT offset, UINT bits)
+{
+	NetField f;
+	f.offset = offset;
+	f.bits = bits < 1 ? 1 : (bits > 32 ? 32 : bits);
+	f.isFloat = false;
+	f.min = 0;
+	f.scale = 1;
+	addField(f);
+}
+
+//=============================================================================
+// Add a field to the last component
+// Throws GameError
+//=============================================================================
+void ReplicationSchema::addField(const NetField& f)
+{
+	if (components.empty())
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Replicated field without a component"));
+	if (fields.size() >= replicationNS::MAX_FIELDS)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Too many replicated fields"));
+	fields.push_back(f);
+	++components.back().fieldCount;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+ReplicationServer::ReplicationServer()
+{
+	transport = nullptr;
+	schema = nullptr;
+	capturing = nullptr;
+	capturingComponent = 0;
+	ticks = 0;
+	fullTick = replicationNS::NONE;
+	memset(&stats, 0, sizeof(stats));
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+ReplicationServer::~ReplicationServer()
+{
+	release();
+}
+
+//=============================================================================
+// Accept clients on transport
+//=============================================================================
+void ReplicationServer::initialize(NetTransport* t, const ReplicationSchema* s)
+{
+	release();
+	transport = t;
+	schema = s;
+	datagram.resize(netTransportNS::MAX_DATAGRAM);
+}
+
+//=============================================================================
+// Close the transport and forget the clients
+//=============================================================================
+void ReplicationServer::release()
+{
+	delete transport;
+	transport = nullptr;
+	clients.clear();
+	for (UINT i = 0; i < replicationNS::FRAMES; i++)
+		frames[i].tick = replicationNS::NONE;
+	fullTick = replicationNS::NONE;
+}
+
+//=============================================================================
+// Receive the connects and acks of the clients
+//=============================================================================
+void ReplicationServer::receive(float stepTime)
+{
+	for (size_t i = 0; i < clients.size(); i++)
+		clients[i].silence += stepTime;
+	NetAddress from;
+	UINT bytes;
+	while ((bytes = transport->receive(from, &datagram[0], (UINT)datagram.size())) > 0)
+	{
+		Client* c = nullptr;
+		for (size_t i = 0; i < clients.size(); i++)
+			if (clients[i].address == from)
+				c = &clients[i];
+		if (datagram[0] == PACKET_HELLO && c == nullptr && clients.size() < replicationNS::MAX_CLIENTS)
+		{
+			Client n = { from, replicationNS::NONE, 0 };
+			clients.push_back(n);
+			c = &clients.back();
+		}
+		if (c == nullptr)
+			continue;
+		c->silence = 0;
+		if (datagram[0] == PACKET_ACK && bytes >= 5)
+		{
+			uint32_t tick;
+			memcpy(&tick, &datagram[1], 4);
+			// acks may arrive out of order
+			if (c->acked == replicationNS::NONE || (int32_t)(tick - c->acked) > 0)
+				c->acked = tick;
+		}
+	}
+	for (size_t i = 0; i < clients.size();)
+	{
+		if (clients[i].silence > replicationNS::CLIENT_TIMEOUT)
+		{
+			clients[i] = clients.back();
+			clients.pop_back();
+		}
+		else
+			i++;
+	}
+}
+
+//=============================================================================
+// Quantize a chunk of components into the frame being captured
+//=============================================================================
+void ReplicationServer::captureChunk(void* context, UINT count, const Entity* entities,
+	const unsigned char* data, UINT size)
+{
+	ReplicationServer* s = (ReplicationServer*)context;
+	NetFrame& f = *s->capturing;
+	const UINT fieldCount = s->schema->getFieldCount();
+	const NetComponent& c = s->schema->getComponent(s->capturingComponent);
+	for (UINT i = 0; i < count; i++, data += size)
+	{
+		uint32_t index = entities[i].index;
+		growFrame(f, index, fieldCount);
+		uint32_t* values = &f.values[(size_t)index * fieldCount];
+		if (f.masks[index] == 0)
+		{
+			// first component of the entity, the values of the others are 0
+			memset(values, 0, fieldCount * 4);
+			f.generations[index] = entities[i].generation;
+			++f.entityCount;
+		}
+		f.masks[index] |= 1u << s->capturingComponent;
+		for (UINT k = c.firstField; k < c.firstField + c.fieldCount; k++)
+		{
+			const NetField& field = s->schema->getField(k);
+			values[k] = quantize(field, data + field.offset);
+		}
+	}
+}
+
+//=============================================================================
+// Quantize the replicated components of world into f
+//=============================================================================
+void ReplicationServer::capture(World& world, NetFrame& f)
+{
+	std::fill(f.generations.begin(), f.generations.end(), 0);
+	std::fill(f.masks.begin(), f.masks.end(), 0);
+	f.entityCount = 0;
+	capturing = &f;
+	for (UINT c = 0; c < schema->getComponentCount(); c++)
+	{
+		capturingComponent = c;
+		schema->getComponent(c).eachChunk(world, this, &ReplicationServer::captureChunk);
+	}
+	capturing = nullptr;
+}
+
+//=============================================================================
+// Encode cur as delta to base into writer.
+// Layout: per changed entity a 1 bit, the index distance to the previous
+// one, a new bit and the components and all fields of a new entity or the
+// change of every field; a 0 bit; then per removed entity a 1 bit and the
+// index distance; a 0 bit.
+//=============================================================================
+void ReplicationServer::encode(const NetFrame& cur, const NetFrame* base)
+{
+	const UINT fieldCount = schema->getFieldCount();
+	const UINT componentCount = schema->getComponentCount();
+	const size_t curSize = cur.generations.size();
+	const size_t baseSize = base ? base->generations.size() : 0;
+	const size_t n = std::max(curSize, baseSize);
+	writer.reset();
+	removed.clear();
+	uint32_t previous = replicationNS::NONE;
+	for (size_t i = 0; i < n; i++)
+	{
+		bool inCur = i < curSize && cur.generations[i] != 0;
+		bool inBase = i < baseSize && base->generations[i] != 0;
+		if (!inCur)
+		{
+			if (inBase)
+				removed.push_back((uint32_t)i);
+			continue;
+		}
+		bool isNew = !inBase || base->generations[i] != cur.generations[i] || base->masks[i] != cur.masks[i];
+		const uint32_t* v = &cur.values[i * fieldCount];
+		const uint32_t* b = isNew ? nullptr : &base->values[i * fieldCount];
+		if (!isNew && memcmp(v, b, fieldCount * 4) == 0)
+			continue;
+		writer.writeBit(true);
+		writeSmall(writer, (uint32_t)i - previous - 1);
+		previous = (uint32_t)i;
+		writer.writeBit(isNew);
+		uint32_t mask = cur.masks[i];
+		if (isNew)
+			writer.write(mask, componentCount);
+		for (UINT c = 0; c < componentCount; c++)
+		{
+			if (!(mask & (1u << c)))
+				continue;
+			const NetComponent& nc = schema->getComponent(c);
+			for (UINT k = nc.firstField; k < nc.firstField + nc.fieldCount; k++)
+			{
+				UINT bits = schema->getField(k).bits;
+				if (isNew)
+					writer.write(v[k], bits);
+				else
+					writeDelta(writer, v[k], b[k], bits);
+			}
+		}
+	}
+	writer.writeBit(false);
+	previous = replicationNS::NONE;
+	for (size_t i = 0; i < removed.size(); i++)
+	{
+		writer.writeBit(true);
+		writeSmall(writer, removed[i] - previous - 1);
+		previous = removed[i];
+	}
+	writer.writeBit(false);
+}
+
+//=============================================================================
+// Send an encoded snapshot in fragments
+//=============================================================================
+void ReplicationServer::send(const NetAddress& to, const NetFrame& f, uint32_t baseline,
+	const std::vector<uint8_t>& data)
+{
+	UINT fragments = ((UINT)data.size() + replicationNS::FRAGMENT_BYTES - 1) / replicationNS::FRAGMENT_BYTES;
+	if (fragments == 0)
+		fragments = 1;
+	if (fragments > replicationNS::MAX_FRAGMENTS)
+	{
+		++stats.dropped;
+		return;
+	}
+	SnapshotHeader h;
+	h.type = PACKET_SNAPSHOT;
+	h.fragments = (uint8_t)fragments;
+	h.unused = 0;
+	h.tick = f.tick;
+	h.baseline = baseline;
+	h.stepTime = f.stepTime;
+	for (UINT k = 0; k < fragments; k++)
+	{
+		UINT at = k * replicationNS::FRAGMENT_BYTES;
+		UINT bytes = std::min((UINT)data.size() - at, replicationNS::FRAGMENT_BYTES);
+		h.fragment = (uint8_t)k;
+		memcpy(&datagram[0], &h, replicationNS::HEADER_BYTES);
+		if (bytes > 0)
+			memcpy(&datagram[replicationNS::HEADER_BYTES], &data[at], bytes);
+		transport->send(to, &datagram[0], replicationNS::HEADER_BYTES + bytes);
+		stats.bytes += replicationNS::HEADER_BYTES + bytes;
+		++stats.datagrams;
+	}
+}
+
+//=============================================================================
+// Send the snapshot of world as the next tick to every client
+//=============================================================================
+void ReplicationServer::tick(World& world, float stepTime)
+{
+	if (transport == nullptr)
+		return;
+	receive(stepTime);
+	uint32_t tick = ticks++;
+	double start = FramePacer::now();
+	NetFrame& f = frames[tick % replicationNS::FRAMES];
+	capture(world, f);
+	f.tick = tick;
+	f.stepTime = stepTime;
+	double captured = FramePacer::now();
+	stats.captureTime += captured - start;
+
+	// clients with the same baseline get the same bytes
+	UINT used = 0;
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		uint32_t baseline = clients[i].acked;
+		const NetFrame* base = nullptr;
+		if (baseline != replicationNS::NONE && frames[baseline % replicationNS::FRAMES].tick == baseline &&
+			baseline != tick)
+			base = &frames[baseline % replicationNS::FRAMES];
+		else
+		{
+			// the same full snapshot until it is acknowledged, all its
+			// fragments arrive over the ticks even if each tick loses some;
+			// renewed half way through the kept frames so the ack finds it
+			if (fullTick == replicationNS::NONE || frames[fullTick % replicationNS::FRAMES].tick != fullTick ||
+				tick - fullTick >= replicationNS::FRAMES / 2)
+			{
+				fullTick = tick;
+				encode(f, nullptr);
+				full = writer.finish();
+				stats.encodedEntities += f.entityCount;
+			}
+			const NetFrame& ff = frames[fullTick % replicationNS::FRAMES];
+			send(clients[i].address, ff, replicationNS::NONE, full);
+			++stats.snapshots;
+			stats.entities += ff.entityCount;
+			++stats.fullSnapshots;
+			continue;
+		}
+		UINT e = 0;
+		while (e < used && encoded[e].first != baseline)
+			e++;
+		if (e == used)
+		{
+			encode(f, base);
+			if (used == encoded.size())
+				encoded.resize(used + 1);
+			encoded[used].first = baseline;
+			encoded[used].second = writer.finish();
+			stats.encodedEntities += f.entityCount;
+			++used;
+		}
+		send(clients[i].address, f, baseline, encoded[e].second);
+		++stats.snapshots;
+		stats.entities += f.entityCount;
+	}
+	stats.time += FramePacer::now() - captured;
+}
+
+//=============================================================================
+// Return a hash of the quantized state of tick
+//=============================================================================
+uint32_t ReplicationServer::getChecksum(uint32_t tick) const
+{
+	const NetFrame& f = frames[tick % replicationNS::FRAMES];
+	if (f.tick != tick || schema == nullptr)
+		return 0;
+	return frameHash(f, schema->getFieldCount());
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+NetStats ReplicationServer::getStats() const
+{
+	NetStats s = stats;
+	s.clients = (UINT)clients.size();
+	return s;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+ReplicationClient::ReplicationClient()
+{
+	transport = nullptr;
+	schema = nullptr;
+	server.host = 0;
+	server.port = 0;
+	newest = replicationNS::NONE;
+	delay = replicationNS::INTERPOLATION_DELAY;
+	renderTick = 0;
+	started = false;
+	helloTimer = 0;
+	pendingTick = replicationNS::NONE;
+	pendingBaseline = replicationNS::NONE;
+	pendingStepTime = 0;
+	pendingFragments = 0;
+	pendingReceived = 0;
+	pendingSize = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+ReplicationClient::~ReplicationClient()
+{
+	release();
+}
+
+//=============================================================================
+// Connect to the server
+//=============================================================================
+void ReplicationClient::initialize(NetTransport* t, const ReplicationSchema* s, const NetAddress& address)
+{
+	release();
+	transport = t;
+	schema = s;
+	server = address;
+	newest = replicationNS::NONE;
+	started = false;
+	helloTimer = 0;
+	pendingTick = replicationNS::NONE;
+	pending.resize(replicationNS::MAX_FRAGMENTS * replicationNS::FRAGMENT_BYTES);
+}
+
+//=============================================================================
+// Close the transport
+//=============================================================================
+void ReplicationClient::release()
+{
+	delete transport;
+	transport = nullptr;
+	for (UINT i = 0; i < replicationNS::FRAMES; i++)
+		frames[i].tick = replicationNS::NONE;
+	entities.clear();
+	entityGenerations.clear();
+	entityMasks.clear();
+}
+
+//=============================================================================
+// Receive the datagrams of the server
+//=============================================================================
+void ReplicationClient::receive()
+{
+	uint8_t buffer[netTransportNS::MAX_DATAGRAM];
+	NetAddress from;
+	UINT bytes;
+	bool again = false;                     // a decoded tick arrived again, its ack was lost
+	while ((bytes = transport->receive(from, buffer, sizeof(buffer))) > 0)
+	{
+		if (from != server || buffer[0] != PACKET_SNAPSHOT || bytes < replicationNS::HEADER_BYTES)
+			continue;
+		SnapshotHeader h;
+		memcpy(&h, buffer, replicationNS::HEADER_BYTES);
+		if (h.fragments == 0 || h.fragment >= h.fragments)
+			continue;
+		// older than the newest decoded, or than the one being reassembled
+		if (newest != replicationNS::NONE && (int32_t)(h.tick - newest) <= 0)
+		{
+			again = true;
+			continue;
+		}
+		// a tick is sent again with another baseline when the client's expired
+		if (h.tick != pendingTick || h.baseline != pendingBaseline || h.fragments != pendingFragments)
+		{
+			if (pendingTick != replicationNS::NONE && (int32_t)(h.tick - pendingTick) < 0)
+				continue;
+			if (pendingTick != replicationNS::NONE)
+				++stats.dropped;            // a newer snapshot replaces an incomplete one
+			pendingTick = h.tick;
+			pendingBaseline = h.baseline;
+			pendingStepTime = h.stepTime;
+			pendingFragments = h.fragments;
+			pendingReceived = 0;
+			pendingSize = 0;
+			pendingHave.assign(h.fragments, false);
+		}
+		if (pendingHave[h.fragment])
+			continue;
+		UINT payload = bytes - replicationNS::HEADER_BYTES;
+		memcpy(&pending[h.fragment * replicationNS::FRAGMENT_BYTES], buffer + replicationNS::HEADER_BYTES, payload);
+		pendingHave[h.fragment] = true;
+		if (h.fragment == h.fragments - 1)
+			pendingSize = h.fragment * replicationNS::FRAGMENT_BYTES + payload;
+		stats.bytes += bytes;
+		++stats.datagrams;
+		if (++pendingReceived < pendingFragments)
+			continue;
+
+		uint32_t tick = pendingTick;
+		pendingTick = replicationNS::NONE;
+		if (!decode(&pending[0], pendingSize, tick, pendingBaseline, pendingStepTime))
+		{
+			++stats.dropped;
+			continue;
+		}
+		acknowledge(tick);
+		again = false;
+	}
+	if (again)
+		acknowledge(newest);
+}
+
+//=============================================================================
+// Tell the server tick was decoded
+//=============================================================================
+void ReplicationClient::acknowledge(uint32_t tick)
+{
+	uint8_t ack[5] = { PACKET_ACK };
+	memcpy(&ack[1], &tick, 4);
+	transport->send(server, ack, sizeof(ack));
+}
+
+//=============================================================================
+// Decode a complete snapshot on its baseline
+//=============================================================================
+bool ReplicationClient::decode(const uint8_t* data, size_t size, uint32_t tick, uint32_t baseline, float stepTime)
+{
+	double start = FramePacer::now();
+	const UINT fieldCount = schema->getFieldCount();
+	const UINT componentCount = schema->getComponentCount();
+	NetFrame& f = frames[tick % replicationNS::FRAMES];
+	if (baseline != replicationNS::NONE)
+	{
+		const NetFrame& base = frames[baseline % replicationNS::FRAMES];
+		if (base.tick != baseline)
+			return false;
+		if (&base != &f)
+		{
+			f.generations = base.generations;
+			f.masks = base.masks;
+			f.values = base.values;
+			f.entityCount = base.entityCount;
+		}
+	}
+	else
+	{
+		std::fill(f.generations.begin(), f.generations.end(), 0);
+		std::fill(f.masks.begin(), f.masks.end(), 0);
+		f.entityCount = 0;
+	}
+	f.tick = replicationNS::NONE;           // until it is complete
+
+	BitReader r(data, size);
+	uint32_t index = replicationNS::NONE;
+	while (r.readBit() && !r.isOverflow())
+	{
+		index += readSmall(r) + 1;
+		growFrame(f, index, fieldCount);
+		uint32_t* v = &f.values[(size_t)index * fieldCount];
+		bool isNew = r.readBit();
+		if (isNew)
+		{
+			if (f.generations[index] == 0)
+				++f.entityCount;
+			// a new entity at the index, the generation only tells it apart
+			f.generations[index] = f.generations[index] + 1 ? f.generations[index] + 1 : 1;
+			f.masks[index] = r.read(componentCount);
+			memset(v, 0, fieldCount * 4);
+		}
+		uint32_t mask = f.masks[index];
+		for (UINT c = 0; c < componentCount; c++)
+		{
+			if (!(mask & (1u << c)))
+				continue;
+			const NetComponent& nc = schema->getComponent(c);
+			for (UINT k = nc.firstField; k < nc.firstField + nc.fieldCount; k++)
+			{
+				UINT bits = schema->getField(k).bits;
+				v[k] = isNew ? r.read(bits) : readDelta(r, v[k], bits);
+			}
+		}
+	}
+	index = replicationNS::NONE;
+	while (r.readBit() && !r.isOverflow())
+	{
+		index += readSmall(r) + 1;
+		if (index < f.generations.size() && f.generations[index] != 0)
+		{
+			f.generations[index] = 0;
+			f.masks[index] = 0;
+			--f.entityCount;
+		}
+	}
+	if (r.isOverflow())
+		return false;
+	f.tick = tick;
+	f.stepTime = stepTime;
+	if (newest == replicationNS::NONE || (int32_t)(tick - newest) > 0)
+		newest = tick;
+	++stats.snapshots;
+	if (baseline == replicationNS::NONE)
+		++stats.fullSnapshots;
+	stats.entities += f.entityCount;
+	stats.time += FramePacer::now() - start;
+	return true;
+}
+
+//=============================================================================
+// Return the newest frame at or before tick
+//=============================================================================
+const NetFrame* ReplicationClient::frameAtOrBefore(uint32_t tick) const
+{
+	for (UINT k = 0; k < replicationNS::FRAMES; k++)
+	{
+		const NetFrame& f = frames[(tick - k) % replicationNS::FRAMES];
+		if (f.tick == tick - k)
+			return &f;
+	}
+	return nullptr;
+}
+
+//=============================================================================
+// Show the frames around renderTick in world
+//=============================================================================
+void ReplicationClient::apply(World& world)
+{
+	const UINT fieldCount = schema->getFieldCount();
+	const UINT componentCount = schema->getComponentCount();
+	uint32_t at = (uint32_t)std::floor(renderTick);
+	const NetFrame* a = frameAtOrBefore(at);
+	const NetFrame* b = nullptr;
+	for (uint32_t t = at + 1; (int32_t)(newest - t) >= 0 && b == nullptr; t++)
+		if (frames[t % replicationNS::FRAMES].tick == t)
+			b = &frames[t % replicationNS::FRAMES];
+	if (b == nullptr)
+	{
+		b = a;                          // hold the newest
+		a = nullptr;
+	}
+	if (b == nullptr)
+		return;
+	float alpha = a ? (float)((renderTick - a->tick) / (double)(b->tick - a->tick)) : 1;
+
+	size_t n = std::max(b->generations.size(), entities.size());
+	if (entities.size() < n)
+	{
+		entities.resize(n, NULL_ENTITY);
+		entityGenerations.resize(n, 0);
+		entityMasks.resize(n, 0);
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		bool inB = i < b->generations.size() && b->generations[i] != 0;
+		if (!inB)
+		{
+			if (entities[i] != NULL_ENTITY)
+			{
+				world.destroy(entities[i]);
+				entities[i] = NULL_ENTITY;
+			}
+			continue;
+		}
+		uint32_t mask = b->masks[i];
+		Entity e = entities[i];
+		if (e == NULL_ENTITY || !world.isAlive(e) || entityGenerations[i] != b->generations[i] ||
+			entityMasks[i] != mask)
+		{
+			// a new entity at the index, or its components changed
+			if (e != NULL_ENTITY)
+				world.destroy(e);
+			e = world.create();
+			for (UINT c = 0; c < componentCount; c++)
+				if (mask & (1u << c))
+					schema->getComponent(c).add(world, e);
+			entities[i] = e;
+			entityGenerations[i] = b->generations[i];
+			entityMasks[i] = mask;
+		}
+		bool lerp = a && i < a->generations.size() && a->generations[i] == b->generations[i] && a->masks[i] == mask;
+		const uint32_t* vb = &b->values[i * fieldCount];
+		const uint32_t* va = lerp ? &a->values[i * fieldCount] : vb;
+		for (UINT c = 0; c < componentCount; c++)
+		{
+			if (!(mask & (1u << c)))
+				continue;
+			const NetComponent& nc = schema->getComponent(c);
+			unsigned char* p = nc.get(world, e);
+			for (UINT k = nc.firstField; k < nc.firstField + nc.fieldCount; k++)
+			{
+				const NetField& f = schema->getField(k);
+				if (f.isFloat)
+				{
+					float x = dequantize(f, va[k]);
+					x += (dequantize(f, vb[k]) - x) * alpha;
+					memcpy(p + f.offset, &x, 4);
+				}
+				else
+					memcpy(p + f.offset, &vb[k], 4);
+			}
+		}
+	}
+}
+
+//=============================================================================
+// Receive and acknowledge the snapshots and show the entities in world
+//=============================================================================
+void ReplicationClient::update(World& world, float frameTime)
+{
+	if (transport == nullptr)
+		return;
+	// ask to connect every few frames until the first snapshot arrives
+	helloTimer -= frameTime;
+	if (newest == replicationNS::NONE && helloTimer <= 0)
+	{
+		uint8_t hello = PACKET_HELLO;
+		transport->send(server, &hello, 1);
+		helloTimer = replicationNS::HELLO_INTERVAL;
+	}
+	receive();
+	if (newest == replicationNS::NONE)
+		return;
+
+	// follow the newest snapshot delay seconds behind, in ticks
+	float stepTime = frames[newest % replicationNS::FRAMES].stepTime;
+	double target = newest - (stepTime > 0 ? delay / stepTime : 0);
+	renderTick += stepTime > 0 ? frameTime / stepTime : 1;
+	if (!started || std::fabs(renderTick - target) > replicationNS::FRAMES / 2)
+	{
+		renderTick = target;
+		started = true;
+	}
+	else
+		renderTick += (target - renderTick) * 0.1;      // drift towards the target slowly
+	if (renderTick > newest)
+		renderTick = newest;
+	if (renderTick < 0)
+		renderTick = 0;
+	double applied = FramePacer::now();
+	apply(world);
+	stats.applyTime += FramePacer::now() - applied;
+}
+
+//=============================================================================
+// Return a hash of the quantized state of tick
+//=============================================================================
+uint32_t ReplicationClient::getChecksum(uint32_t tick) const
+{
+	const NetFrame& f = frames[tick % replicationNS::FRAMES];
+	if (f.tick != tick || schema == nullptr)
+		return 0;
+	return frameHash(f, schema->getFieldCount());
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+NetStats ReplicationClient::getStats() const
+{
+	return stats;
+}
@@ -0,0 +1,325 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "constants.h"
+#include "gameError.h"
+#include "world.h"
+#include "bitStream.h"
+#include "netTransport.h"
+
+namespace replicationNS
+{
+	const UINT FRAMES = 32;                 // snapshots kept as baselines, a power of 2
+	const UINT MAX_COMPONENTS = 16;         // replicated component types
+	const UINT MAX_FIELDS = 64;             // replicated fields of all components
+	const UINT MAX_CLIENTS = 32;
+	const UINT HEADER_BYTES = 16;           // of every snapshot datagram
+	const UINT FRAGMENT_BYTES = netTransportNS::MAX_DATAGRAM - HEADER_BYTES;
+	const UINT MAX_FRAGMENTS = 255;         // datagrams of one snapshot
+	const float INTERPOLATION_DELAY = 0.1f; // seconds clients show behind the newest snapshot
+	const float HELLO_INTERVAL = 0.02f;     // seconds between connect requests of a client
+	const float CLIENT_TIMEOUT = 5.0f;      // seconds until a silent client is dropped
+	const uint32_t NONE = 0xFFFFFFFF;       // no tick
+}
+
+// A replicated field of a component.
+struct NetField
+{
+	UINT    offset;                         // in the component
+	UINT    bits;                           // bits sent, 1..32
+	bool    isFloat;                        // else a 4 byte integer
+	float   min;                            // floats are quantized to bits bits over min..max
+	float   scale;                          // quantization steps per unit
+};
+
+// A replicated component type.
+struct NetComponent
+{
+	UINT    firstField;                     // in the fields of the schema
+	UINT    fieldCount;
+	// Call visit(context, count, entities, components, component size) for
+	// every chunk of entities with the component.
+	void    (*eachChunk)(World& world, void* context,
+		void (*visit)(void* context, UINT count, const Entity* entities, const unsigned char* data, UINT size));
+	// Add the component to e, returns its memory.
+	unsigned char* (*add)(World& world, Entity e);
+	// Return the memory of the component of e.
+	unsigned char* (*get)(World& world, Entity e);
+};
+
+// The components and fields replicated, the same on the server and the clients.
+// Register the component types in the same order on both:
+//   schema.addComponent<Position>();
+//   schema.addFloat(offsetof(Position, x), 0, GAME_WIDTH, 16);
+class ReplicationSchema final
+{
+public:
+	// Constructor
+	ReplicationSchema() {}
+
+	// Replicate component type T, add its fields with addFloat() and addInt()
+	// after. Returns the index of T.
+	// Throws GameError if more than MAX_COMPONENTS are added
+	template<class T> UINT addComponent()
+	{
+		if (components.size() >= replicationNS::MAX_COMPONENTS)
+			throw(GameError(gameErrorNS::FATAL_ERROR, "Too many replicated components"));
+		NetComponent c;
+		c.firstField = (UINT)fields.size();
+		c.fieldCount = 0;
+		c.eachChunk = &eachChunkOf<T>;
+		c.add = &addTo<T>;
+		c.get = &getOf<T>;
+		components.push_back(c);
+		return (UINT)components.size() - 1;
+	}
+
+	// Add a float at offset of the last component, quantized to bits bits
+	// over min..max; values outside are clamped.
+	// Pre: bits = 1..24
+	// Throws GameError if more than MAX_FIELDS are added
+	void    addFloat(UINT offset, float min, float max, UINT bits);
+
+	// Add a 4 byte integer at offset of the last component, its low bits bits
+	// are sent.
+	// Throws GameError if more than MAX_FIELDS are added
+	void    addInt(UINT offset, UINT bits);
+
+	// Return number of components.
+	UINT    getComponentCount() const { return (UINT)components.size(); }
+
+	// Return component i.
+	const NetComponent& getComponent(UINT i) const { return components[i]; }
+
+	// Return number of fields of all components.
+	UINT    getFieldCount() const { return (UINT)fields.size(); }
+
+	// Return field i.
+	const NetField& getField(UINT i) const { return fields[i]; }
+
+private:
+	std::vector<NetComponent> components;
+	std::vector<NetField> fields;
+
+	// Add a field to the last component.
+	void    addField(const NetField& f);
+
+	template<class T> static void eachChunkOf(World& world, void* context,
+		void (*visit)(void*, UINT, const Entity*, const unsigned char*, UINT))
+	{
+		world.eachChunk<T>([=](UINT count, const Entity* e, T* data)
+		{
+			visit(context, count, e, (const unsigned char*)data, (UINT)sizeof(T));
+		});
+	}
+	template<class T> static unsigned char* addTo(World& world, Entity e)
+	{
+		return (unsigned char*)&world.add<T>(e);
+	}
+	template<class T> static unsigned char* getOf(World& world, Entity e)
+	{
+		return (unsigned char*)world.get<T>(e);
+	}
+};
+
+// Quantized state of the replicated entities at a tick.
+struct NetFrame
+{
+	uint32_t tick;                          // NONE if unused
+	float   stepTime;                       // seconds of the step of the tick
+	UINT    entityCount;
+	std::vector<uint32_t> generations;      // by entity index, 0 if not replicated
+	std::vector<uint32_t> masks;            // replicated components by entity index
+	std::vector<uint32_t> values;           // field count values by entity index
+
+	NetFrame() : tick(replicationNS::NONE), stepTime(0), entityCount(0) {}
+};
+
+// Replication statistics.
+struct NetStats
+{
+	UINT    clients;                        // connected to the server
+	UINT64  snapshots;                      // sent to all clients, or decoded
+	UINT64  fullSnapshots;                  // without a baseline
+	UINT64  bytes;                          // of the snapshot datagrams
+	UINT64  datagrams;
+	UINT64  entities;                       // sum of the entities of the snapshots
+	UINT64  encodedEntities;                // entities encoded by the server
+	double  captureTime;                    // seconds quantizing the world
+	double  time;                           // seconds encoding and sending, or receiving and decoding
+	double  applyTime;                      // seconds writing the client world
+	UINT64  dropped;                        // snapshots incomplete or without their baseline
+};
+
+// Server end of the replication.
+// Every tick() quantizes the replicated components of the world into a
+// frame and sends it to each client as a delta to the last frame the
+// client acknowledged: only entities that changed are written, each
+// changed field as a variable length difference. Clients without a
+// baseline get all entities of one kept tick, sent again every tick until
+// they acknowledge it, so a snapshot of many fragments arrives under loss.
+// Snapshots larger than a datagram are sent in fragments; clients that
+// share a baseline share the encoded snapshot.
+class ReplicationServer final
+{
+public:
+	// Constructor
+	ReplicationServer();
+
+	// Destructor
+	~ReplicationServer();
+
+	// Accept clients on transport and send them snapshots of the components
+	// of schema. The server owns transport.
+	void    initialize(NetTransport* transport, const ReplicationSchema* schema);
+
+	// Close the transport and forget the clients.
+	void    release();
+
+	// Return true between initialize() and release().
+	bool    isActive() const { return transport != nullptr; }
+
+	// Receive the connects and acks of the clients, then send them the
+	// snapshot of world after a step of stepTime seconds as the next tick.
+	void    tick(World& world, float stepTime);
+
+	// Return the tick of the newest snapshot, NONE if none was sent.
+	uint32_t getTick() const { return ticks - 1; }
+
+	// Return a hash of the quantized state of tick, 0 if it is not kept.
+	uint32_t getChecksum(uint32_t tick) const;
+
+	// Return statistics.
+	NetStats getStats() const;
+
+private:
+	// A connected client.
+	struct Client
+	{
+		NetAddress address;
+		uint32_t acked;                     // newest tick the client decoded, NONE for none
+		float   silence;                    // seconds since it was heard of
+	};
+
+	NetTransport* transport;
+	const ReplicationSchema* schema;
+	NetFrame frames[replicationNS::FRAMES]; // by tick
+	uint32_t ticks;                         // snapshots taken
+	std::vector<Client> clients;
+	BitWriter writer;
+	std::vector<uint32_t> removed;          // entity indices removed since the baseline
+	std::vector<std::pair<uint32_t, std::vector<uint8_t> > > encoded;  // snapshots of this tick by baseline
+	uint32_t fullTick;                      // tick of the full snapshot, NONE if none
+	std::vector<uint8_t> full;              // all entities of fullTick
+	std::vector<uint8_t> datagram;
+	NetStats stats;
+
+	// Receive the datagrams of the clients.
+	void    receive(float stepTime);
+	// Quantize the replicated components of world into f.
+	void    capture(World& world, NetFrame& f);
+	// Quantize a chunk of components into the frame being captured.
+	static void captureChunk(void* context, UINT count, const Entity* entities, const unsigned char* data, UINT size);
+	// Encode cur as delta to base, nullptr for all entities, into writer.
+	void    encode(const NetFrame& cur, const NetFrame* base);
+	// Send an encoded snapshot in fragments.
+	void    send(const NetAddress& to, const NetFrame& f, uint32_t baseline, const std::vector<uint8_t>& data);
+
+	// the frame and component captureChunk() fills
+	NetFrame* capturing;
+	UINT    capturingComponent;
+
+	ReplicationServer(const ReplicationServer&);    // no copies
+	ReplicationServer& operator=(const ReplicationServer&);
+};
+
+// Client end of the replication.
+// update() receives the snapshots, decodes them on their baseline frame,
+// acknowledges them, again when an older one arrives, and shows the replicated entities in a world,
+// interpolated between the two snapshots around a time INTERPOLATION_DELAY
+// behind the newest one. The entities are created, changed and destroyed
+// to follow the server.
+class ReplicationClient final
+{
+public:
+	// Constructor
+	ReplicationClient();
+
+	// Destructor
+	~ReplicationClient();
+
+	// Connect to the server at address over transport with the components
+	// of schema. The client owns transport.
+	void    initialize(NetTransport* transport, const ReplicationSchema* schema, const NetAddress& server);
+
+	// Close the transport, the entities stay in the world.
+	void    release();
+
+	// Return true between initialize() and release().
+	bool    isActive() const { return transport != nullptr; }
+
+	// Receive and acknowledge the snapshots and show the entities in world.
+	void    update(World& world, float frameTime);
+
+	// Set the seconds the client shows behind the newest snapshot, more
+	// hides more lost snapshots.
+	void    setInterpolationDelay(float sec) { delay = sec; }
+
+	// Return the newest tick decoded, NONE if none.
+	uint32_t getNewestTick() const { return newest; }
+
+	// Return a hash of the quantized state of tick, 0 if it is not kept.
+	uint32_t getChecksum(uint32_t tick) const;
+
+	// Return the entity showing server entity index, NULL_ENTITY if none.
+	Entity  getEntity(uint32_t index) const
+	{
+		return index < entities.size() ? entities[index] : NULL_ENTITY;
+	}
+
+	// Return statistics.
+	NetStats getStats() const;
+
+private:
+	NetTransport* transport;
+	const ReplicationSchema* schema;
+	NetAddress server;
+	NetFrame frames[replicationNS::FRAMES]; // by tick
+	uint32_t newest;                        // newest tick decoded
+	float   delay;                          // seconds behind newest
+	double  renderTick;                     // tick shown, with fraction
+	bool    started;                        // renderTick is set
+	float   helloTimer;                     // seconds until the next connect request
+
+	// snapshot being reassembled
+	uint32_t pendingTick;
+	uint32_t pendingBaseline;
+	float   pendingStepTime;
+	UINT    pendingFragments;
+	UINT    pendingReceived;
+	UINT    pendingSize;
+	std::vector<uint8_t> pending;
+	std::vector<bool> pendingHave;
+
+	std::vector<Entity> entities;           // local entity by server entity index
+	std::vector<uint32_t> entityGenerations;    // frame generation the local entity shows
+	std::vector<uint32_t> entityMasks;      // components of the local entity
+	NetStats stats;
+
+	// Receive the datagrams of the server.
+	void    receive();
+	// Tell the server tick was decoded.
+	void    acknowledge(uint32_t tick);
+	// Decode a complete snapshot, returns false without its baseline.
+	bool    decode(const uint8_t* data, size_t size, uint32_t tick, uint32_t baseline, float stepTime);
+	// Show the frames around renderTick in world.
+	void    apply(World& world);
+	// Return the newest frame at or before tick, nullptr if none.
+	const NetFrame* frameAtOrBefore(uint32_t tick) const;
+
+	ReplicationClient(const ReplicationClient&);    // no copies
+	ReplicationClient& operator=(const ReplicationClient&);
+};
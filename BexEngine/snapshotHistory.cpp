@@ -0,0 +1,311 @@
+#include "snapshotHistory.h"
+#include "framePacer.h"
+#include <cstring>
+
+namespace
+{
+	// Return word i of a state, the words after its end are 0.
+	inline uint64_t word(const unsigned char* state, size_t words, size_t i)
+	{
+		uint64_t w = 0;
+		if (i < words)
+			memcpy(&w, state + i * 8, 8);
+		return w;
+	}
+
+	// Encode cur as the runs of words that differ from prev, xor'ed with prev.
+	// Layout: size of cur in bytes, then per run the words skipped and the
+	// words that follow as 32 bit counts and the xor'ed words.
+	// Pre: the sizes of prev and cur are multiples of 8
+	void encodeDelta(const std::vector<unsigned char>& prev, const std::vector<unsigned char>& cur,
+		std::vector<unsigned char>& out)
+	{
+		const size_t n = cur.size() / 8, prevWords = prev.size() / 8;
+		const size_t common = n < prevWords ? n : prevWords;
+		const unsigned char* p = prev.empty() ? nullptr : &prev[0];
+		const unsigned char* c = cur.empty() ? nullptr : &cur[0];
+		// worst case: a run of one word after every skipped word
+		out.resize(8 + n * 8 + (n / 2 + 1) * 8);
+		unsigned char* o = &out[0];
+		uint64_t size = cur.size();
+		memcpy(o, &size, 8);
+		o += 8;
+		size_t i = 0;
+		while (i < n)
+		{
+			size_t start = i;
+			// unchanged cache lines are skipped with one compare
+			while (i + 8 <= common && memcmp(c + i * 8, p + i * 8, 64) == 0)
+				i += 8;
+			while (i < n && (word(c, n, i) ^ word(p, prevWords, i)) == 0)
+				i++;
+			if (i == n)
+				break;                          // the unchanged tail needs no run
+			unsigned char* counts = o;
+			o += 8;
+			size_t run = i;
+			// a run ends at two unchanged words, a single one is cheaper to keep
+			for (; i < n; i++, o += 8)
+			{
+				uint64_t x = word(c, n, i) ^ word(p, prevWords, i);
+				if (x == 0 && (i + 1 == n || (word(c, n, i + 1) ^ word(p, prevWords, i + 1)) == 0))
+					break;
+				memcpy(o, &x, 8);
+			}
+			uint32_t skipped[2] = { (uint32_t)(run - start), (uint32_t)(i - run) };
+			memcpy(counts, skipped, 8);
+		}
+		out.resize(o - &out[0]);
+	}
+
+	// Turn state from the previous state into the one a delta was encoded from.
+	void applyDelta(std::vector<unsigned char>& state, const std::vector<unsigned char>& delta)
+	{
+		const unsigned char* d = &delta[0];
+		const unsigned char* end = d + delta.size();
+		uint64_t size;
+		memcpy(&size, d, 8);
+		d += 8;
+		// the words after the end of the previous state were 0
+		state.resize((size_t)size, 0);
+		unsigned char* s = state.empty() ? nullptr : &state[0];
+		size_t i = 0;
+		while (d < end)
+		{
+			uint32_t counts[2];
+			memcpy(counts, d, 8);
+			d += 8;
+			i += counts[0];
+			for (uint32_t k = 0; k < counts[1]; k++, i++, d += 8)
+			{
+				uint64_t w, x;
+				memcpy(&w, s + i * 8, 8);
+				memcpy(&x, d, 8);
+				w ^= x;
+				memcpy(s + i * 8, &w, 8);
+			}
+		}
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+SnapshotHistory::SnapshotHistory()
+{
+	world = nullptr;
+	first = 0;
+	count = 0;
+	newest = 0;
+	saves = 0;
+	restores = 0;
+	saveTime = 0;
+	restoreTime = 0;
+}
+
+//=============================================================================
+// Keep the state of world and the blocks for steps steps
+//=============================================================================
+void SnapshotHistory::initialize(World* w, UINT steps)
+{
+	release();
+	world = w;
+	if (steps < snapshotNS::KEYFRAME_INTERVAL)
+		steps = snapshotNS::KEYFRAME_INTERVAL;
+	entries.resize(steps);
+}
+
+//=============================================================================
+// Add a block of game state
+// Throws GameError
+//=============================================================================
+void SnapshotHistory::addBlock(void* data, size_t bytes)
+{
+	if (blocks.size() >= snapshotNS::MAX_BLOCKS)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Too many snapshot blocks"));
+	Block b = { data, bytes };
+	blocks.push_back(b);
+	// the saved steps do not have the block
+	count = 0;
+}
+
+//=============================================================================
+// Add an object of game state
+// Throws GameError
+//=============================================================================
+void SnapshotHistory::addState(SnapshotState* state)
+{
+	if (states.size() >= snapshotNS::MAX_BLOCKS)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Too many snapshot states"));
+	states.push_back(state);
+	// the saved steps do not have the state
+	count = 0;
+}
+
+//=============================================================================
+// Free the history
+//=============================================================================
+void SnapshotHistory::release()
+{
+	world = nullptr;
+	blocks.clear();
+	states.clear();
+	entries.clear();
+	first = 0;
+	count = 0;
+	newest = 0;
+	last.clear();
+	current.clear();
+}
+
+//=============================================================================
+// Append the current state to out, padded to 8 bytes
+//=============================================================================
+void SnapshotHistory::capture(std::vector<unsigned char>& out) const
+{
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		const unsigned char* p = (const unsigned char*)blocks[i].data;
+		out.insert(out.end(), p, p + blocks[i].bytes);
+	}
+	for (size_t i = 0; i < states.size(); i++)
+		states[i]->saveState(out);
+	if (world)
+		world->save(out);
+	out.resize((out.size() + 7) & ~(size_t)7, 0);
+}
+
+//=============================================================================
+// Save the state after step
+//=============================================================================
+void SnapshotHistory::save(UINT64 step)
+{
+	if (world == nullptr)
+		return;
+	double start = FramePacer::now();
+	current.clear();
+	capture(current);
+
+	bool keyframe = count == 0 || step != newest + 1 || step % snapshotNS::KEYFRAME_INTERVAL == 0;
+	UINT slot;
+	if (count < entries.size())
+		slot = (first + count++) % (UINT)entries.size();
+	else
+	{
+		// the oldest step is dropped
+		slot = first;
+		first = (first + 1) % (UINT)entries.size();
+	}
+	Entry& e = entries[slot];
+	e.step = step;
+	e.keyframe = keyframe;
+	if (keyframe)
+		e.data.assign(current.begin(), current.end());
+	else
+		encodeDelta(last, current, e.data);
+	last.swap(current);
+	newest = step;
+	++saves;
+	saveTime = FramePacer::now() - start;
+}
+
+//=============================================================================
+// Return the entry of step, nullptr if not saved
+//=============================================================================
+const SnapshotHistory::Entry* SnapshotHistory::find(UINT64 step) const
+{
+	for (UINT k = count; k-- > 0;)
+	{
+		const Entry& e = entries[(first + k) % entries.size()];
+		if (e.step == step)
+			return &e;
+		if (e.step < step)
+			break;
+	}
+	return nullptr;
+}
+
+//=============================================================================
+// Return the age of the newest keyframe at or before the entry k entries
+// after the oldest, -1 if it was dropped
+//=============================================================================
+int SnapshotHistory::keyframeBefore(UINT k) const
+{
+	for (int j = (int)k; j >= 0; j--)
+		if (entries[(first + j) % entries.size()].keyframe)
+			return j;
+	return -1;
+}
+
+//=============================================================================
+// Return true if the state after step can be restored
+//=============================================================================
+bool SnapshotHistory::has(UINT64 step) const
+{
+	const Entry* e = find(step);
+	if (e == nullptr)
+		return false;
+	UINT k = (UINT)(((e - &entries[0]) + entries.size() - first) % entries.size());
+	return keyframeBefore(k) >= 0;
+}
+
+//=============================================================================
+// Restore the state after step
+// Throws GameError
+//=============================================================================
+void SnapshotHistory::restore(UINT64 step)
+{
+	double start = FramePacer::now();
+	const Entry* e = find(step);
+	if (e == nullptr || world == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Step is not in the snapshot history"));
+	UINT k = (UINT)(((e - &entries[0]) + entries.size() - first) % entries.size());
+	int j = keyframeBefore(k);
+	if (j < 0)
+		throw(GameError(gameErrorNS::WARNING, "Keyframe of the step was dropped from the snapshot history"));
+
+	// the keyframe, then the deltas up to step
+	const std::vector<unsigned char>& key = entries[(first + j) % entries.size()].data;
+	current.assign(key.begin(), key.end());
+	for (UINT m = (UINT)j + 1; m <= k; m++)
+		applyDelta(current, entries[(first + m) % entries.size()].data);
+
+	size_t at = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		memcpy(blocks[i].data, &current[at], blocks[i].bytes);
+		at += blocks[i].bytes;
+	}
+	for (size_t i = 0; i < states.size(); i++)
+		at += states[i]->restoreState(&current[at], current.size() - at);     // throws GameError
+	world->restore(&current[at], current.size() - at);      // throws GameError
+
+	// the newer steps will be simulated again
+	count = k + 1;
+	newest = step;
+	last.swap(current);
+	++restores;
+	restoreTime = FramePacer::now() - start;
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+SnapshotStats SnapshotHistory::getStats() const
+{
+	SnapshotStats s;
+	s.steps = 0;
+	s.storedBytes = 0;
+	for (UINT k = 0; k < count; k++)
+	{
+		s.storedBytes += entries[(first + k) % entries.size()].data.size();
+		if (keyframeBefore(k) >= 0)
+			++s.steps;
+	}
+	s.stateBytes = last.size();
+	s.saves = saves;
+	s.restores = restores;
+	s.saveTime = saveTime;
+	s.restoreTime = restoreTime;
+	return s;
+}
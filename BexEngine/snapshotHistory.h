@@ -0,0 +1,138 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <cstdint>
+#include <vector>
+#include "constants.h"
+#include "gameError.h"
+#include "world.h"
+
+namespace snapshotNS
+{
+	const UINT DEFAULT_STEPS = 64;          // simulation steps kept
+	const UINT KEYFRAME_INTERVAL = 8;       // a full snapshot every 8 steps, deltas between
+	const UINT MAX_BLOCKS = 64;             // state blocks and objects besides the world
+}
+
+// State of variable size kept with the world, see SnapshotHistory::addState().
+class SnapshotState
+{
+public:
+	virtual ~SnapshotState() {}
+
+	// Append the state to out. Equal states must give equal bytes.
+	virtual void   saveState(std::vector<unsigned char>& out) const = 0;
+
+	// Set the state from the bytes saveState() appended at data, bytes is
+	// at least their size. Returns the bytes read.
+	// Throws GameError if the data does not fit
+	virtual size_t restoreState(const unsigned char* data, size_t bytes) = 0;
+};
+
+// Snapshot statistics.
+struct SnapshotStats
+{
+	UINT    steps;                          // steps that can be restored
+	UINT64  stateBytes;                     // bytes of the newest state
+	UINT64  storedBytes;                    // bytes of all keyframes and deltas
+	UINT64  saves;
+	UINT64  restores;
+	double  saveTime;                       // seconds of the last save()
+	double  restoreTime;                    // seconds of the last restore()
+};
+
+// History of the simulation state of the last steps, for rollback, instant
+// replays and reproducing a crash.
+// The state is the World, saved as its chunk memory, blocks of memory the
+// game adds with addBlock(), e.g. its random seed, and objects added with
+// addState(), e.g. the particles; the memory is copied with memcpy. Every KEYFRAME_INTERVAL steps the full state is kept, the
+// steps between are deltas to the step before: runs of 64 bit words that
+// changed, xor'ed with the previous state, so unchanged entities cost
+// nothing. restore() applies the deltas from the keyframe before the step.
+class SnapshotHistory final
+{
+public:
+	// Constructor
+	SnapshotHistory();
+
+	// Keep the state of world and the blocks for steps steps.
+	// Pre: steps >= KEYFRAME_INTERVAL
+	void    initialize(World* world, UINT steps = snapshotNS::DEFAULT_STEPS);
+
+	// Add bytes bytes at data to the state. The block must stay at data
+	// until release().
+	// Throws GameError if more than MAX_BLOCKS blocks are added
+	void    addBlock(void* data, size_t bytes);
+
+	// Add state to the state, saved after the blocks. It must stay valid
+	// until release().
+	// Throws GameError if more than MAX_BLOCKS objects are added
+	void    addState(SnapshotState* state);
+
+	// Free the history and forget the world and the blocks.
+	void    release();
+
+	// Return true if initialize() was called.
+	bool    isEnabled() const { return world != nullptr; }
+
+	// Save the state after step. A step not following the newest saved one
+	// starts a new keyframe.
+	void    save(UINT64 step);
+
+	// Restore the state after step and drop the newer steps, the next save()
+	// is step + 1.
+	// Throws GameError if step is not in the history
+	void    restore(UINT64 step);
+
+	// Return true if the state after step can be restored.
+	bool    has(UINT64 step) const;
+
+	// Return the newest step saved.
+	UINT64  getNewestStep() const { return newest; }
+
+	// Append the current state, as save() would store it, to out.
+	// Equal states give equal bytes.
+	void    capture(std::vector<unsigned char>& out) const;
+
+	// Return statistics.
+	SnapshotStats getStats() const;
+
+private:
+	// A saved step.
+	struct Entry
+	{
+		UINT64  step;
+		bool    keyframe;                   // full state, else delta to step - 1
+		std::vector<unsigned char> data;
+	};
+
+	// A block of game state.
+	struct Block
+	{
+		void*   data;
+		size_t  bytes;
+	};
+
+	World*  world;
+	std::vector<Block> blocks;
+	std::vector<SnapshotState*> states;
+	std::vector<Entry> entries;             // ring of saved steps
+	UINT    first;                          // oldest entry
+	UINT    count;                          // entries used
+	UINT64  newest;                         // step of the newest entry
+	std::vector<unsigned char> last;        // state of the newest entry
+	std::vector<unsigned char> current;     // state being saved or restored
+	UINT64  saves;
+	UINT64  restores;
+	double  saveTime;
+	double  restoreTime;
+
+	// Return the entry of step, nullptr if not saved.
+	const Entry* find(UINT64 step) const;
+	// Return the age of the newest keyframe at or before the entry k entries
+	// after the oldest, -1 if it was dropped.
+	int     keyframeBefore(UINT k) const;
+
+	SnapshotHistory(const SnapshotHistory&);        // no copies
+	SnapshotHistory& operator=(const SnapshotHistory&);
+};
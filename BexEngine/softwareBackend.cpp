@@ -0,0 +1,691 @@
+#include "softwareBackend.h"
+#include "rasterKernels.h"
+#include "framePacer.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Write a 32 bit big endian value.
+	void putBE32(std::vector<unsigned char>& out, uint32_t v)
+	{
+		out.push_back((unsigned char)(v >> 24));
+		out.push_back((unsigned char)(v >> 16));
+		out.push_back((unsigned char)(v >> 8));
+		out.push_back((unsigned char)v);
+	}
+
+	// CRC-32 of the PNG chunks
+	uint32_t crc32(const unsigned char* data, size_t len)
+	{
+		static uint32_t table[256];
+		static bool tableReady = false;
+		if (!tableReady)
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			tableReady = true;
+		}
+		uint32_t c = 0xFFFFFFFFu;
+		for (size_t i = 0; i < len; i++)
+			c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+		return c ^ 0xFFFFFFFFu;
+	}
+
+	// Write a PNG chunk.
+	void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+	{
+		putBE32(out, (uint32_t)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		putBE32(out, crc32(&out[start], out.size() - start));
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+SoftwareBackend::SoftwareBackend(UINT threads)
+{
+	width = GAME_WIDTH;
+	height = GAME_HEIGHT;
+	tilesX = 0;
+	tilesY = 0;
+	threadCount = threads;
+	backColor = 0;
+	texture = nullptr;
+	blend = spriteBatchNS::BLEND_ALPHA;
+	generation = 0;
+	activeWorkers = 0;
+	quit = false;
+	nextTile = 0;
+	pixelCount = 0;
+	framePixels = 0;
+	frameTime = 0;
+	totalPixels = 0;
+	totalTime = 0;
+	frameCount = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+SoftwareBackend::~SoftwareBackend()
+{
+	releaseAll();
+}
+
+//=============================================================================
+// Create the framebuffer and start the worker threads
+// Throws GameError
+//=============================================================================
+void SoftwareBackend::initialize(HWND hw, int w, int h, bool full)
+{
+	if (w <= 0 || h <= 0)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Invalid software framebuffer size"));
+	width = w;
+	height = h;
+	tilesX = (width + softwareNS::TILE_SIZE - 1) / softwareNS::TILE_SIZE;
+	tilesY = (height + softwareNS::TILE_SIZE - 1) / softwareNS::TILE_SIZE;
+
+	try{
+		framebuffer.assign((size_t)width * height, 0);
+		ring.resize(spriteBatchNS::RING_VERTICES);
+		bins.resize((size_t)tilesX * tilesY);
+
+		UINT threads = threadCount;
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		// the thread calling endScene() renders too
+		quit = false;
+		for (UINT i = 1; i < threads; i++)
+			workers.push_back(std::thread(&SoftwareBackend::workerLoop, this));
+	}
+	catch (...)
+	{
+		stopWorkers();
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Error initializing software rasterizer"));
+	}
+}
+
+//=============================================================================
+// Stop the worker threads and release all memory
+//=============================================================================
+void SoftwareBackend::releaseAll()
+{
+	stopWorkers();
+	for (size_t i = 0; i < textures.size(); i++)
+		SAFE_DELETE(textures[i]);
+	textures.clear();
+	std::vector<uint32_t>().swap(framebuffer);
+	std::vector<SpriteVertex>().swap(ring);
+	std::vector<SpriteVertex>().swap(quadVertices);
+	prims.clear();
+	bins.clear();
+}
+
+//=============================================================================
+// Stop and join the worker threads
+//=============================================================================
+void SoftwareBackend::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+//=============================================================================
+// Begin a frame
+//=============================================================================
+HRESULT SoftwareBackend::beginScene(COLOR_ARGB c)
+{
+	if (framebuffer.empty())
+		return E_FAIL;
+	backColor = c;
+	prims.clear();
+	quadVertices.clear();
+	for (size_t i = 0; i < bins.size(); i++)
+		bins[i].clear();
+	return S_OK;
+}
+
+//=============================================================================
+// Render the frame into the framebuffer.
+// The calling thread renders tiles together with the workers.
+//=============================================================================
+HRESULT SoftwareBackend::endScene()
+{
+	if (framebuffer.empty())
+		return E_FAIL;
+
+	double start = FramePacer::now();
+	nextTile = 0;
+	pixelCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++generation;
+		activeWorkers = (UINT)workers.size();
+	}
+	wake.notify_all();
+
+	renderTiles();
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (activeWorkers > 0)
+			done.wait(lock);
+	}
+
+	frameTime = FramePacer::now() - start;
+	framePixels = pixelCount;
+	totalPixels += framePixels;
+	totalTime += frameTime;
+	return S_OK;
+}
+
+//=============================================================================
+// Count the presented frame
+//=============================================================================
+HRESULT SoftwareBackend::present()
+{
+	++frameCount;
+	return S_OK;
+}
+
+//=============================================================================
+// Worker thread main loop
+//=============================================================================
+void SoftwareBackend::workerLoop()
+{
+	UINT64 rendered = 0;                // last frame this worker rendered
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!quit && generation == rendered)
+				wake.wait(lock);
+			if (quit)
+			{
+				Profiler::releaseThread();
+				return;
+			}
+			rendered = generation;
+		}
+
+		renderTiles();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--activeWorkers == 0)
+				done.notify_one();
+		}
+	}
+}
+
+//=============================================================================
+// Render tiles until none are left
+//=============================================================================
+void SoftwareBackend::renderTiles()
+{
+	PROFILE_ZONE("renderTiles");
+	const int tileCount = tilesX * tilesY;
+	UINT64 pixels = 0;
+	for (int t = nextTile++; t < tileCount; t = nextTile++)
+		pixels += renderTile(t);
+	pixelCount += pixels;
+}
+
+//=============================================================================
+// Clear tile t and apply its primitives in submission order
+//=============================================================================
+UINT64 SoftwareBackend::renderTile(int t)
+{
+	int tx0 = (t % tilesX) * softwareNS::TILE_SIZE;
+	int ty0 = (t / tilesX) * softwareNS::TILE_SIZE;
+	int tx1 = std::min(tx0 + softwareNS::TILE_SIZE, width);
+	int ty1 = std::min(ty0 + softwareNS::TILE_SIZE, height);
+
+	for (int y = ty0; y < ty1; y++)
+		rasterKernels::fillSpan(&framebuffer[(size_t)y * width + tx0], tx1 - tx0, backColor);
+	UINT64 pixels = (UINT64)(tx1 - tx0) * (ty1 - ty0);
+
+	uint32_t span[softwareNS::TILE_SIZE];
+	const std::vector<uint32_t>& bin = bins[t];
+	for (size_t i = 0; i < bin.size(); i++)
+	{
+		const RasterPrim& p = prims[bin[i]];
+		if (p.type == PRIM_QUAD)
+			pixels += rasterQuad(p, tx0, ty0, tx1, ty1, span);
+		else
+			pixels += rasterLine(p, tx0, ty0, tx1, ty1);
+	}
+	return pixels;
+}
+
+//=============================================================================
+// Add a primitive to the tiles its bounding box touches
+//=============================================================================
+void SoftwareBackend::addPrim(RasterPrim& p)
+{
+	p.minX = std::max(p.minX, 0);
+	p.minY = std::max(p.minY, 0);
+	p.maxX = std::min(p.maxX, width - 1);
+	p.maxY = std::min(p.maxY, height - 1);
+	if (p.minX > p.maxX || p.minY > p.maxY)
+		return;                         // off screen
+
+	uint32_t index = (uint32_t)prims.size();
+	prims.push_back(p);
+	for (int ty = p.minY / softwareNS::TILE_SIZE; ty <= p.maxY / softwareNS::TILE_SIZE; ty++)
+		for (int tx = p.minX / softwareNS::TILE_SIZE; tx <= p.maxX / softwareNS::TILE_SIZE; tx++)
+			bins[ty * tilesX + tx].push_back(index);
+}
+
+//=============================================================================
+// Return a pointer into the vertex ring
+//=============================================================================
+SpriteVertex* SoftwareBackend::lockVertices(unsigned int offset, unsigned int count, bool discard)
+{
+	if (offset + count > ring.size())
+		return nullptr;
+	return &ring[offset];
+}
+
+//=============================================================================
+// Save the sprite state of the following draws
+//=============================================================================
+void SoftwareBackend::setSpriteState(void* t, int b)
+{
+	texture = (SoftwareTexture*)t;
+	blend = b;
+}
+
+//=============================================================================
+// Record quadCount quads starting at vertex baseVertex of the ring.
+// The vertices are copied, the ring may be overwritten before endScene().
+//=============================================================================
+void SoftwareBackend::drawQuads(unsigned int baseVertex, unsigned int quadCount)
+{
+	for (unsigned int q = 0; q < quadCount; q++)
+	{
+		const SpriteVertex* v = &ring[baseVertex + q * 4];
+		RasterPrim p;
+		p.type = PRIM_QUAD;
+		p.texture = texture;
+		p.blend = blend;
+		p.color = v[0].color;
+		p.firstVertex = (uint32_t)quadVertices.size();
+		p.x1 = p.y1 = p.x2 = p.y2 = 0;
+		float minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+		for (int i = 1; i < 4; i++)
+		{
+			minX = std::min(minX, v[i].x);
+			maxX = std::max(maxX, v[i].x);
+			minY = std::min(minY, v[i].y);
+			maxY = std::max(maxY, v[i].y);
+		}
+		// pixels whose centers may be covered
+		p.minX = (int)std::floor(minX - 0.5f);
+		p.minY = (int)std::floor(minY - 0.5f);
+		p.maxX = (int)std::ceil(maxX - 0.5f);
+		p.maxY = (int)std::ceil(maxY - 0.5f);
+		quadVertices.insert(quadVertices.end(), v, v + 4);
+		addPrim(p);
+	}
+}
+
+//=============================================================================
+// Record a line
+//=============================================================================
+void SoftwareBackend::drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color)
+{
+	RasterPrim p;
+	p.type = PRIM_LINE;
+	p.texture = nullptr;
+	p.blend = spriteBatchNS::BLEND_ALPHA;
+	p.color = color;
+	p.firstVertex = 0;
+	p.x1 = x1;
+	p.y1 = y1;
+	p.x2 = x2;
+	p.y2 = y2;
+	p.minX = (int)std::floor(std::min(x1, x2));
+	p.minY = (int)std::floor(std::min(y1, y2));
+	p.maxX = (int)std::floor(std::max(x1, x2));
+	p.maxY = (int)std::floor(std::max(y1, y2));
+	addPrim(p);
+}
+
+//=============================================================================
+// Rasterize quad p into the tile rectangle.
+// Sprite quads are parallelograms with vertices top left, top right,
+// bottom left, bottom right. Each row is filled between the outermost edge
+// crossings at the pixel center; texture coordinates are an affine function
+// of the pixel position evaluated per pixel, so the result does not depend
+// on the tile layout.
+//=============================================================================
+UINT64 SoftwareBackend::rasterQuad(const RasterPrim& p, int tx0, int ty0, int tx1, int ty1, uint32_t* span)
+{
+	const SpriteVertex* v = &quadVertices[p.firstVertex];
+	// outline in polygon order
+	const SpriteVertex* poly[4] = { &v[0], &v[1], &v[3], &v[2] };
+
+	// affine texture mapping from the top left, top right and bottom left corners
+	float dudx = 0, dudy = 0, dvdx = 0, dvdy = 0;
+	if (p.texture)
+	{
+		float e1x = v[1].x - v[0].x, e1y = v[1].y - v[0].y;
+		float e2x = v[2].x - v[0].x, e2y = v[2].y - v[0].y;
+		float det = e1x * e2y - e1y * e2x;
+		if (std::fabs(det) < 1e-6f)
+			return 0;                   // degenerate
+		float du1 = v[1].u - v[0].u, du2 = v[2].u - v[0].u;
+		float dv1 = v[1].v - v[0].v, dv2 = v[2].v - v[0].v;
+		dudx = (du1 * e2y - du2 * e1y) / det;
+		dudy = (du2 * e1x - du1 * e2x) / det;
+		dvdx = (dv1 * e2y - dv2 * e1y) / det;
+		dvdy = (dv2 * e1x - dv1 * e2x) / det;
+	}
+
+	int y0 = std::max(ty0, p.minY);
+	int y1 = std::min(ty1 - 1, p.maxY);
+	UINT64 pixels = 0;
+	for (int y = y0; y <= y1; y++)
+	{
+		float yc = y + 0.5f;
+		float xl = 1e30f, xr = -1e30f;
+		for (int e = 0; e < 4; e++)
+		{
+			const SpriteVertex* a = poly[e];
+			const SpriteVertex* b = poly[(e + 1) & 3];
+			if ((a->y <= yc && yc < b->y) || (b->y <= yc && yc < a->y))
+			{
+				float x = a->x + (yc - a->y) * (b->x - a->x) / (b->y - a->y);
+				xl = std::min(xl, x);
+				xr = std::max(xr, x);
+			}
+		}
+		if (xl > xr)
+			continue;
+
+		// pixels with centers in [xl, xr)
+		int xs = std::max(tx0, (int)std::ceil(xl - 0.5f));
+		int xe = std::min(tx1, (int)std::ceil(xr - 0.5f));
+		int n = xe - xs;
+		if (n <= 0)
+			continue;
+		uint32_t* dst = &framebuffer[(size_t)y * width + xs];
+		pixels += n;
+
+		if (p.texture == nullptr)
+		{
+			if (p.blend == spriteBatchNS::BLEND_OPAQUE)
+				rasterKernels::fillSpan(dst, n, p.color);
+			else if (p.blend == spriteBatchNS::BLEND_ADDITIVE)
+				rasterKernels::addSpanSolid(dst, n, p.color);
+			else
+				rasterKernels::blendSpanSolid(dst, n, p.color);
+			continue;
+		}
+
+		// gather texels, nearest sampling with clamping
+		const SoftwareTexture* tex = p.texture;
+		float ry = yc - v[0].y;
+		for (int i = 0; i < n; i++)
+		{
+			float rx = (xs + i + 0.5f) - v[0].x;
+			float u = v[0].u + dudx * rx + dudy * ry;
+			float vv = v[0].v + dvdx * rx + dvdy * ry;
+			int tu = (int)std::floor(u * tex->width);
+			int tv = (int)std::floor(vv * tex->height);
+			tu = std::min(std::max(tu, 0), tex->width - 1);
+			tv = std::min(std::max(tv, 0), tex->height - 1);
+			span[i] = tex->pixels[(size_t)tv * tex->width + tu];
+		}
+		rasterKernels::modulateSpan(span, n, p.color);
+		if (p.blend == spriteBatchNS::BLEND_OPAQUE)
+			memcpy(dst, span, n * sizeof(uint32_t));
+		else if (p.blend == spriteBatchNS::BLEND_ADDITIVE)
+			rasterKernels::addSpan(dst, span, n);
+		else
+			rasterKernels::blendSpan(dst, span, n);
+	}
+	return pixels;
+}
+
+//=============================================================================
+// Rasterize line p into the tile rectangle.
+// One pixel per step along the major axis, pixels outside the tile are skipped.
+//=============================================================================
+UINT64 SoftwareBackend::rasterLine(const RasterPrim& p, int tx0, int ty0, int tx1, int ty1)
+{
+	float dx = p.x2 - p.x1;
+	float dy = p.y2 - p.y1;
+	int steps = (int)std::ceil(std::max(std::fabs(dx), std::fabs(dy)));
+	float sx = steps > 0 ? dx / steps : 0;
+	float sy = steps > 0 ? dy / steps : 0;
+
+	// limit the steps to the part of the line near the tile
+	int first = 0, last = steps;
+	if (std::fabs(dx) >= std::fabs(dy) && sx != 0)
+	{
+		int a = (int)std::floor((tx0 - 1 - p.x1) / sx);
+		int b = (int)std::ceil((tx1 + 1 - p.x1) / sx);
+		first = std::max(first, std::min(a, b));
+		last = std::min(last, std::max(a, b));
+	}
+	else if (sy != 0)
+	{
+		int a = (int)std::floor((ty0 - 1 - p.y1) / sy);
+		int b = (int)std::ceil((ty1 + 1 - p.y1) / sy);
+		first = std::max(first, std::min(a, b));
+		last = std::min(last, std::max(a, b));
+	}
+
+	UINT64 pixels = 0;
+	for (int i = first; i <= last; i++)
+	{
+		int x = (int)std::floor(p.x1 + sx * i);
+		int y = (int)std::floor(p.y1 + sy * i);
+		if (x < tx0 || x >= tx1 || y < ty0 || y >= ty1)
+			continue;
+		rasterKernels::blendSpanSolid(&framebuffer[(size_t)y * width + x], 1, p.color);
+		++pixels;
+	}
+	return pixels;
+}
+
+//=============================================================================
+// Create a texture owned by the backend
+// Returns nullptr on failure
+//=============================================================================
+void* SoftwareBackend::createTexture(int w, int h, const uint32_t* pixels, int pool)
+{
+	if (w <= 0 || h <= 0 || pixels == nullptr)
+		return nullptr;
+	SoftwareTexture* t = nullptr;
+	try{
+		t = new SoftwareTexture;
+		t->width = w;
+		t->height = h;
+		t->pixels.assign(pixels, pixels + (size_t)w * h);
+		textures.push_back(t);
+	}
+	catch (...)
+	{
+		SAFE_DELETE(t);
+		return nullptr;
+	}
+	return t;
+}
+
+//=============================================================================
+// Copy pixels into a texture created by createTexture()
+//=============================================================================
+bool SoftwareBackend::updateTexture(void* t, const uint32_t* pixels)
+{
+	SoftwareTexture* texture = (SoftwareTexture*)t;
+	if (texture == nullptr || pixels == nullptr)
+		return false;
+	memcpy(&texture->pixels[0], pixels, texture->pixels.size() * sizeof(uint32_t));
+	return true;
+}
+
+//=============================================================================
+// Release a texture created by createTexture()
+//=============================================================================
+void SoftwareBackend::releaseTexture(void* t)
+{
+	std::vector<SoftwareTexture*>::iterator it = std::find(textures.begin(), textures.end(), t);
+	if (it == textures.end())
+		return;
+	delete *it;
+	textures.erase(it);
+}
+
+//=============================================================================
+// Write the framebuffer as binary PPM image
+//=============================================================================
+bool SoftwareBackend::savePPM(const std::string& filename) const
+{
+	if (framebuffer.empty())
+		return false;
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row((size_t)width * 3);
+	bool ok = true;
+	for (int y = 0; y < height && ok; y++)
+	{
+		const uint32_t* src = &framebuffer[(size_t)y * width];
+		for (int x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = (unsigned char)(src[x] >> 16);
+			row[x * 3 + 1] = (unsigned char)(src[x] >> 8);
+			row[x * 3 + 2] = (unsigned char)src[x];
+		}
+		ok = fwrite(&row[0], 1, row.size(), file) == row.size();
+	}
+	fclose(file);
+	return ok;
+}
+
+//=============================================================================
+// Read a binary PPM image with 255 levels into pixels as opaque ARGB.
+// Returns false on error.
+//=============================================================================
+bool SoftwareBackend::loadPPM(const std::string& filename, int& w, int& h, std::vector<uint32_t>& pixels)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+	int levels = 0;
+	// one whitespace character ends the header
+	bool ok = fscanf(file, "P6 %d %d %d", &w, &h, &levels) == 3 && levels == 255 &&
+		w > 0 && h > 0 && fgetc(file) != EOF;
+	if (ok)
+	{
+		std::vector<unsigned char> row((size_t)w * 3);
+		pixels.resize((size_t)w * h);
+		for (int y = 0; y < h && ok; y++)
+		{
+			ok = fread(&row[0], 1, row.size(), file) == row.size();
+			uint32_t* dst = &pixels[(size_t)y * w];
+			for (int x = 0; x < w && ok; x++)
+				dst[x] = 0xFF000000 | (uint32_t)row[x * 3] << 16 | (uint32_t)row[x * 3 + 1] << 8 | row[x * 3 + 2];
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+//=============================================================================
+// Write the framebuffer as PNG image.
+// The image data is stored in uncompressed deflate blocks, no compression
+// library is needed and the file is byte identical for identical frames.
+//=============================================================================
+bool SoftwareBackend::savePNG(const std::string& filename) const
+{
+	if (framebuffer.empty())
+		return false;
+
+	// raw scanlines, filter type 0, RGBA
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)height * (width * 4 + 1));
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		const uint32_t* src = &framebuffer[(size_t)y * width];
+		for (int x = 0; x < width; x++)
+		{
+			raw.push_back((unsigned char)(src[x] >> 16));
+			raw.push_back((unsigned char)(src[x] >> 8));
+			raw.push_back((unsigned char)src[x]);
+			raw.push_back((unsigned char)(src[x] >> 24));
+		}
+	}
+
+	// zlib stream with stored blocks
+	std::vector<unsigned char> z;
+	z.push_back(0x78);
+	z.push_back(0x01);
+	size_t pos = 0;
+	do
+	{
+		size_t len = std::min(raw.size() - pos, (size_t)65535);
+		bool final = (pos + len == raw.size());
+		z.push_back(final ? 1 : 0);
+		z.push_back((unsigned char)len);
+		z.push_back((unsigned char)(len >> 8));
+		z.push_back((unsigned char)~len);
+		z.push_back((unsigned char)(~len >> 8));
+		z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+		pos += len;
+	} while (pos < raw.size());
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i++)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBE32(z, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	putBE32(header, (uint32_t)width);
+	putBE32(header, (uint32_t)height);
+	header.push_back(8);                // bit depth
+	header.push_back(6);                // color type RGBA
+	header.push_back(0);                // compression
+	header.push_back(0);                // filter
+	header.push_back(0);                // interlace
+
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::vector<unsigned char> png(signature, signature + 8);
+	putChunk(png, "IHDR", header);
+	putChunk(png, "IDAT", z);
+	putChunk(png, "IEND", std::vector<unsigned char>());
+
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool ok = fwrite(&png[0], 1, png.size(), file) == png.size();
+	fclose(file);
+	return ok;
+}
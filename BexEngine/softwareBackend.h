@@ -0,0 +1,175 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "renderBackend.h"
+
+namespace softwareNS
+{
+	const int TILE_SIZE = 64;               // tile width and height in pixels
+}
+
+// Texture of the software backend, 32 bit ARGB pixels.
+struct SoftwareTexture
+{
+	int width;
+	int height;
+	std::vector<uint32_t> pixels;           // width * height pixels, rows top to bottom
+};
+
+// CPU rasterizer backend.
+// Sprites, rectangles and lines are recorded during the scene and rendered
+// into an in-memory ARGB framebuffer by endScene(). The screen is split into
+// tiles that are rendered in parallel by a pool of worker threads; each tile
+// applies the primitives in submission order, so the output is identical for
+// any number of threads. Spans are filled and blended with SIMD kernels.
+// Sprites are drawn with their top left vertex color and nearest sampling.
+class SoftwareBackend final : public RenderBackend
+{
+public:
+	// Constructor
+	// Pre: threads = number of rendering threads, 0 for one per cpu core
+	explicit SoftwareBackend(UINT threads = 0);
+
+	// Destructor
+	virtual ~SoftwareBackend();
+
+	// Create the framebuffer and start the worker threads, hw is ignored.
+	// Throws GameError
+	void    initialize(HWND hw, int width, int height, bool fullscreen) override;
+
+	// Stop the worker threads and release all memory.
+	void    releaseAll() override;
+
+	// Begin a frame that is cleared to backColor.
+	HRESULT beginScene(COLOR_ARGB backColor) override;
+
+	// Render the frame into the framebuffer.
+	HRESULT endScene() override;
+
+	// Count the presented frame.
+	HRESULT present() override;
+
+	// The software device is never lost.
+	HRESULT getDeviceState() override { return S_OK; }
+
+	// Nothing to reset.
+	HRESULT reset() override { return S_OK; }
+
+	// Record a line.
+	void    drawLine(float x1, float y1, float x2, float y2, COLOR_ARGB color) override;
+
+	// SpriteBatchBackend
+	SpriteVertex* lockVertices(unsigned int offset, unsigned int count, bool discard) override;
+	void unlockVertices() override {}
+	void setSpriteState(void* texture, int blend) override;
+	void drawQuads(unsigned int baseVertex, unsigned int quadCount) override;
+
+	// Create a texture owned by the backend, a SoftwareTexture.
+	// The pool is ignored, software textures are never lost.
+	void*   createTexture(int width, int height, const uint32_t* pixels, int pool) override;
+
+	// Copy the pixels into the texture.
+	bool    updateTexture(void* texture, const uint32_t* pixels) override;
+
+	// Release a texture created by createTexture().
+	void    releaseTexture(void* texture) override;
+
+	// Return the framebuffer, width * height ARGB pixels.
+	const uint32_t* getFramebuffer() const { return framebuffer.empty() ? nullptr : &framebuffer[0]; }
+
+	// Return framebuffer width in pixels.
+	int     getWidth() const  { return width; }
+
+	// Return framebuffer height in pixels.
+	int     getHeight() const { return height; }
+
+	// Write the framebuffer as binary PPM image. Returns false on error.
+	bool    savePPM(const std::string& filename) const;
+
+	// Write the framebuffer as PNG image. Returns false on error.
+	bool    savePNG(const std::string& filename) const;
+
+	// Read a binary PPM image with 255 levels, as written by savePPM(), into
+	// pixels as opaque ARGB. Returns false on error.
+	static bool loadPPM(const std::string& filename, int& width, int& height, std::vector<uint32_t>& pixels);
+
+	// Return number of rendering threads including the calling thread.
+	UINT    getThreadCount() const { return (UINT)workers.size() + 1; }
+
+	// Return number of pixels written in the last frame, including the clear.
+	UINT64  getFramePixels() const { return framePixels; }
+
+	// Return seconds spent rendering the last frame.
+	double  getFrameTime() const { return frameTime; }
+
+	// Return average pixels written per second of rendering time.
+	double  getPixelsPerSecond() const { return totalTime > 0 ? totalPixels / totalTime : 0; }
+
+private:
+	// recorded primitive
+	struct RasterPrim
+	{
+		int   type;                         // PRIM_QUAD or PRIM_LINE
+		SoftwareTexture* texture;           // quad texture, nullptr for solid
+		int   blend;                        // spriteBatchNS blend state
+		uint32_t color;                     // ARGB color
+		uint32_t firstVertex;               // quad: index of its four vertices
+		float x1, y1, x2, y2;               // line end points
+		int   minX, minY, maxX, maxY;       // bounding box in pixels, inclusive
+	};
+	enum { PRIM_QUAD, PRIM_LINE };
+
+	int   width;
+	int   height;
+	int   tilesX;                           // tiles per row
+	int   tilesY;                           // tiles per column
+	UINT  threadCount;                      // requested threads
+	COLOR_ARGB backColor;
+	std::vector<uint32_t> framebuffer;
+	std::vector<SpriteVertex> ring;         // vertex ring written by the sprite batch
+	std::vector<SpriteVertex> quadVertices; // vertices of the quads of this frame
+	std::vector<RasterPrim> prims;          // primitives of this frame in submission order
+	std::vector<std::vector<uint32_t> > bins;   // primitive indices per tile
+	std::vector<SoftwareTexture*> textures; // textures owned by the backend
+	SoftwareTexture* texture;               // current sprite state
+	int   blend;
+
+	// worker threads
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;           // signals a new frame to the workers
+	std::condition_variable done;           // signals the last worker finished
+	UINT64 generation;                      // frame number the workers render
+	UINT  activeWorkers;                    // workers still rendering the frame
+	bool  quit;                             // true to stop the workers
+	std::atomic<int> nextTile;              // next tile to render
+	std::atomic<UINT64> pixelCount;         // pixels written this frame
+
+	// statistics
+	UINT64 framePixels;
+	double frameTime;
+	UINT64 totalPixels;
+	double totalTime;
+	UINT64 frameCount;
+
+	// Stop and join the worker threads.
+	void stopWorkers();
+	// Worker thread main loop.
+	void workerLoop();
+	// Render tiles until none are left.
+	void renderTiles();
+	// Render tile t.
+	UINT64 renderTile(int t);
+	// Add a primitive to the tiles its bounding box touches.
+	void addPrim(RasterPrim& p);
+	// Rasterize quad p into the tile rectangle.
+	UINT64 rasterQuad(const RasterPrim& p, int tx0, int ty0, int tx1, int ty1, uint32_t* span);
+	// Rasterize line p into the tile rectangle.
+	UINT64 rasterLine(const RasterPrim& p, int tx0, int ty0, int tx1, int ty1);
+};
@@ -1,10 +1,17 @@
-#include "spaceWar.h"
+#include "spacewar.h"
+#include "mathKernels.h"
+#include <cmath>
+#include <cstddef>
 
 //=============================================================================
 // Constructor
 //=============================================================================
-Spacewar::Spacewar()
-{}
+Spacewar::Spacewar() : starHash(spacewarNS::STAR_CELL_SIZE)
+{
+	seed = 12345;
+	for (int i = 0; i < spacewarNS::STAR_IMAGES; i++)
+		starImages[i] = 0;
+}
 
 //=============================================================================
 // Destructor
@@ -21,15 +28,83 @@ Spacewar::~Spacewar()
 void Spacewar::initialize(HWND hwnd)
 {
 	Game::initialize(hwnd); // throws GameError
+	createStarImages();     // throws GameError
+	// the random sequence is rolled back with the world
+	snapshots.addBlock(&seed, sizeof(seed));
+	// the components a replication client shows
+	netSchema.addComponent<Position>();
+	netSchema.addFloat(offsetof(Position, x), 0, GAME_WIDTH, 16);
+	netSchema.addFloat(offsetof(Position, y), 0, GAME_HEIGHT, 16);
+	netSchema.addComponent<Velocity>();
+	netSchema.addFloat(offsetof(Velocity, x), -spacewarNS::STAR_MAX_SPEED, spacewarNS::STAR_MAX_SPEED, 12);
+	netSchema.addFloat(offsetof(Velocity, y), -spacewarNS::STAR_MAX_SPEED, spacewarNS::STAR_MAX_SPEED, 12);
+	netSchema.addComponent<Appearance>();
+	netSchema.addInt(offsetof(Appearance, image), 2);
+	netSchema.addInt(offsetof(Appearance, color), 32);
 
+	// the star boxes reach one cell past the right and bottom edge
+	starHash.reserve((UINT)(GAME_WIDTH / spacewarNS::STAR_CELL_SIZE + 1) *
+		(UINT)(GAME_HEIGHT / spacewarNS::STAR_CELL_SIZE + 1));
+	// background stars drift to the left, faster stars are brighter and bigger
+	for (int i = 0; i < spacewarNS::STAR_COUNT; i++)
+	{
+		float speed = spacewarNS::STAR_MIN_SPEED +
+			random() * (spacewarNS::STAR_MAX_SPEED - spacewarNS::STAR_MIN_SPEED);
+		int bright = starBrightness(speed);
+		Position p = { random() * GAME_WIDTH, random() * GAME_HEIGHT };
+		Velocity v = { -speed, 0 };
+		int image = (int)((speed - spacewarNS::STAR_MIN_SPEED) * spacewarNS::STAR_IMAGES /
+			(spacewarNS::STAR_MAX_SPEED - spacewarNS::STAR_MIN_SPEED));
+		if (image >= spacewarNS::STAR_IMAGES)
+			image = spacewarNS::STAR_IMAGES - 1;
+		Appearance a = { (UINT)image, SETCOLOR_ARGB(255, bright, bright, bright) };
+		Entity e = world.create(p, v, a);
+		// collisions() moves the box
+		AABB box = { p.x, p.y, p.x, p.y };
+		if (e.index >= starProxies.size())
+			starProxies.resize(e.index + 1, broadphaseNS::INVALID);
+		starProxies[e.index] = starHash.add(box, e.index);
+	}
 	return;
 }
 
+//=============================================================================
+// Add the round star images to the texture cache.
+// All of them share one atlas page, so the stars are drawn with one draw call.
+// Throws GameError
+//=============================================================================
+void Spacewar::createStarImages()
+{
+	uint32_t pixels[(spacewarNS::STAR_IMAGES + 1) * (spacewarNS::STAR_IMAGES + 1)];
+	for (int i = 0; i < spacewarNS::STAR_IMAGES; i++)
+	{
+		// white disc, alpha falls off towards the edge
+		int size = i + 2;
+		float r = size * 0.5f;
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+			{
+				float dx = x + 0.5f - r, dy = y + 0.5f - r;
+				float alpha = 1.0f - std::sqrt(dx * dx + dy * dy) / (r + 0.5f);
+				int a = alpha > 0 ? (int)(alpha * 255 + 0.5f) : 0;
+				pixels[y * size + x] = SETCOLOR_ARGB(a, 255, 255, 255);
+			}
+		starImages[i] = graphics.getTextures().add(size, size, pixels);
+	}
+}
+
 //=============================================================================
 // Update all game items
 //=============================================================================
 void Spacewar::update()
-{}
+{
+	const float t = frameTime;
+	world.eachChunkParallel<Position, Velocity>(jobs, [t](UINT count, const Entity*, Position* p, Velocity* v)
+	{
+		// x and y of all positions as one float array
+		mathKernels::integrate(&p[0].x, &v[0].x, (int)count * 2, t);
+	});
+}
 
 //=============================================================================
 // Artificial Intelligence
@@ -39,15 +114,94 @@ void Spacewar::ai()
 
 //=============================================================================
 // Handle collisions
+// Stars wrap around the screen edges. A star covered by a faster, nearer
+// star is dimmed while they overlap; the spatial hash finds the candidate
+// pairs and the narrowphase tests their discs.
 //=============================================================================
 void Spacewar::collisions()
-{}
+{
+	// stars wrap around the screen edges
+	world.eachChunk<Position>([](UINT count, const Entity*, Position* p)
+	{
+		for (UINT i = 0; i < count; i++)
+		{
+			if (p[i].x < 0)
+				p[i].x += GAME_WIDTH;
+			else if (p[i].x >= GAME_WIDTH)
+				p[i].x -= GAME_WIDTH;
+			if (p[i].y < 0)
+				p[i].y += GAME_HEIGHT;
+			else if (p[i].y >= GAME_HEIGHT)
+				p[i].y -= GAME_HEIGHT;
+		}
+	});
+
+	// star discs and whether a star in front covers them, by entity index
+	Circle* circles = frameArena.allocate<Circle>(starProxies.size());
+	uint8_t* covered = frameArena.allocate<uint8_t>(starProxies.size());
+	world.each<Position, Appearance>([this, circles](Entity e, Position& p, Appearance& a)
+	{
+		// the image of a star is a disc of a.image + 2 pixels
+		Circle& c = circles[e.index];
+		c.radius = (a.image + 2) * 0.5f;
+		c.x = p.x + c.radius;
+		c.y = p.y + c.radius;
+		AABB box = { p.x, p.y, p.x + c.radius * 2, p.y + c.radius * 2 };
+		starHash.update(starProxies[e.index], box);
+	});
+	starHash.findPairs(starPairs);
+	for (size_t i = 0; i < starPairs.size(); i++)
+	{
+		uint32_t a = starPairs[i].a, b = starPairs[i].b;
+		if (collision::circleCircle(circles[a], circles[b]))
+		{
+			// the bigger star is the faster, nearer one
+			covered[circles[a].radius < circles[b].radius ? a : b] = 1;
+		}
+	}
+	world.each<Velocity, Appearance>([covered](Entity e, Velocity& v, Appearance& a)
+	{
+		int bright = starBrightness(std::fabs(v.x));
+		if (covered[e.index])
+			bright /= 2;
+		a.color = SETCOLOR_ARGB(255, bright, bright, bright);
+	});
+}
 
 //=============================================================================
 // Render game items
 //=============================================================================
-void Spacewar::render()
-{}
+void Spacewar::render(float alpha)
+{
+	// With a fixed timestep alpha is the fraction of a tick left over, draw
+	// the stars back off from the last tick by the rest of it, between the
+	// last two ticks; stars move in straight lines, so no previous state is kept
+	const float back = (1.0f - alpha) * tickTime;
+	GraphicsSystem& g = graphics;
+	graphics.spriteBegin();
+	SpriteData stars[spacewarNS::STAR_IMAGES];
+	for (int i = 0; i < spacewarNS::STAR_IMAGES; i++)
+		graphics.getTextures().apply(starImages[i], stars[i]);
+	world.each<Position, Velocity, Appearance>([&g, &stars, back](Entity, Position& p, Velocity& v, Appearance& a)
+	{
+		SpriteData sd = stars[a.image];
+		sd.x = p.x - v.x * back;
+		sd.y = p.y - v.y * back;
+		sd.color = a.color;
+		g.drawSprite(sd);
+	});
+	graphics.spriteEnd();
+}
+
+//=============================================================================
+// Return a random number 0..1
+//=============================================================================
+float Spacewar::random()
+{
+	// linear congruential generator
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) / 16777216.0f;
+}
 
 //=============================================================================
 // The graphics device was lost.
@@ -2,6 +2,23 @@
 #define WIN32_LEAN_AND_MEAN
 
 #include "game.h"
+#include "broadphase.h"
+
+namespace spacewarNS
+{
+	const int   STAR_COUNT = 2000;          // stars in the background
+	const float STAR_MIN_SPEED = 10.0f;     // pixels per second
+	const float STAR_MAX_SPEED = 80.0f;
+	const int   STAR_IMAGES = 4;            // star sizes, 2 to 5 pixels
+	const float STAR_CELL_SIZE = 16.0f;     // broadphase cell size in pixels
+}
+
+// components of the game entities
+struct Position { float x, y; };
+struct Velocity { float x, y; };
+static_assert(sizeof(Position) == 2 * sizeof(float) && sizeof(Velocity) == sizeof(Position),
+	"update() integrates positions as packed floats");
+struct Appearance { UINT image; COLOR_ARGB color; };
 
 //=============================================================================
 // Create game class
@@ -21,9 +38,26 @@ public:
 	void update();      // must override pure virtual from Game
 	void ai();          // "
 	void collisions();  // "
-	void render();      // "
+	void render(float alpha);  // "
 	void releaseAll();
 	void resetAll();
 private:
 	// variables
+	UINT    seed;           // state of the random number generator
+	UINT    starImages[spacewarNS::STAR_IMAGES];   // texture cache ids
+	SpatialHash starHash;   // boxes of the stars for collisions()
+	std::vector<uint32_t> starProxies;  // starHash proxy by entity index
+	std::vector<CollisionPair> starPairs;   // overlapping star boxes of the step
+
+	// Return a random number 0..1 from a fixed seed, same sequence every run.
+	float   random();
+
+	// Return the brightness of a star moving at speed, faster stars are nearer.
+	static int starBrightness(float speed)
+	{
+		return (int)(96 + 159 * speed / spacewarNS::STAR_MAX_SPEED);
+	}
+
+	// Add the round star images to the texture cache.
+	void    createStarImages();
 };
\ No newline at end of file
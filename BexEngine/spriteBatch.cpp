@@ -0,0 +1,289 @@
+#include "spriteBatch.h"
+#include "vectorMath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+	// Orders sprites by blend state, then texture, then submission order.
+	struct SpriteStateLess
+	{
+		const SpriteData* sprites;
+		bool operator()(uint32_t a, uint32_t b) const
+		{
+			const SpriteData& sa = sprites[a];
+			const SpriteData& sb = sprites[b];
+			if (sa.blend != sb.blend)
+				return sa.blend < sb.blend;
+			if (sa.texture != sb.texture)
+				return std::less<void*>()(sa.texture, sb.texture);
+			return a < b;
+		}
+	};
+
+	// true if sprites a and b may be drawn with the same draw call
+	inline bool sameState(const SpriteData& a, const SpriteData& b)
+	{
+		return a.texture == b.texture && a.blend == b.blend;
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+SpriteBatch::SpriteBatch()
+{
+	sortMode = spriteBatchNS::SORT_TEXTURE;
+	begun = false;
+	// first lock discards the ring
+	ringQuad = spriteBatchNS::RING_QUADS;
+	resetFrameStats();
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+SpriteBatch::~SpriteBatch()
+{}
+
+//=============================================================================
+// Clear per frame statistics
+//=============================================================================
+void SpriteBatch::resetFrameStats()
+{
+	drawCalls = 0;
+	vertices = 0;
+	sprites = 0;
+	stateChanges = 0;
+}
+
+//=============================================================================
+// Begin queueing sprites
+//=============================================================================
+void SpriteBatch::begin(int mode)
+{
+	sortMode = mode;
+	queue.clear();
+	begun = true;
+}
+
+//=============================================================================
+// Queue a sprite
+//=============================================================================
+void SpriteBatch::draw(const SpriteData& sprite)
+{
+	if (begun)
+		queue.push_back(sprite);
+}
+
+//=============================================================================
+// Queue a solid color rectangle
+//=============================================================================
+void SpriteBatch::drawRect(float x, float y, float width, float height, uint32_t color, int blend)
+{
+	SpriteData sd;
+	sd.x = x;
+	sd.y = y;
+	sd.width = width;
+	sd.height = height;
+	sd.color = color;
+	sd.blend = blend;
+	draw(sd);
+}
+
+//=============================================================================
+// Sort and draw the queued sprites
+//=============================================================================
+void SpriteBatch::end(SpriteBatchBackend& backend)
+{
+	if (!begun)
+		return;
+	begun = false;
+	if (!queue.empty())
+		drawSprites(&queue[0], (uint32_t)queue.size(), sortMode, backend);
+	queue.clear();
+}
+
+//=============================================================================
+// Sort and draw count sprites of data.
+// All quads are written to the ring with as few locks as possible, one lock
+// per frame unless the ring wraps. Every run of sprites with equal state is
+// drawn with one draw call of at most MAX_BATCH_QUADS quads.
+//=============================================================================
+void SpriteBatch::drawSprites(const SpriteData* data, uint32_t count, int mode, SpriteBatchBackend& backend)
+{
+	if (count == 0)
+		return;
+
+	order.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+		order[i] = i;
+	if (mode == spriteBatchNS::SORT_TEXTURE)
+	{
+		SpriteStateLess less = { data };
+		std::sort(order.begin(), order.end(), less);
+	}
+
+	const float offset = backend.getPixelOffset();
+	const SpriteData* current = nullptr;    // sprite whose state is set
+	uint32_t i = 0;
+	while (i < count)
+	{
+		// wrap the ring when it is full
+		bool discard = false;
+		if (ringQuad >= spriteBatchNS::RING_QUADS)
+		{
+			ringQuad = 0;
+			discard = true;
+		}
+		uint32_t n = std::min(count - i, spriteBatchNS::RING_QUADS - ringQuad);
+
+		SpriteVertex* v = backend.lockVertices(ringQuad * 4, n * 4, discard);
+		if (v == nullptr)
+			break;
+		for (uint32_t k = 0; k < n; k++)
+			buildQuad(data[order[i + k]], v + k * 4, offset);
+		backend.unlockVertices();
+
+		// one draw call per run of equal state
+		uint32_t k = 0;
+		while (k < n)
+		{
+			const SpriteData& s = data[order[i + k]];
+			uint32_t runEnd = k + 1;
+			while (runEnd < n && runEnd - k < spriteBatchNS::MAX_BATCH_QUADS &&
+				sameState(s, data[order[i + runEnd]]))
+				++runEnd;
+
+			if (current == nullptr || !sameState(*current, s))
+			{
+				backend.setSpriteState(s.texture, s.blend);
+				++stateChanges;
+			}
+			current = &s;
+
+			backend.drawQuads((ringQuad + k) * 4, runEnd - k);
+			++drawCalls;
+			k = runEnd;
+		}
+
+		ringQuad += n;
+		i += n;
+	}
+	sprites += i;
+	vertices += i * 4;
+}
+
+//=============================================================================
+// Draw quadCount quads of prepared vertices.
+// The vertices are copied to the ring in pieces of at most MAX_BATCH_QUADS
+// quads, one draw call each.
+//=============================================================================
+void SpriteBatch::drawVertices(const SpriteVertex* data, uint32_t quadCount, void* texture, int blend,
+	SpriteBatchBackend& backend)
+{
+	if (quadCount == 0)
+		return;
+	backend.setSpriteState(texture, blend);
+	++stateChanges;
+
+	const float offset = backend.getPixelOffset();
+	uint32_t i = 0;
+	while (i < quadCount)
+	{
+		bool discard = false;
+		if (ringQuad >= spriteBatchNS::RING_QUADS)
+		{
+			ringQuad = 0;
+			discard = true;
+		}
+		uint32_t n = std::min(quadCount - i, spriteBatchNS::RING_QUADS - ringQuad);
+		n = std::min(n, spriteBatchNS::MAX_BATCH_QUADS);
+
+		SpriteVertex* v = backend.lockVertices(ringQuad * 4, n * 4, discard);
+		if (v == nullptr)
+			break;
+		const SpriteVertex* src = data + i * 4;
+		// locked memory may be write combined, write it once and never read it
+		if (offset == 0)
+			memcpy(v, src, n * 4 * sizeof(SpriteVertex));
+		else
+		{
+			for (uint32_t k = 0; k < n * 4; k++)
+			{
+				SpriteVertex sv = src[k];
+				sv.x += offset;
+				sv.y += offset;
+				v[k] = sv;
+			}
+		}
+		backend.unlockVertices();
+
+		backend.drawQuads(ringQuad * 4, n);
+		++drawCalls;
+		ringQuad += n;
+		i += n;
+	}
+	sprites += i;
+	vertices += i * 4;
+}
+
+//=============================================================================
+// Write the four vertices of sprite s to v.
+// Order is top left, top right, bottom left, bottom right.
+//=============================================================================
+void SpriteBatch::buildQuad(const SpriteData& s, SpriteVertex* v, float offset)
+{
+	// corners relative to the sprite center
+	float hw = s.width * s.scale * 0.5f;
+	float hh = s.height * s.scale * 0.5f;
+	float cx = s.x + hw + offset;
+	float cy = s.y + hh + offset;
+	float c = 1, sn = 0;
+	if (s.angle != 0)
+	{
+		c = std::cos(s.angle);
+		sn = std::sin(s.angle);
+	}
+
+#ifdef VECMATH_SSE2
+	// the four corners at once, x, y, z, rhw of a vertex with one store
+	__m128 dx = _mm_setr_ps(-hw, hw, -hw, hw);
+	__m128 dy = _mm_setr_ps(-hh, -hh, hh, hh);
+	__m128 x = _mm_add_ps(_mm_set1_ps(cx), _mm_sub_ps(_mm_mul_ps(dx, _mm_set1_ps(c)), _mm_mul_ps(dy, _mm_set1_ps(sn))));
+	__m128 y = _mm_add_ps(_mm_set1_ps(cy), _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(sn)), _mm_mul_ps(dy, _mm_set1_ps(c))));
+	const __m128 zw = _mm_setr_ps(0, 1, 0, 1);
+	__m128 lo = _mm_unpacklo_ps(x, y);
+	__m128 hi = _mm_unpackhi_ps(x, y);
+	_mm_storeu_ps(&v[0].x, _mm_movelh_ps(lo, zw));
+	_mm_storeu_ps(&v[1].x, _mm_movehl_ps(zw, lo));
+	_mm_storeu_ps(&v[2].x, _mm_movelh_ps(hi, zw));
+	_mm_storeu_ps(&v[3].x, _mm_movehl_ps(zw, hi));
+#else
+	float dx[4] = { -hw, hw, -hw, hw };
+	float dy[4] = { -hh, -hh, hh, hh };
+	for (int i = 0; i < 4; i++)
+	{
+		v[i].x = cx + (dx[i] * c - dy[i] * sn);
+		v[i].y = cy + (dx[i] * sn + dy[i] * c);
+		v[i].z = 0;
+		v[i].rhw = 1;
+	}
+#endif
+
+	float u0 = s.u0, u1 = s.u1, v0 = s.v0, v1 = s.v1;
+	if (s.flipHorizontal)
+		std::swap(u0, u1);
+	if (s.flipVertical)
+		std::swap(v0, v1);
+	float us[4] = { u0, u1, u0, u1 };
+	float vs[4] = { v0, v0, v1, v1 };
+	for (int i = 0; i < 4; i++)
+	{
+		v[i].color = s.color;
+		v[i].u = us[i];
+		v[i].v = vs[i];
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+namespace spriteBatchNS
+{
+	// blend states, sprites are grouped by blend state and texture
+	const int BLEND_ALPHA = 0;              // source alpha blending
+	const int BLEND_ADDITIVE = 1;           // source alpha added to destination
+	const int BLEND_OPAQUE = 2;             // no blending
+
+	// sort modes
+	const int SORT_TEXTURE = 0;             // group sprites by blend state and texture
+	const int SORT_NONE = 1;                // keep submission order, merge equal neighbours
+
+	const unsigned int MAX_BATCH_QUADS = 16384;     // quads per draw call, limited by 16 bit indices
+	const unsigned int RING_QUADS = 32768;          // quads in the ring vertex buffer
+	const unsigned int RING_VERTICES = RING_QUADS * 4;
+}
+
+// Vertex of a sprite quad in screen space.
+// Layout matches D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1.
+struct SpriteVertex
+{
+	float x, y, z, rhw;         // screen position
+	uint32_t color;             // ARGB color
+	float u, v;                 // texture coordinates
+};
+
+// Properties of one sprite.
+struct SpriteData
+{
+	float x, y;                 // screen location of top left corner
+	float width, height;        // size in pixels before scaling
+	float scale;                // < 1 smaller, > 1 bigger
+	float angle;                // rotation angle in radians around the center
+	float u0, v0, u1, v1;       // texture rectangle, 0..1
+	uint32_t color;             // ARGB tint, COLOR_ARGB
+	void* texture;              // backend texture, nullptr draws a solid rectangle
+	int  blend;                 // spriteBatchNS blend state
+	bool flipHorizontal;        // true to flip sprite horizontally (mirror)
+	bool flipVertical;          // true to flip sprite vertically
+
+	// Constructor, white untextured 1x1 sprite at 0,0
+	SpriteData() : x(0), y(0), width(1), height(1), scale(1), angle(0),
+		u0(0), v0(0), u1(1), v1(1), color(0xFFFFFFFF), texture(nullptr),
+		blend(spriteBatchNS::BLEND_ALPHA), flipHorizontal(false), flipVertical(false) {}
+};
+
+// Interface a rendering backend implements to draw sprite batches.
+// The backend owns a ring vertex buffer of spriteBatchNS::RING_VERTICES
+// vertices and a static index buffer with spriteBatchNS::MAX_BATCH_QUADS
+// quads, each quad indexed as the triangles 0,1,2 and 2,1,3.
+class SpriteBatchBackend
+{
+public:
+	// Destructor
+	virtual ~SpriteBatchBackend() {}
+
+	// Lock count vertices of the ring vertex buffer starting at offset.
+	// discard is true when the ring wrapped, the previous contents may be discarded.
+	// Return nullptr on failure.
+	virtual SpriteVertex* lockVertices(unsigned int offset, unsigned int count, bool discard) = 0;
+
+	// Unlock the ring vertex buffer.
+	virtual void unlockVertices() = 0;
+
+	// Set the texture and blend state used by the following drawQuads calls.
+	virtual void setSpriteState(void* texture, int blend) = 0;
+
+	// Draw quadCount quads starting at vertex baseVertex of the ring.
+	virtual void drawQuads(unsigned int baseVertex, unsigned int quadCount) = 0;
+
+	// Return offset added to vertex positions to map pixel centers.
+	virtual float getPixelOffset() const { return 0; }
+};
+
+// Batched sprite renderer.
+// Sprites are queued between begin() and end(). end() sorts them by blend
+// state and texture, writes all quads into the backend's ring vertex buffer
+// and draws every run of equal state with one draw call.
+class SpriteBatch final
+{
+public:
+	// Constructor
+	SpriteBatch();
+
+	// Destructor
+	~SpriteBatch();
+
+	// Begin queueing sprites.
+	// Pre: sortMode = spriteBatchNS::SORT_TEXTURE or SORT_NONE
+	void begin(int sortMode = spriteBatchNS::SORT_TEXTURE);
+
+	// Queue a sprite.
+	void draw(const SpriteData& sprite);
+
+	// Queue a solid color rectangle.
+	void drawRect(float x, float y, float width, float height, uint32_t color,
+		int blend = spriteBatchNS::BLEND_ALPHA);
+
+	// Sort and draw the queued sprites.
+	void end(SpriteBatchBackend& backend);
+
+	// Sort and draw count sprites of data recorded elsewhere, without queueing them.
+	// Pre: sortMode = spriteBatchNS::SORT_TEXTURE or SORT_NONE
+	void drawSprites(const SpriteData* data, uint32_t count, int sortMode, SpriteBatchBackend& backend);
+
+	// Draw quadCount quads of prepared vertices, four per quad in the order
+	// of buildQuad(), with one texture and blend state.
+	void drawVertices(const SpriteVertex* data, uint32_t quadCount, void* texture, int blend,
+		SpriteBatchBackend& backend);
+
+	// Drop the queued sprites without drawing them.
+	void cancel() { queue.clear(); begun = false; }
+
+	// Start writing at the beginning of the ring with a discard.
+	// Call when the backend vertex buffer has been recreated.
+	void resetRing() { ringQuad = spriteBatchNS::RING_QUADS; }
+
+	// Clear per frame statistics.
+	void resetFrameStats();
+
+	// Return number of draw calls in the current frame.
+	unsigned int getDrawCalls() const { return drawCalls; }
+
+	// Return number of vertices drawn in the current frame.
+	unsigned int getVertices() const { return vertices; }
+
+	// Return number of sprites drawn in the current frame.
+	unsigned int getSprites() const { return sprites; }
+
+	// Return number of state changes in the current frame.
+	unsigned int getStateChanges() const { return stateChanges; }
+
+private:
+	std::vector<SpriteData> queue;      // sprites queued since begin()
+	std::vector<uint32_t> order;        // draw order, indices into queue
+	int  sortMode;
+	bool begun;                         // true between begin() and end()
+	unsigned int ringQuad;              // next free quad in the ring
+	unsigned int drawCalls;             // per frame statistics
+	unsigned int vertices;
+	unsigned int sprites;
+	unsigned int stateChanges;
+
+	// Write the four vertices of sprite s to v.
+	static void buildQuad(const SpriteData& s, SpriteVertex* v, float offset);
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace spscQueueNS
+{
+	const size_t CACHE_LINE = 64;
+}
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// The producer owns tail and the consumer owns head; each publishes its
+// index with release and reads the other with acquire, so neither side
+// waits for the other. push() fails when the queue is full.
+// T must be copyable; capacity is rounded up to a power of 2.
+template<class T> class SpscQueue final
+{
+public:
+	// Constructor
+	explicit SpscQueue(size_t capacity = 1024) : head(0), tail(0)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		items.resize(size);
+		mask = size - 1;
+	}
+
+	// Add item at the back. Returns false if the queue is full.
+	// Producer thread only.
+	bool push(const T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask)
+			return false;
+		items[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Return the front item without removing it, nullptr if empty.
+	// Consumer thread only.
+	const T* front() const
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return nullptr;
+		return &items[h & mask];
+	}
+
+	// Remove the front item. Returns false if empty.
+	// Consumer thread only.
+	bool pop(T& item)
+	{
+		const T* f = front();
+		if (f == nullptr)
+			return false;
+		item = *f;
+		pop();
+		return true;
+	}
+
+	// Remove the front item, the queue must not be empty.
+	// Consumer thread only.
+	void pop()
+	{
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Return number of items, exact only on the producer or consumer thread.
+	size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	// Return true if the queue has no items.
+	bool empty() const { return size() == 0; }
+
+	// Return the most items the queue holds.
+	size_t capacity() const { return mask + 1; }
+
+private:
+	std::vector<T> items;
+	size_t mask;
+	// head and tail on their own cache lines, the two threads do not share a line
+	char pad0[spscQueueNS::CACHE_LINE];
+	std::atomic<size_t> head;               // next item to read, consumer
+	char pad1[spscQueueNS::CACHE_LINE];
+	std::atomic<size_t> tail;               // next item to write, producer
+	char pad2[spscQueueNS::CACHE_LINE];
+
+	SpscQueue(const SpscQueue&);            // no copies
+	SpscQueue& operator=(const SpscQueue&);
+};
@@ -0,0 +1,454 @@
+#include "telemetry.h"
+#include "graphics.h"
+#include "framePacer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const char* const phaseNames[telemetryNS::PHASE_COUNT + 1] =
+		{ "simulate", "render", "present", "other", "wait", "frame" };
+
+	// graph colors of the phases
+	const COLOR_ARGB phaseColors[telemetryNS::PHASE_COUNT] =
+	{
+		SETCOLOR_ARGB(255, 64, 192, 64),    // simulate
+		SETCOLOR_ARGB(255, 64, 128, 255),   // render
+		SETCOLOR_ARGB(255, 224, 192, 64),   // present
+		SETCOLOR_ARGB(255, 160, 160, 160),  // other
+		SETCOLOR_ARGB(255, 72, 72, 72),     // wait
+	};
+	const COLOR_ARGB BACK_COLOR = SETCOLOR_ARGB(160, 0, 0, 0);
+	const COLOR_ARGB BUDGET_COLOR = SETCOLOR_ARGB(255, 255, 255, 255);
+	const COLOR_ARGB HITCH_COLOR = SETCOLOR_ARGB(255, 255, 32, 32);
+	const COLOR_ARGB TEXT_COLOR = SETCOLOR_ARGB(255, 255, 255, 255);
+
+	// 3x5 pixel font, rows top to bottom
+	struct Glyph { char c; const char* rows; };
+	const Glyph glyphs[] =
+	{
+		{ '0', "###" "#.#" "#.#" "#.#" "###" },
+		{ '1', ".#." "##." ".#." ".#." "###" },
+		{ '2', "###" "..#" "###" "#.." "###" },
+		{ '3', "###" "..#" "###" "..#" "###" },
+		{ '4', "#.#" "#.#" "###" "..#" "..#" },
+		{ '5', "###" "#.." "###" "..#" "###" },
+		{ '6', "###" "#.." "###" "#.#" "###" },
+		{ '7', "###" "..#" "..#" "..#" "..#" },
+		{ '8', "###" "#.#" "###" "#.#" "###" },
+		{ '9', "###" "#.#" "###" "..#" "###" },
+		{ '.', "..." "..." "..." "..." ".#." },
+		{ 'p', "..." "##." "#.#" "##." "#.." },
+		{ 'm', "..." "###" "###" "#.#" "#.#" },
+		{ 'a', "..." ".##" "#.#" "#.#" ".##" },
+		{ 'x', "..." "#.#" ".#." ".#." "#.#" },
+		{ 'h', "#.." "#.." "##." "#.#" "#.#" },
+		{ 'i', ".#." "..." ".#." ".#." ".#." },
+		{ 't', ".#." "###" ".#." ".#." "..#" },
+		{ 'c', "..." ".##" "#.." "#.." ".##" },
+		{ 'e', "..." ".##" "###" "#.." ".##" },
+		{ 's', "..." ".##" "#.." ".#." "##." },
+	};
+
+	// Draw text with the 3x5 font, characters without a glyph are blanks.
+	void drawText(GraphicsSystem& graphics, float x, float y, const char* text, COLOR_ARGB color)
+	{
+		const float s = telemetryNS::GLYPH_SCALE;
+		for (; *text; text++, x += 4 * s)
+		{
+			const Glyph* g = nullptr;
+			for (size_t i = 0; i < sizeof(glyphs) / sizeof(glyphs[0]); i++)
+				if (glyphs[i].c == *text)
+					g = &glyphs[i];
+			if (g == nullptr)
+				continue;
+			for (int p = 0; p < 15; p++)
+				if (g->rows[p] == '#')
+					graphics.drawRect(x + (p % 3) * s, y + (p / 3) * s, s, s, color);
+		}
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+TimeHistogram::TimeHistogram()
+{
+	clear();
+}
+
+//=============================================================================
+// Return the bucket of a time of us micro-seconds
+//=============================================================================
+UINT TimeHistogram::bucketOf(UINT64 us)
+{
+	if (us < telemetryNS::LINEAR_LIMIT)
+		return (UINT)us;
+	const UINT64 limit = ((UINT64)1 << telemetryNS::MAX_EXPONENT) - 1;
+	if (us > limit)
+		us = limit;
+	UINT e = 6;                         // highest bit, LINEAR_LIMIT = 2^6
+	while (us >> (e + 1))
+		e++;
+	UINT sub = (UINT)(us >> (e - telemetryNS::SUB_BUCKET_BITS)) - telemetryNS::SUB_BUCKETS;
+	return telemetryNS::LINEAR_LIMIT + (e - 6) * telemetryNS::SUB_BUCKETS + sub;
+}
+
+//=============================================================================
+// Return the smallest time of bucket i
+//=============================================================================
+UINT64 TimeHistogram::bucketLow(UINT i)
+{
+	if (i < telemetryNS::LINEAR_LIMIT)
+		return i;
+	UINT j = i - telemetryNS::LINEAR_LIMIT;
+	UINT e = 6 + j / telemetryNS::SUB_BUCKETS;
+	UINT64 sub = j % telemetryNS::SUB_BUCKETS;
+	return (telemetryNS::SUB_BUCKETS + sub) << (e - telemetryNS::SUB_BUCKET_BITS);
+}
+
+//=============================================================================
+// Return the largest time of bucket i
+//=============================================================================
+UINT64 TimeHistogram::bucketHigh(UINT i)
+{
+	if (i < telemetryNS::LINEAR_LIMIT)
+		return i;
+	UINT e = 6 + (i - telemetryNS::LINEAR_LIMIT) / telemetryNS::SUB_BUCKETS;
+	return bucketLow(i) + ((UINT64)1 << (e - telemetryNS::SUB_BUCKET_BITS)) - 1;
+}
+
+//=============================================================================
+// Add a time
+//=============================================================================
+void TimeHistogram::add(UINT64 us)
+{
+	++buckets[bucketOf(us)];
+	++count;
+	sum += us;
+	if (us < minimum)
+		minimum = us;
+	if (us > maximum)
+		maximum = us;
+}
+
+//=============================================================================
+// Return the time p percent of the added times are within
+//=============================================================================
+UINT64 TimeHistogram::getPercentile(double p) const
+{
+	if (count == 0)
+		return 0;
+	UINT64 target = (UINT64)ceil(p / 100 * count);
+	if (target < 1)
+		target = 1;
+	UINT64 seen = 0;
+	for (UINT i = 0; i < telemetryNS::HISTOGRAM_BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if (seen >= target)
+			return std::max(std::min(bucketHigh(i), maximum), minimum);
+	}
+	return maximum;
+}
+
+//=============================================================================
+// Remove all times
+//=============================================================================
+void TimeHistogram::clear()
+{
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+	sum = 0;
+	minimum = ~(UINT64)0;
+	maximum = 0;
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+Telemetry::Telemetry()
+{
+	ring.resize(telemetryNS::RING_FRAMES);
+	hitches.reserve(telemetryNS::MAX_HITCHES);
+	budget = telemetryNS::DEFAULT_BUDGET;
+	reset();
+}
+
+//=============================================================================
+// End the previous frame and start timing the next one
+//=============================================================================
+void Telemetry::beginFrame()
+{
+	double now = FramePacer::now();
+	if (frameStart > 0)
+	{
+		double frameTime = now - frameStart;
+		double marked = 0;
+		for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+			if (i != telemetryNS::PHASE_WAIT)
+				marked += phaseTime[i];
+		phaseTime[telemetryNS::PHASE_WAIT] = std::max(frameTime - marked, 0.0);
+
+		FrameSample& s = ring[ringIndex];
+		s.frame = frames;
+		s.ms = (float)(frameTime * 1000);
+		int longest = 0;
+		for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+		{
+			s.phaseMs[i] = (float)(phaseTime[i] * 1000);
+			histograms[i].add((UINT64)(phaseTime[i] * 1e6 + 0.5));
+			if (phaseTime[i] > phaseTime[longest])
+				longest = i;
+		}
+		histograms[telemetryNS::FRAME].add((UINT64)(frameTime * 1e6 + 0.5));
+		ringIndex = (ringIndex + 1) % telemetryNS::RING_FRAMES;
+		if (samples < telemetryNS::RING_FRAMES)
+			++samples;
+
+		if (frameTime > budget)
+		{
+			Hitch h = { frames, s.ms, longest };
+			if (hitches.size() < telemetryNS::MAX_HITCHES)
+				hitches.push_back(h);
+			else
+				hitches[hitchIndex] = h;
+			hitchIndex = (hitchIndex + 1) % telemetryNS::MAX_HITCHES;
+			++hitchCount;
+		}
+		++frames;
+	}
+	for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+		phaseTime[i] = 0;
+	frameStart = now;
+	lastMark = now;
+}
+
+//=============================================================================
+// Add the time since the previous mark to phase
+//=============================================================================
+void Telemetry::mark(int phase)
+{
+	double now = FramePacer::now();
+	if (frameStart > 0)
+		phaseTime[phase] += now - lastMark;
+	lastMark = now;
+}
+
+//=============================================================================
+// Return kept sample i, 0 is the oldest
+//=============================================================================
+const FrameSample& Telemetry::getSample(UINT i) const
+{
+	UINT first = (ringIndex + telemetryNS::RING_FRAMES - samples) % telemetryNS::RING_FRAMES;
+	return ring[(first + i) % telemetryNS::RING_FRAMES];
+}
+
+//=============================================================================
+// Return kept hitch i, 0 is the oldest
+//=============================================================================
+const Hitch& Telemetry::getHitch(UINT i) const
+{
+	UINT first = hitches.size() < telemetryNS::MAX_HITCHES ? 0 : hitchIndex;
+	return hitches[(first + i) % hitches.size()];
+}
+
+//=============================================================================
+// Return the time p percent of the frames or a phase are within
+//=============================================================================
+double Telemetry::getPercentile(double p, int phase) const
+{
+	return histograms[phase].getPercentile(p) / 1e6;
+}
+
+//=============================================================================
+// Add the time statistics of histogram h to s
+//=============================================================================
+void Telemetry::fillStats(const TimeHistogram& h, TimeStats& s)
+{
+	s.avgMs = h.getMean() / 1000;
+	s.minMs = h.getMin() / 1000.0;
+	s.p50Ms = h.getPercentile(50) / 1000.0;
+	s.p90Ms = h.getPercentile(90) / 1000.0;
+	s.p95Ms = h.getPercentile(95) / 1000.0;
+	s.p99Ms = h.getPercentile(99) / 1000.0;
+	s.p999Ms = h.getPercentile(99.9) / 1000.0;
+	s.maxMs = h.getMax() / 1000.0;
+}
+
+//=============================================================================
+// Return the frame time statistics
+//=============================================================================
+TelemetryStats Telemetry::getStats() const
+{
+	TelemetryStats s;
+	s.frames = frames;
+	s.hitches = hitchCount;
+	s.budgetMs = budget * 1000;
+	fillStats(histograms[telemetryNS::FRAME], s.frame);
+	for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+		fillStats(histograms[i], s.phases[i]);
+	return s;
+}
+
+//=============================================================================
+// Write the kept samples as CSV
+//=============================================================================
+bool Telemetry::saveCSV(const char* filename) const
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "frame,ms");
+	for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+		fprintf(file, ",%s", phaseNames[i]);
+	fprintf(file, "\n");
+	for (UINT f = 0; f < samples; f++)
+	{
+		const FrameSample& s = getSample(f);
+		fprintf(file, "%llu,%.3f", (unsigned long long)s.frame, s.ms);
+		for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+			fprintf(file, ",%.3f", s.phaseMs[i]);
+		fprintf(file, "\n");
+	}
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+//=============================================================================
+// Write the statistics, the hitches and the frame time histogram as JSON
+//=============================================================================
+bool Telemetry::saveJSON(const char* filename) const
+{
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr)
+		return false;
+	TelemetryStats st = getStats();
+	fprintf(file, "{\"frames\":%llu,\"hitches\":%llu,\"budgetMs\":%.3f,\n",
+		(unsigned long long)st.frames, (unsigned long long)st.hitches, st.budgetMs);
+	// the whole frame first, then the phases
+	for (int i = -1; i < telemetryNS::PHASE_COUNT; i++)
+	{
+		const TimeStats& t = i < 0 ? st.frame : st.phases[i];
+		const char* name = phaseNames[i < 0 ? telemetryNS::FRAME : i];
+		fprintf(file, "\"%s\":{\"avg\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,"
+			"\"p95\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f},\n", name,
+			t.avgMs, t.minMs, t.p50Ms, t.p90Ms, t.p95Ms, t.p99Ms, t.p999Ms, t.maxMs);
+	}
+	fprintf(file, "\"hitchFrames\":[");
+	for (UINT i = 0; i < getHitchCount(); i++)
+	{
+		const Hitch& h = getHitch(i);
+		fprintf(file, "%s{\"frame\":%llu,\"ms\":%.3f,\"phase\":\"%s\"}", i == 0 ? "" : ",",
+			(unsigned long long)h.frame, h.ms, phaseNames[h.phase]);
+	}
+	// non-empty buckets of the frame times as [low us, high us, count]
+	fprintf(file, "],\n\"histogram\":[");
+	const TimeHistogram& h = histograms[telemetryNS::FRAME];
+	bool first = true;
+	for (UINT i = 0; i < telemetryNS::HISTOGRAM_BUCKETS; i++)
+	{
+		if (h.getBucket(i) == 0)
+			continue;
+		fprintf(file, "%s[%llu,%llu,%u]", first ? "" : ",", (unsigned long long)TimeHistogram::bucketLow(i),
+			(unsigned long long)TimeHistogram::bucketHigh(i), h.getBucket(i));
+		first = false;
+	}
+	fprintf(file, "]}\n");
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+//=============================================================================
+// Write the statistics as a text table
+//=============================================================================
+void Telemetry::printStats(FILE* file) const
+{
+	TelemetryStats st = getStats();
+	fprintf(file, "%-12s %9s %9s %9s %9s %9s %9s\n", "phase (ms)", "avg", "p50", "p95", "p99", "p99.9", "max");
+	// the whole frame first, then the phases
+	for (int i = -1; i < telemetryNS::PHASE_COUNT; i++)
+	{
+		const TimeStats& t = i < 0 ? st.frame : st.phases[i];
+		const char* name = phaseNames[i < 0 ? telemetryNS::FRAME : i];
+		fprintf(file, "%-12s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+			t.avgMs, t.p50Ms, t.p95Ms, t.p99Ms, t.p999Ms, t.maxMs);
+	}
+	fprintf(file, "hitches: %llu of %llu frames over %.3f ms\n",
+		(unsigned long long)st.hitches, (unsigned long long)st.frames, st.budgetMs);
+}
+
+//=============================================================================
+// Draw the frame time graph and the percentiles
+//=============================================================================
+void Telemetry::drawOverlay(GraphicsSystem& graphics) const
+{
+	const float x0 = telemetryNS::OVERLAY_X;
+	const float y0 = telemetryNS::OVERLAY_Y;
+	const float w = (float)telemetryNS::OVERLAY_FRAMES;
+	const float h = telemetryNS::OVERLAY_HEIGHT;
+	const float lineHeight = 7 * telemetryNS::GLYPH_SCALE;
+	const float bottom = y0 + h;
+	// the graph shows up to two budgets
+	const float pixelsPerMs = (float)(h / (2 * budget * 1000));
+
+	graphics.spriteBegin(spriteBatchNS::SORT_NONE);
+	// room for the graph and 36 characters of text
+	const float backWidth = std::max(w, 36 * 4 * telemetryNS::GLYPH_SCALE);
+	graphics.drawRect(x0 - 2, y0 - 2, backWidth + 4, h + 2 * lineHeight + 6, BACK_COLOR);
+
+	// newest frame on the right, phases stacked from the bottom
+	UINT n = std::min(samples, telemetryNS::OVERLAY_FRAMES);
+	for (UINT f = 0; f < n; f++)
+	{
+		const FrameSample& s = getSample(samples - n + f);
+		float x = x0 + w - n + f;
+		float y = bottom;
+		for (int i = 0; i < telemetryNS::PHASE_COUNT && y > y0; i++)
+		{
+			float ph = std::min(s.phaseMs[i] * pixelsPerMs, y - y0);
+			graphics.drawRect(x, y - ph, 1, ph, phaseColors[i]);
+			y -= ph;
+		}
+		if (s.ms > budget * 1000)
+			graphics.drawRect(x, y0, 1, 3, HITCH_COLOR);
+	}
+	graphics.drawRect(x0, bottom - h / 2, w, 1, BUDGET_COLOR);
+
+	char text[64];
+	const TimeHistogram& fh = histograms[telemetryNS::FRAME];
+	sprintf(text, "p50 %.1f p95 %.1f p99 %.1f max %.1f", fh.getPercentile(50) / 1000.0,
+		fh.getPercentile(95) / 1000.0, fh.getPercentile(99) / 1000.0, fh.getMax() / 1000.0);
+	drawText(graphics, x0, bottom + 4, text, TEXT_COLOR);
+	sprintf(text, "hitches %llu", (unsigned long long)hitchCount);
+	drawText(graphics, x0, bottom + 4 + lineHeight, text, hitchCount > 0 ? HITCH_COLOR : TEXT_COLOR);
+	graphics.spriteEnd();
+}
+
+//=============================================================================
+// Remove all samples, hitches and histograms
+//=============================================================================
+void Telemetry::reset()
+{
+	for (int i = 0; i <= telemetryNS::PHASE_COUNT; i++)
+		histograms[i].clear();
+	ringIndex = 0;
+	samples = 0;
+	hitches.clear();
+	hitchIndex = 0;
+	hitchCount = 0;
+	frames = 0;
+	frameStart = 0;
+	lastMark = 0;
+	for (int i = 0; i < telemetryNS::PHASE_COUNT; i++)
+		phaseTime[i] = 0;
+}
+
+//=============================================================================
+// Return the name of a phase
+//=============================================================================
+const char* Telemetry::getPhaseName(int phase)
+{
+	return phaseNames[phase];
+}
@@ -0,0 +1,216 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <stdio.h>
+#include <vector>
+#include "constants.h"
+
+class GraphicsSystem;
+
+namespace telemetryNS
+{
+	const UINT RING_FRAMES = 1024;          // frames kept for the graph and the CSV dump
+	const UINT MAX_HITCHES = 64;            // most recent hitches kept
+	const double DEFAULT_BUDGET = 1.0 / 60; // seconds, longer frames are hitches
+
+	// log-linear histogram of micro-seconds: exact below LINEAR_LIMIT, then
+	// SUB_BUCKETS buckets per power of two, about 3% wide
+	const UINT LINEAR_LIMIT = 64;
+	const UINT SUB_BUCKET_BITS = 5;
+	const UINT SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	const UINT MAX_EXPONENT = 26;           // 2^26 us = 67 s, longer times are clamped
+	const UINT HISTOGRAM_BUCKETS = LINEAR_LIMIT + (MAX_EXPONENT - 6) * SUB_BUCKETS;
+
+	// phases of a frame, measured on the game thread
+	const int PHASE_SIMULATE = 0;           // input, update(), ai(), collisions()
+	const int PHASE_RENDER = 1;             // render(), includes waiting for a free frame buffer
+	const int PHASE_PRESENT = 2;            // showBackbuffer() and device loss handling
+	const int PHASE_OTHER = 3;              // assets, controllers and the rest of Game::run()
+	const int PHASE_WAIT = 4;               // frame pacing and the message pump, not marked
+	const int PHASE_COUNT = 5;
+	const int FRAME = PHASE_COUNT;          // the whole frame, where a phase is expected
+
+	// overlay
+	const UINT OVERLAY_FRAMES = 240;        // frames in the graph, one pixel wide each
+	const float OVERLAY_HEIGHT = 64;        // pixels of two frame budgets
+	const float OVERLAY_X = 8;
+	const float OVERLAY_Y = 8;
+	const float GLYPH_SCALE = 2;            // pixels per font pixel
+}
+
+// Histogram of times with a bounded relative error.
+// Adding a time and reading a percentile cost the same at any count, and
+// percentiles are taken over everything added, not over a recent window.
+class TimeHistogram final
+{
+public:
+	// Constructor
+	TimeHistogram();
+
+	// Add a time of us micro-seconds.
+	void add(UINT64 us);
+
+	// Return the time in micro-seconds that p percent of the added times are
+	// within, the upper end of its bucket. 0 if nothing was added.
+	// Pre: 0 <= p <= 100
+	UINT64 getPercentile(double p) const;
+
+	// Return number of added times.
+	UINT64 getCount() const { return count; }
+
+	// Return the average in micro-seconds.
+	double getMean() const { return count > 0 ? (double)sum / count : 0; }
+
+	// Return the smallest and largest added time in micro-seconds.
+	UINT64 getMin() const { return count > 0 ? minimum : 0; }
+	UINT64 getMax() const { return maximum; }
+
+	// Return number of times in bucket i.
+	UINT getBucket(UINT i) const { return buckets[i]; }
+
+	// Return the smallest and largest time in micro-seconds of bucket i.
+	static UINT64 bucketLow(UINT i);
+	static UINT64 bucketHigh(UINT i);
+
+	// Return the bucket of a time of us micro-seconds.
+	static UINT bucketOf(UINT64 us);
+
+	// Remove all times.
+	void clear();
+
+private:
+	UINT   buckets[telemetryNS::HISTOGRAM_BUCKETS];
+	UINT64 count;
+	UINT64 sum;
+	UINT64 minimum;
+	UINT64 maximum;
+};
+
+// Frame time of one frame.
+struct FrameSample
+{
+	UINT64 frame;                       // number of the frame
+	float  ms;
+	float  phaseMs[telemetryNS::PHASE_COUNT];
+};
+
+// Frame over the budget.
+struct Hitch
+{
+	UINT64 frame;
+	float  ms;
+	int    phase;                       // telemetryNS::PHASE_ that took longest
+};
+
+// Percentiles of a frame time or phase, in milli-seconds.
+struct TimeStats
+{
+	double avgMs;
+	double minMs;
+	double p50Ms;
+	double p90Ms;
+	double p95Ms;
+	double p99Ms;
+	double p999Ms;
+	double maxMs;
+};
+
+// Frame time telemetry statistics.
+struct TelemetryStats
+{
+	UINT64 frames;
+	UINT64 hitches;                     // frames over the budget
+	double budgetMs;
+	TimeStats frame;
+	TimeStats phases[telemetryNS::PHASE_COUNT];
+};
+
+// Frame time telemetry.
+// Game::run() calls beginFrame() when a frame starts and mark() when a phase
+// of it ends; the time between the marks goes to the marked phase and the
+// time not marked is PHASE_WAIT. Frame times are measured between successive
+// beginFrame() calls with the real clock, also when the game runs with a
+// simulated frame time. The last RING_FRAMES frames are kept as samples and
+// all frames go into histograms, so p95/p99 cover the whole run at constant
+// memory. A frame longer than the budget is counted as a hitch.
+class Telemetry final
+{
+public:
+	// Constructor
+	Telemetry();
+
+	// End the previous frame and start timing the next one.
+	void beginFrame();
+
+	// Add the time since the previous mark to phase.
+	// Pre: phase = telemetryNS::PHASE_ other than PHASE_WAIT
+	void mark(int phase);
+
+	// Set the frame time budget in seconds, longer frames are hitches.
+	void setBudget(double sec) { budget = sec > 0 ? sec : telemetryNS::DEFAULT_BUDGET; }
+
+	// Return the frame time budget in seconds.
+	double getBudget() const { return budget; }
+
+	// Return the frame time statistics.
+	TelemetryStats getStats() const;
+
+	// Return the time in seconds that p percent of the frames or a phase are within.
+	// Pre: 0 <= p <= 100
+	//      phase = telemetryNS::PHASE_ or FRAME
+	double getPercentile(double p, int phase = telemetryNS::FRAME) const;
+
+	// Return the histogram of the frame times or a phase.
+	// Pre: phase = telemetryNS::PHASE_ or FRAME
+	const TimeHistogram& getHistogram(int phase = telemetryNS::FRAME) const { return histograms[phase]; }
+
+	// Return number of kept samples, at most RING_FRAMES.
+	UINT getSampleCount() const { return samples; }
+
+	// Return kept sample i, 0 is the oldest.
+	const FrameSample& getSample(UINT i) const;
+
+	// Return number of kept hitches, at most MAX_HITCHES.
+	UINT getHitchCount() const { return (UINT)hitches.size(); }
+
+	// Return kept hitch i, 0 is the oldest.
+	const Hitch& getHitch(UINT i) const;
+
+	// Write the kept samples as CSV, one frame per line in milli-seconds.
+	// Returns false on error.
+	bool saveCSV(const char* filename) const;
+
+	// Write the statistics, the hitches and the frame time histogram as JSON.
+	// Returns false on error.
+	bool saveJSON(const char* filename) const;
+
+	// Write the statistics as a text table.
+	void printStats(FILE* file) const;
+
+	// Draw the frame time graph and the percentiles, call between
+	// beginScene() and endScene() after the game is drawn.
+	void drawOverlay(GraphicsSystem& graphics) const;
+
+	// Remove all samples, hitches and histograms.
+	void reset();
+
+	// Return the name of a phase.
+	static const char* getPhaseName(int phase);
+
+private:
+	TimeHistogram histograms[telemetryNS::PHASE_COUNT + 1];
+	std::vector<FrameSample> ring;
+	UINT   ringIndex;                   // next write position in ring
+	UINT   samples;                     // kept samples
+	std::vector<Hitch> hitches;         // ring of MAX_HITCHES
+	UINT   hitchIndex;
+	UINT64 hitchCount;
+	UINT64 frames;
+	double budget;
+	double frameStart;                  // time of beginFrame(), 0 before the first frame
+	double lastMark;
+	double phaseTime[telemetryNS::PHASE_COUNT];
+
+	// Add the time statistics of histogram h to s.
+	static void fillStats(const TimeHistogram& h, TimeStats& s);
+};
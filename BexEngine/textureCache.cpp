@@ -0,0 +1,357 @@
+#include "textureCache.h"
+#include "framePacer.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+//=============================================================================
+// Constructor
+//=============================================================================
+SkylinePacker::SkylinePacker()
+{
+	width = 0;
+	height = 0;
+	usedArea = 0;
+}
+
+//=============================================================================
+// Start an empty width x height area
+//=============================================================================
+void SkylinePacker::initialize(int w, int h)
+{
+	width = w;
+	height = h;
+	usedArea = 0;
+	skyline.clear();
+	Node n = { 0, 0, w };
+	skyline.push_back(n);
+}
+
+//=============================================================================
+// Return top of a w x h rectangle at segment i, -1 if it does not fit
+//=============================================================================
+int SkylinePacker::fit(size_t i, int w, int h) const
+{
+	if (skyline[i].x + w > width)
+		return -1;
+	// the rectangle rests on the highest segment below it
+	int y = 0;
+	for (int left = w; left > 0; i++)
+	{
+		y = std::max(y, skyline[i].y);
+		if (y + h > height)
+			return -1;
+		left -= skyline[i].width;
+	}
+	return y;
+}
+
+//=============================================================================
+// Place a w x h rectangle
+// Returns false if it does not fit
+//=============================================================================
+bool SkylinePacker::insert(int w, int h, int& x, int& y)
+{
+	size_t best = skyline.size();
+	int bestTop = height + 1;
+	int bestWidth = width + 1;
+	for (size_t i = 0; i < skyline.size(); i++)
+	{
+		int top = fit(i, w, h);
+		if (top < 0)
+			continue;
+		if (top + h < bestTop || (top + h == bestTop && skyline[i].width < bestWidth))
+		{
+			best = i;
+			bestTop = top + h;
+			bestWidth = skyline[i].width;
+		}
+	}
+	if (best == skyline.size())
+		return false;
+	x = skyline[best].x;
+	y = bestTop - h;
+
+	// the rectangle top becomes a segment, the segments it covers shrink or go
+	Node n = { x, bestTop, w };
+	skyline.insert(skyline.begin() + best, n);
+	for (size_t i = best + 1; i < skyline.size();)
+	{
+		int overlap = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+		if (overlap <= 0)
+			break;
+		skyline[i].x += overlap;
+		skyline[i].width -= overlap;
+		if (skyline[i].width > 0)
+			break;
+		skyline.erase(skyline.begin() + i);
+	}
+	// merge neighbours of equal height
+	for (size_t i = 0; i + 1 < skyline.size();)
+	{
+		if (skyline[i].y == skyline[i + 1].y)
+		{
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+			i++;
+	}
+	usedArea += (UINT64)w * h;
+	return true;
+}
+
+//=============================================================================
+// Return the fraction of the area used by rectangles
+//=============================================================================
+float SkylinePacker::getOccupancy() const
+{
+	if (width == 0 || height == 0)
+		return 0;
+	return (float)((double)usedArea / ((double)width * height));
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+TextureCache::TextureCache()
+{
+	backend = nullptr;
+	dirty = false;
+	atlasing = true;
+	uploads = 0;
+	updates = 0;
+	resets = 0;
+	recreated = 0;
+	recreateTime = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+TextureCache::~TextureCache()
+{
+	clear();
+}
+
+//=============================================================================
+// Use backend to create the textures
+//=============================================================================
+void TextureCache::initialize(RenderBackend* b)
+{
+	clear();
+	backend = b;
+}
+
+//=============================================================================
+// Add an image
+// Throws GameError
+//=============================================================================
+UINT TextureCache::add(int w, int h, const uint32_t* pixels, UINT flags)
+{
+	if (w <= 0 || h <= 0 || pixels == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Invalid image"));
+	int pool = (flags & textureCacheNS::FLAG_VIDEO) ? graphicsNS::POOL_DEFAULT : graphicsNS::POOL_MANAGED;
+
+	TextureRegion r;
+	int x = 0, y = 0;
+	try{
+		if (atlasing && !(flags & textureCacheNS::FLAG_NO_ATLAS) &&
+			w <= textureCacheNS::MAX_ATLAS_IMAGE && h <= textureCacheNS::MAX_ATLAS_IMAGE)
+			r.page = placeInAtlas(w, h, pool, x, y);
+		else
+		{
+			pages.push_back(Page());
+			Page& p = pages.back();
+			p.width = w;
+			p.height = h;
+			p.atlas = false;
+			p.pixels.resize((size_t)w * h);
+			r.page = (UINT)pages.size() - 1;
+		}
+		regions.reserve(regions.size() + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		throw(GameError(gameErrorNS::WARNING, "Out of memory adding an image"));
+	}
+
+	Page& p = pages[r.page];
+	p.pool = pool;
+	p.dirty = true;
+	++p.images;
+	for (int row = 0; row < h; row++)
+		memcpy(&p.pixels[(size_t)(y + row) * p.width + x], pixels + (size_t)row * w, w * sizeof(uint32_t));
+	dirty = true;
+
+	r.texture = p.texture;
+	r.u0 = (float)x / p.width;
+	r.v0 = (float)y / p.height;
+	r.u1 = (float)(x + w) / p.width;
+	r.v1 = (float)(y + h) / p.height;
+	r.width = w;
+	r.height = h;
+	regions.push_back(r);
+	return (UINT)regions.size() - 1;
+}
+
+//=============================================================================
+// Place a w x h image in an atlas page of pool
+// Returns the page
+//=============================================================================
+UINT TextureCache::placeInAtlas(int w, int h, int pool, int& x, int& y)
+{
+	const int pw = w + textureCacheNS::PADDING;
+	const int ph = h + textureCacheNS::PADDING;
+	for (size_t i = 0; i < pages.size(); i++)
+		if (pages[i].atlas && pages[i].pool == pool && pages[i].packer.insert(pw, ph, x, y))
+			return (UINT)i;
+
+	pages.push_back(Page());
+	Page& p = pages.back();
+	p.width = textureCacheNS::ATLAS_SIZE;
+	p.height = textureCacheNS::ATLAS_SIZE;
+	p.atlas = true;
+	p.pixels.assign((size_t)p.width * p.height, 0);
+	p.packer.initialize(p.width, p.height);
+	p.packer.insert(pw, ph, x, y);
+	return (UINT)pages.size() - 1;
+}
+
+//=============================================================================
+// Set texture, texture rectangle and size of sd to image id
+//=============================================================================
+void TextureCache::apply(UINT id, SpriteData& sd) const
+{
+	const TextureRegion& r = regions[id];
+	sd.texture = r.texture;
+	sd.u0 = r.u0;
+	sd.v0 = r.v0;
+	sd.u1 = r.u1;
+	sd.v1 = r.v1;
+	sd.width = (float)r.width;
+	sd.height = (float)r.height;
+}
+
+//=============================================================================
+// Upload the dirty pages
+// Returns number of textures created
+//=============================================================================
+UINT TextureCache::upload()
+{
+	if (backend == nullptr)
+		return 0;
+	UINT created = 0;
+	dirty = false;
+	for (UINT i = 0; i < pages.size(); i++)
+	{
+		Page& p = pages[i];
+		if (!p.dirty)
+			continue;
+		// a changed page keeps its texture, the frames being recorded and
+		// drawn may still use it
+		if (p.texture)
+		{
+			if (backend->updateTexture(p.texture, &p.pixels[0]))
+			{
+				p.dirty = false;
+				++updates;
+			}
+			else
+				dirty = true;           // try again on the next commit
+			continue;
+		}
+		p.texture = backend->createTexture(p.width, p.height, &p.pixels[0], p.pool);
+		if (p.texture == nullptr)
+		{
+			dirty = true;
+			continue;
+		}
+		p.dirty = false;
+		++created;
+		for (size_t r = 0; r < regions.size(); r++)
+			if (regions[r].page == i)
+				regions[r].texture = p.texture;
+	}
+	uploads += created;
+	return created;
+}
+
+//=============================================================================
+// Release the textures lost with the device
+//=============================================================================
+void TextureCache::onLostDevice()
+{
+	if (backend == nullptr)
+		return;
+	for (UINT i = 0; i < pages.size(); i++)
+	{
+		Page& p = pages[i];
+		if (p.pool != graphicsNS::POOL_DEFAULT || p.texture == nullptr)
+			continue;
+		backend->releaseTexture(p.texture);
+		p.texture = nullptr;
+		p.dirty = true;
+		dirty = true;
+		for (size_t r = 0; r < regions.size(); r++)
+			if (regions[r].page == i)
+				regions[r].texture = nullptr;
+	}
+}
+
+//=============================================================================
+// Recreate the released textures from their system memory copies
+//=============================================================================
+void TextureCache::onResetDevice()
+{
+	double start = FramePacer::now();
+	recreated = upload();
+	recreateTime = FramePacer::now() - start;
+	++resets;
+}
+
+//=============================================================================
+// Release all textures and images
+//=============================================================================
+void TextureCache::clear()
+{
+	if (backend)
+		for (size_t i = 0; i < pages.size(); i++)
+			if (pages[i].texture)
+				backend->releaseTexture(pages[i].texture);
+	pages.clear();
+	regions.clear();
+	dirty = false;
+}
+
+//=============================================================================
+// Return texture cache statistics
+//=============================================================================
+TextureCacheStats TextureCache::getStats() const
+{
+	TextureCacheStats s;
+	s.images = (UINT)regions.size();
+	s.atlasImages = 0;
+	s.pages = (UINT)pages.size();
+	s.atlasPages = 0;
+	s.bytes = 0;
+	s.occupancy = 0;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		s.bytes += pages[i].pixels.size() * sizeof(uint32_t);
+		if (pages[i].atlas)
+		{
+			++s.atlasPages;
+			s.atlasImages += pages[i].images;
+			s.occupancy += pages[i].packer.getOccupancy();
+		}
+	}
+	if (s.atlasPages > 0)
+		s.occupancy /= s.atlasPages;
+	s.uploads = uploads;
+	s.updates = updates;
+	s.resets = resets;
+	s.recreated = recreated;
+	s.recreateTime = recreateTime;
+	return s;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#define WIN32_LEAN_AND_MEAN
+
+#include <vector>
+#include <deque>
+#include "renderBackend.h"
+
+namespace textureCacheNS
+{
+	const int ATLAS_SIZE = 1024;            // width and height of an atlas page in pixels
+	const int MAX_ATLAS_IMAGE = 256;        // larger images get a page of their own
+	const int PADDING = 1;                  // transparent pixels around atlas images
+
+	// image flags
+	const UINT FLAG_NO_ATLAS = 1;           // page of its own
+	const UINT FLAG_VIDEO = 2;              // graphicsNS::POOL_DEFAULT, recreated after a reset
+}
+
+// Skyline rectangle packer.
+// The packed area is described by the heights of its top edge; a rectangle
+// goes where its top is lowest, ties are broken by the narrowest fit.
+class SkylinePacker final
+{
+public:
+	// Constructor
+	SkylinePacker();
+
+	// Start an empty width x height area.
+	void initialize(int width, int height);
+
+	// Place a w x h rectangle. Returns false if it does not fit.
+	bool insert(int w, int h, int& x, int& y);
+
+	// Return the fraction of the area used by rectangles.
+	float getOccupancy() const;
+
+private:
+	struct Node { int x, y, width; };   // skyline segment
+	std::vector<Node> skyline;          // segments left to right
+	int    width;
+	int    height;
+	UINT64 usedArea;
+
+	// Return top of a w wide rectangle at segment i, -1 if it does not fit.
+	int fit(size_t i, int w, int h) const;
+};
+
+// Texture rectangle of an image.
+struct TextureRegion
+{
+	void* texture;                      // backend texture, nullptr until uploaded
+	float u0, v0, u1, v1;               // texture rectangle, 0..1
+	int   width, height;                // in pixels
+	UINT  page;
+};
+
+// Texture cache statistics.
+struct TextureCacheStats
+{
+	UINT   images;
+	UINT   atlasImages;                 // images sharing an atlas page
+	UINT   pages;                       // textures
+	UINT   atlasPages;
+	UINT64 bytes;                       // pixels of all pages
+	float  occupancy;                   // average fraction of the atlas pages used
+	UINT   uploads;                     // textures created
+	UINT   updates;                     // textures updated in place with new images
+	UINT   resets;                      // device resets survived
+	UINT   recreated;                   // textures recreated by the last reset
+	double recreateTime;                // seconds the last reset spent recreating textures
+};
+
+// Owns the textures of the game.
+// Small images are packed into atlas pages so sprites of different images
+// share a texture and draw with one draw call. Every page keeps a system
+// memory copy of its pixels, so the POOL_DEFAULT pages lost with the device
+// are recreated after a reset without reloading anything. Pages are uploaded
+// by commit(), GraphicsSystem::spriteBegin() calls it. A page that gains an
+// image is updated in place, so draws recorded with its texture stay valid.
+class TextureCache final
+{
+public:
+	// Constructor
+	TextureCache();
+
+	// Destructor
+	~TextureCache();
+
+	// Use backend to create the textures.
+	void initialize(RenderBackend* backend);
+
+	// Add an image, returns its id.
+	// Throws GameError
+	// Pre: pixels = width * height ARGB pixels, rows top to bottom
+	//      flags = textureCacheNS::FLAG_ bits
+	UINT add(int width, int height, const uint32_t* pixels, UINT flags = 0);
+
+	// Return the texture rectangle of image id.
+	const TextureRegion& get(UINT id) const { return regions[id]; }
+
+	// Set texture, texture rectangle and size of sd to image id.
+	void apply(UINT id, SpriteData& sd) const;
+
+	// Upload the pages changed since the last commit.
+	void commit() { if (dirty) upload(); }
+
+	// Return true if commit() has pages to upload.
+	bool hasChanges() const { return dirty; }
+
+	// Release the textures lost with the device, call before the reset.
+	void onLostDevice();
+
+	// Recreate the released textures, call after the reset.
+	void onResetDevice();
+
+	// Release all textures and images.
+	void clear();
+
+	// false gives every image a page of its own, to measure what atlases save.
+	// Call before images are added.
+	void setAtlasing(bool enabled) { atlasing = enabled; }
+
+	// Return number of images.
+	UINT getImageCount() const { return (UINT)regions.size(); }
+
+	// Return texture cache statistics.
+	TextureCacheStats getStats() const;
+
+private:
+	struct Page
+	{
+		void* texture;                  // backend texture, nullptr if not uploaded
+		int   width;
+		int   height;
+		int   pool;                     // graphicsNS::POOL_
+		bool  atlas;                    // shared by small images
+		bool  dirty;                    // pixels changed since the upload
+		UINT  images;
+		std::vector<uint32_t> pixels;   // system memory copy
+		SkylinePacker packer;
+
+		Page() : texture(nullptr), width(0), height(0), pool(graphicsNS::POOL_MANAGED),
+			atlas(false), dirty(false), images(0) {}
+	};
+
+	RenderBackend* backend;
+	std::deque<Page> pages;             // a deque, adding a page moves no pixels
+	std::vector<TextureRegion> regions; // by image id
+	bool   dirty;                       // a page waits for upload
+	bool   atlasing;
+	UINT   uploads;
+	UINT   updates;
+	UINT   resets;
+	UINT   recreated;
+	double recreateTime;
+
+	TextureCache(const TextureCache&);  // no copies
+	TextureCache& operator=(const TextureCache&);
+
+	// Create the textures of new pages and update the changed ones in
+	// place, returns number of textures created.
+	UINT upload();
+	// Place a w x h image in an atlas page of pool, returns the page.
+	UINT placeInAtlas(int w, int h, int pool, int& x, int& y);
+};
@@ -0,0 +1,438 @@
+#include "tilemap.h"
+#include "graphics.h"
+#include "mappedFile.h"
+#include "framePacer.h"
+#include "profiler.h"
+#include "lz4.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILEMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const char MAGIC[4] = { 'B', 'E', 'X', 'T' };
+
+	// Copy quads of src to dst moved by dx, dy.
+	void copyQuads(const SpriteVertex* src, SpriteVertex* dst, UINT quads, float dx, float dy)
+	{
+#ifdef TILEMAP_SSE2
+		// a quad is 28 floats, 7 vectors; x and y of the four vertices are
+		// at floats 0, 1, 7, 8, 14, 15, 21 and 22. The other floats are
+		// copied as bits, color is not a float.
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 d[7] = {
+			_mm_setr_ps(dx, dy, 0, 0), _mm_setr_ps(0, 0, 0, dx), _mm_setr_ps(dy, 0, 0, 0),
+			_mm_setr_ps(0, 0, dx, dy), zero, _mm_setr_ps(0, dx, dy, 0), zero };
+		const __m128 m[7] = {
+			_mm_castsi128_ps(_mm_setr_epi32(-1, -1, 0, 0)), _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)),
+			_mm_castsi128_ps(_mm_setr_epi32(-1, 0, 0, 0)), _mm_castsi128_ps(_mm_setr_epi32(0, 0, -1, -1)),
+			zero, _mm_castsi128_ps(_mm_setr_epi32(0, -1, -1, 0)), zero };
+		const float* s = &src[0].x;
+		float* o = &dst[0].x;
+		for (UINT q = 0; q < quads; q++, s += 28, o += 28)
+		{
+			for (int k = 0; k < 7; k++)
+			{
+				__m128 a = _mm_loadu_ps(s + k * 4);
+				__m128 moved = _mm_add_ps(a, d[k]);
+				_mm_storeu_ps(o + k * 4, _mm_or_ps(_mm_and_ps(m[k], moved), _mm_andnot_ps(m[k], a)));
+			}
+		}
+#else
+		for (UINT i = 0; i < quads * 4; i++)
+		{
+			SpriteVertex v = src[i];
+			v.x += dx;
+			v.y += dy;
+			dst[i] = v;
+		}
+#endif
+	}
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+Tilemap::Tilemap()
+{
+	width = height = 0;
+	tileWidth = tileHeight = 0;
+	chunksX = chunksY = 0;
+	frame = 0;
+	stats = TilemapStats();
+}
+
+//=============================================================================
+// Create a map of empty tiles
+// Throws GameError
+//=============================================================================
+void Tilemap::create(UINT w, UINT h, UINT layerCount, UINT tw, UINT th)
+{
+	if (w == 0 || h == 0 || w > tilemapNS::MAX_SIZE || h > tilemapNS::MAX_SIZE ||
+		layerCount == 0 || layerCount > tilemapNS::MAX_LAYERS || tw == 0 || th == 0)
+		throw(GameError(gameErrorNS::WARNING, "Invalid tilemap size"));
+	width = w;
+	height = h;
+	tileWidth = tw;
+	tileHeight = th;
+	layers.clear();
+	layers.resize(layerCount);
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		layers[i].tiles.assign((size_t)w * h, tilemapNS::EMPTY);
+		layers[i].tileset = -1;
+		layers[i].visible = true;
+	}
+	resetChunks();
+}
+
+//=============================================================================
+// Size the chunk arrays of all layers to the map and drop the chunk cache
+//=============================================================================
+void Tilemap::resetChunks()
+{
+	chunksX = (width + tilemapNS::CHUNK_TILES - 1) / tilemapNS::CHUNK_TILES;
+	chunksY = (height + tilemapNS::CHUNK_TILES - 1) / tilemapNS::CHUNK_TILES;
+	Chunk empty = { -1, false };
+	for (size_t i = 0; i < layers.size(); i++)
+		layers[i].chunks.assign((size_t)chunksX * chunksY, empty);
+	slots.clear();
+	stats = TilemapStats();
+}
+
+//=============================================================================
+// Load a map file
+// Throws GameError
+//=============================================================================
+void Tilemap::load(const std::string& filename)
+{
+	MappedFile file;
+	file.open(filename);                // throws GameError
+	load(file.getData(), file.getSize(), filename);
+}
+
+//=============================================================================
+// Load a map from size bytes of the file format
+// Throws GameError
+//=============================================================================
+void Tilemap::load(const void* data, size_t size, const std::string& name)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	TilemapHeader h;
+	bool ok = size >= sizeof(h);
+	if (ok)
+	{
+		memcpy(&h, p, sizeof(h));
+		ok = memcmp(h.magic, MAGIC, 4) == 0 && h.version == tilemapNS::VERSION &&
+			h.width > 0 && h.width <= tilemapNS::MAX_SIZE && h.height > 0 && h.height <= tilemapNS::MAX_SIZE &&
+			h.layerCount > 0 && h.layerCount <= tilemapNS::MAX_LAYERS && h.tileWidth > 0 && h.tileHeight > 0;
+	}
+	if (ok)
+	{
+		create(h.width, h.height, h.layerCount, h.tileWidth, h.tileHeight);
+		size_t pos = sizeof(h);
+		const size_t bytes = (size_t)width * height * sizeof(uint16_t);
+		for (size_t i = 0; i < layers.size() && ok; i++)
+		{
+			TilemapLayerHeader lh;
+			ok = size - pos >= sizeof(lh);
+			if (!ok)
+				break;
+			memcpy(&lh, p + pos, sizeof(lh));
+			pos += sizeof(lh);
+			ok = lh.storedSize <= size - pos;
+			if (!ok)
+				break;
+			if (lh.flags & tilemapNS::FLAG_LZ4)
+				ok = lz4::decompress(p + pos, lh.storedSize, &layers[i].tiles[0], bytes);
+			else if ((ok = lh.storedSize == bytes))
+				memcpy(&layers[i].tiles[0], p + pos, bytes);
+			pos += lh.storedSize;
+		}
+	}
+	if (!ok)
+	{
+		width = height = 0;
+		layers.clear();
+		resetChunks();
+		throw(GameError(gameErrorNS::WARNING, "Not a valid tilemap " + name));
+	}
+}
+
+//=============================================================================
+// Write the map
+// Throws GameError
+//=============================================================================
+void Tilemap::save(const std::string& filename) const
+{
+	TilemapHeader h;
+	memcpy(h.magic, MAGIC, 4);
+	h.version = tilemapNS::VERSION;
+	h.width = width;
+	h.height = height;
+	h.tileWidth = tileWidth;
+	h.tileHeight = tileHeight;
+	h.layerCount = (UINT)layers.size();
+	h.reserved = 0;
+
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == nullptr)
+		throw(GameError(gameErrorNS::WARNING, "Error creating tilemap " + filename));
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	const size_t bytes = (size_t)width * height * sizeof(uint16_t);
+	std::vector<unsigned char> packed(lz4::compressBound(bytes));
+	for (size_t i = 0; i < layers.size() && ok; i++)
+	{
+		TilemapLayerHeader lh;
+		size_t n = lz4::compress(&layers[i].tiles[0], bytes, &packed[0], packed.size());
+		const void* blob = &packed[0];
+		lh.flags = tilemapNS::FLAG_LZ4;
+		if (n == 0 || n >= bytes)
+		{
+			n = bytes;
+			blob = &layers[i].tiles[0];
+			lh.flags = 0;
+		}
+		lh.storedSize = (UINT)n;
+		ok = fwrite(&lh, sizeof(lh), 1, f) == 1 && fwrite(blob, 1, n, f) == n;
+	}
+	if (fclose(f) != 0 || !ok)
+		throw(GameError(gameErrorNS::WARNING, "Error writing tilemap " + filename));
+}
+
+//=============================================================================
+// Set the tileset of layer
+//=============================================================================
+void Tilemap::setTileset(UINT layer, UINT image)
+{
+	if (layer >= layers.size())
+		return;
+	Layer& l = layers[layer];
+	l.tileset = (int)image;
+	// texture coordinates changed
+	for (size_t c = 0; c < l.chunks.size(); c++)
+		l.chunks[c].dirty = true;
+}
+
+//=============================================================================
+// Set tile x, y of layer
+//=============================================================================
+void Tilemap::setTile(UINT layer, UINT x, UINT y, uint16_t tile)
+{
+	if (layer >= layers.size() || x >= width || y >= height)
+		return;
+	Layer& l = layers[layer];
+	uint16_t& t = l.tiles[(size_t)y * width + x];
+	if (t == tile)
+		return;
+	t = tile;
+	l.chunks[(y / tilemapNS::CHUNK_TILES) * chunksX + x / tilemapNS::CHUNK_TILES].dirty = true;
+}
+
+//=============================================================================
+// Show or hide a layer
+//=============================================================================
+void Tilemap::setLayerVisible(UINT layer, bool visible)
+{
+	if (layer < layers.size())
+		layers[layer].visible = visible;
+}
+
+//=============================================================================
+// Drop the vertices of all chunks
+//=============================================================================
+void Tilemap::invalidate()
+{
+	for (size_t i = 0; i < slots.size(); i++)
+		layers[slots[i].layer].chunks[slots[i].chunk].slot = -1;
+	slots.clear();
+}
+
+//=============================================================================
+// Return a slot for chunk of layer.
+// The cache grows to CACHED_CHUNKS slots; then the slot drawn longest ago is
+// reused. Slots drawn in this frame are never reused, a view that needs more
+// chunks grows the cache.
+//=============================================================================
+int Tilemap::allocateSlot(UINT layer, UINT chunk)
+{
+	int best = -1;
+	if (slots.size() >= tilemapNS::CACHED_CHUNKS)
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+			if (slots[i].frame < frame && (best < 0 || slots[i].frame < slots[best].frame))
+				best = (int)i;
+	}
+	if (best < 0)
+	{
+		slots.push_back(Slot());
+		best = (int)slots.size() - 1;
+	}
+	else
+		layers[slots[best].layer].chunks[slots[best].chunk].slot = -1;
+	Slot& s = slots[best];
+	s.quads = 0;
+	s.layer = layer;
+	s.chunk = chunk;
+	s.frame = frame;
+	layers[layer].chunks[chunk].slot = best;
+	return best;
+}
+
+//=============================================================================
+// Build the quads of chunk of layer.
+// uv is the texture rectangle of the tileset with columns x rows tiles.
+//=============================================================================
+void Tilemap::buildChunk(UINT layer, UINT chunk, const float* uv, int columns, int rows)
+{
+	double start = FramePacer::now();
+	Layer& l = layers[layer];
+	Chunk& c = l.chunks[chunk];
+	if (c.slot < 0)
+		allocateSlot(layer, chunk);
+	c.dirty = false;
+	Slot& s = slots[c.slot];
+
+	const UINT x0 = (chunk % chunksX) * tilemapNS::CHUNK_TILES;
+	const UINT y0 = (chunk / chunksX) * tilemapNS::CHUNK_TILES;
+	const UINT x1 = x0 + tilemapNS::CHUNK_TILES < width ? x0 + tilemapNS::CHUNK_TILES : width;
+	const UINT y1 = y0 + tilemapNS::CHUNK_TILES < height ? y0 + tilemapNS::CHUNK_TILES : height;
+	const float du = (uv[2] - uv[0]) / columns;
+	const float dv = (uv[3] - uv[1]) / rows;
+	const float tw = (float)tileWidth, th = (float)tileHeight;
+
+	s.vertices.resize(tilemapNS::CHUNK_TILES * tilemapNS::CHUNK_TILES * 4);
+	SpriteVertex* v = &s.vertices[0];
+	UINT quads = 0;
+	for (UINT y = y0; y < y1; y++)
+	{
+		const uint16_t* row = &l.tiles[(size_t)y * width];
+		for (UINT x = x0; x < x1; x++)
+		{
+			if (row[x] == tilemapNS::EMPTY)
+				continue;
+			int image = row[x] - 1;
+			float u0 = uv[0] + (image % columns) * du;
+			float v0 = uv[1] + (image / columns % rows) * dv;
+			float u1 = u0 + du, v1 = v0 + dv;
+			float px = x * tw, py = y * th;
+			float xs[4] = { px, px + tw, px, px + tw };
+			float ys[4] = { py, py, py + th, py + th };
+			float us[4] = { u0, u1, u0, u1 };
+			float vs[4] = { v0, v0, v1, v1 };
+			for (int k = 0; k < 4; k++, v++)
+			{
+				v->x = xs[k];
+				v->y = ys[k];
+				v->z = 0;
+				v->rhw = 1;
+				v->color = 0xFFFFFFFF;
+				v->u = us[k];
+				v->v = vs[k];
+			}
+			quads++;
+		}
+	}
+	s.quads = quads;
+	stats.chunksBuilt++;
+	stats.buildTime += FramePacer::now() - start;
+}
+
+//=============================================================================
+// Draw the visible layers.
+// Only the chunks overlapping the view are visited: their range follows from
+// the camera by division. Missing or dirty chunks are built, then the quads
+// of all visible chunks of a layer are copied into one beginQuads() block.
+//=============================================================================
+void Tilemap::draw(GraphicsSystem& graphics, float cameraX, float cameraY, float viewWidth, float viewHeight)
+{
+	if (layers.empty())
+		return;
+	PROFILE_ZONE("tilemap");
+	frame++;
+	stats.chunksDrawn = 0;
+	stats.quadsDrawn = 0;
+
+	const float camX = std::floor(cameraX), camY = std::floor(cameraY);
+	const float chunkW = (float)(tileWidth * tilemapNS::CHUNK_TILES);
+	const float chunkH = (float)(tileHeight * tilemapNS::CHUNK_TILES);
+	int cx0 = (int)std::floor(camX / chunkW), cy0 = (int)std::floor(camY / chunkH);
+	int cx1 = (int)std::floor((camX + viewWidth - 1) / chunkW), cy1 = (int)std::floor((camY + viewHeight - 1) / chunkH);
+	cx0 = cx0 < 0 ? 0 : cx0;
+	cy0 = cy0 < 0 ? 0 : cy0;
+	cx1 = cx1 >= (int)chunksX ? (int)chunksX - 1 : cx1;
+	cy1 = cy1 >= (int)chunksY ? (int)chunksY - 1 : cy1;
+	if (cx0 > cx1 || cy0 > cy1 || viewWidth <= 0 || viewHeight <= 0)
+		return;
+
+	const TextureCache& textures = graphics.getTextures();
+	for (UINT li = 0; li < layers.size(); li++)
+	{
+		Layer& l = layers[li];
+		if (!l.visible)
+			continue;
+		const bool textured = l.tileset >= 0 && (UINT)l.tileset < textures.getImageCount();
+		float uv[4] = { 0, 0, 1, 1 };
+		int columns = 1, rows = 1;
+		if (textured)
+		{
+			const TextureRegion& r = textures.get(l.tileset);
+			uv[0] = r.u0;
+			uv[1] = r.v0;
+			uv[2] = r.u1;
+			uv[3] = r.v1;
+			columns = r.width / (int)tileWidth > 0 ? r.width / (int)tileWidth : 1;
+			rows = r.height / (int)tileHeight > 0 ? r.height / (int)tileHeight : 1;
+		}
+
+		// build what is missing, count the quads
+		visibleSlots.clear();
+		UINT quads = 0;
+		for (int cy = cy0; cy <= cy1; cy++)
+		{
+			for (int cx = cx0; cx <= cx1; cx++)
+			{
+				UINT chunk = cy * chunksX + cx;
+				Chunk& c = l.chunks[chunk];
+				if (c.slot < 0 || c.dirty)
+					buildChunk(li, chunk, uv, columns, rows);
+				Slot& s = slots[c.slot];
+				s.frame = frame;
+				if (s.quads == 0)
+					continue;
+				visibleSlots.push_back(c.slot);
+				quads += s.quads;
+			}
+		}
+		stats.chunksDrawn += (UINT)visibleSlots.size();
+		stats.quadsDrawn += quads;
+
+		SpriteVertex* v = graphics.beginQuads(quads);
+		if (v == nullptr)
+			continue;
+		// beginQuads() uploaded new textures
+		void* texture = textured ? textures.get(l.tileset).texture : nullptr;
+		for (size_t i = 0; i < visibleSlots.size(); i++)
+		{
+			const Slot& s = slots[visibleSlots[i]];
+			copyQuads(&s.vertices[0], v, s.quads, -camX, -camY);
+			v += s.quads * 4;
+		}
+		graphics.endQuads(texture, spriteBatchNS::BLEND_ALPHA);
+	}
+}
+
+//=============================================================================
+// Return statistics
+//=============================================================================
+TilemapStats Tilemap::getStats() const
+{
+	TilemapStats s = stats;
+	s.cachedChunks = (UINT)slots.size();
+	return s;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "constants.h"
+#include "spriteBatch.h"
+#include "gameError.h"
+
+class GraphicsSystem;
+
+namespace tilemapNS
+{
+	const UINT VERSION = 1;
+	const UINT CHUNK_TILES = 32;            // width and height of a chunk in tiles
+	const UINT MAX_LAYERS = 16;
+	const UINT MAX_SIZE = 65536;            // width and height in tiles
+	const UINT CACHED_CHUNKS = 256;         // chunks whose vertices are kept, more if a frame needs them
+	const UINT FLAG_LZ4 = 1;                // layer tiles are an LZ4 block
+	const uint16_t EMPTY = 0;               // tile that is not drawn, tile n is image n - 1 of the tileset
+}
+
+// Tilemap file header, little endian.
+// Followed by a TilemapLayerHeader and the tiles of every layer, width *
+// height 16 bit tiles row by row, stored as is or as an LZ4 block.
+struct TilemapHeader
+{
+	char   magic[4];                    // "BEXT"
+	UINT   version;
+	UINT   width, height;               // in tiles
+	UINT   tileWidth, tileHeight;       // in pixels
+	UINT   layerCount;
+	UINT   reserved;
+};
+
+// Header of the tiles of one layer in a tilemap file.
+struct TilemapLayerHeader
+{
+	UINT   storedSize;                  // bytes that follow
+	UINT   flags;                       // tilemapNS::FLAG_
+};
+
+// Tilemap statistics.
+struct TilemapStats
+{
+	UINT   chunksDrawn;                 // in the last draw()
+	UINT   quadsDrawn;
+	UINT   cachedChunks;                // chunks with vertices
+	UINT64 chunksBuilt;                 // since create() or load()
+	double buildTime;                   // seconds building chunks since create() or load()
+};
+
+// Layers of tiles drawn with static geometry.
+// Every layer is split into chunks of CHUNK_TILES x CHUNK_TILES tiles. The
+// quads of a chunk are built once, when it first becomes visible or after
+// one of its tiles changed, and kept in a cache of CACHED_CHUNKS chunks; the
+// chunks not drawn longest are reused. draw() only looks at the chunks that
+// overlap the view and copies their quads, shifted by the camera, into the
+// vertices of the frame, so the cost follows the screen area and not the
+// map size. The tiles of a layer are cells of one tileset image of the
+// texture cache, left to right and top to bottom.
+class Tilemap final
+{
+public:
+	// Constructor, an empty map.
+	Tilemap();
+
+	// Create a map of empty tiles.
+	// Throws GameError on invalid sizes
+	// Pre: width, height = 1..MAX_SIZE tiles, layers = 1..MAX_LAYERS
+	void    create(UINT width, UINT height, UINT layers, UINT tileWidth, UINT tileHeight);
+
+	// Load a map file.
+	// Throws GameError if the file can not be read or is not a valid tilemap
+	void    load(const std::string& filename);
+
+	// Load a map from size bytes of the file format, name is used in errors.
+	// Throws GameError if the data is not a valid tilemap
+	void    load(const void* data, size_t size, const std::string& name);
+
+	// Write the map, layers are LZ4 compressed if that saves space.
+	// Throws GameError if the file can not be written
+	void    save(const std::string& filename) const;
+
+	// Set the tileset of layer, an image id of the texture cache.
+	// Pre: image holds whole tiles of tileWidth x tileHeight pixels
+	void    setTileset(UINT layer, UINT image);
+
+	// Set tile x, y of layer, its chunk is rebuilt when it is drawn next.
+	// Coordinates outside the map are ignored.
+	void    setTile(UINT layer, UINT x, UINT y, uint16_t tile);
+
+	// Return tile x, y of layer, EMPTY outside the map.
+	uint16_t getTile(UINT layer, UINT x, UINT y) const
+	{
+		if (layer >= layers.size() || x >= width || y >= height)
+			return tilemapNS::EMPTY;
+		return layers[layer].tiles[(size_t)y * width + x];
+	}
+
+	// Show or hide a layer.
+	void    setLayerVisible(UINT layer, bool visible);
+
+	// Draw the visible layers in order with the top left corner of the
+	// screen at map pixel cameraX, cameraY. The camera is rounded to whole
+	// pixels so the tiles do not shimmer. Call between beginScene() and
+	// endScene(), outside spriteBegin() and spriteEnd().
+	void    draw(GraphicsSystem& graphics, float cameraX, float cameraY, float viewWidth, float viewHeight);
+
+	// Drop the vertices of all chunks, after the tilesets changed.
+	void    invalidate();
+
+	// Return width in tiles.
+	UINT    getWidth() const { return width; }
+
+	// Return height in tiles.
+	UINT    getHeight() const { return height; }
+
+	// Return number of layers.
+	UINT    getLayerCount() const { return (UINT)layers.size(); }
+
+	// Return width of a tile in pixels.
+	UINT    getTileWidth() const { return tileWidth; }
+
+	// Return height of a tile in pixels.
+	UINT    getTileHeight() const { return tileHeight; }
+
+	// Return statistics.
+	TilemapStats getStats() const;
+
+private:
+	// State of one chunk of a layer.
+	struct Chunk
+	{
+		int   slot;                     // cache slot with the vertices, -1 for none
+		bool  dirty;                    // a tile changed since the vertices were built
+	};
+
+	// One layer of tiles.
+	struct Layer
+	{
+		std::vector<uint16_t> tiles;    // width * height, row by row
+		std::vector<Chunk> chunks;      // chunksX * chunksY, row by row
+		int   tileset;                  // image id, -1 draws solid squares
+		bool  visible;
+	};
+
+	// Vertices of a built chunk.
+	struct Slot
+	{
+		std::vector<SpriteVertex> vertices;     // four per non empty tile, map pixels
+		UINT  quads;
+		UINT  layer;                    // owner
+		UINT  chunk;
+		UINT64 frame;                   // draw() that used it last
+	};
+
+	UINT    width, height;              // in tiles
+	UINT    tileWidth, tileHeight;      // in pixels
+	UINT    chunksX, chunksY;
+	std::vector<Layer> layers;
+	std::vector<Slot> slots;            // the chunk cache
+	std::vector<UINT> visibleSlots;     // slots drawn by the current draw() of a layer
+	UINT64  frame;                      // draw() count
+	TilemapStats stats;
+
+	// Return a slot for chunk of layer, evicting the chunk drawn longest ago.
+	int     allocateSlot(UINT layer, UINT chunk);
+	// Build the quads of chunk of layer into its slot.
+	void    buildChunk(UINT layer, UINT chunk, const float* uv, int columns, int rows);
+	// Size the chunk arrays of all layers to the map.
+	void    resetChunks();
+};
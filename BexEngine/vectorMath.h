@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VECMATH_SSE2
+#include <emmintrin.h>
+#endif
+
+// Vector and matrix types of the engine.
+// Vectors are plain floats without alignment requirements, so they can be
+// components, live in std::vector and be passed by value on every compiler.
+// Matrices follow the Direct3D convention: vectors are rows and multiply
+// from the left, a * b applies a first, then b. Vec4 and Mat4 operations use
+// SSE2 where available; Vec2 and Mat3 are cheaper as scalar code. Batches of
+// points are transformed by the functions of mathKernels.h.
+
+// 2D vector.
+struct Vec2
+{
+	float x, y;
+
+	Vec2() : x(0), y(0) {}
+	Vec2(float x, float y) : x(x), y(y) {}
+
+	Vec2  operator+(const Vec2& v) const { return Vec2(x + v.x, y + v.y); }
+	Vec2  operator-(const Vec2& v) const { return Vec2(x - v.x, y - v.y); }
+	Vec2  operator-() const              { return Vec2(-x, -y); }
+	Vec2  operator*(float s) const       { return Vec2(x * s, y * s); }
+	Vec2  operator/(float s) const       { return Vec2(x / s, y / s); }
+	Vec2& operator+=(const Vec2& v)      { x += v.x; y += v.y; return *this; }
+	Vec2& operator-=(const Vec2& v)      { x -= v.x; y -= v.y; return *this; }
+	Vec2& operator*=(float s)            { x *= s; y *= s; return *this; }
+	bool  operator==(const Vec2& v) const { return x == v.x && y == v.y; }
+	bool  operator!=(const Vec2& v) const { return !(*this == v); }
+
+	float dot(const Vec2& v) const   { return x * v.x + y * v.y; }
+	// z of the 3D cross product, > 0 if v is counter clockwise from this
+	float cross(const Vec2& v) const { return x * v.y - y * v.x; }
+	float lengthSquared() const      { return x * x + y * y; }
+	float length() const             { return std::sqrt(lengthSquared()); }
+	// Return the vector with length 1, the zero vector stays zero.
+	Vec2  normalized() const
+	{
+		float len = length();
+		return len > 0 ? *this / len : Vec2();
+	}
+	// Return the vector rotated 90 degrees.
+	Vec2  perpendicular() const      { return Vec2(-y, x); }
+};
+
+inline Vec2 operator*(float s, const Vec2& v) { return v * s; }
+
+// 4D vector, a homogeneous point or direction.
+struct Vec4
+{
+	float x, y, z, w;
+
+	Vec4() : x(0), y(0), z(0), w(0) {}
+	Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+#ifdef VECMATH_SSE2
+	explicit Vec4(__m128 v) { _mm_storeu_ps(&x, v); }
+	__m128 load() const     { return _mm_loadu_ps(&x); }
+
+	Vec4 operator+(const Vec4& v) const { return Vec4(_mm_add_ps(load(), v.load())); }
+	Vec4 operator-(const Vec4& v) const { return Vec4(_mm_sub_ps(load(), v.load())); }
+	Vec4 operator*(const Vec4& v) const { return Vec4(_mm_mul_ps(load(), v.load())); }
+	Vec4 operator*(float s) const       { return Vec4(_mm_mul_ps(load(), _mm_set1_ps(s))); }
+	float dot(const Vec4& v) const
+	{
+		__m128 m = _mm_mul_ps(load(), v.load());
+		// (x + z) + (y + w)
+		m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+		return _mm_cvtss_f32(m);
+	}
+#else
+	Vec4 operator+(const Vec4& v) const { return Vec4(x + v.x, y + v.y, z + v.z, w + v.w); }
+	Vec4 operator-(const Vec4& v) const { return Vec4(x - v.x, y - v.y, z - v.z, w - v.w); }
+	Vec4 operator*(const Vec4& v) const { return Vec4(x * v.x, y * v.y, z * v.z, w * v.w); }
+	Vec4 operator*(float s) const       { return Vec4(x * s, y * s, z * s, w * s); }
+	float dot(const Vec4& v) const      { return (x * v.x + z * v.z) + (y * v.y + w * v.w); }
+#endif
+	Vec4& operator+=(const Vec4& v) { return *this = *this + v; }
+	Vec4& operator-=(const Vec4& v) { return *this = *this - v; }
+	Vec4& operator*=(float s)       { return *this = *this * s; }
+	bool  operator==(const Vec4& v) const { return x == v.x && y == v.y && z == v.z && w == v.w; }
+	bool  operator!=(const Vec4& v) const { return !(*this == v); }
+
+	float lengthSquared() const { return dot(*this); }
+	float length() const        { return std::sqrt(lengthSquared()); }
+};
+
+inline Vec4 operator*(float s, const Vec4& v) { return v * s; }
+
+// 2D affine transform, a 3x3 matrix whose last column is 0, 0, 1.
+// A point x, y is transformed as the row x, y, 1.
+struct Mat3
+{
+	float m[3][3];
+
+	// Return the identity.
+	static Mat3 identity() { return Mat3(1, 0, 0, 1, 0, 0); }
+
+	// Return a translation by x, y.
+	static Mat3 translation(float x, float y) { return Mat3(1, 0, 0, 1, x, y); }
+
+	// Return a scaling by x, y.
+	static Mat3 scaling(float x, float y) { return Mat3(x, 0, 0, y, 0, 0); }
+
+	// Return a rotation by angle radians, clockwise on screen where y is down.
+	static Mat3 rotation(float angle)
+	{
+		float c = std::cos(angle), s = std::sin(angle);
+		return Mat3(c, s, -s, c, 0, 0);
+	}
+
+	// Constructor of the transform x' = x * m00 + y * m10 + tx, y' = x * m01 + y * m11 + ty
+	Mat3(float m00, float m01, float m10, float m11, float tx, float ty)
+	{
+		m[0][0] = m00; m[0][1] = m01; m[0][2] = 0;
+		m[1][0] = m10; m[1][1] = m11; m[1][2] = 0;
+		m[2][0] = tx;  m[2][1] = ty;  m[2][2] = 1;
+	}
+
+	// Return this transform followed by b.
+	Mat3 operator*(const Mat3& b) const
+	{
+		return Mat3(m[0][0] * b.m[0][0] + m[0][1] * b.m[1][0], m[0][0] * b.m[0][1] + m[0][1] * b.m[1][1],
+			m[1][0] * b.m[0][0] + m[1][1] * b.m[1][0], m[1][0] * b.m[0][1] + m[1][1] * b.m[1][1],
+			m[2][0] * b.m[0][0] + m[2][1] * b.m[1][0] + b.m[2][0],
+			m[2][0] * b.m[0][1] + m[2][1] * b.m[1][1] + b.m[2][1]);
+	}
+
+	// Return transformed point p.
+	Vec2 transformPoint(const Vec2& p) const
+	{
+		return Vec2(p.x * m[0][0] + p.y * m[1][0] + m[2][0], p.x * m[0][1] + p.y * m[1][1] + m[2][1]);
+	}
+
+	// Return transformed direction d, the translation is ignored.
+	Vec2 transformVector(const Vec2& d) const
+	{
+		return Vec2(d.x * m[0][0] + d.y * m[1][0], d.x * m[0][1] + d.y * m[1][1]);
+	}
+
+	// Return the inverse, the identity if the transform is not invertible.
+	Mat3 inverse() const
+	{
+		float det = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+		if (det == 0)
+			return identity();
+		float i = 1 / det;
+		float a = m[1][1] * i, b = -m[0][1] * i, c = -m[1][0] * i, d = m[0][0] * i;
+		return Mat3(a, b, c, d, -(m[2][0] * a + m[2][1] * c), -(m[2][0] * b + m[2][1] * d));
+	}
+};
+
+// 4x4 matrix.
+struct Mat4
+{
+	Vec4 rows[4];
+
+	// Return the identity.
+	static Mat4 identity()
+	{
+		return Mat4(Vec4(1, 0, 0, 0), Vec4(0, 1, 0, 0), Vec4(0, 0, 1, 0), Vec4(0, 0, 0, 1));
+	}
+
+	// Return a translation by x, y, z.
+	static Mat4 translation(float x, float y, float z)
+	{
+		return Mat4(Vec4(1, 0, 0, 0), Vec4(0, 1, 0, 0), Vec4(0, 0, 1, 0), Vec4(x, y, z, 1));
+	}
+
+	// Return a scaling by x, y, z.
+	static Mat4 scaling(float x, float y, float z)
+	{
+		return Mat4(Vec4(x, 0, 0, 0), Vec4(0, y, 0, 0), Vec4(0, 0, z, 0), Vec4(0, 0, 0, 1));
+	}
+
+	// Return a rotation by angle radians around the z axis.
+	static Mat4 rotationZ(float angle)
+	{
+		float c = std::cos(angle), s = std::sin(angle);
+		return Mat4(Vec4(c, s, 0, 0), Vec4(-s, c, 0, 0), Vec4(0, 0, 1, 0), Vec4(0, 0, 0, 1));
+	}
+
+	// Return the orthographic projection of the box left..right, top..bottom,
+	// zNear..zFar to -1..1, -1..1, 0..1, like D3DXMatrixOrthoOffCenterLH.
+	static Mat4 orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+	{
+		float w = right - left, h = top - bottom, d = zFar - zNear;
+		return Mat4(Vec4(2 / w, 0, 0, 0), Vec4(0, 2 / h, 0, 0), Vec4(0, 0, 1 / d, 0),
+			Vec4(-(left + right) / w, -(top + bottom) / h, -zNear / d, 1));
+	}
+
+	// Constructor
+	Mat4(const Vec4& r0, const Vec4& r1, const Vec4& r2, const Vec4& r3)
+	{
+		rows[0] = r0;
+		rows[1] = r1;
+		rows[2] = r2;
+		rows[3] = r3;
+	}
+
+	// Return row vector v transformed, v * this.
+	Vec4 transform(const Vec4& v) const
+	{
+#ifdef VECMATH_SSE2
+		__m128 r = _mm_mul_ps(_mm_set1_ps(v.x), rows[0].load());
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.y), rows[1].load()));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), rows[2].load()));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.w), rows[3].load()));
+		return Vec4(r);
+#else
+		return rows[0] * v.x + rows[1] * v.y + rows[2] * v.z + rows[3] * v.w;
+#endif
+	}
+
+	// Return this transform followed by b.
+	Mat4 operator*(const Mat4& b) const
+	{
+		return Mat4(b.transform(rows[0]), b.transform(rows[1]), b.transform(rows[2]), b.transform(rows[3]));
+	}
+
+	// Return the transposed matrix.
+	Mat4 transposed() const
+	{
+		return Mat4(Vec4(rows[0].x, rows[1].x, rows[2].x, rows[3].x),
+			Vec4(rows[0].y, rows[1].y, rows[2].y, rows[3].y),
+			Vec4(rows[0].z, rows[1].z, rows[2].z, rows[3].z),
+			Vec4(rows[0].w, rows[1].w, rows[2].w, rows[3].w));
+	}
+};
@@ -0,0 +1,441 @@
+#include "world.h"
+
+namespace
+{
+	const uint32_t SNAPSHOT_MAGIC = 0x534E5757;    // "WWNS"
+
+	// Round offset up to the chunk alignment.
+	unsigned int alignUp(unsigned int offset)
+	{
+		return (offset + worldNS::CHUNK_ALIGN - 1) & ~(worldNS::CHUNK_ALIGN - 1);
+	}
+
+	// Append bytes bytes to out.
+	void put(std::vector<unsigned char>& out, const void* data, size_t bytes)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		out.insert(out.end(), p, p + bytes);
+	}
+
+	// Reads a snapshot, throws GameError at its end.
+	struct SnapshotReader
+	{
+		const unsigned char* p;
+		const unsigned char* end;
+
+		void read(void* data, size_t bytes)
+		{
+			if ((size_t)(end - p) < bytes)
+				throw(GameError(gameErrorNS::WARNING, "World snapshot is truncated"));
+			memcpy(data, p, bytes);
+			p += bytes;
+		}
+		const unsigned char* skip(size_t bytes)
+		{
+			if ((size_t)(end - p) < bytes)
+				throw(GameError(gameErrorNS::WARNING, "World snapshot is truncated"));
+			const unsigned char* at = p;
+			p += bytes;
+			return at;
+		}
+	};
+}
+
+//=============================================================================
+// Constructor
+//=============================================================================
+World::World()
+{
+	for (unsigned int i = 0; i < worldNS::MAX_COMPONENTS; i++)
+		componentSizes[i] = 0;
+	entityCount = 0;
+	queryDepth = 0;
+}
+
+//=============================================================================
+// Destructor
+//=============================================================================
+World::~World()
+{
+	queryDepth = 0;
+	clear();
+}
+
+//=============================================================================
+// Return the next unused component id
+// Throws GameError
+//=============================================================================
+unsigned int World::nextComponentId()
+{
+	static unsigned int next = 0;
+	if (next >= worldNS::MAX_COMPONENTS)
+		throw(GameError(gameErrorNS::FATAL_ERROR, "Too many component types"));
+	return next++;
+}
+
+//=============================================================================
+// Create an entity without components
+//=============================================================================
+Entity World::create()
+{
+	return createIn(getArchetype(0));
+}
+
+//=============================================================================
+// Create an entity in archetype a, its components are not initialized
+// Throws GameError inside a query
+//=============================================================================
+Entity World::createIn(Archetype* a)
+{
+	if (queryDepth > 0)
+		throw(GameError(gameErrorNS::WARNING, "Entity created inside a query"));
+	Entity e;
+	if (freeIndices.empty())
+	{
+		Record r = { 1, nullptr, 0 };
+		e.index = (uint32_t)records.size();
+		records.push_back(r);
+	}
+	else
+	{
+		e.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	Record& r = records[e.index];
+	e.generation = r.generation;
+	r.archetype = a;
+	r.row = pushRow(a, e);
+	++entityCount;
+	return e;
+}
+
+//=============================================================================
+// Destroy an entity
+// Throws GameError inside a query
+//=============================================================================
+void World::destroy(Entity e)
+{
+	if (!isAlive(e))
+		return;
+	if (queryDepth > 0)
+		throw(GameError(gameErrorNS::WARNING, "Entity destroyed inside a query, use destroyLater"));
+	Record& r = records[e.index];
+	eraseRow(r.archetype, r.row);
+	// handles of this entity are no longer alive
+	if (++r.generation == 0)
+		r.generation = 1;
+	r.archetype = nullptr;
+	freeIndices.push_back(e.index);
+	--entityCount;
+}
+
+//=============================================================================
+// Destroy the entities passed to destroyLater()
+//=============================================================================
+void World::flush()
+{
+	for (size_t i = 0; i < pendingDestroy.size(); i++)
+		destroy(pendingDestroy[i]);
+	pendingDestroy.clear();
+}
+
+//=============================================================================
+// Destroy all entities and release all chunks
+// Throws GameError inside a query
+//=============================================================================
+void World::clear()
+{
+	if (queryDepth > 0)
+		throw(GameError(gameErrorNS::WARNING, "World cleared inside a query"));
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		Record& r = records[i];
+		if (r.archetype == nullptr)
+			continue;
+		if (++r.generation == 0)
+			r.generation = 1;
+		r.archetype = nullptr;
+		freeIndices.push_back((uint32_t)i);
+	}
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		for (size_t c = 0; c < archetypes[i]->chunks.size(); c++)
+			TaggedAllocator::free(archetypes[i]->chunks[c]);
+		delete archetypes[i];
+	}
+	archetypes.clear();
+	archetypeMap.clear();
+	pendingDestroy.clear();
+	entityCount = 0;
+}
+
+//=============================================================================
+// Return number of allocated chunks
+//=============================================================================
+unsigned int World::getChunkCount() const
+{
+	size_t count = 0;
+	for (size_t i = 0; i < archetypes.size(); i++)
+		count += archetypes[i]->chunks.size();
+	return (unsigned int)count;
+}
+
+//=============================================================================
+// Return the archetype with mask, created if needed
+//=============================================================================
+World::Archetype* World::getArchetype(ComponentMask mask)
+{
+	std::unordered_map<ComponentMask, Archetype*>::iterator it = archetypeMap.find(mask);
+	if (it != archetypeMap.end())
+		return it->second;
+
+	Archetype* a = new Archetype;
+	a->mask = mask;
+	a->index = (unsigned int)archetypes.size();
+	a->count = 0;
+	for (unsigned int id = 0; id < worldNS::MAX_COMPONENTS; id++)
+	{
+		a->column[id] = worldNS::INVALID;
+		a->addEdge[id] = nullptr;
+		a->removeEdge[id] = nullptr;
+		if (mask & ((ComponentMask)1 << id))
+		{
+			a->column[id] = (uint32_t)a->ids.size();
+			a->ids.push_back(id);
+			a->sizes.push_back(componentSizes[id]);
+		}
+	}
+	a->offsets.resize(a->ids.size());
+
+	// the most entities whose arrays fit in a chunk, at least one
+	unsigned int rowBytes = sizeof(Entity);
+	for (size_t col = 0; col < a->sizes.size(); col++)
+		rowBytes += a->sizes[col];
+	unsigned int capacity = worldNS::CHUNK_BYTES / rowBytes + 1;
+	unsigned int bytes;
+	do
+	{
+		if (capacity > 1)
+			--capacity;
+		bytes = alignUp(capacity * sizeof(Entity));
+		for (size_t col = 0; col < a->sizes.size(); col++)
+		{
+			a->offsets[col] = bytes;
+			bytes = alignUp(bytes + capacity * a->sizes[col]);
+		}
+	} while (bytes > worldNS::CHUNK_BYTES && capacity > 1);
+	a->capacity = capacity;
+	a->chunkBytes = bytes;
+
+	archetypeMap[mask] = a;
+	archetypes.push_back(a);
+	return a;
+}
+
+//=============================================================================
+// Return the archetype of a with component id added
+//=============================================================================
+World::Archetype* World::addTarget(Archetype* a, unsigned int id)
+{
+	if (a->addEdge[id] == nullptr)
+	{
+		Archetype* b = getArchetype(a->mask | ((ComponentMask)1 << id));
+		a->addEdge[id] = b;
+		b->removeEdge[id] = a;
+	}
+	return a->addEdge[id];
+}
+
+//=============================================================================
+// Return the archetype of a with component id removed
+//=============================================================================
+World::Archetype* World::removeTarget(Archetype* a, unsigned int id)
+{
+	if (a->removeEdge[id] == nullptr)
+	{
+		Archetype* b = getArchetype(a->mask & ~((ComponentMask)1 << id));
+		a->removeEdge[id] = b;
+		b->addEdge[id] = a;
+	}
+	return a->removeEdge[id];
+}
+
+//=============================================================================
+// Append a row for e to archetype a
+// Throws GameError when out of memory
+//=============================================================================
+unsigned int World::pushRow(Archetype* a, Entity e)
+{
+	unsigned int row = a->count;
+	if (row == a->chunks.size() * a->capacity)
+		a->chunks.push_back((unsigned char*)TaggedAllocator::allocate(a->chunkBytes,
+			memoryNS::TAG_WORLD, worldNS::CHUNK_ALIGN));
+	a->entities(row / a->capacity)[row % a->capacity] = e;
+	++a->count;
+	return row;
+}
+
+//=============================================================================
+// Remove row of archetype a by moving the last row into it
+//=============================================================================
+void World::eraseRow(Archetype* a, unsigned int row)
+{
+	unsigned int last = a->count - 1;
+	if (row != last)
+	{
+		Entity moved = a->entities(last / a->capacity)[last % a->capacity];
+		a->entities(row / a->capacity)[row % a->capacity] = moved;
+		for (size_t col = 0; col < a->ids.size(); col++)
+			memcpy(a->at((unsigned int)col, row), a->at((unsigned int)col, last), a->sizes[col]);
+		records[moved.index].row = row;
+	}
+	--a->count;
+
+	// keep one spare chunk
+	if (a->chunks.size() >= 2 && a->count <= (a->chunks.size() - 2) * a->capacity)
+	{
+		TaggedAllocator::free(a->chunks.back());
+		a->chunks.pop_back();
+	}
+}
+
+//=============================================================================
+// Move e to archetype to, copying the components both archetypes have
+//=============================================================================
+void World::move(Entity e, Archetype* to)
+{
+	Archetype* from = records[e.index].archetype;
+	unsigned int oldRow = records[e.index].row;
+	unsigned int newRow = pushRow(to, e);
+	for (size_t col = 0; col < from->ids.size(); col++)
+	{
+		uint32_t toCol = to->column[from->ids[col]];
+		if (toCol != worldNS::INVALID)
+			memcpy(to->at(toCol, newRow), from->at((unsigned int)col, oldRow), from->sizes[col]);
+	}
+	eraseRow(from, oldRow);
+	records[e.index].archetype = to;
+	records[e.index].row = newRow;
+}
+
+//=============================================================================
+// Throw GameError if e is not alive or a query is running
+//=============================================================================
+void World::checkChange(Entity e) const
+{
+	if (queryDepth > 0)
+		throw(GameError(gameErrorNS::WARNING, "Entity changed inside a query"));
+	if (!isAlive(e))
+		throw(GameError(gameErrorNS::WARNING, "Entity is not alive"));
+}
+
+//=============================================================================
+// Append the state of all entities to out.
+// Layout: magic, entity count, record count, free index count, archetype
+// count, the records as generation, archetype index and row, the free
+// indices, then per archetype its mask, entity count, chunk size and the
+// used chunks.
+//=============================================================================
+void World::save(std::vector<unsigned char>& out) const
+{
+	uint32_t header[5] = { SNAPSHOT_MAGIC, entityCount, (uint32_t)records.size(),
+		(uint32_t)freeIndices.size(), (uint32_t)archetypes.size() };
+	size_t recordBytes = records.size() * 3 * sizeof(uint32_t);
+	size_t at = out.size();
+	out.resize(at + sizeof(header) + recordBytes);
+	memcpy(&out[at], header, sizeof(header));
+	unsigned char* p = &out[at + sizeof(header)];
+	for (size_t i = 0; i < records.size(); i++, p += sizeof(uint32_t) * 3)
+	{
+		uint32_t r[3] = { records[i].generation,
+			records[i].archetype ? records[i].archetype->index : worldNS::INVALID, records[i].row };
+		memcpy(p, r, sizeof(r));
+	}
+	if (!freeIndices.empty())
+		put(out, &freeIndices[0], freeIndices.size() * sizeof(uint32_t));
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		const Archetype* a = archetypes[i];
+		put(out, &a->mask, sizeof(a->mask));
+		uint32_t sizes[2] = { a->count, a->chunkBytes };
+		put(out, sizes, sizeof(sizes));
+		unsigned int chunkCount = (a->count + a->capacity - 1) / a->capacity;
+		for (unsigned int c = 0; c < chunkCount; c++)
+			put(out, a->chunks[c], a->chunkBytes);
+	}
+}
+
+//=============================================================================
+// Replace all entities with a snapshot of save()
+// Throws GameError
+//=============================================================================
+void World::restore(const unsigned char* data, size_t size)
+{
+	if (queryDepth > 0)
+		throw(GameError(gameErrorNS::WARNING, "World restored inside a query"));
+	SnapshotReader in = { data, data + size };
+	uint32_t header[5];
+	in.read(header, sizeof(header));
+	if (header[0] != SNAPSHOT_MAGIC)
+		throw(GameError(gameErrorNS::WARNING, "Not a world snapshot"));
+	const unsigned char* saved = in.skip((size_t)header[2] * 3 * sizeof(uint32_t));
+	const unsigned char* freeData = in.skip((size_t)header[3] * sizeof(uint32_t));
+
+	// the archetypes of the snapshot, the others are emptied
+	std::vector<Archetype*> map(header[4]);
+	std::vector<bool> restored(archetypes.size(), false);
+	for (uint32_t i = 0; i < header[4]; i++)
+	{
+		ComponentMask mask;
+		uint32_t sizes[2];
+		in.read(&mask, sizeof(mask));
+		in.read(sizes, sizeof(sizes));
+		Archetype* a = getArchetype(mask);
+		if (a->chunkBytes != sizes[1])
+			throw(GameError(gameErrorNS::WARNING, "World snapshot of other component types"));
+		unsigned int chunkCount = (sizes[0] + a->capacity - 1) / a->capacity;
+		while (a->chunks.size() < chunkCount)
+			a->chunks.push_back((unsigned char*)TaggedAllocator::allocate(a->chunkBytes,
+				memoryNS::TAG_WORLD, worldNS::CHUNK_ALIGN));
+		for (unsigned int c = 0; c < chunkCount; c++)
+			memcpy(a->chunks[c], in.skip(a->chunkBytes), a->chunkBytes);
+		a->count = sizes[0];
+		map[i] = a;
+		if (a->index >= restored.size())
+			restored.resize(a->index + 1, false);
+		restored[a->index] = true;
+	}
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		Archetype* a = archetypes[i];
+		if (i < restored.size() && restored[i])
+			continue;
+		a->count = 0;
+	}
+	// keep one spare chunk, like eraseRow()
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		Archetype* a = archetypes[i];
+		size_t used = (a->count + a->capacity - 1) / a->capacity;
+		while (a->chunks.size() > used + 1)
+		{
+			TaggedAllocator::free(a->chunks.back());
+			a->chunks.pop_back();
+		}
+	}
+
+	records.resize(header[2]);
+	for (uint32_t i = 0; i < header[2]; i++, saved += sizeof(uint32_t) * 3)
+	{
+		uint32_t r[3];
+		memcpy(r, saved, sizeof(r));
+		records[i].generation = r[0];
+		records[i].archetype = r[1] < map.size() ? map[r[1]] : nullptr;
+		records[i].row = r[2];
+	}
+	freeIndices.resize(header[3]);
+	if (header[3] > 0)
+		memcpy(&freeIndices[0], freeData, (size_t)header[3] * sizeof(uint32_t));
+	entityCount = header[1];
+	pendingDestroy.clear();
+}
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include "gameError.h"
+#include "jobSystem.h"
+#include "allocators.h"
+
+namespace worldNS
+{
+	const unsigned int CHUNK_BYTES = 16384;         // memory of one archetype chunk
+	const unsigned int CHUNK_ALIGN = 64;            // alignment of every component array, a cache line
+	const unsigned int MAX_COMPONENTS = 64;         // component types, one bit of ComponentMask each
+	const uint32_t INVALID = 0xFFFFFFFF;
+}
+
+// Set of component types, bit n is the component with id n.
+typedef uint64_t ComponentMask;
+
+// Handle of an entity.
+// The generation changes when the entity is destroyed, so handles of
+// destroyed entities are detected even after their index is reused.
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation;                    // 0 for the null entity
+
+	bool operator==(const Entity& e) const { return index == e.index && generation == e.generation; }
+	bool operator!=(const Entity& e) const { return !(*this == e); }
+};
+
+// The null entity, never alive.
+const Entity NULL_ENTITY = { worldNS::INVALID, 0 };
+
+// Entity component storage.
+// Entities with the same set of components share an archetype. An archetype
+// stores its entities in fixed size chunks; each chunk holds an array per
+// component (structure of arrays), so a query streams contiguous memory.
+// Entities are kept dense: destroying or moving an entity moves the last
+// entity of its archetype into the hole.
+//
+// Components are plain data that is copied with memcpy; any trivially
+// copyable struct can be a component without registration. Entities must
+// not be created, destroyed or change components inside a query, use
+// destroyLater() and flush() instead.
+class World final
+{
+public:
+	// Constructor
+	World();
+
+	// Destructor
+	~World();
+
+	// Create an entity without components.
+	Entity create();
+
+	// Create an entity with the given components.
+	template<class... Ts> Entity create(const Ts&... components);
+
+	// Destroy an entity. Does nothing if e is not alive.
+	void    destroy(Entity e);
+
+	// Destroy an entity at the next flush(), may be called inside a query.
+	void    destroyLater(Entity e) { pendingDestroy.push_back(e); }
+
+	// Destroy the entities passed to destroyLater().
+	void    flush();
+
+	// Destroy all entities and release all chunks.
+	void    clear();
+
+	// Return true if e is alive.
+	bool    isAlive(Entity e) const
+	{
+		return e.index < records.size() && records[e.index].generation == e.generation;
+	}
+
+	// Add component T to e, or replace it if e has one. Returns the component.
+	// Throws GameError if e is not alive or inside a query.
+	template<class T> T& add(Entity e, const T& component = T());
+
+	// Remove component T from e. Does nothing if e does not have one.
+	// Throws GameError if e is not alive or inside a query.
+	template<class T> void remove(Entity e);
+
+	// Return component T of e, nullptr if e is not alive or has no T.
+	template<class T> T* get(Entity e);
+
+	// Return true if e is alive and has component T.
+	template<class T> bool has(Entity e) const
+	{
+		return isAlive(e) && (records[e.index].archetype->mask & maskOf<T>()) != 0;
+	}
+
+	// Call f(Entity e, Ts&... components) for every entity with all components Ts.
+	template<class... Ts, class F> void each(F f);
+
+	// Call f(UINT count, const Entity* entities, Ts*... arrays) for every chunk
+	// of entities with all components Ts. The arrays hold count components.
+	template<class... Ts, class F> void eachChunk(F f);
+
+	// Like eachChunk(), with the chunks spread over the job threads.
+	// f runs concurrently and must only change the components it is given.
+	template<class... Ts, class F> void eachChunkParallel(JobSystem& jobs, F f);
+
+	// Return the id of component type T.
+	// Throws GameError if more than worldNS::MAX_COMPONENTS types are used.
+	template<class T> static unsigned int componentId()
+	{
+		static const unsigned int id = nextComponentId();
+		return id;
+	}
+
+	// Return the mask of the component types Ts.
+	template<class... Ts> static ComponentMask maskOf()
+	{
+		ComponentMask mask = 0;
+		int expand[] = { 0, ((mask |= (ComponentMask)1 << componentId<Ts>()), 0)... };
+		(void)expand;
+		return mask;
+	}
+
+	// Return number of alive entities.
+	unsigned int getEntityCount() const { return entityCount; }
+
+	// Return number of archetypes.
+	unsigned int getArchetypeCount() const { return (unsigned int)archetypes.size(); }
+
+	// Return number of allocated chunks.
+	unsigned int getChunkCount() const;
+
+	// Append the state of all entities to out: the entity records, the free
+	// indices and the used chunks of every archetype as they are in memory.
+	// Component ids are assigned at run time, so a snapshot is only valid in
+	// the process that saved it.
+	void    save(std::vector<unsigned char>& out) const;
+
+	// Replace all entities with a snapshot of save(). The archetypes and
+	// chunks of the world are reused, entity handles are the saved ones.
+	// Throws GameError if data is not a snapshot or inside a query.
+	void    restore(const unsigned char* data, size_t size);
+
+private:
+	// All entities with the same components.
+	struct Archetype
+	{
+		ComponentMask mask;
+		unsigned int index;                     // in archetypes
+		unsigned int capacity;                  // entities per chunk
+		unsigned int chunkBytes;                // bytes of one chunk
+		unsigned int count;                     // entities in all chunks
+		std::vector<unsigned int> ids;          // component id of each column
+		uint32_t column[worldNS::MAX_COMPONENTS];    // column of a component id or INVALID
+		std::vector<unsigned int> offsets;      // byte offset of each column in a chunk
+		std::vector<unsigned int> sizes;        // component size of each column
+		std::vector<unsigned char*> chunks;     // aligned chunk memory, entities first
+		Archetype* addEdge[worldNS::MAX_COMPONENTS];     // archetype with a component added
+		Archetype* removeEdge[worldNS::MAX_COMPONENTS];  // archetype with a component removed
+
+		// Return the entity array of chunk c.
+		Entity* entities(unsigned int c) { return (Entity*)chunks[c]; }
+		// Return the address of a component of row in the archetype.
+		unsigned char* at(unsigned int col, unsigned int row)
+		{
+			return chunks[row / capacity] + offsets[col] + (row % capacity) * sizes[col];
+		}
+		// Return number of entities in chunk c.
+		unsigned int chunkCount(unsigned int c) const
+		{
+			unsigned int first = c * capacity;
+			return count - first < capacity ? count - first : capacity;
+		}
+	};
+
+	// Location of an entity.
+	struct Record
+	{
+		uint32_t generation;
+		Archetype* archetype;               // nullptr if the index is free
+		unsigned int row;                   // row in the archetype
+	};
+
+	// Marks a running query while in scope.
+	struct QueryScope
+	{
+		int& depth;
+		explicit QueryScope(int& d) : depth(d) { ++depth; }
+		~QueryScope() { --depth; }
+	};
+
+	// Calls f(entity, components...) for each entity of a chunk.
+	template<class F, class... Ts> struct EachRow
+	{
+		F& f;
+		explicit EachRow(F& fn) : f(fn) {}
+		void operator()(unsigned int count, const Entity* e, Ts*... arrays)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				f(e[i], arrays[i]...);
+		}
+	};
+
+	// Calls f for a range of chunks collected by eachChunkParallel().
+	template<class F, class... Ts> struct ChunkRange
+	{
+		World& world;
+		F& f;
+		const std::vector<std::pair<Archetype*, unsigned int> >& chunks;
+		ChunkRange(World& w, F& fn, const std::vector<std::pair<Archetype*, unsigned int> >& c)
+			: world(w), f(fn), chunks(c) {}
+		void operator()(UINT first, UINT last) const
+		{
+			for (UINT i = first; i < last; i++)
+			{
+				Archetype* a = chunks[i].first;
+				unsigned int c = chunks[i].second;
+				f(a->chunkCount(c), (const Entity*)a->entities(c), world.array<Ts>(a, c)...);
+			}
+		}
+	};
+
+	std::vector<Record> records;            // indexed by Entity::index
+	std::vector<uint32_t> freeIndices;      // indices of destroyed entities
+	std::unordered_map<ComponentMask, Archetype*> archetypeMap;
+	std::vector<Archetype*> archetypes;     // in creation order
+	unsigned int componentSizes[worldNS::MAX_COMPONENTS];
+	std::vector<Entity> pendingDestroy;
+	std::vector<std::pair<Archetype*, unsigned int> > parallelChunks;  // chunks of eachChunkParallel()
+	unsigned int entityCount;
+	int     queryDepth;                     // > 0 inside a query
+
+	World(const World&);                    // no copies
+	World& operator=(const World&);
+
+	// Return the next unused component id.
+	static unsigned int nextComponentId();
+	// Record the size of component type T.
+	template<class T> unsigned int registerComponent()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "components must be trivially copyable");
+		unsigned int id = componentId<T>();
+		componentSizes[id] = sizeof(T);
+		return id;
+	}
+	// Return the archetype with mask, created if needed.
+	Archetype* getArchetype(ComponentMask mask);
+	// Return the archetype of a with component id added or removed.
+	Archetype* addTarget(Archetype* a, unsigned int id);
+	Archetype* removeTarget(Archetype* a, unsigned int id);
+	// Create an entity in archetype a with uninitialized components.
+	Entity  createIn(Archetype* a);
+	// Append a row for e to archetype a, allocating a chunk if needed.
+	unsigned int pushRow(Archetype* a, Entity e);
+	// Remove a row by moving the last row of the archetype into it.
+	void    eraseRow(Archetype* a, unsigned int row);
+	// Move e to archetype to, copying the shared components.
+	void    move(Entity e, Archetype* to);
+	// Throw GameError if e is not alive or a query is running.
+	void    checkChange(Entity e) const;
+	// Copy a component into row of archetype a.
+	template<class T> void set(Archetype* a, unsigned int row, const T& component)
+	{
+		memcpy(a->at(a->column[componentId<T>()], row), &component, sizeof(T));
+	}
+	template<class T, class... Ts> void setAll(Archetype* a, unsigned int row, const T& c, const Ts&... rest)
+	{
+		set(a, row, c);
+		setAll(a, row, rest...);
+	}
+	void    setAll(Archetype*, unsigned int) {}
+	// Register component types Ts.
+	template<class... Ts> void registerAll()
+	{
+		int expand[] = { 0, ((void)registerComponent<Ts>(), 0)... };
+		(void)expand;
+	}
+	// Return the array of component T in chunk c of archetype a.
+	template<class T> T* array(Archetype* a, unsigned int c)
+	{
+		return (T*)(a->chunks[c] + a->offsets[a->column[componentId<T>()]]);
+	}
+};
+
+//=============================================================================
+// Create an entity with the given components
+//=============================================================================
+template<class... Ts> Entity World::create(const Ts&... components)
+{
+	registerAll<Ts...>();
+	Archetype* a = getArchetype(maskOf<Ts...>());
+	Entity e = createIn(a);
+	setAll(a, records[e.index].row, components...);
+	return e;
+}
+
+//=============================================================================
+// Add or replace component T of e
+//=============================================================================
+template<class T> T& World::add(Entity e, const T& component)
+{
+	checkChange(e);
+	unsigned int id = registerComponent<T>();
+	Archetype* a = records[e.index].archetype;
+	if ((a->mask & ((ComponentMask)1 << id)) == 0)
+		move(e, addTarget(a, id));
+	Record& r = records[e.index];
+	set(r.archetype, r.row, component);
+	return *(T*)r.archetype->at(r.archetype->column[id], r.row);
+}
+
+//=============================================================================
+// Remove component T of e
+//=============================================================================
+template<class T> void World::remove(Entity e)
+{
+	checkChange(e);
+	unsigned int id = componentId<T>();
+	Archetype* a = records[e.index].archetype;
+	if (a->mask & ((ComponentMask)1 << id))
+		move(e, removeTarget(a, id));
+}
+
+//=============================================================================
+// Return component T of e
+//=============================================================================
+template<class T> T* World::get(Entity e)
+{
+	if (!isAlive(e))
+		return nullptr;
+	const Record& r = records[e.index];
+	uint32_t col = r.archetype->column[componentId<T>()];
+	if (col == worldNS::INVALID)
+		return nullptr;
+	return (T*)r.archetype->at(col, r.row);
+}
+
+//=============================================================================
+// Call f for every chunk of entities with all components Ts
+//=============================================================================
+template<class... Ts, class F> void World::eachChunk(F f)
+{
+	ComponentMask mask = maskOf<Ts...>();
+	QueryScope scope(queryDepth);
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		Archetype* a = archetypes[i];
+		if ((a->mask & mask) != mask || a->count == 0)
+			continue;
+		unsigned int chunkCount = (a->count + a->capacity - 1) / a->capacity;
+		for (unsigned int c = 0; c < chunkCount; c++)
+			f(a->chunkCount(c), (const Entity*)a->entities(c), array<Ts>(a, c)...);
+	}
+}
+
+//=============================================================================
+// Call f for every entity with all components Ts
+//=============================================================================
+template<class... Ts, class F> void World::each(F f)
+{
+	eachChunk<Ts...>(EachRow<F, Ts...>(f));
+}
+
+//=============================================================================
+// Call f for every chunk of entities with all components Ts on the job threads
+//=============================================================================
+template<class... Ts, class F> void World::eachChunkParallel(JobSystem& jobs, F f)
+{
+	ComponentMask mask = maskOf<Ts...>();
+	// the chunk list is kept between calls, nested calls use their own
+	std::vector<std::pair<Archetype*, unsigned int> > nested;
+	std::vector<std::pair<Archetype*, unsigned int> >& chunks = queryDepth == 0 ? parallelChunks : nested;
+	chunks.clear();
+	QueryScope scope(queryDepth);
+	for (size_t i = 0; i < archetypes.size(); i++)
+	{
+		Archetype* a = archetypes[i];
+		if ((a->mask & mask) != mask || a->count == 0)
+			continue;
+		unsigned int chunkCount = (a->count + a->capacity - 1) / a->capacity;
+		for (unsigned int c = 0; c < chunkCount; c++)
+			chunks.push_back(std::make_pair(a, c));
+	}
+	jobs.parallelFor(0, (UINT)chunks.size(), 1, ChunkRange<F, Ts...>(*this, f, chunks));
+}